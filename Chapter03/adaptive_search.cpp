@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "adaptive_search.hpp"
+#include "point.hpp"
+
+//
+// This example compares a linear SIMD scan with branchless bisection
+// on small sorted arrays, and shows where adaptive::lower_bound()
+// switches from one to the other on this machine.
+//
+
+namespace {
+
+constexpr auto kNumQueries = size_t{1'000'000};
+
+auto make_point(int i) { return Point{i / 3, i % 3}; }
+
+template <typename T>
+auto random_sorted(size_t n, std::mt19937& gen, int max_value) {
+  auto dist = std::uniform_int_distribution<int>{0, max_value};
+  auto a = std::vector<T>(n);
+  for (auto& v : a) {
+    if constexpr (std::is_same_v<T, Point>) {
+      v = make_point(dist(gen));
+    } else {
+      v = static_cast<T>(dist(gen));
+    }
+  }
+  std::sort(a.begin(), a.end());
+  return a;
+}
+
+template <typename T>
+auto check_lower_bound(const std::vector<T>& a, int max_value) {
+  for (auto i = -1; i <= max_value + 1; ++i) {
+    auto key = T{};
+    if constexpr (std::is_same_v<T, Point>) {
+      key = make_point(i);
+    } else {
+      key = static_cast<T>(i);
+    }
+    const auto expected =
+      static_cast<size_t>(std::lower_bound(a.begin(), a.end(), key) - a.begin());
+    ASSERT_EQ(expected, adaptive::lower_bound(a, key));
+    // The scan is checked separately as the crossover may be small
+    ASSERT_EQ(expected, adaptive::detail::scan_kernel<T>()(a.data(), a.size(), key));
+    const auto found = std::binary_search(a.begin(), a.end(), key);
+    ASSERT_EQ(found, adaptive::contains(a, key));
+  }
+}
+
+// Average nanoseconds per call of f(key)
+template <typename T, typename F>
+auto ns_per_query(const std::vector<T>& queries, F&& f) {
+  auto checksum = size_t{0};
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& key : queries) {
+    checksum += f(key);
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  // Keeps the calls from being optimized away
+  if (checksum == size_t(-1)) {
+    std::cout << checksum;
+  }
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+  return static_cast<double>(ns) / static_cast<double>(queries.size());
+}
+
+template <typename T>
+auto print_search_times(const char* name) {
+  auto gen = std::mt19937{};
+  std::cout << name << ", crossover " << adaptive::crossover<T>() << " (default "
+            << adaptive::kDefaultCrossover<T> << "), ns per query" << '\n'
+            << std::setw(8) << "keys" << std::setw(8) << "scan" << std::setw(12)
+            << "branchless" << std::setw(10) << "adaptive" << '\n';
+  for (auto n = size_t{4}; n <= 4096; n *= 4) {
+    const auto max_value = static_cast<int>(2 * n);
+    const auto a = random_sorted<T>(n, gen, max_value);
+    const auto queries = random_sorted<T>(kNumQueries, gen, max_value);
+    auto shuffled = queries;
+    std::shuffle(shuffled.begin(), shuffled.end(), gen);
+    const auto scan = adaptive::detail::scan_kernel<T>();
+    std::cout << std::fixed << std::setprecision(1) << std::setw(8) << n
+      << std::setw(8) << ns_per_query(shuffled, [&](const T& k) {
+           return scan(a.data(), a.size(), k); })
+      << std::setw(12) << ns_per_query(shuffled, [&](const T& k) {
+           return branchless_lower_bound(a, k); })
+      << std::setw(10) << ns_per_query(shuffled, [&](const T& k) {
+           return adaptive::lower_bound(a, k); })
+      << '\n';
+  }
+}
+
+} // namespace
+
+TEST(AdaptiveSearch, SameResultAsStdLowerBound) {
+  auto gen = std::mt19937{};
+  for (auto n : {0, 1, 2, 3, 4, 5, 7, 8, 9, 31, 32, 33, 100, 1000, 5000}) {
+    // Few distinct values gives many duplicates
+    for (auto max_value : {10, 10'000}) {
+      check_lower_bound(random_sorted<int>(n, gen, max_value), max_value);
+      check_lower_bound(random_sorted<float>(n, gen, max_value), max_value);
+      check_lower_bound(random_sorted<Point>(n, gen, max_value), max_value);
+    }
+  }
+}
+
+TEST(AdaptiveSearch, NegativeAndExtremeKeys) {
+  const auto min = std::numeric_limits<int>::min();
+  const auto max = std::numeric_limits<int>::max();
+  const auto a = std::vector<int>{min, min, -5, -1, 0, 3, 3, 3, 9, max};
+  const auto points = std::vector<Point>{{min, max}, {-1, min}, {-1, -1}, {-1, 0},
+                                         {0, -3},    {0, 0},    {2, max}, {max, min}};
+  for (auto k : a) {
+    ASSERT_EQ(std::lower_bound(a.begin(), a.end(), k) - a.begin(),
+              adaptive::detail::scan_kernel<int>()(a.data(), a.size(), k));
+  }
+  for (const auto& p : points) {
+    ASSERT_EQ(std::lower_bound(points.begin(), points.end(), p) - points.begin(),
+              adaptive::detail::scan_kernel<Point>()(points.data(), points.size(), p));
+    ASSERT_TRUE(adaptive::contains(points, p));
+  }
+  ASSERT_FALSE(adaptive::contains(points, Point{-1, 1}));
+  ASSERT_EQ(points.size(), adaptive::search(points, Point{max, max}));
+}
+
+TEST(AdaptiveSearch, CompareSearchTimes) {
+  print_search_times<int>("int");
+  print_search_times<float>("float");
+  print_search_times<Point>("Point");
+}
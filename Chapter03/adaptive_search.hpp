@@ -0,0 +1,259 @@
+#pragma once
+#ifndef ADAPTIVE_SEARCH_HPP
+#define ADAPTIVE_SEARCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <random>
+#include <type_traits>
+#include <vector>
+#include "cpu_features.hpp"
+#include "point.hpp"
+#include "sorted_search.hpp"
+
+//
+// Searching a small sorted array is faster with a linear SIMD scan
+// than with bisection: the scan has no dependent loads and no
+// unpredictable branches, and all of the array is in one or a few
+// cache lines. The functions in namespace adaptive scan arrays up to
+// a crossover size, and use branchless_lower_bound() above it.
+//
+// The crossover size depends on the CPU. By default it's measured
+// once per key type the first time it's needed, which takes a few
+// milliseconds. Define ADAPTIVE_SEARCH_CALIBRATE to 0 to use the
+// constexpr defaults instead.
+//
+// The keys can be int, float, or a point with int members x and y
+// ordered by x and then by y, such as Point in point.hpp.
+//
+
+#ifndef ADAPTIVE_SEARCH_CALIBRATE
+  #define ADAPTIVE_SEARCH_CALIBRATE 1
+#endif
+
+namespace adaptive {
+namespace detail {
+
+// True for structs laid out as two ints x and y, like Point
+template <typename T, typename = void>
+struct is_int_point : std::false_type {};
+
+template <typename T>
+struct is_int_point<T, std::void_t<decltype(T::x), decltype(T::y)>>
+  : std::bool_constant<std::is_same_v<decltype(T::x), int> &&
+                       std::is_same_v<decltype(T::y), int> &&
+                       std::is_standard_layout_v<T> && sizeof(T) == 2 * sizeof(int) &&
+                       offsetof(T, x) == 0 && offsetof(T, y) == sizeof(int)> {};
+
+template <typename T>
+constexpr auto is_supported_key() {
+  return std::is_same_v<T, int> || std::is_same_v<T, float> || is_int_point<T>::value;
+}
+
+// In a sorted array the elements less than the key come first, so
+// counting them gives the position. The count has no branches which
+// depend on the data, unlike a scan which stops at the key.
+template <typename T>
+auto scan_generic(const T* a, size_t n, const T& key) -> size_t {
+  auto count = size_t{0};
+  for (size_t i = 0; i < n; ++i) {
+    count += a[i] < key ? 1 : 0;
+  }
+  return count;
+}
+
+#if CPU_DISPATCH_ENABLED
+
+// Each kernel compares 8 ints or floats, or 4 points, per step and
+// subtracts the all-ones lanes of the comparison from a counter.
+
+TARGET_AVX2 inline auto horizontal_sum_avx2(__m256i v) -> size_t {
+  auto sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return static_cast<size_t>(static_cast<unsigned>(_mm_cvtsi128_si32(sum)));
+}
+
+TARGET_AVX2 inline auto scan_avx2(const int* a, size_t n, const int& key) -> size_t {
+  const auto k = _mm256_set1_epi32(key);
+  auto count = _mm256_setzero_si256();
+  auto i = size_t{0};
+  for (; i + 8 <= n; i += 8) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    count = _mm256_sub_epi32(count, _mm256_cmpgt_epi32(k, v));
+  }
+  return horizontal_sum_avx2(count) + scan_generic(a + i, n - i, key);
+}
+
+TARGET_AVX2 inline auto scan_avx2(const float* a, size_t n, const float& key) -> size_t {
+  const auto k = _mm256_set1_ps(key);
+  auto count = _mm256_setzero_si256();
+  auto i = size_t{0};
+  for (; i + 8 <= n; i += 8) {
+    const auto less = _mm256_cmp_ps(_mm256_loadu_ps(a + i), k, _CMP_LT_OQ);
+    count = _mm256_sub_epi32(count, _mm256_castps_si256(less));
+  }
+  return horizontal_sum_avx2(count) + scan_generic(a + i, n - i, key);
+}
+
+// A point is less than the key if x is less, or if x is equal and y
+// is less. x is in the low and y in the high half of each 64 bits, so
+// the y comparison is shifted down to x, and only the x lanes count.
+template <typename P>
+TARGET_AVX2 inline auto scan_points_avx2(const P* a, size_t n, const P& key) -> size_t {
+  const auto k = _mm256_set_epi32(key.y, key.x, key.y, key.x, key.y, key.x, key.y, key.x);
+  const auto x_lanes = _mm256_set1_epi64x(0xffffffff);
+  auto count = _mm256_setzero_si256();
+  auto i = size_t{0};
+  for (; i + 4 <= n; i += 4) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    const auto lt = _mm256_cmpgt_epi32(k, v);
+    const auto eq = _mm256_cmpeq_epi32(k, v);
+    const auto less = _mm256_or_si256(lt, _mm256_and_si256(eq, _mm256_srli_epi64(lt, 32)));
+    count = _mm256_sub_epi32(count, _mm256_and_si256(less, x_lanes));
+  }
+  return horizontal_sum_avx2(count) + scan_generic(a + i, n - i, key);
+}
+
+#endif // CPU_DISPATCH_ENABLED
+
+template <typename T>
+using ScanFn = size_t (*)(const T*, size_t, const T&);
+
+template <typename T>
+auto scan_kernel() -> ScanFn<T> {
+#if CPU_DISPATCH_ENABLED
+  if (cpu_features().avx2_) {
+    if constexpr (is_int_point<T>::value) {
+      return scan_points_avx2<T>;
+    } else {
+      return scan_avx2;
+    }
+  }
+#endif
+  return scan_generic<T>;
+}
+
+template <typename T>
+auto make_key(int i) -> T {
+  if constexpr (is_int_point<T>::value) {
+    auto key = T{};
+    key.x = i / 4;
+    key.y = i % 4;
+    return key;
+  } else {
+    return static_cast<T>(i);
+  }
+}
+
+} // namespace detail
+
+// Crossover size measured on x86 CPUs with AVX2, where a scan of 64
+// keys is about as fast as bisection for all key types. Arrays of
+// this size or smaller are scanned.
+template <typename T>
+constexpr auto kDefaultCrossover = size_t{64};
+
+// Finds the array size where branchless_lower_bound() becomes faster
+// than the linear scan, by timing both on arrays in the L1 cache
+template <typename T>
+auto calibrate_crossover() -> size_t {
+  static_assert(detail::is_supported_key<T>(), "Unsupported key type");
+  constexpr auto kNumQueries = 4096;
+  constexpr auto kMaxSize = size_t{1024};
+  auto gen = std::mt19937{};
+  auto sorted = std::vector<T>(kMaxSize);
+  for (size_t i = 0; i < kMaxSize; ++i) {
+    sorted[i] = detail::make_key<T>(static_cast<int>(2 * i));
+  }
+  const auto scan = detail::scan_kernel<T>();
+  // Best of a few runs, to not be fooled by interrupts
+  const auto time = [&](const std::vector<T>& queries, auto&& search) {
+    using namespace std::chrono;
+    auto best = nanoseconds::max();
+    for (auto run = 0; run < 3; ++run) {
+      auto checksum = size_t{0};
+      const auto start = steady_clock::now();
+      for (const auto& key : queries) {
+        checksum += search(key);
+      }
+      best = std::min(best, duration_cast<nanoseconds>(steady_clock::now() - start));
+      // Keeps the searches from being optimized away
+      volatile auto sink = checksum;
+      (void)sink;
+    }
+    return best;
+  };
+  for (auto n = size_t{8}; n < kMaxSize; n *= 2) {
+    auto dist = std::uniform_int_distribution<int>{0, static_cast<int>(2 * n)};
+    auto queries = std::vector<T>(kNumQueries);
+    for (auto& q : queries) {
+      q = detail::make_key<T>(dist(gen));
+    }
+    const auto* a = sorted.data();
+    const auto scan_time = time(queries, [&](const T& key) { return scan(a, n, key); });
+    const auto bisect_time = time(queries, [&](const T& key) {
+      return branchless_lower_bound(a, n, key);
+    });
+    if (bisect_time < scan_time) {
+      return n / 2;
+    }
+  }
+  return kMaxSize;
+}
+
+namespace detail {
+
+// The scan kernel and crossover for T, chosen once
+template <typename T>
+struct Dispatch {
+  ScanFn<T> scan_{scan_kernel<T>()};
+  size_t crossover_{ADAPTIVE_SEARCH_CALIBRATE ? calibrate_crossover<T>() : kDefaultCrossover<T>};
+};
+
+template <typename T>
+auto dispatch() -> const Dispatch<T>& {
+  static const auto d = Dispatch<T>{};
+  return d;
+}
+
+} // namespace detail
+
+template <typename T>
+auto crossover() -> size_t {
+  return detail::dispatch<T>().crossover_;
+}
+
+// Position of the first element in the sorted range [a, a + n) which
+// is not less than key, the same as std::lower_bound()
+template <typename T>
+auto lower_bound(const T* a, size_t n, const T& key) -> size_t {
+  static_assert(detail::is_supported_key<T>(), "Unsupported key type");
+  const auto& d = detail::dispatch<T>();
+  if (n <= d.crossover_) {
+    return d.scan_(a, n, key);
+  }
+  return branchless_lower_bound(a, n, key);
+}
+
+template <typename T>
+auto lower_bound(const std::vector<T>& a, const T& key) -> size_t {
+  return lower_bound(a.data(), a.size(), key);
+}
+
+// Position of an element equal to key, or a.size() if there is none
+template <typename T>
+auto search(const std::vector<T>& a, const T& key) -> size_t {
+  const auto i = lower_bound(a, key);
+  return i < a.size() && !(key < a[i]) ? i : a.size();
+}
+
+template <typename T>
+auto contains(const std::vector<T>& a, const T& key) -> bool {
+  return search(a, key) != a.size();
+}
+
+} // namespace adaptive
+
+#endif
@@ -2,11 +2,7 @@
 #include <iostream>
 #include <vector>
 #include <gtest/gtest.h>
-
-struct Point {
-  int x{};
-  int y{};
-};
+#include "point.hpp"
 
 auto linear_search(const std::vector<Point>& a, const Point& key) {
   for (size_t i = 0; i < a.size(); ++i) {
@@ -0,0 +1,24 @@
+#pragma once
+#ifndef POINT_HPP
+#define POINT_HPP
+
+// The point used by the search examples. Points are ordered by x
+// and then by y, so that a sorted array of points can be searched.
+struct Point {
+  int x{};
+  int y{};
+};
+
+inline auto operator==(const Point& a, const Point& b) noexcept {
+  return a.x == b.x && a.y == b.y;
+}
+
+inline auto operator!=(const Point& a, const Point& b) noexcept {
+  return !(a == b);
+}
+
+inline auto operator<(const Point& a, const Point& b) noexcept {
+  return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "point.hpp"
+#include "point_set.hpp"
+
+//
+// This example compares searching an array of Point one point at a
+// time, like linear_search() in linear_search_point.cpp, with the
+// SIMD search of PointSet and with lookups in a GridIndex.
+//
+
+namespace {
+
+// Number of points in the benchmark. Increase if you want more.
+constexpr auto kNumPoints = size_t{1'000'000};
+constexpr auto kNumFindQueries = size_t{200};
+constexpr auto kNumRadiusQueries = size_t{2'000};
+
+auto random_points(size_t n, int min_value, int max_value, std::mt19937& gen) {
+  auto dist = std::uniform_int_distribution<int>{min_value, max_value};
+  auto points = std::vector<Point>(n);
+  for (auto& p : points) {
+    p = Point{dist(gen), dist(gen)};
+  }
+  return points;
+}
+
+auto find_aos(const std::vector<Point>& a, const Point& key) {
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].x == key.x && a[i].y == key.y) {
+      return i;
+    }
+  }
+  return a.size();
+}
+
+auto brute_force_radius(const std::vector<Point>& a, const Point& c, int radius) {
+  auto result = std::vector<size_t>{};
+  for (size_t i = 0; i < a.size(); ++i) {
+    const auto dx = static_cast<double>(a[i].x) - c.x;
+    const auto dy = static_cast<double>(a[i].y) - c.y;
+    if (dx * dx + dy * dy <= static_cast<double>(radius) * radius) {
+      result.push_back(i);
+    }
+  }
+  return result;
+}
+
+auto sorted(std::vector<size_t> v) {
+  std::sort(v.begin(), v.end());
+  return v;
+}
+
+template <typename F>
+auto time_ms(const char* name, F&& f) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto checksum = f();
+  const auto stop = std::chrono::steady_clock::now();
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+  std::cout << ms << " ms " << name << '\n';
+  return checksum;
+}
+
+} // namespace
+
+TEST(PointSet, FindSameAsLinearSearch) {
+  auto gen = std::mt19937{};
+  // Sizes around the vector widths test the tails
+  for (auto n : {0, 1, 7, 8, 9, 15, 16, 17, 100, 1000}) {
+    const auto points = random_points(n, -20, 20, gen);
+    const auto set = PointSet{points};
+    ASSERT_EQ(points.size(), set.size());
+    const auto queries = random_points(200, -21, 21, gen);
+    const auto batch = set.find_batch(queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      ASSERT_EQ(find_aos(points, queries[i]), set.find(queries[i]));
+      ASSERT_EQ(batch[i], set.find(queries[i]));
+    }
+  }
+}
+
+TEST(PointSet, GridFindsEveryPoint) {
+  auto gen = std::mt19937{};
+  const auto min = std::numeric_limits<int>::min();
+  const auto max = std::numeric_limits<int>::max();
+  auto points = random_points(5000, -1000, 1000, gen);
+  // Outliers make the bounding box as large as possible
+  points.push_back({min, min});
+  points.push_back({max, max});
+  const auto set = PointSet{points};
+  for (auto cell_size : {0, 1, 7, 100000}) {
+    const auto grid = GridIndex{set, cell_size};
+    ASSERT_LE(grid.num_cells(), GridIndex::kPointsPerCell * points.size() + 16);
+    for (const auto& p : points) {
+      const auto i = grid.find(p);
+      ASSERT_LT(i, points.size());
+      ASSERT_EQ(p, points[i]);
+    }
+    const auto queries = random_points(2000, -1001, 1001, gen);
+    const auto batch = grid.find_batch(queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      ASSERT_EQ(set.contains(queries[i]), grid.contains(queries[i]));
+      ASSERT_EQ(grid.find(queries[i]), batch[i]);
+    }
+  }
+}
+
+TEST(PointSet, RadiusSameAsBruteForce) {
+  auto gen = std::mt19937{};
+  const auto points = random_points(3000, -500, 500, gen);
+  const auto set = PointSet{points};
+  for (auto cell_size : {0, 3, 50}) {
+    const auto grid = GridIndex{set, cell_size};
+    for (auto radius : {0, 1, 10, 60, 2000}) {
+      // Some centers are far outside the points
+      const auto centers = random_points(50, -700, 700, gen);
+      const auto batch = grid.within_radius_batch(centers, radius);
+      for (size_t i = 0; i < centers.size(); ++i) {
+        const auto expected = brute_force_radius(points, centers[i], radius);
+        ASSERT_EQ(expected, sorted(grid.within_radius(centers[i], radius)));
+        ASSERT_EQ(expected, sorted(batch[i]));
+      }
+    }
+  }
+  ASSERT_TRUE(GridIndex{PointSet{}}.within_radius({0, 0}, 10).empty());
+  ASSERT_FALSE(GridIndex{PointSet{}}.contains({0, 0}));
+}
+
+TEST(PointSet, CompareSearchTimes) {
+  auto gen = std::mt19937{};
+  const auto max_value = 1 << 20;
+  const auto points = random_points(kNumPoints, 0, max_value, gen);
+  const auto set = PointSet{points};
+  const auto grid = time_ms("building the grid", [&] { return GridIndex{set}; });
+  // Every other query is a point in the set
+  auto queries = random_points(kNumFindQueries, 0, max_value, gen);
+  for (size_t i = 0; i < queries.size(); i += 2) {
+    queries[i] = points[gen() % points.size()];
+  }
+  const auto aos = time_ms("array of Point", [&] {
+    auto sum = size_t{0};
+    for (const auto& q : queries) {
+      sum += find_aos(points, q);
+    }
+    return sum;
+  });
+  const auto soa = time_ms("PointSet::find", [&] {
+    auto sum = size_t{0};
+    for (const auto& q : queries) {
+      sum += set.find(q);
+    }
+    return sum;
+  });
+  ASSERT_EQ(aos, soa);
+
+  auto many_queries = random_points(kNumFindQueries * 10'000, 0, max_value, gen);
+  const auto grid_single = time_ms("GridIndex::find, 10000x more queries", [&] {
+    auto sum = size_t{0};
+    for (const auto& q : many_queries) {
+      sum += grid.contains(q) ? 1 : 0;
+    }
+    return sum;
+  });
+  const auto grid_batch = time_ms("GridIndex::find_batch, 10000x more queries", [&] {
+    auto sum = size_t{0};
+    for (auto i : grid.find_batch(many_queries)) {
+      sum += i != grid.size() ? 1 : 0;
+    }
+    return sum;
+  });
+  ASSERT_EQ(grid_single, grid_batch);
+
+  const auto radius = max_value / 500;
+  const auto centers = random_points(kNumRadiusQueries, 0, max_value, gen);
+  const auto brute = time_ms("radius, brute force", [&] {
+    auto sum = size_t{0};
+    for (const auto& c : centers) {
+      sum += brute_force_radius(points, c, radius).size();
+    }
+    return sum;
+  });
+  const auto in_grid = time_ms("radius, GridIndex", [&] {
+    auto sum = size_t{0};
+    for (const auto& c : centers) {
+      grid.for_each_in_radius(c, radius, [&](size_t) { ++sum; });
+    }
+    return sum;
+  });
+  ASSERT_EQ(brute, in_grid);
+}
@@ -0,0 +1,334 @@
+#pragma once
+#ifndef POINT_SET_HPP
+#define POINT_SET_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <numeric>
+#include <utility>
+#include <vector>
+#include "cpu_features.hpp"
+#include "point.hpp"
+#include "sorted_search.hpp"
+
+//
+// PointSet stores points as a structure of arrays, one array of x and
+// one of y, instead of an array of Point. An equality search loads 8
+// or 16 x and as many y per step and compares them with SIMD, where
+// linear_search() in linear_search_point.cpp compares one point at a
+// time.
+//
+// GridIndex divides the bounding box of a PointSet into square cells
+// and stores the points grouped by cell, so that an exact match only
+// searches one cell and a radius query only the cells which overlap
+// the circle. The batch queries visit the queries in cell order, so
+// that queries in the same cell use the same cache lines. This pays
+// off when the index is much larger than the caches; for a smaller
+// index the sort costs more than it saves.
+//
+
+namespace point_detail {
+
+// Index of the first point equal to (x, y), or n
+inline auto find_generic(const int* xs, const int* ys, size_t n, int x, int y) -> size_t {
+  for (size_t i = 0; i < n; ++i) {
+    if (xs[i] == x && ys[i] == y) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#if CPU_DISPATCH_ENABLED
+
+TARGET_AVX2 inline auto find_avx2(const int* xs, const int* ys, size_t n, int x, int y)
+  -> size_t {
+  const auto kx = _mm256_set1_epi32(x);
+  const auto ky = _mm256_set1_epi32(y);
+  auto i = size_t{0};
+  for (; i + 8 <= n; i += 8) {
+    const auto vx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs + i));
+    const auto vy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ys + i));
+    const auto eq = _mm256_and_si256(_mm256_cmpeq_epi32(vx, kx), _mm256_cmpeq_epi32(vy, ky));
+    const auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+    if (mask != 0) {
+      return i + static_cast<size_t>(_tzcnt_u32(mask));
+    }
+  }
+  return i + find_generic(xs + i, ys + i, n - i, x, y);
+}
+
+// The tail is loaded with a mask, so there is no scalar loop
+TARGET_AVX512 inline auto find_avx512(const int* xs, const int* ys, size_t n, int x, int y)
+  -> size_t {
+  const auto kx = _mm512_set1_epi32(x);
+  const auto ky = _mm512_set1_epi32(y);
+  for (size_t i = 0; i < n; i += 16) {
+    const auto remaining = n - i;
+    const auto load = static_cast<__mmask16>(remaining >= 16 ? 0xffff : (1u << remaining) - 1);
+    const auto vx = _mm512_maskz_loadu_epi32(load, xs + i);
+    const auto vy = _mm512_maskz_loadu_epi32(load, ys + i);
+    const auto eq = _mm512_mask_cmpeq_epi32_mask(_mm512_mask_cmpeq_epi32_mask(load, vx, kx),
+                                                 vy, ky);
+    if (eq != 0) {
+      return i + static_cast<size_t>(_tzcnt_u32(eq));
+    }
+  }
+  return n;
+}
+
+#endif // CPU_DISPATCH_ENABLED
+
+using FindFn = size_t (*)(const int*, const int*, size_t, int, int);
+
+inline auto find_kernel() -> FindFn {
+  static const FindFn fn = []() -> FindFn {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_) {
+      return find_avx512;
+    }
+    if (cpu.avx2_) {
+      return find_avx2;
+    }
+#endif
+    return find_generic;
+  }();
+  return fn;
+}
+
+} // namespace point_detail
+
+
+class PointSet {
+public:
+  PointSet() = default;
+  explicit PointSet(const std::vector<Point>& points) {
+    xs_.reserve(points.size());
+    ys_.reserve(points.size());
+    for (const auto& p : points) {
+      push_back(p);
+    }
+  }
+
+  auto push_back(const Point& p) -> void {
+    xs_.push_back(p.x);
+    ys_.push_back(p.y);
+  }
+  auto size() const noexcept { return xs_.size(); }
+  auto empty() const noexcept { return xs_.empty(); }
+  auto operator[](size_t i) const { return Point{xs_[i], ys_[i]}; }
+  auto xs() const noexcept { return xs_.data(); }
+  auto ys() const noexcept { return ys_.data(); }
+
+  // Index of the first point equal to p, or size() if there is none
+  auto find(const Point& p) const -> size_t {
+    return point_detail::find_kernel()(xs_.data(), ys_.data(), size(), p.x, p.y);
+  }
+  auto contains(const Point& p) const { return find(p) != size(); }
+
+  auto find_batch(const std::vector<Point>& keys) const {
+    const auto kernel = point_detail::find_kernel();
+    auto result = std::vector<size_t>(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      result[i] = kernel(xs_.data(), ys_.data(), size(), keys[i].x, keys[i].y);
+    }
+    return result;
+  }
+
+private:
+  search_detail::AlignedVector<int> xs_;
+  search_detail::AlignedVector<int> ys_;
+};
+
+
+class GridIndex {
+public:
+  // Average number of points per cell when no cell size is given
+  static constexpr auto kPointsPerCell = 4;
+
+  // A cell_size of 0 picks one from the density of the points. The
+  // cell size is doubled until there are at most a few cells per
+  // point, so that outliers don't give a huge and empty grid.
+  explicit GridIndex(const PointSet& points, std::int64_t cell_size = 0)
+    : size_{points.size()} {
+    if (size_ == 0) {
+      cell_start_.assign(2, 0);
+      return;
+    }
+    const auto [min_x, max_x] = std::minmax_element(points.xs(), points.xs() + size_);
+    const auto [min_y, max_y] = std::minmax_element(points.ys(), points.ys() + size_);
+    min_x_ = *min_x;
+    min_y_ = *min_y;
+    const auto width = std::int64_t{*max_x} - min_x_ + 1;
+    const auto height = std::int64_t{*max_y} - min_y_ + 1;
+    if (cell_size <= 0) {
+      const auto num_cells = std::max<double>(1.0, static_cast<double>(size_) / kPointsPerCell);
+      const auto area = static_cast<double>(width) * static_cast<double>(height);
+      cell_size = static_cast<std::int64_t>(std::ceil(std::sqrt(area / num_cells)));
+    }
+    cell_size_ = std::max<std::int64_t>(1, cell_size);
+    const auto max_cells = std::int64_t{kPointsPerCell} * static_cast<std::int64_t>(size_) + 16;
+    for (;;) {
+      cols_ = (width + cell_size_ - 1) / cell_size_;
+      rows_ = (height + cell_size_ - 1) / cell_size_;
+      // Divides instead of multiplying, which could overflow
+      if (cols_ <= max_cells / rows_) {
+        break;
+      }
+      cell_size_ *= 2;
+    }
+
+    // Counting sort of the points by cell
+    auto cells = std::vector<size_t>(size_);
+    cell_start_.assign(static_cast<size_t>(cols_ * rows_) + 1, 0);
+    for (size_t i = 0; i < size_; ++i) {
+      cells[i] = cell_of(points.xs()[i], points.ys()[i]);
+      ++cell_start_[cells[i] + 1];
+    }
+    std::partial_sum(cell_start_.begin(), cell_start_.end(), cell_start_.begin());
+    xs_.resize(size_);
+    ys_.resize(size_);
+    ids_.resize(size_);
+    auto next = std::vector<size_t>(cell_start_.begin(), cell_start_.end() - 1);
+    for (size_t i = 0; i < size_; ++i) {
+      const auto j = next[cells[i]]++;
+      xs_[j] = points.xs()[i];
+      ys_[j] = points.ys()[i];
+      ids_[j] = i;
+    }
+  }
+
+  auto size() const noexcept { return size_; }
+  auto cell_size() const noexcept { return cell_size_; }
+  auto num_cells() const noexcept { return cell_start_.size() - 1; }
+
+  // Index in the PointSet of a point equal to p, or size() if there
+  // is none. If the set holds p more than once, any of them is found.
+  auto find(const Point& p) const -> size_t {
+    if (!inside(p.x, p.y)) {
+      return size_;
+    }
+    return find_in_cell(cell_of(p.x, p.y), p, point_detail::find_kernel());
+  }
+  auto contains(const Point& p) const { return find(p) != size_; }
+
+  auto find_batch(const std::vector<Point>& keys) const {
+    const auto kernel = point_detail::find_kernel();
+    auto result = std::vector<size_t>(keys.size(), size_);
+    for (const auto& [cell, i] : sort_by_cell(keys)) {
+      if (inside(keys[i].x, keys[i].y)) {
+        result[i] = find_in_cell(cell, keys[i], kernel);
+      }
+    }
+    return result;
+  }
+
+  // Calls f(index) for each point at a distance of at most radius
+  // from center, in no particular order
+  template <typename F>
+  auto for_each_in_radius(const Point& center, int radius, F&& f) const -> void {
+    if (size_ == 0 || radius < 0) {
+      return;
+    }
+    const auto cx = std::int64_t{center.x};
+    const auto cy = std::int64_t{center.y};
+    const auto col_first = clamp_col(cx - radius);
+    const auto col_last = clamp_col(cx + radius);
+    const auto row_first = clamp_row(cy - radius);
+    const auto row_last = clamp_row(cy + radius);
+    // The squares are at most 2^62 each, so the sum fits in 64 bits
+    const auto r = static_cast<std::uint64_t>(radius);
+    const auto r2 = r * r;
+    for (auto row = row_first; row <= row_last; ++row) {
+      const auto first = cell_start_[static_cast<size_t>(row * cols_ + col_first)];
+      const auto last = cell_start_[static_cast<size_t>(row * cols_ + col_last) + 1];
+      for (auto j = first; j < last; ++j) {
+        const auto dx = static_cast<std::uint64_t>(std::abs(xs_[j] - cx));
+        const auto dy = static_cast<std::uint64_t>(std::abs(ys_[j] - cy));
+        if (dx <= r && dy <= r && dx * dx + dy * dy <= r2) {
+          f(ids_[j]);
+        }
+      }
+    }
+  }
+
+  auto within_radius(const Point& center, int radius) const {
+    auto result = std::vector<size_t>{};
+    for_each_in_radius(center, radius, [&](size_t i) { result.push_back(i); });
+    return result;
+  }
+
+  auto within_radius_batch(const std::vector<Point>& centers, int radius) const {
+    auto result = std::vector<std::vector<size_t>>(centers.size());
+    for (const auto& [cell, i] : sort_by_cell(centers)) {
+      auto& out = result[i];
+      for_each_in_radius(centers[i], radius, [&](size_t id) { out.push_back(id); });
+    }
+    return result;
+  }
+
+private:
+  auto inside(std::int64_t x, std::int64_t y) const noexcept -> bool {
+    return size_ != 0 && x >= min_x_ && y >= min_y_ && x - min_x_ < cols_ * cell_size_ &&
+           y - min_y_ < rows_ * cell_size_;
+  }
+  auto cell_of(std::int64_t x, std::int64_t y) const noexcept -> size_t {
+    return static_cast<size_t>((y - min_y_) / cell_size_ * cols_ + (x - min_x_) / cell_size_);
+  }
+  auto clamp_col(std::int64_t x) const noexcept -> std::int64_t {
+    return std::clamp<std::int64_t>((x - min_x_) / cell_size_, 0, cols_ - 1);
+  }
+  auto clamp_row(std::int64_t y) const noexcept -> std::int64_t {
+    return std::clamp<std::int64_t>((y - min_y_) / cell_size_, 0, rows_ - 1);
+  }
+
+  auto find_in_cell(size_t cell, const Point& p, point_detail::FindFn kernel) const -> size_t {
+    const auto first = cell_start_[cell];
+    const auto n = cell_start_[cell + 1] - first;
+    const auto j = kernel(xs_.data() + first, ys_.data() + first, n, p.x, p.y);
+    return j < n ? ids_[first + j] : size_;
+  }
+
+  // (cell, query index) pairs of the queries, ordered by cell. Queries
+  // outside the grid go to the nearest cell. Large batches are sorted
+  // with a counting sort over the cells, small ones with std::sort().
+  auto sort_by_cell(const std::vector<Point>& queries) const
+    -> std::vector<std::pair<size_t, size_t>> {
+    auto order = std::vector<std::pair<size_t, size_t>>(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const auto& q = queries[i];
+      order[i] = {static_cast<size_t>(clamp_row(q.y) * cols_ + clamp_col(q.x)), i};
+    }
+    if (queries.size() < num_cells()) {
+      std::sort(order.begin(), order.end());
+      return order;
+    }
+    auto start = std::vector<size_t>(num_cells() + 1, 0);
+    for (const auto& [cell, i] : order) {
+      ++start[cell + 1];
+    }
+    std::partial_sum(start.begin(), start.end(), start.begin());
+    auto sorted = std::vector<std::pair<size_t, size_t>>(order.size());
+    for (const auto& entry : order) {
+      sorted[start[entry.first]++] = entry;
+    }
+    return sorted;
+  }
+
+  size_t size_{};
+  std::int64_t min_x_{};
+  std::int64_t min_y_{};
+  std::int64_t cell_size_{1};
+  std::int64_t cols_{1};
+  std::int64_t rows_{1};
+  std::vector<size_t> cell_start_;
+  search_detail::AlignedVector<int> xs_;
+  search_detail::AlignedVector<int> ys_;
+  std::vector<size_t> ids_;
+};
+
+#endif
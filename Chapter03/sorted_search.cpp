@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "sorted_search.hpp"
+
+//
+// This example compares std::lower_bound(), a branchy bisection like
+// binary_search() in binary_search.cpp, with the sorted layouts in
+// sorted_search.hpp. The arrays range from fitting in the L1 cache
+// to being much larger than the last level cache.
+//
+
+namespace {
+
+// The largest array in the benchmark, 64 MB of ints. The layouts
+// support up to 2^32 keys, so increase it towards 1B keys if you
+// have the memory (about 12 GB for all layouts at 1B).
+constexpr auto kMaxKeys = size_t{1} << 24;
+constexpr auto kNumQueries = size_t{1'000'000};
+
+template <typename T>
+auto random_sorted(size_t n, std::mt19937& gen, int max_value) {
+  auto dist = std::uniform_int_distribution<int>{0, max_value};
+  auto a = std::vector<T>(n);
+  for (auto& v : a) {
+    v = static_cast<T>(dist(gen));
+  }
+  std::sort(a.begin(), a.end());
+  return a;
+}
+
+template <typename T>
+auto check_all_layouts(const std::vector<T>& a, int max_value) {
+  const auto eytzinger = EytzingerIndex<T>{a};
+  const auto stree = STree<T>{a};
+  for (auto key = -1; key <= max_value + 1; ++key) {
+    const auto k = static_cast<T>(key);
+    const auto expected =
+      static_cast<size_t>(std::lower_bound(a.begin(), a.end(), k) - a.begin());
+    ASSERT_EQ(expected, branchless_lower_bound(a, k));
+    ASSERT_EQ(expected, eytzinger.lower_bound(k));
+    ASSERT_EQ(expected, stree.lower_bound(k));
+  }
+}
+
+// Average nanoseconds per call of f(key)
+template <typename F>
+auto ns_per_query(const std::vector<int>& queries, F&& f) {
+  auto checksum = size_t{0};
+  const auto start = std::chrono::steady_clock::now();
+  for (auto key : queries) {
+    checksum += f(key);
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  // Keeps the calls from being optimized away
+  if (checksum == size_t(-1)) {
+    std::cout << checksum;
+  }
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+  return static_cast<double>(ns) / static_cast<double>(queries.size());
+}
+
+} // namespace
+
+TEST(SortedSearch, SameResultAsStdLowerBound) {
+  auto gen = std::mt19937{};
+  for (auto n : {0, 1, 2, 15, 16, 17, 100, 255, 256, 257, 1000, 4913, 5000}) {
+    // Few distinct values gives many duplicates
+    for (auto max_value : {10, 10'000}) {
+      check_all_layouts(random_sorted<int>(n, gen, max_value), max_value);
+      check_all_layouts(random_sorted<float>(n, gen, max_value), max_value);
+      check_all_layouts(random_sorted<double>(n, gen, max_value), max_value);
+      check_all_layouts(random_sorted<std::uint64_t>(n, gen, max_value), max_value);
+    }
+  }
+}
+
+TEST(SortedSearch, LargestKey) {
+  // The padding of the S-tree uses the largest value
+  const auto max = std::numeric_limits<int>::max();
+  auto a = std::vector<int>(100, 7);
+  a.back() = max;
+  ASSERT_EQ(size_t{99}, STree<int>{a}.lower_bound(max));
+  ASSERT_EQ(size_t{99}, EytzingerIndex<int>{a}.lower_bound(max));
+  ASSERT_EQ(size_t{99}, branchless_lower_bound(a, max));
+}
+
+TEST(SortedSearch, InfiniteKeys) {
+  // The padding of a floating point S-tree is infinity, which must
+  // not count as less than an infinite key
+  const auto inf = std::numeric_limits<float>::infinity();
+  auto a = std::vector<float>(1000);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a[i] = static_cast<float>(i);
+  }
+  std::fill(a.end() - 10, a.end(), inf);
+  for (auto key : {-inf, 0.0f, 500.5f, 989.0f, 990.0f, inf}) {
+    const auto expected =
+      static_cast<size_t>(std::lower_bound(a.begin(), a.end(), key) - a.begin());
+    ASSERT_EQ(expected, STree<float>{a}.lower_bound(key));
+    ASSERT_EQ(expected, EytzingerIndex<float>{a}.lower_bound(key));
+    ASSERT_EQ(expected, branchless_lower_bound(a, key));
+  }
+  const auto finite = std::vector<double>(1000, 1.0);
+  ASSERT_EQ(size_t{1000}, STree<double>{finite}.lower_bound(std::numeric_limits<double>::infinity()));
+}
+
+TEST(SortedSearch, CompareSearchTimes) {
+  auto gen = std::mt19937{};
+  std::cout << "ns per query" << '\n'
+            << std::setw(10) << "keys" << std::setw(18) << "std::lower_bound"
+            << std::setw(12) << "branchless" << std::setw(11) << "eytzinger"
+            << std::setw(8) << "s-tree" << '\n';
+  for (auto n = size_t{1024}; n <= kMaxKeys; n *= 4) {
+    auto a = std::vector<int>(n);
+    for (size_t i = 0; i < n; ++i) {
+      a[i] = static_cast<int>(2 * i); // Every other key is a miss
+    }
+    auto dist = std::uniform_int_distribution<int>{0, static_cast<int>(2 * n)};
+    auto queries = std::vector<int>(kNumQueries);
+    std::generate(queries.begin(), queries.end(), [&] { return dist(gen); });
+    const auto eytzinger = EytzingerIndex<int>{a};
+    const auto stree = STree<int>{a};
+
+    std::cout << std::fixed << std::setprecision(1) << std::setw(10) << n
+      << std::setw(18) << ns_per_query(queries, [&](int k) {
+           return static_cast<size_t>(std::lower_bound(a.begin(), a.end(), k) - a.begin()); })
+      << std::setw(12) << ns_per_query(queries, [&](int k) {
+           return branchless_lower_bound(a, k); })
+      << std::setw(11) << ns_per_query(queries, [&](int k) { return eytzinger.lower_bound(k); })
+      << std::setw(8) << ns_per_query(queries, [&](int k) { return stree.lower_bound(k); })
+      << '\n';
+  }
+}
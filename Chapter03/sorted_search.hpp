@@ -0,0 +1,353 @@
+#pragma once
+#ifndef SORTED_SEARCH_HPP
+#define SORTED_SEARCH_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "cpu_features.hpp"
+
+//
+// Three ways of finding the position of the first element which is
+// not less than a key, the same as std::lower_bound(), in a sorted
+// array:
+//
+// - branchless_lower_bound() bisects the array like binary_search()
+//   but without branches which depend on the data, so there are no
+//   mispredictions.
+//
+// - EytzingerIndex stores the keys in breadth-first order, like a
+//   binary heap. The nodes of the next few levels are adjacent in
+//   memory and can be prefetched long before they are needed.
+//
+// - STree is a static B+-tree where each node is one cache line of
+//   keys, and the position within a node is found with SIMD. The
+//   leaves are the sorted array itself.
+//
+// For large arrays the time is dominated by cache misses: bisection
+// misses on almost every step, while the S-tree only misses once per
+// level and has far fewer levels.
+//
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define SEARCH_PREFETCH(address) __builtin_prefetch(address)
+#else
+  #define SEARCH_PREFETCH(address)
+#endif
+
+namespace search_detail {
+
+constexpr auto kCacheLineSize = size_t{64};
+
+// Allocates cache line aligned memory, so that the blocks of keys
+// in the layouts below start at a cache line
+template <typename T>
+struct CacheAlignedAllocator {
+  using value_type = T;
+
+  CacheAlignedAllocator() = default;
+  template <typename U>
+  CacheAlignedAllocator(const CacheAlignedAllocator<U>&) noexcept {}
+
+  auto allocate(size_t n) -> T* {
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{kCacheLineSize}));
+  }
+  auto deallocate(T* p, size_t) noexcept -> void {
+    ::operator delete(p, std::align_val_t{kCacheLineSize});
+  }
+
+  template <typename U>
+  auto operator==(const CacheAlignedAllocator<U>&) const noexcept { return true; }
+  template <typename U>
+  auto operator!=(const CacheAlignedAllocator<U>&) const noexcept { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, CacheAlignedAllocator<T>>;
+
+inline auto countr_one(size_t k) noexcept -> unsigned {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(~static_cast<unsigned long long>(k)));
+#else
+  auto n = 0u;
+  for (; (k & 1u) != 0; k >>= 1) {
+    ++n;
+  }
+  return n;
+#endif
+}
+
+} // namespace search_detail
+
+
+// Same result as std::lower_bound(a, a + n, key) - a. The loop
+// always runs log2(n) times, and the comparison selects the next
+// base with a conditional move instead of a branch.
+template <typename T>
+auto branchless_lower_bound(const T* a, size_t n, const T& key) -> size_t {
+  if (n == 0) {
+    return 0;
+  }
+  const auto* base = a;
+  while (n > 1) {
+    const auto half = n / 2;
+    // Both possible middles of the next step
+    SEARCH_PREFETCH(base + half / 2);
+    SEARCH_PREFETCH(base + half + half / 2);
+    base = base[half] < key ? base + half : base;
+    n -= half;
+  }
+  return static_cast<size_t>(base - a) + (*base < key ? 1 : 0);
+}
+
+template <typename T>
+auto branchless_lower_bound(const std::vector<T>& a, const T& key) -> size_t {
+  return branchless_lower_bound(a.data(), a.size(), key);
+}
+
+
+template <typename T>
+class EytzingerIndex {
+public:
+  explicit EytzingerIndex(const std::vector<T>& sorted)
+    : size_{sorted.size()}, keys_(sorted.size() + 1), positions_(sorted.size() + 1) {
+    assert(std::is_sorted(sorted.begin(), sorted.end()));
+    if (size_ > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::length_error{"EytzingerIndex supports at most 2^32 - 1 keys"};
+    }
+    auto i = size_t{0};
+    build(sorted, i, 1);
+  }
+
+  auto size() const noexcept { return size_; }
+
+  // Position of the first key not less than key in the sorted array
+  auto lower_bound(const T& key) const -> size_t {
+    const auto* keys = keys_.data();
+    auto k = size_t{1};
+    while (k <= size_) {
+      // The descendants a few levels down are adjacent, e.g. the 16
+      // int keys four levels down fill one cache line. Prefetching
+      // past the end is harmless.
+      SEARCH_PREFETCH(keys + k * kKeysPerLine);
+      k = 2 * k + (keys[k] < key ? 1 : 0);
+    }
+    // Undo the right turns after the last left turn, which went to
+    // the node we are looking for
+    k >>= search_detail::countr_one(k) + 1;
+    return k == 0 ? size_ : positions_[k];
+  }
+
+private:
+  static constexpr auto kKeysPerLine = std::max<size_t>(1, search_detail::kCacheLineSize / sizeof(T));
+
+  // In-order traversal of the implicit tree, assigning the sorted
+  // keys in order
+  auto build(const std::vector<T>& sorted, size_t& i, size_t k) -> void {
+    if (k <= size_) {
+      build(sorted, i, 2 * k);
+      keys_[k] = sorted[i];
+      positions_[k] = static_cast<std::uint32_t>(i);
+      ++i;
+      build(sorted, i, 2 * k + 1);
+    }
+  }
+
+  size_t size_{};
+  // Index 0 is unused, the children of k are 2k and 2k + 1
+  search_detail::AlignedVector<T> keys_{};
+  std::vector<std::uint32_t> positions_{};
+};
+
+
+namespace search_detail {
+
+// Number of keys in node which are less than key
+template <typename T, size_t B>
+inline auto node_rank_generic(const T* node, const T& key) -> unsigned {
+  auto rank = 0u;
+  for (size_t i = 0; i < B; ++i) {
+    rank += node[i] < key ? 1 : 0;
+  }
+  return rank;
+}
+
+#if CPU_DISPATCH_ENABLED
+
+TARGET_AVX2 inline auto node_rank_avx2(const int* node, int key) -> unsigned {
+  const auto x = _mm256_set1_epi32(key);
+  const auto lo = _mm256_cmpgt_epi32(x, _mm256_load_si256(reinterpret_cast<const __m256i*>(node)));
+  const auto hi = _mm256_cmpgt_epi32(x, _mm256_load_si256(reinterpret_cast<const __m256i*>(node + 8)));
+  const auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(lo))) |
+                    static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(hi))) << 8;
+  return static_cast<unsigned>(_mm_popcnt_u32(mask));
+}
+
+TARGET_AVX2 inline auto node_rank_avx2(const float* node, float key) -> unsigned {
+  const auto x = _mm256_set1_ps(key);
+  const auto lo = _mm256_cmp_ps(_mm256_load_ps(node), x, _CMP_LT_OQ);
+  const auto hi = _mm256_cmp_ps(_mm256_load_ps(node + 8), x, _CMP_LT_OQ);
+  const auto mask = static_cast<unsigned>(_mm256_movemask_ps(lo)) |
+                    static_cast<unsigned>(_mm256_movemask_ps(hi)) << 8;
+  return static_cast<unsigned>(_mm_popcnt_u32(mask));
+}
+
+TARGET_AVX512 inline auto node_rank_avx512(const int* node, int key) -> unsigned {
+  const auto mask = _mm512_cmplt_epi32_mask(_mm512_load_si512(node), _mm512_set1_epi32(key));
+  return static_cast<unsigned>(_mm_popcnt_u32(mask));
+}
+
+TARGET_AVX512 inline auto node_rank_avx512(const float* node, float key) -> unsigned {
+  const auto mask = _mm512_cmp_ps_mask(_mm512_load_ps(node), _mm512_set1_ps(key), _CMP_LT_OQ);
+  return static_cast<unsigned>(_mm_popcnt_u32(mask));
+}
+
+#endif // CPU_DISPATCH_ENABLED
+
+} // namespace search_detail
+
+
+// A static B+-tree with B keys per node, B + 1 children per internal
+// node, and all nodes of a level stored after each other. Level 0 is
+// the sorted keys, padded to a whole number of nodes, so the
+// position in level 0 is the position in the sorted array. A key in
+// an internal node is the smallest key in the subtree to the right
+// of it. The layout is described in "Static B-Trees" in Sergey
+// Slotin's Algorithms for Modern Hardware.
+template <typename T>
+class STree {
+  static_assert(std::is_arithmetic_v<T>, "The padding needs a largest value of T");
+
+public:
+  // One cache line per node
+  static constexpr auto B = std::max<size_t>(1, search_detail::kCacheLineSize / sizeof(T));
+
+  explicit STree(const std::vector<T>& sorted) : size_{sorted.size()} {
+    assert(std::is_sorted(sorted.begin(), sorted.end()));
+    // Size and position of every level, from the leaves and up
+    auto n = size_;
+    offsets_.push_back(0);
+    for (;;) {
+      offsets_.push_back(offsets_.back() + blocks(n) * B);
+      if (n <= B) {
+        break;
+      }
+      n = keys_above(n);
+    }
+    height_ = offsets_.size() - 1;
+
+    tree_.assign(offsets_.back(), kPadding);
+    std::copy(sorted.begin(), sorted.end(), tree_.begin());
+    for (size_t h = 1; h < height_; ++h) {
+      for (size_t i = 0; i < offsets_[h + 1] - offsets_[h]; ++i) {
+        // The first leaf in the subtree right of key j in node k
+        const auto k = i / B;
+        const auto j = i % B;
+        auto leaf = k * (B + 1) + j + 1;
+        for (size_t l = 1; l < h; ++l) {
+          leaf *= B + 1;
+        }
+        tree_[offsets_[h] + i] = leaf * B < size_ ? tree_[leaf * B] : kPadding;
+      }
+    }
+    select_kernel();
+  }
+
+  auto size() const noexcept { return size_; }
+  auto height() const noexcept { return height_; }
+
+  // Position of the first key not less than key in the sorted array
+  auto lower_bound(const T& key) const -> size_t {
+    if (size_ == 0) {
+      return 0;
+    }
+    return (this->*lower_bound_)(key);
+  }
+
+private:
+  // Not less than any key, so no key is ever counted past the padding
+  static constexpr auto kPadding =
+    std::is_floating_point_v<T> ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+
+  static auto blocks(size_t n) -> size_t { return (n + B - 1) / B; }
+  static auto keys_above(size_t n) -> size_t { return (blocks(n) + B) / (B + 1) * B; }
+
+  // Child k of level h, kept within the nodes of level h - 1, so a
+  // key which compares greater than the padding can never descend
+  // past the last node
+  auto child(size_t h, size_t k) const -> size_t {
+    return std::min(k, (offsets_[h] - offsets_[h - 1]) / B - 1);
+  }
+
+  // The same loop for every kernel, node_rank() is inlined
+  template <typename Rank>
+  auto lower_bound_with(const T& key, Rank node_rank) const -> size_t {
+    const auto* tree = tree_.data();
+    auto k = size_t{0};
+    for (auto h = height_ - 1; h > 0; --h) {
+      k = child(h, k * (B + 1) + node_rank(tree + offsets_[h] + k * B, key));
+    }
+    const auto position = k * B + node_rank(tree + k * B, key);
+    return std::min(position, size_);
+  }
+
+  auto lower_bound_generic(const T& key) const -> size_t {
+    return lower_bound_with(key, search_detail::node_rank_generic<T, B>);
+  }
+
+#if CPU_DISPATCH_ENABLED
+  TARGET_AVX2 auto lower_bound_avx2(const T& key) const -> size_t {
+    if constexpr (B == 16 && (std::is_same_v<T, int> || std::is_same_v<T, float>)) {
+      const auto* tree = tree_.data();
+      auto k = size_t{0};
+      for (auto h = height_ - 1; h > 0; --h) {
+        k = child(h, k * (B + 1) + search_detail::node_rank_avx2(tree + offsets_[h] + k * B, key));
+      }
+      const auto position = k * B + search_detail::node_rank_avx2(tree + k * B, key);
+      return std::min(position, size_);
+    } else {
+      return lower_bound_generic(key);
+    }
+  }
+
+  TARGET_AVX512 auto lower_bound_avx512(const T& key) const -> size_t {
+    if constexpr (B == 16 && (std::is_same_v<T, int> || std::is_same_v<T, float>)) {
+      const auto* tree = tree_.data();
+      auto k = size_t{0};
+      for (auto h = height_ - 1; h > 0; --h) {
+        k = child(h, k * (B + 1) + search_detail::node_rank_avx512(tree + offsets_[h] + k * B, key));
+      }
+      const auto position = k * B + search_detail::node_rank_avx512(tree + k * B, key);
+      return std::min(position, size_);
+    } else {
+      return lower_bound_generic(key);
+    }
+  }
+#endif
+
+  auto select_kernel() -> void {
+    lower_bound_ = &STree::lower_bound_generic;
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_) {
+      lower_bound_ = &STree::lower_bound_avx512;
+    } else if (cpu.avx2_) {
+      lower_bound_ = &STree::lower_bound_avx2;
+    }
+#endif
+  }
+
+  size_t size_{};
+  size_t height_{};
+  std::vector<size_t> offsets_{}; // offsets_[h] is the start of level h
+  search_detail::AlignedVector<T> tree_{};
+  size_t (STree::*lower_bound_)(const T&) const {};
+};
+
+#endif
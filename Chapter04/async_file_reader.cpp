@@ -0,0 +1,208 @@
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "async_file_reader.hpp"
+#include "scooped_timer.hpp"
+
+#if ASYNC_FILE_PREAD_ENABLED
+
+//
+// This example loads many small files at once, as an asset server
+// does at startup, and compares reading them one by one with
+// std::ifstream to reading them asynchronously.
+//
+
+namespace {
+
+// The number of files in the benchmark. Increase if you want more.
+constexpr auto kNumFiles = size_t{10'000};
+
+class AsyncFileReaderTest : public testing::Test {
+protected:
+  void SetUp() override {
+    char dir[] = "/tmp/async_file_reader_XXXXXX";
+    ASSERT_NE(nullptr, ::mkdtemp(dir));
+    dir_ = dir;
+  }
+
+  void TearDown() override {
+    for (const auto& path : paths_) {
+      ::unlink(path.c_str());
+    }
+    ::rmdir(dir_.c_str());
+  }
+
+  auto create_file(const std::string& content) -> std::string {
+    auto path = dir_ + "/file" + std::to_string(paths_.size()) + ".bin";
+    auto out = std::ofstream{path, std::ios::binary};
+    out.write(content.data(), static_cast<std::streamsize>(content.size()));
+    paths_.push_back(path);
+    contents_.push_back(content);
+    return path;
+  }
+
+  auto backends() const {
+    auto result = std::vector<IoBackend>{IoBackend::ThreadPool};
+    if (AsyncFileReader::io_uring_available()) {
+      result.push_back(IoBackend::IoUring);
+    }
+    return result;
+  }
+
+  std::string dir_{};
+  std::vector<std::string> paths_{};
+  std::vector<std::string> contents_{};
+};
+
+auto make_content(size_t size, char seed) {
+  auto content = std::string(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    content[i] = static_cast<char>(seed + i * 7);
+  }
+  return content;
+}
+
+auto read_with_ifstream(const std::string& path) {
+  auto in = std::ifstream{path, std::ios::binary | std::ios::ate};
+  const auto size = static_cast<size_t>(in.tellg());
+  auto content = std::string(size, '\0');
+  in.seekg(0);
+  in.read(&content[0], static_cast<std::streamsize>(size));
+  return content;
+}
+
+} // namespace
+
+TEST_F(AsyncFileReaderTest, ReadAll) {
+  for (auto size : {size_t{0}, size_t{1}, size_t{4096}, size_t{100'000}, size_t{3'000'000}}) {
+    create_file(make_content(size, static_cast<char>(size)));
+  }
+  for (auto backend : backends()) {
+    auto reader = AsyncFileReader{backend, 4};
+    ASSERT_NE(IoBackend::Auto, reader.backend());
+    auto futures = reader.read_all(paths_);
+    for (size_t i = 0; i < futures.size(); ++i) {
+      ASSERT_EQ(contents_[i], futures[i].get());
+    }
+  }
+}
+
+TEST_F(AsyncFileReaderTest, Callbacks) {
+  for (size_t i = 0; i < 100; ++i) {
+    create_file(make_content(i * 10, static_cast<char>(i)));
+  }
+  for (auto backend : backends()) {
+    auto num_correct = std::atomic<size_t>{0};
+    {
+      auto reader = AsyncFileReader{backend};
+      for (size_t i = 0; i < paths_.size(); ++i) {
+        reader.read(paths_[i], [&, i](std::error_code ec, std::string data) {
+          if (!ec && data == contents_[i]) {
+            ++num_correct;
+          }
+        });
+      }
+    } // The destructor waits for the reads to finish
+    ASSERT_EQ(paths_.size(), num_correct);
+  }
+}
+
+TEST_F(AsyncFileReaderTest, MissingFile) {
+  for (auto backend : backends()) {
+    auto reader = AsyncFileReader{backend};
+    auto future = reader.read(dir_ + "/missing.bin");
+    try {
+      future.get();
+      FAIL() << "Expected an exception";
+    } catch (const std::system_error& e) {
+      ASSERT_EQ(std::errc::no_such_file_or_directory, e.code());
+    }
+
+    auto promise = std::promise<std::error_code>{};
+    reader.read(dir_ + "/missing.bin", [&promise](std::error_code ec, std::string data) {
+      promise.set_value(data.empty() ? ec : std::error_code{});
+    });
+    ASSERT_EQ(std::errc::no_such_file_or_directory, promise.get_future().get());
+  }
+}
+
+TEST_F(AsyncFileReaderTest, FallBackToThreadPool) {
+  if (!AsyncFileReader::io_uring_available()) {
+    GTEST_SKIP() << "io_uring is not available";
+  }
+  for (size_t i = 0; i < 100; ++i) {
+    create_file(make_content(i * 100, static_cast<char>(i)));
+  }
+  constexpr auto kQueueDepth = 8u;
+  for (auto enters : {0u, 1u, 3u}) {
+    auto reader = AsyncFileReader{IoBackend::IoUring, kQueueDepth};
+    reader.fail_io_uring_after(enters, std::make_error_code(std::errc::not_enough_memory));
+    auto futures = reader.read_all(paths_);
+    auto num_failed = size_t{0};
+    for (size_t i = 0; i < futures.size(); ++i) {
+      try {
+        ASSERT_EQ(contents_[i], futures[i].get());
+      } catch (const std::system_error& e) {
+        ASSERT_EQ(std::errc::not_enough_memory, e.code());
+        ++num_failed;
+      }
+    }
+    // Only the reads which the kernel had started fail, at most one
+    // for each entry of the ring. The ones still queued are read by
+    // the thread pool.
+    ASSERT_LE(num_failed, kQueueDepth);
+    if (enters == 0) {
+      ASSERT_EQ(0u, num_failed);
+    }
+    ASSERT_EQ(IoBackend::ThreadPool, reader.backend());
+  }
+}
+
+#if defined(__linux__)
+TEST_F(AsyncFileReaderTest, FileWithUnknownSize) {
+  // Files in /proc report a size of zero but aren't empty
+  for (auto backend : backends()) {
+    auto reader = AsyncFileReader{backend};
+    const auto content = reader.read("/proc/self/status").get();
+    ASSERT_NE(std::string::npos, content.find("Name:"));
+  }
+}
+#endif
+
+TEST_F(AsyncFileReaderTest, CompareLoadingTime) {
+  for (size_t i = 0; i < kNumFiles; ++i) {
+    // Sizes between 1 and 8 KB, like small assets
+    create_file(make_content(1024 + (i * 4099) % (7 * 1024), static_cast<char>(i)));
+  }
+  // All files are in the page cache after being written, so this
+  // measures the overhead of the system calls rather than the disk.
+  // The asynchronous readers pay off when the files have to be read
+  // from a disk with many requests in flight, and when there are
+  // several CPUs to share the work.
+
+  auto total_size = size_t{0};
+  {
+    ScopedTimer timer{"std::ifstream"};
+    for (const auto& path : paths_) {
+      total_size += read_with_ifstream(path).size();
+    }
+  }
+  for (auto backend : backends()) {
+    auto reader = AsyncFileReader{backend};
+    const auto* name = backend == IoBackend::IoUring ? "io_uring" : "thread pool";
+    auto size = size_t{0};
+    {
+      ScopedTimer timer{name};
+      auto futures = reader.read_all(paths_);
+      for (auto& future : futures) {
+        size += future.get().size();
+      }
+    }
+    ASSERT_EQ(total_size, size);
+  }
+}
+
+#endif // ASYNC_FILE_PREAD_ENABLED
@@ -0,0 +1,734 @@
+#pragma once
+#ifndef ASYNC_FILE_READER_HPP
+#define ASYNC_FILE_READER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "thread_pool.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+  #define ASYNC_FILE_PREAD_ENABLED 1
+  #include <fcntl.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#else
+  #define ASYNC_FILE_PREAD_ENABLED 0
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+  #if __has_include(<linux/io_uring.h>)
+    #include <linux/io_uring.h>
+    #include <linux/stat.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+  #endif
+#endif
+
+// Headers with IORING_FEAT_FAST_POLL (5.7) also have the open and
+// statx operations and the probe of supported operations (5.6)
+#if defined(IORING_FEAT_FAST_POLL) && defined(__NR_io_uring_setup)
+  #define ASYNC_FILE_IO_URING_ENABLED 1
+#else
+  #define ASYNC_FILE_IO_URING_ENABLED 0
+#endif
+
+//
+// An AsyncFileReader reads whole files into strings without blocking
+// the calling thread. The result is delivered either through a
+// std::future or by invoking a callback.
+//
+// On Linux the files are read with io_uring: the open, statx and read
+// operations of many files are placed in a shared submission queue
+// and handed to the kernel with a single system call. Where io_uring
+// is missing or blocked, e.g. by the seccomp filter of a container,
+// the files are read with blocking pread() calls on a thread pool. If
+// the ring fails later on, the reads in progress fail with its error
+// and the reader switches to the thread pool.
+//
+
+enum class IoBackend {
+  Auto,      // io_uring if available, otherwise ThreadPool
+  IoUring,
+  ThreadPool
+};
+
+// Called with the content of the file, or with an error code and an
+// empty string. The callback is invoked on an internal thread and
+// must not throw.
+using ReadCallback = std::function<void(std::error_code, std::string)>;
+
+namespace async_io_detail {
+
+#if ASYNC_FILE_PREAD_ENABLED
+
+// Reads the rest of fd, starting at offset, into data. size is the
+// expected size of the file, or 0 if unknown.
+inline auto read_fd(int fd, size_t size, std::string& data, size_t offset = 0) -> std::error_code {
+  constexpr auto kChunkSize = size_t{64 * 1024};
+  for (;;) {
+    if (offset == data.size()) {
+      // The file is larger than expected, or the size is unknown
+      data.resize(std::max(data.size() + kChunkSize, size));
+    }
+    const auto n = ::pread(fd, &data[offset], data.size() - offset, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      data.clear();
+      return {errno, std::generic_category()};
+    }
+    if (n == 0) {
+      data.resize(offset);
+      return {};
+    }
+    offset += static_cast<size_t>(n);
+  }
+}
+
+inline auto read_file_blocking(const std::string& path, std::string& data) -> std::error_code {
+  const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return {errno, std::generic_category()};
+  }
+  struct stat st {};
+  auto ec = std::error_code{};
+  if (::fstat(fd, &st) == -1) {
+    ec = {errno, std::generic_category()};
+  } else {
+    // Files in e.g. /proc report a size of zero
+    const auto size = S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) : 0;
+    data.resize(size);
+    ec = read_fd(fd, size, data);
+  }
+  ::close(fd);
+  return ec;
+}
+
+#else
+
+inline auto read_file_blocking(const std::string& path, std::string& data) -> std::error_code {
+  auto in = std::ifstream{path, std::ios::binary};
+  if (!in) {
+    return std::make_error_code(std::errc::no_such_file_or_directory);
+  }
+  data.assign(std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{});
+  return {};
+}
+
+#endif // ASYNC_FILE_PREAD_ENABLED
+
+#if ASYNC_FILE_IO_URING_ENABLED
+
+//
+// A minimal io_uring wrapper using the raw system calls, since
+// liburing may not be installed. The submission and completion rings
+// are shared with the kernel; the kernel consumes the submission
+// queue entries at sq head and produces completions at cq tail.
+//
+class IoUring {
+public:
+  // Returns nullptr if io_uring or one of the needed operations is
+  // not supported by the kernel, or if the system call is blocked
+  static auto create(unsigned entries) -> std::unique_ptr<IoUring> {
+    auto params = io_uring_params{};
+    const auto fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return nullptr;
+    }
+    auto ring = std::unique_ptr<IoUring>{new IoUring{fd}};
+    if (!ring->map_rings(params) || !ring->supports_needed_ops()) {
+      return nullptr;
+    }
+    return ring;
+  }
+
+  IoUring(const IoUring&) = delete;
+  auto operator=(const IoUring&) -> IoUring& = delete;
+
+  ~IoUring() {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    ::close(fd_);
+  }
+
+  auto entries() const noexcept { return sq_entries_; }
+
+  // Prepared entries which the kernel has not taken yet
+  auto unsubmitted() const noexcept -> unsigned {
+    return local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  }
+
+  auto prepare_openat(const char* path, int flags, uint64_t user_data) -> void {
+    auto* sqe = next_sqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uintptr_t>(path);
+    sqe->open_flags = static_cast<uint32_t>(flags);
+    sqe->user_data = user_data;
+  }
+
+  auto prepare_statx(const char* path, unsigned mask, struct statx* out,
+                     uint64_t user_data) -> void {
+    auto* sqe = next_sqe();
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uintptr_t>(path);
+    sqe->len = mask;
+    sqe->off = reinterpret_cast<uintptr_t>(out);
+    sqe->user_data = user_data;
+  }
+
+  auto prepare_read(int fd, char* buffer, unsigned length, uint64_t offset,
+                    uint64_t user_data) -> void {
+    auto* sqe = next_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+  }
+
+  // Submits all prepared entries with one system call, and waits
+  // until at least min_complete operations have completed. EAGAIN and
+  // EBUSY mean that the kernel is short of resources or that the
+  // completion queue is full. The entries stay in the submission
+  // queue, and can be submitted again once completions are consumed.
+  auto submit_and_wait(unsigned min_complete) -> std::error_code {
+    __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+    for (;;) {
+      const auto n = ::syscall(__NR_io_uring_enter, fd_, unsubmitted(), min_complete,
+                               IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        return {errno, std::generic_category()};
+      }
+      return {};
+    }
+  }
+
+  // Calls f(user_data) for every entry which the kernel has not taken
+  template <typename F>
+  auto for_each_unsubmitted(F&& f) const -> void {
+    for (auto i = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE); i != local_tail_; ++i) {
+      f(sqes_[sq_array_[i & sq_mask_]].user_data);
+    }
+  }
+
+  // Calls f(user_data, result) for every available completion
+  template <typename F>
+  auto for_each_completion(F&& f) -> void {
+    auto head = *cq_head_;
+    const auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const auto& cqe = cqes_[head & cq_mask_];
+      const auto user_data = cqe.user_data;
+      const auto result = cqe.res;
+      // Release the entry before f() as f() may submit new entries
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      f(user_data, result);
+    }
+  }
+
+private:
+  explicit IoUring(int fd) : fd_{fd} {}
+
+  auto map_rings(const io_uring_params& p) -> bool {
+    const auto map = [this](size_t size, off_t offset) -> void* {
+      auto* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd_, offset);
+      return ptr == MAP_FAILED ? nullptr : ptr;
+    };
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const auto single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == nullptr) {
+      return false;
+    }
+    cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+    if (cq_ring_ == nullptr || sqes_ == nullptr) {
+      return false;
+    }
+
+    auto* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sq_entries_ = p.sq_entries;
+    local_tail_ = *sq_tail_;
+
+    auto* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  auto supports_needed_ops() const -> bool {
+    constexpr auto kMaxOps = 256;
+    // io_uring_probe ends with a flexible array of io_uring_probe_op
+    auto buffer = std::vector<uint64_t>(
+      (sizeof(io_uring_probe) + kMaxOps * sizeof(io_uring_probe_op)) / sizeof(uint64_t) + 1);
+    auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, kMaxOps) < 0) {
+      return false;
+    }
+    for (auto op : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ}) {
+      if (op > probe->last_op || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The caller never has more operations in flight than there are
+  // entries, so there is always a free entry
+  auto next_sqe() -> io_uring_sqe* {
+    assert(local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) < sq_entries_);
+    const auto index = local_tail_ & sq_mask_;
+    auto* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++local_tail_;
+    return sqe;
+  }
+
+  int fd_{-1};
+  void* sq_ring_{nullptr};
+  void* cq_ring_{nullptr};
+  size_t sq_ring_size_{};
+  size_t cq_ring_size_{};
+  io_uring_sqe* sqes_{nullptr};
+  size_t sqes_size_{};
+
+  unsigned* sq_head_{};
+  unsigned* sq_tail_{};
+  unsigned* sq_array_{};
+  unsigned sq_mask_{};
+  unsigned sq_entries_{};
+  unsigned local_tail_{}; // Tail including prepared, unpublished entries
+
+  unsigned* cq_head_{};
+  unsigned* cq_tail_{};
+  unsigned cq_mask_{};
+  io_uring_cqe* cqes_{};
+};
+
+#endif // ASYNC_FILE_IO_URING_ENABLED
+
+} // namespace async_io_detail
+
+
+class AsyncFileReader {
+public:
+  // Maximum number of io_uring operations in flight
+  static constexpr unsigned kDefaultQueueDepth = 256;
+
+  explicit AsyncFileReader(IoBackend backend = IoBackend::Auto,
+                           unsigned queue_depth = kDefaultQueueDepth,
+                           size_t num_threads = default_num_threads())
+    : num_threads_{num_threads} {
+#if ASYNC_FILE_IO_URING_ENABLED
+    if (backend != IoBackend::ThreadPool) {
+      ring_ = async_io_detail::IoUring::create(std::max(queue_depth, 2u));
+      if (ring_ != nullptr) {
+        backend_ = IoBackend::IoUring;
+        io_thread_ = std::thread{[this] { run_io_uring(); }};
+        return;
+      }
+    }
+#else
+    (void)queue_depth;
+#endif
+    if (backend == IoBackend::IoUring) {
+      throw std::system_error(std::make_error_code(std::errc::function_not_supported),
+                              "io_uring is not available");
+    }
+    backend_ = IoBackend::ThreadPool;
+    pool_ = std::make_unique<ThreadPool>(num_threads);
+  }
+
+  AsyncFileReader(const AsyncFileReader&) = delete;
+  auto operator=(const AsyncFileReader&) -> AsyncFileReader& = delete;
+
+  // Waits for all reads which have been started to finish
+  ~AsyncFileReader() {
+    if (io_thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+      }
+      cv_.notify_one();
+      io_thread_.join();
+    }
+    pool_.reset();
+  }
+
+  // Reading small files from the page cache is bound by the system
+  // calls rather than the disk, so the fallback uses more threads
+  // than there are CPUs to hide the latency of the ones that block
+  static auto default_num_threads() -> size_t {
+    return std::max<size_t>(4, 2 * ThreadPool::default_num_threads());
+  }
+
+  static auto io_uring_available() -> bool {
+#if ASYNC_FILE_IO_URING_ENABLED
+    static const auto available = async_io_detail::IoUring::create(2) != nullptr;
+    return available;
+#else
+    return false;
+#endif
+  }
+
+  // The backend in use, never Auto. It changes from IoUring to
+  // ThreadPool if the ring fails.
+  auto backend() const noexcept { return backend_.load(); }
+
+  // Makes the io_uring_enter call which follows the next n ones fail
+  // with ec, to test the switch to the thread pool
+  auto fail_io_uring_after(unsigned n, std::error_code ec) -> void {
+    std::lock_guard<std::mutex> lock{mutex_};
+    enters_before_failure_ = static_cast<int>(n);
+    injected_error_ = ec;
+  }
+
+  auto read(std::string path, ReadCallback callback) -> void {
+    auto requests = std::vector<std::unique_ptr<Request>>{};
+    requests.push_back(make_request(std::move(path), std::move(callback)));
+    enqueue(std::move(requests));
+  }
+
+  auto read(std::string path) -> std::future<std::string> {
+    auto future = std::future<std::string>{};
+    auto requests = std::vector<std::unique_ptr<Request>>{};
+    requests.push_back(make_request(std::move(path), future));
+    enqueue(std::move(requests));
+    return future;
+  }
+
+  // Starts reading all files at once. With io_uring this lets the
+  // reads of up to queue depth files be submitted together.
+  auto read_all(const std::vector<std::string>& paths) -> std::vector<std::future<std::string>> {
+    auto futures = std::vector<std::future<std::string>>(paths.size());
+    auto requests = std::vector<std::unique_ptr<Request>>{};
+    requests.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+      requests.push_back(make_request(paths[i], futures[i]));
+    }
+    enqueue(std::move(requests));
+    return futures;
+  }
+
+private:
+  struct alignas(8) Request {
+    std::string path_{};
+    ReadCallback callback_{};
+    std::string data_{};
+#if ASYNC_FILE_IO_URING_ENABLED
+    struct statx statx_ {};
+#endif
+    int fd_{-1};
+    int error_{};
+    size_t offset_{};
+    unsigned ops_in_flight_{};
+  };
+
+  static auto make_request(std::string path, ReadCallback callback) -> std::unique_ptr<Request> {
+    auto request = std::make_unique<Request>();
+    request->path_ = std::move(path);
+    request->callback_ = std::move(callback);
+    return request;
+  }
+
+  // Creates a request which fulfills future
+  static auto make_request(std::string path, std::future<std::string>& future)
+    -> std::unique_ptr<Request> {
+    auto promise = std::make_shared<std::promise<std::string>>();
+    future = promise->get_future();
+    auto callback = [promise, what = "Failed to read " + path](std::error_code ec,
+                                                               std::string data) {
+      if (ec) {
+        promise->set_exception(std::make_exception_ptr(std::system_error{ec, what}));
+      } else {
+        promise->set_value(std::move(data));
+      }
+    };
+    return make_request(std::move(path), std::move(callback));
+  }
+
+  auto enqueue(std::vector<std::unique_ptr<Request>> requests) -> void {
+    {
+      // The io_uring thread may switch to the thread pool at any time
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (backend_ == IoBackend::ThreadPool) {
+        for (auto& request : requests) {
+          post(std::move(request));
+        }
+        return;
+      }
+      for (auto& request : requests) {
+        pending_.push_back(std::move(request));
+      }
+    }
+    cv_.notify_one();
+  }
+
+  // Reads the request on the thread pool, with mutex_ locked
+  auto post(std::unique_ptr<Request> request) -> void {
+    pool_->post([r = request.release()] {
+      auto owner = std::unique_ptr<Request>{r};
+      const auto ec = async_io_detail::read_file_blocking(r->path_, r->data_);
+      r->callback_(ec, std::move(r->data_));
+    });
+  }
+
+#if ASYNC_FILE_IO_URING_ENABLED
+  // The two lowest bits of the user data tells which operation of
+  // the request completed
+  enum Op : uint64_t { OpOpen = 0, OpStat = 1, OpRead = 2, OpMask = 3 };
+
+  // Reads larger than this are split, a single read is limited to
+  // what fits in 32 bits
+  static constexpr auto kMaxReadSize = size_t{1} << 30;
+
+  static auto tag(Request* r, Op op) -> uint64_t {
+    return reinterpret_cast<uintptr_t>(r) | op;
+  }
+  static auto request_of(uint64_t user_data) -> Request* {
+    return reinterpret_cast<Request*>(user_data & ~uint64_t{OpMask});
+  }
+
+  auto run_io_uring() -> void {
+    auto in_flight = 0u;
+    for (;;) {
+      auto injected_error = std::error_code{};
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        if (in_flight == 0) {
+          cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+          if (pending_.empty()) {
+            return; // Stopping and all reads have finished
+          }
+        }
+        // Each new request needs two entries, one for open and one
+        // for statx, which are independent of each other
+        while (!pending_.empty() && in_flight + 2 <= ring_->entries()) {
+          auto* r = pending_.front().release();
+          pending_.pop_front();
+          in_flight_requests_.insert(r);
+          r->ops_in_flight_ = 2;
+          ring_->prepare_openat(r->path_.c_str(), O_RDONLY | O_CLOEXEC, tag(r, OpOpen));
+          ring_->prepare_statx(r->path_.c_str(), STATX_TYPE | STATX_SIZE, &r->statx_,
+                               tag(r, OpStat));
+          in_flight += 2;
+        }
+        if (enters_before_failure_ >= 0 && enters_before_failure_-- == 0) {
+          injected_error = injected_error_;
+        }
+      }
+      const auto ec = injected_error ? injected_error : ring_->submit_and_wait(1);
+      if (ec == std::errc::resource_unavailable_try_again ||
+          ec == std::errc::device_or_resource_busy) {
+        // Make room in the completion queue and try again
+        const auto before = in_flight;
+        reap(in_flight);
+        if (in_flight == before) {
+          std::this_thread::yield();
+        }
+        continue;
+      }
+      if (ec) {
+        fall_back_to_thread_pool(ec, in_flight);
+        return;
+      }
+      reap(in_flight);
+    }
+  }
+
+  auto reap(unsigned& in_flight) -> void {
+    ring_->for_each_completion([this, &in_flight](uint64_t user_data, int result) {
+      auto* r = request_of(user_data);
+      const auto op = static_cast<Op>(user_data & OpMask);
+      --in_flight;
+      in_flight += on_completion(r, op, result);
+    });
+  }
+
+  // Fails the requests which the kernel has started with ec, and
+  // sends the others, and the reads that follow, to the thread pool
+  auto fall_back_to_thread_pool(std::error_code ec, unsigned in_flight) -> void {
+    // A request none of whose operations the kernel has taken is read
+    // again from the start by the thread pool
+    auto unsubmitted_ops = std::unordered_map<Request*, unsigned>{};
+    ring_->for_each_unsubmitted([&unsubmitted_ops](uint64_t user_data) {
+      ++unsubmitted_ops[request_of(user_data)];
+    });
+    auto retried = std::vector<std::unique_ptr<Request>>{};
+    for (const auto& [r, ops] : unsubmitted_ops) {
+      if (ops == r->ops_in_flight_) {
+        in_flight_requests_.erase(r);
+        if (r->fd_ >= 0) {
+          ::close(r->fd_);
+        }
+        r->data_.clear();
+        retried.emplace_back(r);
+      }
+    }
+
+    // The kernel may still write to the requests of the operations it
+    // has taken, so wait for them before the requests are freed. The
+    // entries it never took are dropped with the ring.
+    auto outstanding = in_flight - ring_->unsubmitted();
+    while (outstanding > 0) {
+      ring_->for_each_completion([&outstanding](uint64_t user_data, int result) {
+        auto* r = request_of(user_data);
+        if ((user_data & OpMask) == OpOpen && result >= 0) {
+          r->fd_ = result; // Closed by finish()
+        }
+        --outstanding;
+      });
+      if (outstanding > 0) {
+        std::this_thread::yield();
+      }
+    }
+    ring_.reset();
+
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      pool_ = std::make_unique<ThreadPool>(num_threads_);
+      backend_ = IoBackend::ThreadPool;
+      for (auto& r : retried) {
+        post(std::move(r));
+      }
+      for (auto& r : pending_) {
+        post(std::move(r));
+      }
+      pending_.clear();
+    }
+    auto started = std::unordered_set<Request*>{};
+    started.swap(in_flight_requests_);
+    for (auto* r : started) {
+      r->error_ = ec.value();
+      finish(r);
+    }
+  }
+
+  // Returns the number of new operations submitted for the request
+  auto on_completion(Request* r, Op op, int result) -> unsigned {
+    --r->ops_in_flight_;
+    if (op == OpRead) {
+      if (result == -EINTR || result == -EAGAIN) {
+        return submit_read(r);
+      }
+      if (result < 0) {
+        r->error_ = -result;
+      } else if (result == 0) {
+        r->data_.resize(r->offset_); // The file was truncated
+      } else {
+        r->offset_ += static_cast<size_t>(result);
+        if (r->offset_ < r->data_.size()) {
+          return submit_read(r);
+        }
+      }
+      finish(r);
+      return 0;
+    }
+
+    if (result < 0) {
+      r->error_ = -result;
+    } else if (op == OpOpen) {
+      r->fd_ = result;
+    }
+    if (r->ops_in_flight_ > 0) {
+      return 0; // Wait for both open and statx
+    }
+    if (r->error_ != 0) {
+      finish(r);
+      return 0;
+    }
+    if (!S_ISREG(r->statx_.stx_mode) || r->statx_.stx_size == 0) {
+      // Files in e.g. /proc report a size of zero. They are rare, so
+      // simply read them here.
+      const auto ec = async_io_detail::read_fd(r->fd_, 0, r->data_);
+      r->error_ = ec.value();
+      finish(r);
+      return 0;
+    }
+    r->data_.resize(static_cast<size_t>(r->statx_.stx_size));
+    return submit_read(r);
+  }
+
+  auto submit_read(Request* r) -> unsigned {
+    ++r->ops_in_flight_;
+    const auto length = std::min(r->data_.size() - r->offset_, kMaxReadSize);
+    ring_->prepare_read(r->fd_, &r->data_[r->offset_], static_cast<unsigned>(length),
+                        r->offset_, tag(r, OpRead));
+    return 1;
+  }
+
+  auto finish(Request* r) -> void {
+    auto owner = std::unique_ptr<Request>{r};
+    in_flight_requests_.erase(r);
+    if (r->fd_ >= 0) {
+      ::close(r->fd_);
+    }
+    if (r->error_ != 0) {
+      r->data_.clear();
+    }
+    r->callback_(std::error_code{r->error_, std::generic_category()}, std::move(r->data_));
+  }
+
+  std::unique_ptr<async_io_detail::IoUring> ring_{};
+  std::unordered_set<Request*> in_flight_requests_{}; // Only used by io_thread_
+#endif // ASYNC_FILE_IO_URING_ENABLED
+
+  size_t num_threads_{};
+  std::atomic<IoBackend> backend_{IoBackend::ThreadPool};
+  std::mutex mutex_{};
+  std::condition_variable cv_{};
+  std::deque<std::unique_ptr<Request>> pending_{};
+  int enters_before_failure_{-1};
+  std::error_code injected_error_{};
+  bool stopping_{false};
+  std::thread io_thread_{};
+  std::unique_ptr<ThreadPool> pool_{};
+};
+
+#endif
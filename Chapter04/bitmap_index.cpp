@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <gtest/gtest.h>
+#include "bitmap_index.hpp"
+#include "scooped_timer.hpp"
+
+//
+// This example demonstrates how a bitmap index can replace the
+// linear scans in parallel_arrays.cpp when the same questions
+// about a low-cardinality column are asked over and over again.
+//
+
+namespace {
+
+// The same question is asked many times, as a dashboard would do
+constexpr auto kNumQueries = 100;
+
+auto count_at_level_linear(short level, const std::vector<short>& levels) {
+  ScopedTimer t{"count level using linear scan of vector<short>"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += static_cast<size_t>(std::count(levels.begin(), levels.end(), level));
+  }
+  return n / kNumQueries;
+}
+
+auto count_at_level_indexed(short level, const BitmapIndex<short>& index) {
+  ScopedTimer t{"count level using BitmapIndex<short>"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += index.count(level);
+  }
+  return n / kNumQueries;
+}
+
+auto count_playing_at_level_linear(short level,
+                                   const std::vector<short>& levels,
+                                   const std::vector<bool>& playing) {
+  ScopedTimer t{"count playing at level using linear scan"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    for (size_t i = 0; i < levels.size(); ++i) {
+      if (levels[i] == level && playing[i]) {
+        ++n;
+      }
+    }
+  }
+  return n / kNumQueries;
+}
+
+auto count_playing_at_level_indexed(short level,
+                                    const BitmapIndex<short>& levels,
+                                    const BitmapIndex<bool>& playing) {
+  ScopedTimer t{"count playing at level using BitmapIndex"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += levels.bitmap(level).and_count(playing.bitmap(true));
+  }
+  return n / kNumQueries;
+}
+
+auto create_levels(size_t count) {
+  auto vec = std::vector<short>(count);
+  for (auto& level : vec) {
+    level = static_cast<short>(std::rand() % 100);
+  }
+  return vec;
+}
+
+auto create_playing_users(size_t count) {
+  auto vec = std::vector<bool>(count);
+  for (auto&& is_playing : vec) {
+    is_playing = static_cast<bool>(std::rand() % 2);
+  }
+  return vec;
+}
+
+} // namespace
+
+TEST(BitmapIndex, CountValues) {
+  auto levels = std::vector<short>{3, 5, 3, 7, 5, 3};
+  auto index = BitmapIndex<short>{levels};
+
+  ASSERT_EQ(6u, index.size());
+  ASSERT_EQ(3u, index.cardinality());
+  ASSERT_EQ(3u, index.count(3));
+  ASSERT_EQ(2u, index.count(5));
+  ASSERT_EQ(1u, index.count(7));
+  ASSERT_EQ(0u, index.count(42));
+}
+
+TEST(BitmapIndex, CombinePredicates) {
+  auto index = BitmapIndex<short>{{1, 2, 1, 2, 1, 3}};
+  auto playing = BitmapIndex<bool>{{true, true, false, false, true, true}};
+
+  // level == 1 && is_playing
+  ASSERT_EQ(2u, (index.bitmap(1) & playing.bitmap(true)).count());
+  // level == 1 || level == 3
+  ASSERT_EQ(4u, (index.bitmap(1) | index.bitmap(3)).count());
+  // !(level == 2)
+  ASSERT_EQ(4u, (~index.bitmap(2)).count());
+  // A value that is not present matches nothing, and its negation everything
+  ASSERT_EQ(0u, index.bitmap(99).count());
+  ASSERT_EQ(6u, (~index.bitmap(99)).count());
+}
+
+TEST(BitmapIndex, IncrementalUpdates) {
+  auto index = BitmapIndex<short>{};
+  for (auto level : {4, 4, 8}) {
+    index.push_back(static_cast<short>(level));
+  }
+  ASSERT_EQ(2u, index.count(4));
+
+  // A user levels up from 4 to 5
+  index.update(1, 5);
+  ASSERT_EQ(1u, index.count(4));
+  ASSERT_EQ(1u, index.count(5));
+  ASSERT_TRUE(index.bitmap(5).test(1));
+  ASSERT_FALSE(index.bitmap(4).test(1));
+
+  // Grow past a word boundary, which must keep the bitmaps comparable
+  for (auto i = 0; i < 100; ++i) {
+    index.push_back(8);
+  }
+  ASSERT_EQ(101u, index.count(8));
+  ASSERT_EQ(0u, (index.bitmap(8) & index.bitmap(4)).count());
+}
+
+TEST(BitmapIndex, CompareProcessingTime) {
+  auto num_objects = 1'000'000; // Increase if you want more objects
+
+  auto levels = create_levels(num_objects);
+  auto playing = create_playing_users(num_objects);
+  auto level_index = BitmapIndex<short>{levels};
+  auto playing_index = BitmapIndex<bool>{playing};
+
+  auto level = short{5};
+  auto n = size_t{0};
+
+  std::cout << '\n' << "+++ Count users at level +++" << '\n';
+  auto expected = count_at_level_linear(level, levels);
+  ASSERT_EQ(expected, count_at_level_indexed(level, level_index));
+  n += expected;
+
+  std::cout << '\n' << "+++ Count playing users at level +++" << '\n';
+  expected = count_playing_at_level_linear(level, levels, playing);
+  ASSERT_EQ(expected, count_playing_at_level_indexed(level, level_index, playing_index));
+  n += expected;
+
+  // Print n to prevent it from being optmized away...
+  std::cout << n << '\n';
+}
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef BITMAP_INDEX_HPP
+#define BITMAP_INDEX_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <map>
+#include <vector>
+#include "dynamic_bitset.hpp"
+
+//
+// A bitmap index stores one bitset per distinct value of a column.
+// Bit i in the bitset for value v is set if row i holds v.
+// Counting the rows matching a value is then a popcount of the
+// bitset, and combining predicates is a word-wise AND/OR/NOT.
+// This only pays off for low-cardinality columns, such as a
+// level ranging from 0 to 99 or a bool.
+//
+
+template <typename T>
+class BitmapIndex {
+public:
+  BitmapIndex() = default;
+  explicit BitmapIndex(const std::vector<T>& column)
+    : none_(column.size()), size_{column.size()} {
+    for (std::size_t row = 0; row < column.size(); ++row) {
+      bitmap_for(column[row]).set(row);
+    }
+  }
+
+  auto size() const noexcept { return size_; }
+
+  // Number of distinct values that has a bitmap
+  auto cardinality() const noexcept { return bitmaps_.size(); }
+
+  auto push_back(const T& value) {
+    ++size_;
+    none_.resize(size_);
+    for (auto& entry : bitmaps_) {
+      entry.second.resize(size_);
+    }
+    bitmap_for(value).set(size_ - 1);
+  }
+
+  // Moves row from its current value to new_value. Since the
+  // column is low-cardinality, finding the old bitmap by testing
+  // one bit per distinct value is cheap.
+  auto update(std::size_t row, const T& new_value) {
+    assert(row < size_);
+    for (auto& entry : bitmaps_) {
+      if (entry.second.test(row)) {
+        entry.second.reset(row);
+        break;
+      }
+    }
+    bitmap_for(new_value).set(row);
+  }
+
+  // Returns the bitmap of rows holding value
+  auto bitmap(const T& value) const -> const DynamicBitset& {
+    auto it = bitmaps_.find(value);
+    return it != bitmaps_.end() ? it->second : none_;
+  }
+
+  auto count(const T& value) const -> std::size_t {
+    auto it = bitmaps_.find(value);
+    return it != bitmaps_.end() ? it->second.count() : 0;
+  }
+
+private:
+  auto bitmap_for(const T& value) -> DynamicBitset& {
+    auto it = bitmaps_.find(value);
+    if (it == bitmaps_.end()) {
+      it = bitmaps_.emplace(value, DynamicBitset(size_)).first;
+    }
+    return it->second;
+  }
+
+  std::map<T, DynamicBitset> bitmaps_{};
+  DynamicBitset none_{}; // All zeros, returned for values not in the column
+  std::size_t size_{};
+};
+
+#endif
@@ -1,5 +1,7 @@
-#include <array>
+#include <algorithm>
+#include <vector>
 #include <gtest/gtest.h>
+#include "hardware_info.hpp"
 
 //
 // This example demonstrates cache thrashing.
@@ -8,38 +10,53 @@
 // performance.
 //
 
-// The L1 Data cache size, replace this number with the
-// L1 Data cache size on your machine
-constexpr auto kL1CacheCapacity = 32768;
-constexpr auto kSize = kL1CacheCapacity / sizeof(int);
-using MatrixType = std::array<std::array<int, kSize>, kSize>;
+// A square matrix stored in one contiguous block in row-major
+// order, matrix[i] returns a pointer to the i:th row.
+class MatrixType {
+public:
+  explicit MatrixType(size_t size) : size_{size}, data_(size * size) {}
+  auto operator[](size_t row) { return data_.data() + row * size_; }
+  auto size() const { return size_; }
+private:
+  size_t size_{};
+  std::vector<int> data_{};
+};
 
 auto cache_thrashing_fast(MatrixType& matrix) {
-  auto counter = 0;
-  for (auto i = 0; i < kSize; ++i) {
-    for (auto j = 0; j < kSize; ++j) {
-      matrix[i][j] = counter++;
+  auto counter = size_t{0}; // An int would overflow for large L1 caches
+  for (size_t i = 0; i < matrix.size(); ++i) {
+    for (size_t j = 0; j < matrix.size(); ++j) {
+      matrix[i][j] = static_cast<int>(counter++);
     }
   }
 }
 
 auto cache_thrashing_slow(MatrixType& matrix) {
-  auto counter = 0;
-  for (auto i = 0; i < kSize; ++i) {
-    for (auto j = 0; j < kSize; ++j) {
-      matrix[j][i] = counter++; // Slow due to cache thrashing
+  auto counter = size_t{0};
+  for (size_t i = 0; i < matrix.size(); ++i) {
+    for (size_t j = 0; j < matrix.size(); ++j) {
+      matrix[j][i] = static_cast<int>(counter++); // Slow due to cache thrashing
     }
   }
 }
 
-// Use static storage, since this matrix
-// might not fit on the stack.
-MatrixType m;
+// One row of the matrix fills the L1 data cache, which is detected
+// at runtime. Since the matrix grows with the square of it, sizes
+// above 256 KB, twice the largest L1 data caches around, are taken
+// to be misdetected and capped. The matrix is allocated at the first
+// use, rather than before main() by every run of the tests.
+auto matrix() -> MatrixType& {
+  static auto m = [] {
+    const auto l1_cache_size = std::min(hardware_info().data_cache_size(1), size_t{256 * 1024});
+    return MatrixType{l1_cache_size / sizeof(int)};
+  }();
+  return m;
+}
 
 TEST(CacheThrashing, Fast) {
-  cache_thrashing_fast(m);
+  cache_thrashing_fast(matrix());
 }
 
 TEST(CacheThrashing, Slow) {
-  cache_thrashing_slow(m);
+  cache_thrashing_slow(matrix());
 }
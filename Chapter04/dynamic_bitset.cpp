@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <bitset>
+#include <cstdlib>
+#include <vector>
+#include <gtest/gtest.h>
+#include "dynamic_bitset.hpp"
+#include "scooped_timer.hpp"
+
+//
+// This example compares counting and searching bits in a
+// std::vector<bool>, a std::bitset and a DynamicBitset which uses
+// word-level SIMD kernels selected at runtime.
+//
+
+namespace {
+
+// Number of bits used in the benchmark, increase if you want more bits.
+// Note that std::bitset needs the size at compile time.
+constexpr auto kNumBits = size_t{1'000'000};
+constexpr auto kNumQueries = 100;
+
+// Use static storage, since these might not fit on the stack
+std::bitset<kNumBits> std_bits_a;
+std::bitset<kNumBits> std_bits_b;
+
+auto create_random_bits(size_t count) {
+  auto vec = std::vector<bool>(count);
+  for (auto&& bit : vec) {
+    bit = static_cast<bool>(std::rand() % 2);
+  }
+  return vec;
+}
+
+auto to_dynamic_bitset(const std::vector<bool>& bits) {
+  auto result = DynamicBitset(bits.size());
+  for (size_t i = 0; i < bits.size(); ++i) {
+    if (bits[i]) {
+      result.set(i);
+    }
+  }
+  return result;
+}
+
+auto count_vector_bool(const std::vector<bool>& bits) {
+  ScopedTimer t{"count using vector<bool>"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += static_cast<size_t>(std::count(bits.begin(), bits.end(), true));
+  }
+  return n / kNumQueries;
+}
+
+auto count_std_bitset(const std::bitset<kNumBits>& bits) {
+  ScopedTimer t{"count using std::bitset"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += bits.count();
+  }
+  return n / kNumQueries;
+}
+
+auto count_dynamic_bitset(const DynamicBitset& bits) {
+  ScopedTimer t{"count using DynamicBitset"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += bits.count();
+  }
+  return n / kNumQueries;
+}
+
+auto and_count_vector_bool(const std::vector<bool>& a, const std::vector<bool>& b) {
+  ScopedTimer t{"and count using vector<bool>"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    for (size_t i = 0; i < a.size(); ++i) {
+      n += (a[i] && b[i]) ? 1 : 0;
+    }
+  }
+  return n / kNumQueries;
+}
+
+auto and_count_std_bitset(const std::bitset<kNumBits>& a, const std::bitset<kNumBits>& b) {
+  ScopedTimer t{"and count using std::bitset"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += (a & b).count();
+  }
+  return n / kNumQueries;
+}
+
+auto and_count_dynamic_bitset(const DynamicBitset& a, const DynamicBitset& b) {
+  ScopedTimer t{"and count using DynamicBitset"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += a.and_count(b);
+  }
+  return n / kNumQueries;
+}
+
+auto find_first_vector_bool(const std::vector<bool>& bits) {
+  ScopedTimer t{"find first using vector<bool>"};
+  auto pos = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    pos = static_cast<size_t>(std::find(bits.begin(), bits.end(), true) - bits.begin());
+  }
+  return pos;
+}
+
+auto find_first_dynamic_bitset(const DynamicBitset& bits) {
+  ScopedTimer t{"find first using DynamicBitset"};
+  auto pos = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    pos = bits.find_first();
+  }
+  return pos;
+}
+
+} // namespace
+
+TEST(DynamicBitset, SetAndResetRanges) {
+  auto bits = DynamicBitset(200);
+  bits.set(10, 150);
+  ASSERT_EQ(140u, bits.count());
+  ASSERT_FALSE(bits.test(9));
+  ASSERT_TRUE(bits.test(10));
+  ASSERT_TRUE(bits.test(149));
+  ASSERT_FALSE(bits.test(150));
+
+  bits.reset(64, 128);
+  ASSERT_EQ(140u - 64u, bits.count());
+
+  // Ranges within a single word
+  bits.reset(12, 18);
+  ASSERT_EQ(70u, bits.count());
+  ASSERT_TRUE(bits.test(11));
+  ASSERT_FALSE(bits.test(12));
+  ASSERT_FALSE(bits.test(17));
+  ASSERT_TRUE(bits.test(18));
+  bits.set(160, 163);
+  ASSERT_EQ(73u, bits.count());
+  ASSERT_FALSE(bits.test(159));
+  ASSERT_TRUE(bits.test(160));
+  ASSERT_TRUE(bits.test(162));
+  ASSERT_FALSE(bits.test(163));
+
+  bits.set();
+  ASSERT_EQ(200u, bits.count());
+  bits.reset();
+  ASSERT_TRUE(bits.none());
+}
+
+TEST(DynamicBitset, UnusedBitsAreZero) {
+  auto bits = DynamicBitset(70, true);
+  ASSERT_EQ(70u, bits.count());
+  ASSERT_EQ(0u, (~bits).count());
+  bits.resize(65);
+  ASSERT_EQ(65u, bits.count());
+  bits.resize(130);
+  ASSERT_EQ(65u, bits.count());
+}
+
+TEST(DynamicBitset, CountMatchesVectorBool) {
+  for (auto num_bits : {0, 1, 63, 64, 65, 255, 256, 257, 1000, 8191, 10000}) {
+    const auto a = create_random_bits(num_bits);
+    const auto b = create_random_bits(num_bits);
+    const auto bits_a = to_dynamic_bitset(a);
+    const auto bits_b = to_dynamic_bitset(b);
+
+    auto expected_and = size_t{0};
+    for (size_t i = 0; i < a.size(); ++i) {
+      expected_and += (a[i] && b[i]) ? 1 : 0;
+    }
+    ASSERT_EQ(static_cast<size_t>(std::count(a.begin(), a.end(), true)), bits_a.count());
+    ASSERT_EQ(expected_and, bits_a.and_count(bits_b));
+    ASSERT_EQ(expected_and, (bits_a & bits_b).count());
+  }
+}
+
+TEST(DynamicBitset, FindFirstAndNext) {
+  auto bits = DynamicBitset(1000);
+  ASSERT_EQ(DynamicBitset::npos, bits.find_first());
+
+  for (auto pos : {3, 64, 65, 511, 999}) {
+    bits.set(pos);
+  }
+  auto found = std::vector<size_t>{};
+  for (auto pos = bits.find_first(); pos != DynamicBitset::npos; pos = bits.find_next(pos)) {
+    found.push_back(pos);
+  }
+  ASSERT_EQ((std::vector<size_t>{3, 64, 65, 511, 999}), found);
+}
+
+#if CPU_DISPATCH_ENABLED
+TEST(DynamicBitset, KernelsAgreeWithGenericVersion) {
+  const auto& cpu = cpu_features();
+  for (size_t n = 0; n < 80; ++n) {
+    auto a = std::vector<std::uint64_t>(n);
+    auto b = std::vector<std::uint64_t>(n);
+    for (size_t i = 0; i < n; ++i) {
+      a[i] = (std::uint64_t(std::rand()) << 32) ^ std::uint64_t(std::rand());
+      b[i] = (std::uint64_t(std::rand()) << 32) ^ std::uint64_t(std::rand());
+    }
+    const auto count = simd::detail::popcount_generic(a.data(), n);
+    const auto and_count = simd::detail::and_popcount_generic(a.data(), b.data(), n);
+    if (cpu.popcnt_) {
+      ASSERT_EQ(count, simd::detail::popcount_popcnt(a.data(), n));
+      ASSERT_EQ(and_count, simd::detail::and_popcount_popcnt(a.data(), b.data(), n));
+    }
+    if (cpu.avx2_) {
+      ASSERT_EQ(count, simd::detail::popcount_avx2(a.data(), n));
+      ASSERT_EQ(and_count, simd::detail::and_popcount_avx2(a.data(), b.data(), n));
+    }
+    if (cpu.avx512_popcnt_) {
+      ASSERT_EQ(count, simd::detail::popcount_avx512(a.data(), n));
+      ASSERT_EQ(and_count, simd::detail::and_popcount_avx512(a.data(), b.data(), n));
+    }
+
+    // Only the last word is non-zero
+    std::fill(a.begin(), a.end(), 0);
+    if (n > 0) {
+      a.back() = 1;
+    }
+    const auto expected = n > 0 ? n - 1 : 0;
+    if (cpu.avx2_) {
+      ASSERT_EQ(expected, simd::detail::find_first_avx2(a.data(), n));
+    }
+    if (cpu.avx512_) {
+      ASSERT_EQ(expected, simd::detail::find_first_avx512(a.data(), n));
+    }
+  }
+}
+#endif
+
+TEST(DynamicBitset, CompareProcessingTime) {
+  const auto a = create_random_bits(kNumBits);
+  const auto b = create_random_bits(kNumBits);
+  const auto bits_a = to_dynamic_bitset(a);
+  const auto bits_b = to_dynamic_bitset(b);
+  for (size_t i = 0; i < kNumBits; ++i) {
+    std_bits_a[i] = a[i];
+    std_bits_b[i] = b[i];
+  }
+
+  std::cout << '\n' << "+++ Count set bits +++" << '\n';
+  const auto count = count_vector_bool(a);
+  ASSERT_EQ(count, count_std_bitset(std_bits_a));
+  ASSERT_EQ(count, count_dynamic_bitset(bits_a));
+
+  std::cout << '\n' << "+++ Count set bits in a & b +++" << '\n';
+  const auto and_count = and_count_vector_bool(a, b);
+  ASSERT_EQ(and_count, and_count_std_bitset(std_bits_a, std_bits_b));
+  ASSERT_EQ(and_count, and_count_dynamic_bitset(bits_a, bits_b));
+
+  std::cout << '\n' << "+++ Find the only set bit, located at the end +++" << '\n';
+  auto last_only = std::vector<bool>(kNumBits);
+  last_only.back() = true;
+  auto last_only_bits = DynamicBitset(kNumBits);
+  last_only_bits.set(kNumBits - 1);
+  ASSERT_EQ(kNumBits - 1, find_first_vector_bool(last_only));
+  ASSERT_EQ(kNumBits - 1, find_first_dynamic_bitset(last_only_bits));
+}
@@ -0,0 +1,456 @@
+#pragma once
+#ifndef DYNAMIC_BITSET_HPP
+#define DYNAMIC_BITSET_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "cpu_features.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//
+// A DynamicBitset stores its bits in 64-bit words, unlike
+// std::vector<bool> whose algorithms often walk the bits one at a
+// time through proxy references. The heavy lifting, counting bits
+// and searching for the first set bit, is done by the kernels in
+// namespace simd which operate on whole words and are selected at
+// runtime depending on the CPU.
+//
+
+inline auto popcount64(std::uint64_t word) noexcept -> std::size_t {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<std::size_t>(__builtin_popcountll(word));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  return static_cast<std::size_t>(__popcnt64(word));
+#else
+  word = word - ((word >> 1) & 0x5555555555555555ull);
+  word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+  word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return static_cast<std::size_t>((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Index of the lowest set bit, word must not be zero
+inline auto countr_zero64(std::uint64_t word) noexcept -> std::size_t {
+  assert(word != 0);
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<std::size_t>(__builtin_ctzll(word));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index = 0;
+  _BitScanForward64(&index, word);
+  return static_cast<std::size_t>(index);
+#else
+  auto n = std::size_t{0};
+  while ((word & 1u) == 0) {
+    word >>= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+namespace simd {
+namespace detail {
+
+using Word = std::uint64_t;
+
+inline auto popcount_generic(const Word* a, std::size_t n) -> std::size_t {
+  auto count = std::size_t{0};
+  for (std::size_t i = 0; i < n; ++i) {
+    count += popcount64(a[i]);
+  }
+  return count;
+}
+
+inline auto and_popcount_generic(const Word* a, const Word* b, std::size_t n) -> std::size_t {
+  auto count = std::size_t{0};
+  for (std::size_t i = 0; i < n; ++i) {
+    count += popcount64(a[i] & b[i]);
+  }
+  return count;
+}
+
+inline auto find_first_generic(const Word* a, std::size_t n) -> std::size_t {
+  for (std::size_t i = 0; i < n; ++i) {
+    if (a[i] != 0) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#if CPU_DISPATCH_ENABLED
+
+// Same loops as above, but compiled to use the popcnt instruction
+// instead of a bit twiddling sequence.
+TARGET_POPCNT inline auto popcount_popcnt(const Word* a, std::size_t n) -> std::size_t {
+  auto count = std::size_t{0};
+  for (std::size_t i = 0; i < n; ++i) {
+    count += static_cast<std::size_t>(_mm_popcnt_u64(a[i]));
+  }
+  return count;
+}
+
+TARGET_POPCNT inline auto and_popcount_popcnt(const Word* a, const Word* b,
+                                              std::size_t n) -> std::size_t {
+  auto count = std::size_t{0};
+  for (std::size_t i = 0; i < n; ++i) {
+    count += static_cast<std::size_t>(_mm_popcnt_u64(a[i] & b[i]));
+  }
+  return count;
+}
+
+// AVX2 has no popcount instruction. Instead each nibble is used as
+// an index into a 16 entry lookup table of bit counts (Mula's
+// algorithm). The per-byte counts are summed into 64-bit lanes
+// with a SAD against zero.
+TARGET_AVX2 inline auto popcount_bytes_avx2(__m256i v) -> __m256i {
+  const auto lookup = _mm256_setr_epi8(
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const auto low_mask = _mm256_set1_epi8(0x0f);
+  const auto lo = _mm256_and_si256(v, low_mask);
+  const auto hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+  return _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                         _mm256_shuffle_epi8(lookup, hi));
+}
+
+TARGET_AVX2 inline auto horizontal_sum_avx2(__m256i v) -> std::size_t {
+  return static_cast<std::size_t>(
+    _mm256_extract_epi64(v, 0) + _mm256_extract_epi64(v, 1) +
+    _mm256_extract_epi64(v, 2) + _mm256_extract_epi64(v, 3));
+}
+
+// A byte holds at most 8 bits per vector, so the byte counts of up
+// to 31 vectors can be accumulated before they are summed.
+constexpr auto kAvx2VectorsPerBlock = std::size_t{31};
+
+TARGET_AVX2 inline auto popcount_avx2(const Word* a, std::size_t n) -> std::size_t {
+  auto total = _mm256_setzero_si256();
+  auto i = std::size_t{0};
+  while (i + 4 <= n) {
+    auto bytes = _mm256_setzero_si256();
+    const auto block_end = std::min(n, i + 4 * kAvx2VectorsPerBlock);
+    for (; i + 4 <= block_end; i += 4) {
+      const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      bytes = _mm256_add_epi8(bytes, popcount_bytes_avx2(v));
+    }
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+  }
+  return horizontal_sum_avx2(total) + popcount_popcnt(a + i, n - i);
+}
+
+TARGET_AVX2 inline auto and_popcount_avx2(const Word* a, const Word* b,
+                                          std::size_t n) -> std::size_t {
+  auto total = _mm256_setzero_si256();
+  auto i = std::size_t{0};
+  while (i + 4 <= n) {
+    auto bytes = _mm256_setzero_si256();
+    const auto block_end = std::min(n, i + 4 * kAvx2VectorsPerBlock);
+    for (; i + 4 <= block_end; i += 4) {
+      const auto v = _mm256_and_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+      bytes = _mm256_add_epi8(bytes, popcount_bytes_avx2(v));
+    }
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+  }
+  return horizontal_sum_avx2(total) + and_popcount_popcnt(a + i, b + i, n - i);
+}
+
+TARGET_AVX2 inline auto find_first_avx2(const Word* a, std::size_t n) -> std::size_t {
+  auto i = std::size_t{0};
+  for (; i + 4 <= n; i += 4) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    if (!_mm256_testz_si256(v, v)) {
+      break;
+    }
+  }
+  return i + find_first_generic(a + i, n - i);
+}
+
+// Adds the eight lanes. _mm512_reduce_add_epi64 does the same, but
+// it and the unmasked extracts make GCC warn about an uninitialized
+// variable in its headers.
+TARGET_AVX512 inline auto horizontal_sum_avx512(__m512i v) -> std::size_t {
+  const auto lo = _mm512_maskz_extracti64x4_epi64(0xf, v, 0);
+  const auto hi = _mm512_maskz_extracti64x4_epi64(0xf, v, 1);
+  return horizontal_sum_avx2(_mm256_add_epi64(lo, hi));
+}
+
+// With VPOPCNTDQ, AVX-512 counts the bits of eight words in one
+// instruction. The tail is handled with a masked load.
+TARGET_AVX512_POPCNT inline auto popcount_avx512(const Word* a, std::size_t n) -> std::size_t {
+  auto total = _mm512_setzero_si512();
+  auto i = std::size_t{0};
+  for (; i + 8 <= n; i += 8) {
+    total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512(a + i)));
+  }
+  const auto tail = static_cast<__mmask8>((1u << (n - i)) - 1);
+  total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(tail, a + i)));
+  return horizontal_sum_avx512(total);
+}
+
+TARGET_AVX512_POPCNT inline auto and_popcount_avx512(const Word* a, const Word* b,
+                                                     std::size_t n) -> std::size_t {
+  auto total = _mm512_setzero_si512();
+  auto i = std::size_t{0};
+  for (; i + 8 <= n; i += 8) {
+    const auto v = _mm512_and_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+    total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+  }
+  const auto tail = static_cast<__mmask8>((1u << (n - i)) - 1);
+  const auto v = _mm512_and_si512(_mm512_maskz_loadu_epi64(tail, a + i),
+                                  _mm512_maskz_loadu_epi64(tail, b + i));
+  total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+  return horizontal_sum_avx512(total);
+}
+
+TARGET_AVX512 inline auto find_first_avx512(const Word* a, std::size_t n) -> std::size_t {
+  for (std::size_t i = 0; i < n; i += 8) {
+    const auto remaining = std::min<std::size_t>(n - i, 8);
+    const auto tail = static_cast<__mmask8>((1u << remaining) - 1);
+    const auto v = _mm512_maskz_loadu_epi64(tail, a + i);
+    const auto nonzero = _mm512_test_epi64_mask(v, v);
+    if (nonzero != 0) {
+      return i + countr_zero64(nonzero);
+    }
+  }
+  return n;
+}
+
+#endif // CPU_DISPATCH_ENABLED
+
+} // namespace detail
+
+// Number of set bits in the n words starting at a
+inline auto popcount(const std::uint64_t* a, std::size_t n) -> std::size_t {
+  using Fn = std::size_t (*)(const std::uint64_t*, std::size_t);
+  static const Fn fn = []() -> Fn {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_popcnt_) return detail::popcount_avx512;
+    if (cpu.avx2_) return detail::popcount_avx2;
+    if (cpu.popcnt_) return detail::popcount_popcnt;
+#endif
+    return detail::popcount_generic;
+  }();
+  return fn(a, n);
+}
+
+// Number of set bits in a & b without materializing the result
+inline auto and_popcount(const std::uint64_t* a, const std::uint64_t* b,
+                         std::size_t n) -> std::size_t {
+  using Fn = std::size_t (*)(const std::uint64_t*, const std::uint64_t*, std::size_t);
+  static const Fn fn = []() -> Fn {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_popcnt_) return detail::and_popcount_avx512;
+    if (cpu.avx2_) return detail::and_popcount_avx2;
+    if (cpu.popcnt_) return detail::and_popcount_popcnt;
+#endif
+    return detail::and_popcount_generic;
+  }();
+  return fn(a, b, n);
+}
+
+// Index of the first non-zero word, or n if all words are zero
+inline auto find_first_nonzero(const std::uint64_t* a, std::size_t n) -> std::size_t {
+  using Fn = std::size_t (*)(const std::uint64_t*, std::size_t);
+  static const Fn fn = []() -> Fn {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_) return detail::find_first_avx512;
+    if (cpu.avx2_) return detail::find_first_avx2;
+#endif
+    return detail::find_first_generic;
+  }();
+  return fn(a, n);
+}
+
+} // namespace simd
+
+
+// The bits past size() in the last word are always kept at zero so
+// that the kernels can operate on whole words.
+class DynamicBitset {
+public:
+  using Word = std::uint64_t;
+  static constexpr std::size_t kBitsPerWord = 64;
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  DynamicBitset() = default;
+  explicit DynamicBitset(std::size_t num_bits, bool value = false)
+    : words_(num_words(num_bits), value ? ~Word{0} : Word{0}), size_{num_bits} {
+    clear_unused_bits();
+  }
+
+  auto size() const noexcept { return size_; }
+  auto num_words() const noexcept { return words_.size(); }
+  auto data() const noexcept { return words_.data(); }
+
+  auto resize(std::size_t num_bits) {
+    words_.resize(num_words(num_bits));
+    size_ = num_bits;
+    clear_unused_bits();
+  }
+
+  auto test(std::size_t pos) const noexcept -> bool {
+    assert(pos < size_);
+    return (words_[pos / kBitsPerWord] >> (pos % kBitsPerWord)) & 1u;
+  }
+  auto set(std::size_t pos) noexcept {
+    assert(pos < size_);
+    words_[pos / kBitsPerWord] |= Word{1} << (pos % kBitsPerWord);
+  }
+  auto reset(std::size_t pos) noexcept {
+    assert(pos < size_);
+    words_[pos / kBitsPerWord] &= ~(Word{1} << (pos % kBitsPerWord));
+  }
+
+  // Sets or resets all bits in the range [first, last). Only the
+  // two boundary words are masked, the words in between are filled.
+  auto set(std::size_t first, std::size_t last) noexcept {
+    fill_range(first, last, ~Word{0});
+  }
+  auto reset(std::size_t first, std::size_t last) noexcept {
+    fill_range(first, last, Word{0});
+  }
+  auto set() noexcept { set(0, size_); }
+  auto reset() noexcept { reset(0, size_); }
+
+  auto count() const noexcept {
+    return simd::popcount(words_.data(), words_.size());
+  }
+
+  // Equivalent to (*this & other).count(), but without the temporary
+  auto and_count(const DynamicBitset& other) const noexcept {
+    assert(size_ == other.size_);
+    return simd::and_popcount(words_.data(), other.words_.data(), words_.size());
+  }
+
+  auto any() const noexcept { return find_first() != npos; }
+  auto none() const noexcept { return !any(); }
+
+  // Position of the first set bit, or npos if no bit is set
+  auto find_first() const noexcept -> std::size_t {
+    return find_from_word(0);
+  }
+
+  // Position of the first set bit after pos, or npos
+  auto find_next(std::size_t pos) const noexcept -> std::size_t {
+    ++pos;
+    if (pos >= size_) {
+      return npos;
+    }
+    const auto word_idx = pos / kBitsPerWord;
+    const auto word = words_[word_idx] & (~Word{0} << (pos % kBitsPerWord));
+    if (word != 0) {
+      return word_idx * kBitsPerWord + countr_zero64(word);
+    }
+    return find_from_word(word_idx + 1);
+  }
+
+  auto& operator&=(const DynamicBitset& other) noexcept {
+    assert(size_ == other.size_);
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+      words_[i] &= other.words_[i];
+    }
+    return *this;
+  }
+  auto& operator|=(const DynamicBitset& other) noexcept {
+    assert(size_ == other.size_);
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+      words_[i] |= other.words_[i];
+    }
+    return *this;
+  }
+  auto& operator^=(const DynamicBitset& other) noexcept {
+    assert(size_ == other.size_);
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+      words_[i] ^= other.words_[i];
+    }
+    return *this;
+  }
+  auto operator~() const {
+    auto result = *this;
+    for (auto& w : result.words_) {
+      w = ~w;
+    }
+    result.clear_unused_bits();
+    return result;
+  }
+
+  auto operator==(const DynamicBitset& other) const noexcept {
+    return size_ == other.size_ && words_ == other.words_;
+  }
+  auto operator!=(const DynamicBitset& other) const noexcept {
+    return !(*this == other);
+  }
+
+private:
+  static auto num_words(std::size_t num_bits) noexcept -> std::size_t {
+    return (num_bits + kBitsPerWord - 1) / kBitsPerWord;
+  }
+  auto clear_unused_bits() noexcept -> void {
+    const auto tail = size_ % kBitsPerWord;
+    if (tail != 0) {
+      words_.back() &= (Word{1} << tail) - 1;
+    }
+  }
+  auto find_from_word(std::size_t word_idx) const noexcept -> std::size_t {
+    if (word_idx >= words_.size()) {
+      return npos;
+    }
+    const auto n = words_.size() - word_idx;
+    const auto found = simd::find_first_nonzero(words_.data() + word_idx, n);
+    if (found == n) {
+      return npos;
+    }
+    const auto i = word_idx + found;
+    return i * kBitsPerWord + countr_zero64(words_[i]);
+  }
+  auto fill_range(std::size_t first, std::size_t last, Word value) noexcept -> void {
+    assert(first <= last && last <= size_);
+    if (first == last) {
+      return;
+    }
+    const auto first_word = first / kBitsPerWord;
+    const auto last_word = (last - 1) / kBitsPerWord;
+    const auto first_mask = ~Word{0} << (first % kBitsPerWord);
+    const auto last_mask = ~Word{0} >> (kBitsPerWord - 1 - (last - 1) % kBitsPerWord);
+    auto assign = [value](Word& w, Word mask) {
+      w = (w & ~mask) | (value & mask);
+    };
+    if (first_word == last_word) {
+      assign(words_[first_word], first_mask & last_mask);
+      return;
+    }
+    assign(words_[first_word], first_mask);
+    std::fill(words_.begin() + first_word + 1, words_.begin() + last_word, value);
+    assign(words_[last_word], last_mask);
+  }
+
+  std::vector<Word> words_{};
+  std::size_t size_{};
+};
+
+inline auto operator&(DynamicBitset lhs, const DynamicBitset& rhs) {
+  lhs &= rhs;
+  return lhs;
+}
+inline auto operator|(DynamicBitset lhs, const DynamicBitset& rhs) {
+  lhs |= rhs;
+  return lhs;
+}
+inline auto operator^(DynamicBitset lhs, const DynamicBitset& rhs) {
+  lhs ^= rhs;
+  return lhs;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#include <iostream>
+#include <gtest/gtest.h>
+#include "hardware_info.hpp"
+
+//
+// This example prints the cache and core topology detected at
+// runtime, and the tile, chunk and grain sizes derived from it.
+//
+
+TEST(HardwareInfo, ParseSysfsValues) {
+  namespace detail = hardware_info_detail;
+  ASSERT_EQ(48u * 1024, detail::parse_size("48K"));
+  ASSERT_EQ(32u * 1024 * 1024, detail::parse_size("32M"));
+  ASSERT_EQ(64u, detail::parse_size("64"));
+  ASSERT_EQ(0u, detail::parse_size("garbage"));
+
+  ASSERT_EQ(1u, detail::count_cpu_list("0"));
+  ASSERT_EQ(4u, detail::count_cpu_list("0-3"));
+  ASSERT_EQ(8u, detail::count_cpu_list("0-3,8-11"));
+  ASSERT_EQ(3u, detail::count_cpu_list("1,5,7"));
+}
+
+TEST(HardwareInfo, DetectTopology) {
+  const auto& hw = hardware_info();
+  std::cout << "Cache line size: " << hw.cache_line_size_ << " bytes" << '\n';
+  for (const auto& cache : hw.caches_) {
+    const auto type =
+      cache.type_ == CacheType::Data ? "Data" :
+      cache.type_ == CacheType::Instruction ? "Instruction" : "Unified";
+    std::cout << "L" << cache.level_ << " " << type << ": " << cache.size_ / 1024 << " KB"
+              << ", shared by " << cache.shared_by_cpus_ << " CPU(s)" << '\n';
+  }
+  std::cout << "Logical CPUs: " << hw.num_logical_cpus_ << '\n';
+  std::cout << "Physical cores: " << hw.num_physical_cores_ << '\n';
+  std::cout << "NUMA nodes: " << hw.num_numa_nodes_ << '\n';
+
+  // The sizes are either detected or defaulted, never missing
+  ASSERT_GT(hw.cache_line_size_, 0u);
+  ASSERT_GT(hw.data_cache_size(1), 0u);
+  ASSERT_GE(hw.data_cache_size(2), hw.data_cache_size(1));
+  ASSERT_GE(hw.last_level_cache_size(), hw.data_cache_size(2));
+  ASSERT_GE(hw.num_logical_cpus_, hw.num_physical_cores_);
+  ASSERT_GE(hw.threads_per_core(), 1u);
+}
+
+TEST(HardwareInfo, DerivedSizes) {
+  const auto& hw = hardware_info();
+  std::cout << "Chunk size for float: " << cache_chunk_size<float>() << '\n';
+  std::cout << "Grain size for 1M floats: " << parallel_grain_size<float>(1'000'000) << '\n';
+
+  ASSERT_LE(cache_chunk_size<float>() * sizeof(float), hw.data_cache_size(2));
+  ASSERT_GE(parallel_grain_size<float>(10), hw.data_cache_size(1) / sizeof(float));
+}
@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "line_reader.hpp"
+#include "scooped_timer.hpp"
+
+//
+// This example compares reading a text file line by line using
+// std::getline() with a LineReader, which hands out string_views
+// into a reusable buffer and scans for newlines with SIMD.
+//
+
+namespace {
+
+// Size of the file used by the benchmark. The memory used by the
+// LineReader does not depend on the file size, so this can be
+// increased to several GB.
+constexpr auto kFileSize = size_t{64} * 1024 * 1024;
+
+auto write_file(const std::string& path, const std::string& content) {
+  auto out = std::ofstream{path, std::ios::binary};
+  out.write(content.data(), content.size());
+}
+
+// Lines of varying length, some of them empty
+auto create_text_file(const std::string& path, size_t size) {
+  auto out = std::ofstream{path, std::ios::binary};
+  auto line = std::string{};
+  for (size_t written = 0; written < size; written += line.size()) {
+    line.assign(static_cast<size_t>(std::rand() % 160), 'x');
+    line += '\n';
+    out.write(line.data(), line.size());
+  }
+}
+
+auto read_lines(const std::string& path, size_t buffer_size) {
+  auto lines = std::vector<std::string>{};
+  auto reader = LineReader{path, buffer_size};
+  auto line = std::string_view{};
+  while (reader.next_line(line)) {
+    lines.emplace_back(line);
+  }
+  return lines;
+}
+
+struct Stats {
+  size_t num_lines_{};
+  size_t num_chars_{};
+};
+
+auto count_using_getline(const std::string& path) {
+  ScopedTimer t{"count lines using std::getline"};
+  auto stats = Stats{};
+  auto in = std::ifstream{path, std::ios::binary};
+  auto line = std::string{};
+  while (std::getline(in, line)) {
+    ++stats.num_lines_;
+    stats.num_chars_ += line.size();
+  }
+  return stats;
+}
+
+auto count_using_line_reader(const std::string& path) {
+  ScopedTimer t{"count lines using LineReader"};
+  auto stats = Stats{};
+  auto reader = LineReader{path};
+  auto line = std::string_view{};
+  while (reader.next_line(line)) {
+    ++stats.num_lines_;
+    stats.num_chars_ += line.size();
+  }
+  return stats;
+}
+
+} // namespace
+
+TEST(LineReader, SplitsLines) {
+  write_file("line_reader.txt", "first\n\nthird line\nno newline at end");
+  const auto expected = std::vector<std::string>{"first", "", "third line", "no newline at end"};
+  // A tiny buffer forces refills in the middle of lines, and
+  // growing the buffer for lines longer than it
+  for (auto buffer_size : {size_t{1}, size_t{4}, size_t{7}, LineReader::kDefaultBufferSize}) {
+    ASSERT_EQ(expected, read_lines("line_reader.txt", buffer_size));
+  }
+  std::remove("line_reader.txt");
+}
+
+TEST(LineReader, EmptyFileAndTrailingNewline) {
+  write_file("line_reader.txt", "");
+  ASSERT_TRUE(read_lines("line_reader.txt", 16).empty());
+  write_file("line_reader.txt", "\n");
+  ASSERT_EQ(std::vector<std::string>{""}, read_lines("line_reader.txt", 16));
+  write_file("line_reader.txt", "a\nb\n");
+  ASSERT_EQ((std::vector<std::string>{"a", "b"}), read_lines("line_reader.txt", 16));
+  std::remove("line_reader.txt");
+}
+
+TEST(LineReader, MissingFileThrows) {
+  ASSERT_THROW(LineReader{"this_file_does_not_exist.txt"}, std::system_error);
+}
+
+TEST(LineReader, FindByteKernels) {
+  auto text = std::string(300, 'a');
+  for (size_t pos = 0; pos < text.size(); ++pos) {
+    text[pos] = '\n';
+    const auto* first = text.data();
+    const auto* last = text.data() + text.size();
+    ASSERT_EQ(first + pos, simd::find_byte(first, last, '\n'));
+#if CPU_DISPATCH_ENABLED
+    if (cpu_features().avx2_) {
+      ASSERT_EQ(first + pos, simd::detail::find_byte_avx2(first, last, '\n'));
+    }
+    if (cpu_features().avx512_) {
+      ASSERT_EQ(first + pos, simd::detail::find_byte_avx512(first, last, '\n'));
+      // Searching a range ending before the newline must not find it
+      ASSERT_EQ(first + pos, simd::detail::find_byte_avx512(first, first + pos, '\n'));
+    }
+#endif
+    text[pos] = 'a';
+  }
+}
+
+TEST(LineReader, CompareProcessingTime) {
+  const auto path = std::string{"line_reader_benchmark.txt"};
+  create_text_file(path, kFileSize);
+
+  const auto expected = count_using_getline(path);
+  const auto stats = count_using_line_reader(path);
+  ASSERT_EQ(expected.num_lines_, stats.num_lines_);
+  ASSERT_EQ(expected.num_chars_, stats.num_chars_);
+  std::cout << stats.num_lines_ << " lines" << '\n';
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,172 @@
+#pragma once
+#ifndef LINE_READER_HPP
+#define LINE_READER_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include "cpu_features.hpp"
+#include "dynamic_bitset.hpp"
+
+//
+// A LineReader streams a text file line by line using a fixed size
+// buffer, so that files much larger than the available memory can be
+// processed. Unlike std::getline(), no std::string is created for
+// each line. Instead the lines are handed out as string_views
+// pointing into the buffer.
+//
+// The search for the end of each line is done with SIMD, comparing
+// 32 or 64 bytes at a time against '\n'.
+//
+
+namespace simd {
+namespace detail {
+
+inline auto find_byte_generic(const char* first, const char* last, char c) -> const char* {
+  const auto* p = static_cast<const char*>(std::memchr(first, c, static_cast<size_t>(last - first)));
+  return p != nullptr ? p : last;
+}
+
+#if CPU_DISPATCH_ENABLED
+
+TARGET_AVX2 inline auto find_byte_avx2(const char* first, const char* last, char c) -> const char* {
+  const auto needle = _mm256_set1_epi8(c);
+  auto p = first;
+  for (; last - p >= 32; p += 32) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+    if (mask != 0) {
+      return p + countr_zero64(mask);
+    }
+  }
+  return find_byte_generic(p, last, c);
+}
+
+TARGET_AVX512 inline auto find_byte_avx512(const char* first, const char* last,
+                                           char c) -> const char* {
+  const auto needle = _mm512_set1_epi8(c);
+  for (auto p = first; p < last; p += 64) {
+    // The tail is read with a masked load, which never touches
+    // the bytes past last
+    const auto remaining = static_cast<size_t>(last - p);
+    const auto valid = remaining >= 64 ? ~__mmask64{0} : (__mmask64{1} << remaining) - 1;
+    const auto v = _mm512_maskz_loadu_epi8(valid, p);
+    const auto mask = _mm512_mask_cmpeq_epi8_mask(valid, v, needle);
+    if (mask != 0) {
+      return p + countr_zero64(mask);
+    }
+  }
+  return last;
+}
+
+#endif // CPU_DISPATCH_ENABLED
+
+} // namespace detail
+
+// Returns a pointer to the first c in [first, last), or last
+inline auto find_byte(const char* first, const char* last, char c) -> const char* {
+  using Fn = const char* (*)(const char*, const char*, char);
+  static const Fn fn = []() -> Fn {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_) return detail::find_byte_avx512;
+    if (cpu.avx2_) return detail::find_byte_avx2;
+#endif
+    return detail::find_byte_generic;
+  }();
+  return fn(first, last, c);
+}
+
+} // namespace simd
+
+
+class LineReader {
+public:
+  static constexpr size_t kDefaultBufferSize = 1024 * 1024;
+
+  explicit LineReader(const std::string& path, size_t buffer_size = kDefaultBufferSize)
+    : file_{std::fopen(path.c_str(), "rb")}, buffer_(std::max<size_t>(buffer_size, 1)) {
+    if (file_ == nullptr) {
+      throw std::system_error(errno, std::generic_category(), "Failed to open " + path);
+    }
+    // Our buffer replaces the one in FILE, avoiding a copy
+    std::setvbuf(file_.get(), nullptr, _IONBF, 0);
+  }
+
+  LineReader(const LineReader&) = delete;
+  auto operator=(const LineReader&) -> LineReader& = delete;
+
+  // Reads the next line, without the '\n', into line. The line is
+  // only valid until the next call to next_line(). Returns false
+  // when there are no more lines.
+  auto next_line(std::string_view& line) -> bool {
+    for (;;) {
+      const auto* first = buffer_.data() + begin_;
+      const auto* last = buffer_.data() + end_;
+      const auto* newline = simd::find_byte(first + scanned_, last, '\n');
+      if (newline != last) {
+        line = std::string_view{first, static_cast<size_t>(newline - first)};
+        begin_ += line.size() + 1;
+        scanned_ = 0;
+        return true;
+      }
+      scanned_ = end_ - begin_;
+      if (eof_) {
+        // The last line may not end with a newline
+        if (begin_ == end_) {
+          return false;
+        }
+        line = std::string_view{first, end_ - begin_};
+        begin_ = end_;
+        scanned_ = 0;
+        return true;
+      }
+      refill();
+    }
+  }
+
+  // The size of the buffer only grows if a line doesn't fit in it
+  auto buffer_size() const noexcept { return buffer_.size(); }
+
+private:
+  // Moves the incomplete line to the front of the buffer and fills
+  // the rest of it from the file
+  auto refill() -> void {
+    if (begin_ > 0) {
+      std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (end_ == buffer_.size()) {
+      buffer_.resize(buffer_.size() * 2);
+    }
+    const auto n = std::fread(buffer_.data() + end_, 1, buffer_.size() - end_, file_.get());
+    if (n == 0) {
+      if (std::ferror(file_.get())) {
+        throw std::system_error(errno, std::generic_category(), "Failed to read file");
+      }
+      eof_ = true;
+    }
+    end_ += n;
+  }
+
+  struct FileCloser {
+    auto operator()(std::FILE* file) const noexcept { std::fclose(file); }
+  };
+  // Closed if allocating the buffer throws
+  std::unique_ptr<std::FILE, FileCloser> file_{};
+  std::vector<char> buffer_{};
+  size_t begin_{};   // Start of the unconsumed data in buffer_
+  size_t end_{};     // End of the valid data in buffer_
+  size_t scanned_{}; // Bytes after begin_ known not to contain '\n'
+  bool eof_{};
+};
+
+#endif
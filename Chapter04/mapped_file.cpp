@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <gtest/gtest.h>
+#include "mapped_file.hpp"
+#include "scooped_timer.hpp"
+
+//
+// This example compares reading a file into a std::string, as in
+// read_file_into_string.cpp, with accessing it through a MappedFile.
+// Both versions count the newlines to make sure that every byte of
+// the file is actually touched.
+//
+
+namespace {
+
+// The largest file used by the benchmark. Increase it if you want
+// to measure with larger files, e.g. 10 GB, and have the disk space.
+constexpr auto kMaxFileSize = size_t{64} * 1024 * 1024;
+
+auto create_file(const std::string& path, size_t size) {
+  auto out = std::ofstream{path, std::ios::binary};
+  auto line = std::string(79, 'x') + '\n';
+  for (size_t written = 0; written < size; written += line.size()) {
+    out.write(line.data(), std::min(line.size(), size - written));
+  }
+}
+
+auto count_lines_ifstream(const std::string& path) {
+  ScopedTimer t{"count lines using ifstream and std::string"};
+  auto in = std::ifstream{path, std::ios::binary | std::ios::ate};
+  const auto size = static_cast<size_t>(in.tellg());
+  auto content = std::string(size, '\0');
+  in.seekg(0);
+  in.read(&content[0], size);
+  return std::count(content.begin(), content.end(), '\n');
+}
+
+auto count_lines_mapped(const std::string& path) {
+  ScopedTimer t{"count lines using MappedFile"};
+  const auto file = MappedFile{path, AccessHint::Sequential};
+  return std::count(file.begin(), file.end(), '\n');
+}
+
+} // namespace
+
+TEST(MappedFile, ReadRegularFile) {
+  create_file("mapped_file.txt", 1000);
+  {
+    auto file = MappedFile{"mapped_file.txt"};
+    ASSERT_TRUE(file.is_mapped());
+    ASSERT_EQ(1000u, file.size());
+    ASSERT_EQ(12, std::count(file.begin(), file.end(), '\n'));
+    ASSERT_EQ('x', file.view().front());
+
+    // Hints for parts of the file are allowed as well
+    file.advise(AccessHint::WillNeed, 500, 100);
+    file.advise(AccessHint::Random, 999);
+
+    auto moved = MappedFile{std::move(file)};
+    ASSERT_EQ(1000u, moved.size());
+    ASSERT_TRUE(file.empty());
+  }
+  std::remove("mapped_file.txt");
+}
+
+TEST(MappedFile, EmptyFile) {
+  create_file("mapped_file_empty.txt", 0);
+  {
+    const auto file = MappedFile{"mapped_file_empty.txt"};
+    ASSERT_TRUE(file.empty());
+    ASSERT_EQ(std::string_view{}, file.view());
+  }
+  std::remove("mapped_file_empty.txt");
+}
+
+TEST(MappedFile, MissingFileThrows) {
+  ASSERT_THROW(MappedFile{"this_file_does_not_exist.txt"}, std::system_error);
+}
+
+#if defined(__linux__)
+TEST(MappedFile, NonRegularFileIsBuffered) {
+  // Files in /proc report a size of zero and can't be mapped
+  const auto file = MappedFile{"/proc/self/status"};
+  ASSERT_FALSE(file.is_mapped());
+  ASSERT_NE(std::string_view::npos, file.view().find("Name:"));
+}
+#endif
+
+TEST(MappedFile, CompareProcessingTime) {
+  for (auto size = size_t{1024 * 1024}; size <= kMaxFileSize; size *= 8) {
+    std::cout << '\n' << "+++ " << size / (1024 * 1024) << " MB file +++" << '\n';
+    const auto path = std::string{"mapped_file_benchmark.txt"};
+    create_file(path, size);
+    const auto expected = count_lines_ifstream(path);
+    ASSERT_EQ(expected, count_lines_mapped(path));
+    std::remove(path.c_str());
+  }
+}
@@ -0,0 +1,196 @@
+#pragma once
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+  #define MAPPED_FILE_MMAP_ENABLED 1
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#else
+  #define MAPPED_FILE_MMAP_ENABLED 0
+#endif
+
+//
+// A MappedFile gives read-only access to the content of a file
+// without copying it. The file is mapped into memory with mmap(),
+// and the pages are read from disk lazily the first time they are
+// touched. Compared to reading the file into a std::string this
+// avoids both zero-initializing the string and copying the content.
+//
+// Files which can't be mapped, such as pipes, character devices and
+// files in /proc reporting a size of zero, are read into an internal
+// buffer instead. The same is done on platforms without mmap().
+//
+
+enum class AccessHint {
+  Normal,
+  Sequential, // Aggressive read-ahead, pages can be dropped after use
+  Random,     // No read-ahead
+  WillNeed    // Start reading the pages in the background right away
+};
+
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path, AccessHint hint = AccessHint::Normal) {
+#if MAPPED_FILE_MMAP_ENABLED
+    const auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw std::system_error(errno, std::generic_category(), "Failed to open " + path);
+    }
+    try {
+      open_fd(fd, hint);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+#else
+    (void)hint;
+    read_with_stream(path);
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+  MappedFile(MappedFile&& other) noexcept { swap(other); }
+  auto operator=(MappedFile&& other) noexcept -> MappedFile& {
+    if (this != &other) {
+      unmap();
+      swap(other);
+    }
+    return *this;
+  }
+
+  ~MappedFile() { unmap(); }
+
+  auto data() const noexcept -> const char* {
+    return mapping_ != nullptr ? mapping_ : buffer_.data();
+  }
+  auto size() const noexcept { return size_; }
+  auto empty() const noexcept { return size_ == 0; }
+  auto begin() const noexcept { return data(); }
+  auto end() const noexcept { return data() + size_; }
+  auto view() const noexcept { return std::string_view{data(), size_}; }
+
+  // True if the file is mapped, false if it was read into a buffer
+  auto is_mapped() const noexcept { return mapping_ != nullptr; }
+
+  // Gives the kernel a hint about how the given part of the file is
+  // going to be accessed. Does nothing for buffered files.
+  auto advise(AccessHint hint, size_t offset = 0, size_t length = std::string_view::npos) const {
+#if MAPPED_FILE_MMAP_ENABLED
+    if (!is_mapped() || offset >= size_) {
+      return;
+    }
+    // madvise() requires a page aligned address
+    const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    const auto aligned_offset = offset / page_size * page_size;
+    length = std::min(length, size_ - offset) + (offset - aligned_offset);
+    ::madvise(const_cast<char*>(mapping_) + aligned_offset, length, to_advice(hint));
+#else
+    (void)hint;
+    (void)offset;
+    (void)length;
+#endif
+  }
+
+private:
+#if MAPPED_FILE_MMAP_ENABLED
+  static auto to_advice(AccessHint hint) noexcept -> int {
+    switch (hint) {
+      case AccessHint::Sequential: return MADV_SEQUENTIAL;
+      case AccessHint::Random: return MADV_RANDOM;
+      case AccessHint::WillNeed: return MADV_WILLNEED;
+      case AccessHint::Normal:
+      default: return MADV_NORMAL;
+    }
+  }
+
+  auto open_fd(int fd, AccessHint hint) -> void {
+    struct stat st {};
+    if (::fstat(fd, &st) == -1) {
+      throw std::system_error(errno, std::generic_category(), "Failed to stat file");
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+      read_with_fd(fd);
+      return;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    // No MAP_POPULATE, the pages are faulted in as they are accessed
+    auto* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      size_ = 0;
+      throw std::system_error(errno, std::generic_category(), "Failed to map file");
+    }
+    mapping_ = static_cast<const char*>(p);
+    advise(hint);
+  }
+
+  auto read_with_fd(int fd) -> void {
+    constexpr auto kChunkSize = size_t{64 * 1024};
+    for (;;) {
+      const auto old_size = buffer_.size();
+      buffer_.resize(old_size + kChunkSize);
+      const auto n = ::read(fd, &buffer_[old_size], kChunkSize);
+      if (n < 0 && errno == EINTR) {
+        buffer_.resize(old_size);
+        continue;
+      }
+      if (n < 0) {
+        throw std::system_error(errno, std::generic_category(), "Failed to read file");
+      }
+      buffer_.resize(old_size + static_cast<size_t>(n));
+      if (n == 0) {
+        break;
+      }
+    }
+    size_ = buffer_.size();
+  }
+#else
+  auto read_with_stream(const std::string& path) -> void {
+    auto in = std::ifstream{path, std::ios::binary};
+    if (!in) {
+      throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory),
+                              "Failed to open " + path);
+    }
+    buffer_.assign(std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{});
+    size_ = buffer_.size();
+  }
+#endif
+
+  auto unmap() noexcept -> void {
+#if MAPPED_FILE_MMAP_ENABLED
+    if (mapping_ != nullptr) {
+      ::munmap(const_cast<char*>(mapping_), size_);
+    }
+#endif
+    mapping_ = nullptr;
+    size_ = 0;
+    buffer_.clear();
+  }
+
+  auto swap(MappedFile& other) noexcept -> void {
+    std::swap(mapping_, other.mapping_);
+    std::swap(size_, other.size_);
+    std::swap(buffer_, other.buffer_);
+  }
+
+  const char* mapping_{nullptr};
+  size_t size_{};
+  std::string buffer_{}; // Only used if the file isn't mapped
+};
+
+#endif
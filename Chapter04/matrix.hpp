@@ -0,0 +1,173 @@
+#pragma once
+#ifndef MATRIX_HPP
+#define MATRIX_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "hardware_info.hpp"
+
+//
+// A dense row-major matrix and a few ways of transposing it.
+// Transposing reads one matrix row by row while writing the other
+// column by column, which is the access pattern from
+// cache_thrashing.cpp. The blocked and the cache-oblivious versions
+// both make sure that the part of the matrix being written stays in
+// the cache until all of it has been written.
+//
+
+template <typename T>
+class Matrix {
+public:
+  Matrix() = default;
+  Matrix(size_t rows, size_t cols) : rows_{rows}, cols_{cols}, data_(rows * cols) {}
+
+  auto rows() const noexcept { return rows_; }
+  auto cols() const noexcept { return cols_; }
+  auto data() noexcept { return data_.data(); }
+  auto data() const noexcept { return data_.data(); }
+
+  auto& operator()(size_t row, size_t col) noexcept {
+    assert(row < rows_ && col < cols_);
+    return data_[row * cols_ + col];
+  }
+  const auto& operator()(size_t row, size_t col) const noexcept {
+    assert(row < rows_ && col < cols_);
+    return data_[row * cols_ + col];
+  }
+
+  // matrix[i][j] works as for a nested array
+  auto operator[](size_t row) noexcept { return data_.data() + row * cols_; }
+  auto operator[](size_t row) const noexcept { return data_.data() + row * cols_; }
+
+  auto operator==(const Matrix& other) const {
+    return rows_ == other.rows_ && cols_ == other.cols_ && data_ == other.data_;
+  }
+
+private:
+  size_t rows_{};
+  size_t cols_{};
+  std::vector<T> data_{};
+};
+
+// The same access pattern as cache_thrashing_slow(), every write to
+// dst is a full row apart
+template <typename T>
+auto transpose_naive(const Matrix<T>& src, Matrix<T>& dst) {
+  assert(src.rows() == dst.cols() && src.cols() == dst.rows());
+  for (size_t i = 0; i < src.rows(); ++i) {
+    for (size_t j = 0; j < src.cols(); ++j) {
+      dst(j, i) = src(i, j);
+    }
+  }
+}
+
+namespace matrix_detail {
+
+template <typename T>
+auto transpose_tile(const Matrix<T>& src, Matrix<T>& dst,
+                    size_t row_begin, size_t row_end,
+                    size_t col_begin, size_t col_end) {
+  for (size_t i = row_begin; i < row_end; ++i) {
+    for (size_t j = col_begin; j < col_end; ++j) {
+      dst(j, i) = src(i, j);
+    }
+  }
+}
+
+} // namespace matrix_detail
+
+// The default tile side for transposes is one cache line of
+// elements, so every destination line is completely written while
+// it is in the cache. It depends on the detected line size, but not
+// on the cache size: larger tiles, even if two of them fit in L1,
+// are slower for large matrices. The rows of a tile are a full
+// matrix row apart, and compete for the same few sets of the cache.
+template <typename T>
+auto transpose_tile_size() -> size_t {
+  return std::max<size_t>(1, hardware_info().cache_line_size_ / sizeof(T));
+}
+
+// Transposes one tile at a time
+template <typename T>
+auto transpose_blocked(const Matrix<T>& src, Matrix<T>& dst,
+                       size_t tile = transpose_tile_size<T>()) {
+  assert(src.rows() == dst.cols() && src.cols() == dst.rows());
+  assert(tile > 0);
+  for (size_t i = 0; i < src.rows(); i += tile) {
+    const auto row_end = std::min(i + tile, src.rows());
+    for (size_t j = 0; j < src.cols(); j += tile) {
+      const auto col_end = std::min(j + tile, src.cols());
+      matrix_detail::transpose_tile(src, dst, i, row_end, j, col_end);
+    }
+  }
+}
+
+namespace matrix_detail {
+
+// Sub-matrices at or below this number of elements are transposed
+// directly. It is small enough to fit in any L1 cache.
+constexpr auto kRecursionCutoff = size_t{256};
+
+template <typename T>
+auto transpose_recursive(const Matrix<T>& src, Matrix<T>& dst,
+                         size_t row_begin, size_t row_end,
+                         size_t col_begin, size_t col_end) -> void {
+  const auto num_rows = row_end - row_begin;
+  const auto num_cols = col_end - col_begin;
+  if (num_rows * num_cols <= kRecursionCutoff) {
+    transpose_tile(src, dst, row_begin, row_end, col_begin, col_end);
+  } else if (num_rows >= num_cols) {
+    const auto mid = row_begin + num_rows / 2;
+    transpose_recursive(src, dst, row_begin, mid, col_begin, col_end);
+    transpose_recursive(src, dst, mid, row_end, col_begin, col_end);
+  } else {
+    const auto mid = col_begin + num_cols / 2;
+    transpose_recursive(src, dst, row_begin, row_end, col_begin, mid);
+    transpose_recursive(src, dst, row_begin, row_end, mid, col_end);
+  }
+}
+
+} // namespace matrix_detail
+
+// Cache-oblivious transpose which always splits the longest side in
+// half. At some depth the sub-matrices fit in each level of the
+// cache, without the cache sizes being known.
+template <typename T>
+auto transpose_recursive(const Matrix<T>& src, Matrix<T>& dst) {
+  assert(src.rows() == dst.cols() && src.cols() == dst.rows());
+  matrix_detail::transpose_recursive(src, dst, 0, src.rows(), 0, src.cols());
+}
+
+// Transposes a square matrix without a second matrix. The tiles on
+// the diagonal are transposed in place, and each tile above the
+// diagonal is swapped with its mirrored tile below it.
+template <typename T>
+auto transpose_in_place(Matrix<T>& m, size_t tile = transpose_tile_size<T>()) {
+  assert(m.rows() == m.cols());
+  assert(tile > 0);
+  using std::swap;
+  const auto n = m.rows();
+  for (size_t i = 0; i < n; i += tile) {
+    const auto row_end = std::min(i + tile, n);
+    // Diagonal tile
+    for (size_t r = i; r < row_end; ++r) {
+      for (size_t c = r + 1; c < row_end; ++c) {
+        swap(m(r, c), m(c, r));
+      }
+    }
+    // Off-diagonal tiles
+    for (size_t j = i + tile; j < n; j += tile) {
+      const auto col_end = std::min(j + tile, n);
+      for (size_t r = i; r < row_end; ++r) {
+        for (size_t c = j; c < col_end; ++c) {
+          swap(m(r, c), m(c, r));
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "hardware_info.hpp"
+#include "matrix.hpp"
+#include "scooped_timer.hpp"
+
+//
+// This example compares the naive transpose, which has the same
+// access pattern as cache_thrashing_slow(), with a blocked and a
+// cache-oblivious transpose for matrices ranging from fitting in
+// the L1 cache to being larger than the last level cache.
+//
+
+namespace {
+
+// Matrices larger than this are skipped by the benchmark to keep
+// the running time and memory usage reasonable. Increase it if you
+// want to go further beyond the size of the last level cache.
+constexpr auto kMaxMatrixBytes = size_t{256} * 1024 * 1024;
+
+auto create_matrix(size_t rows, size_t cols) {
+  auto m = Matrix<int>{rows, cols};
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t j = 0; j < cols; ++j) {
+      m(i, j) = static_cast<int>(i * cols + j);
+    }
+  }
+  return m;
+}
+
+auto is_transpose(const Matrix<int>& src, const Matrix<int>& dst) {
+  for (size_t i = 0; i < src.rows(); ++i) {
+    for (size_t j = 0; j < src.cols(); ++j) {
+      if (dst(j, i) != src(i, j)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Side of a square int matrix occupying about bytes
+auto side_for_bytes(size_t bytes) {
+  return static_cast<size_t>(std::sqrt(static_cast<double>(bytes / sizeof(int))));
+}
+
+} // namespace
+
+TEST(MatrixTranspose, AllVersionsAgree) {
+  for (auto dims : {std::make_pair(1, 1), std::make_pair(3, 7), std::make_pair(64, 64),
+                    std::make_pair(100, 37), std::make_pair(129, 250)}) {
+    const auto src = create_matrix(dims.first, dims.second);
+    auto expected = Matrix<int>{src.cols(), src.rows()};
+    transpose_naive(src, expected);
+    ASSERT_TRUE(is_transpose(src, expected));
+
+    for (auto tile : {size_t{1}, size_t{8}, size_t{64}, transpose_tile_size<int>()}) {
+      auto dst = Matrix<int>{src.cols(), src.rows()};
+      transpose_blocked(src, dst, tile);
+      ASSERT_EQ(expected, dst);
+    }
+
+    auto dst = Matrix<int>{src.cols(), src.rows()};
+    transpose_recursive(src, dst);
+    ASSERT_EQ(expected, dst);
+  }
+}
+
+TEST(MatrixTranspose, InPlace) {
+  for (auto n : {1, 2, 15, 64, 100}) {
+    for (auto tile : {size_t{1}, size_t{7}, size_t{64}, transpose_tile_size<int>()}) {
+      const auto src = create_matrix(n, n);
+      auto m = src;
+      transpose_in_place(m, tile);
+      ASSERT_TRUE(is_transpose(src, m));
+      // Transposing twice gives back the original
+      transpose_in_place(m, tile);
+      ASSERT_EQ(src, m);
+    }
+  }
+}
+
+TEST(MatrixTranspose, CompareProcessingTime) {
+  const auto& hw = hardware_info();
+  std::cout << "Tile size: " << transpose_tile_size<int>() << '\n';
+
+  // Each size is chosen such that the two matrices roughly fill the cache
+  const auto sizes = std::vector<std::pair<std::string, size_t>>{
+    {"L1", hw.data_cache_size(1) / 2},
+    {"L2", hw.data_cache_size(2) / 2},
+    {"LLC", hw.last_level_cache_size() / 2},
+    {"4 x LLC", hw.last_level_cache_size() * 2}
+  };
+
+  for (const auto& size : sizes) {
+    if (size.second > kMaxMatrixBytes) {
+      std::cout << '\n' << "Skipping size " << size.first << '\n';
+      continue;
+    }
+    const auto n = side_for_bytes(size.second);
+    std::cout << '\n' << "+++ " << size.first << ": " << n << 'x' << n << " ints +++" << '\n';
+    auto src = create_matrix(n, n);
+    auto dst = Matrix<int>{n, n};
+    // Repeat small sizes to get measurable times
+    const auto repeats = std::max<size_t>(1, (size_t{64} << 20) / (n * n * sizeof(int)));
+    {
+      ScopedTimer t{"transpose_naive"};
+      for (size_t r = 0; r < repeats; ++r) {
+        transpose_naive(src, dst);
+      }
+    }
+    {
+      ScopedTimer t{"transpose_blocked"};
+      for (size_t r = 0; r < repeats; ++r) {
+        transpose_blocked(src, dst);
+      }
+    }
+    {
+      ScopedTimer t{"transpose_recursive"};
+      for (size_t r = 0; r < repeats; ++r) {
+        transpose_recursive(src, dst);
+      }
+    }
+    {
+      ScopedTimer t{"transpose_in_place"};
+      for (size_t r = 0; r < repeats; ++r) {
+        transpose_in_place(src);
+      }
+    }
+    ASSERT_TRUE(repeats % 2 == 0 ? is_transpose(src, dst) : src == dst);
+  }
+}
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <gtest/gtest.h>
+#include "packed_column.hpp"
+#include "scooped_timer.hpp"
+
+//
+// This example demonstrates how the levels from parallel_arrays.cpp,
+// which only range from 0 to 99, can be stored using 7 bits each
+// instead of 16. Since a scan over the levels is limited by memory
+// bandwidth, the packed column can be counted and filtered faster
+// than the vector<short>, as long as we never unpack the values.
+//
+
+namespace {
+
+constexpr auto kNumQueries = 100;
+
+auto create_levels(size_t count) {
+  auto vec = std::vector<short>(count);
+  for (auto& level : vec) {
+    level = static_cast<short>(std::rand() % 100);
+  }
+  return vec;
+}
+
+auto count_at_level(short level, const std::vector<short>& levels) {
+  ScopedTimer t{"count level using vector<short>"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += static_cast<size_t>(std::count(levels.begin(), levels.end(), level));
+  }
+  return n / kNumQueries;
+}
+
+auto count_at_level(short level, const PackedColumn& levels) {
+  ScopedTimer t{"count level using PackedColumn"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += levels.count_equal(static_cast<std::uint32_t>(level));
+  }
+  return n / kNumQueries;
+}
+
+auto count_in_level_range(short lo, short hi, const std::vector<short>& levels) {
+  ScopedTimer t{"count level range using vector<short>"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += static_cast<size_t>(std::count_if(levels.begin(), levels.end(), [lo, hi](short level) {
+      return lo <= level && level <= hi;
+    }));
+  }
+  return n / kNumQueries;
+}
+
+auto count_in_level_range(short lo, short hi, const PackedColumn& levels) {
+  ScopedTimer t{"count level range using PackedColumn"};
+  auto n = size_t{0};
+  for (auto q = 0; q < kNumQueries; ++q) {
+    n += levels.count_between(static_cast<std::uint32_t>(lo), static_cast<std::uint32_t>(hi));
+  }
+  return n / kNumQueries;
+}
+
+} // namespace
+
+TEST(PackedColumn, ChoosesBitWidth) {
+  ASSERT_EQ(1u, PackedColumn::bits_needed(0));
+  ASSERT_EQ(1u, PackedColumn::bits_needed(1));
+  ASSERT_EQ(7u, PackedColumn::bits_needed(99));
+  ASSERT_EQ(8u, PackedColumn::bits_needed(255));
+  ASSERT_EQ(9u, PackedColumn::bits_needed(256));
+
+  auto levels = std::vector<short>{0, 99, 42};
+  auto column = PackedColumn::from_values(levels.begin(), levels.end());
+  ASSERT_EQ(7u, column.bit_width());
+  ASSERT_THROW(PackedColumn{32}, std::invalid_argument);
+}
+
+TEST(PackedColumn, GetSetAndUnpack) {
+  for (auto bit_width : {1u, 3u, 7u, 12u, 31u}) {
+    const auto max_value = (std::uint64_t{1} << bit_width) - 1;
+    auto values = std::vector<std::uint32_t>(1000);
+    for (auto& v : values) {
+      v = static_cast<std::uint32_t>(std::rand() % (max_value + 1));
+    }
+    auto column = PackedColumn{bit_width};
+    for (auto v : values) {
+      column.push_back(v);
+    }
+    ASSERT_EQ(values.size(), column.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      ASSERT_EQ(values[i], column.get(i));
+    }
+    ASSERT_EQ(values, column.unpack());
+
+    column.set(500, static_cast<std::uint32_t>(max_value));
+    values[500] = static_cast<std::uint32_t>(max_value);
+    ASSERT_EQ(values, column.unpack());
+  }
+}
+
+TEST(PackedColumn, RejectsValuesWiderThanBitWidth) {
+  auto column = PackedColumn{3};
+  for (auto v : {7u, 0u, 7u}) {
+    column.push_back(v);
+  }
+  ASSERT_THROW(column.push_back(8), std::out_of_range);
+  ASSERT_THROW(column.set(1, 8), std::out_of_range);
+  ASSERT_THROW(column.set(1, 0xffffffff), std::out_of_range);
+  // The neighbouring rows and the predicates are unaffected
+  ASSERT_EQ(3u, column.size());
+  ASSERT_EQ((std::vector<std::uint32_t>{7, 0, 7}), column.unpack());
+  ASSERT_EQ(1u, column.count_equal(0));
+  ASSERT_EQ(2u, column.count_between(1, 7));
+}
+
+TEST(PackedColumn, PredicatesMatchUnpackedScan) {
+  // Odd sizes make sure the unused lanes of the last block are ignored
+  for (auto size : {0, 1, 7, 37, 1001}) {
+    auto levels = create_levels(size);
+    auto column = PackedColumn::from_values(levels.begin(), levels.end());
+    for (auto x : {0, 5, 99, 100, 127, 1000}) {
+      const auto expected = std::count(levels.begin(), levels.end(), x);
+      ASSERT_EQ(static_cast<size_t>(expected), column.count_equal(x));
+    }
+    for (auto range : {std::make_pair(0, 0), std::make_pair(0, 49), std::make_pair(10, 20),
+                       std::make_pair(50, 500), std::make_pair(20, 10)}) {
+      auto expected_rows = DynamicBitset(levels.size());
+      for (size_t i = 0; i < levels.size(); ++i) {
+        if (range.first <= levels[i] && levels[i] <= range.second) {
+          expected_rows.set(i);
+        }
+      }
+      ASSERT_EQ(expected_rows.count(), column.count_between(range.first, range.second));
+      ASSERT_EQ(expected_rows, column.filter_between(range.first, range.second));
+    }
+  }
+}
+
+#if CPU_DISPATCH_ENABLED
+TEST(PackedColumn, KernelsAgreeWithGenericVersion) {
+  const auto& cpu = cpu_features();
+  for (auto bit_width : {1u, 7u, 15u}) {
+    const auto layout = packed::Layout{bit_width};
+    auto words = std::vector<packed::Word>(packed::kWordsPerBlock * 9);
+    for (auto& w : words) {
+      w = (packed::Word(std::rand()) << 32) ^ packed::Word(std::rand());
+      w &= ~layout.guard_bits_;
+    }
+    const auto lo = layout.broadcast(1);
+    const auto hi = layout.broadcast(static_cast<std::uint32_t>(layout.value_mask_ / 2));
+    const auto expected = packed::detail::count_between_generic(
+      words.data(), words.size(), lo, hi, layout.guard_bits_);
+    const auto num_blocks = words.size() / packed::kWordsPerBlock;
+    auto expected_values = std::vector<std::uint32_t>(num_blocks * layout.values_per_block());
+    packed::detail::unpack_generic(words.data(), num_blocks, layout, expected_values.data());
+
+    if (cpu.avx2_) {
+      ASSERT_EQ(expected, packed::detail::count_between_avx2(
+        words.data(), words.size(), lo, hi, layout.guard_bits_));
+      auto values = std::vector<std::uint32_t>(expected_values.size());
+      packed::detail::unpack_avx2(words.data(), num_blocks, layout, values.data());
+      ASSERT_EQ(expected_values, values);
+    }
+    if (cpu.avx512_popcnt_) {
+      ASSERT_EQ(expected, packed::detail::count_between_avx512(
+        words.data(), words.size(), lo, hi, layout.guard_bits_));
+    }
+  }
+}
+#endif
+
+TEST(PackedColumn, CompareProcessingTime) {
+  auto num_objects = 1'000'000; // Increase if you want more objects
+
+  auto levels = create_levels(num_objects);
+  auto column = PackedColumn::from_values(levels.begin(), levels.end());
+  std::cout << "vector<short>: " << levels.size() * sizeof(short) << " bytes" << '\n';
+  std::cout << "PackedColumn: " << column.memory_usage() << " bytes" << '\n';
+
+  auto level = short{5};
+  std::cout << '\n' << "+++ Count users at level +++" << '\n';
+  const auto expected = count_at_level(level, levels);
+  ASSERT_EQ(expected, count_at_level(level, column));
+
+  std::cout << '\n' << "+++ Count users in level range +++" << '\n';
+  const auto expected_range = count_in_level_range(10, 19, levels);
+  ASSERT_EQ(expected_range, count_in_level_range(10, 19, column));
+
+  std::cout << '\n' << "+++ Unpack all levels +++" << '\n';
+  auto unpacked = std::vector<std::uint32_t>(column.size());
+  {
+    ScopedTimer t{"unpack PackedColumn"};
+    for (auto q = 0; q < kNumQueries; ++q) {
+      column.unpack(unpacked.data());
+    }
+  }
+  ASSERT_TRUE(std::equal(levels.begin(), levels.end(), unpacked.begin()));
+}
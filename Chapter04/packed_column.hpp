@@ -0,0 +1,349 @@
+#pragma once
+#ifndef PACKED_COLUMN_HPP
+#define PACKED_COLUMN_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "cpu_features.hpp"
+#include "dynamic_bitset.hpp"
+
+//
+// A PackedColumn stores small unsigned integers using only as many
+// bits per value as the largest value needs, e.g. 7 bits for a
+// level in the range 0-99 instead of the 16 bits of a short.
+//
+// Each value occupies a lane of bit_width + 1 bits in a 64-bit word.
+// The extra, most significant, bit of every lane is a guard bit
+// which is always zero in the stored data. With the guard bit in
+// place, comparisons of all lanes in a word can be done at once
+// with a subtraction, since a borrow never crosses into the next
+// lane. This lets us count and filter directly on the packed data
+// without unpacking it first.
+//
+// The words are grouped in blocks of four (256 bits). Row r of a
+// block is stored in word r % 4, lane r / 4, which means that
+// shifting a whole block right by one lane yields four consecutive
+// rows. This makes unpacking with AVX2 straightforward.
+//
+
+namespace packed {
+
+using Word = std::uint64_t;
+constexpr auto kWordsPerBlock = std::size_t{4};
+
+// The masks needed by the lane-parallel comparisons
+struct Layout {
+  unsigned bit_width_{};
+  unsigned lane_bits_{};
+  std::size_t lanes_per_word_{};
+  Word value_mask_{}; // bit_width_ ones
+  Word low_bits_{};   // The lowest bit of each lane
+  Word guard_bits_{}; // The highest bit of each lane
+
+  explicit Layout(unsigned bit_width)
+    : bit_width_{bit_width}
+    , lane_bits_{bit_width + 1}
+    , lanes_per_word_{64 / (bit_width + 1)}
+    , value_mask_{(Word{1} << bit_width) - 1} {
+    for (std::size_t lane = 0; lane < lanes_per_word_; ++lane) {
+      low_bits_ |= Word{1} << (lane * lane_bits_);
+    }
+    guard_bits_ = low_bits_ << bit_width;
+  }
+  auto broadcast(std::uint32_t value) const noexcept -> Word {
+    return low_bits_ * value;
+  }
+  auto values_per_block() const noexcept {
+    return lanes_per_word_ * kWordsPerBlock;
+  }
+};
+
+// Guard bits are set for the lanes whose value is in [lo, hi]
+inline auto between_mask(Word v, Word lo, Word hi, Word guard) noexcept -> Word {
+  return ((v | guard) - lo) & ((hi | guard) - v) & guard;
+}
+
+namespace detail {
+
+inline auto count_between_generic(const Word* words, std::size_t n, Word lo, Word hi,
+                                  Word guard) -> std::size_t {
+  auto count = std::size_t{0};
+  for (std::size_t i = 0; i < n; ++i) {
+    count += popcount64(between_mask(words[i], lo, hi, guard));
+  }
+  return count;
+}
+
+inline auto unpack_generic(const Word* words, std::size_t num_blocks, const Layout& layout,
+                           std::uint32_t* out) -> void {
+  for (std::size_t b = 0; b < num_blocks; ++b) {
+    const auto* block = words + b * kWordsPerBlock;
+    for (std::size_t lane = 0; lane < layout.lanes_per_word_; ++lane) {
+      const auto shift = lane * layout.lane_bits_;
+      for (std::size_t w = 0; w < kWordsPerBlock; ++w) {
+        *out++ = static_cast<std::uint32_t>((block[w] >> shift) & layout.value_mask_);
+      }
+    }
+  }
+}
+
+#if CPU_DISPATCH_ENABLED
+
+TARGET_AVX2 inline auto count_between_avx2(const Word* words, std::size_t n, Word lo, Word hi,
+                                           Word guard) -> std::size_t {
+  assert(n % kWordsPerBlock == 0);
+  const auto lo_v = _mm256_set1_epi64x(static_cast<long long>(lo));
+  const auto hi_v = _mm256_set1_epi64x(static_cast<long long>(hi | guard));
+  const auto guard_v = _mm256_set1_epi64x(static_cast<long long>(guard));
+  auto count = std::size_t{0};
+  for (std::size_t i = 0; i < n; i += kWordsPerBlock) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+    const auto ge = _mm256_sub_epi64(_mm256_or_si256(v, guard_v), lo_v);
+    const auto le = _mm256_sub_epi64(hi_v, v);
+    const auto m = _mm256_and_si256(_mm256_and_si256(ge, le), guard_v);
+    count += static_cast<std::size_t>(
+      _mm_popcnt_u64(static_cast<Word>(_mm256_extract_epi64(m, 0))) +
+      _mm_popcnt_u64(static_cast<Word>(_mm256_extract_epi64(m, 1))) +
+      _mm_popcnt_u64(static_cast<Word>(_mm256_extract_epi64(m, 2))) +
+      _mm_popcnt_u64(static_cast<Word>(_mm256_extract_epi64(m, 3))));
+  }
+  return count;
+}
+
+TARGET_AVX512_POPCNT inline auto count_between_avx512(const Word* words, std::size_t n,
+                                                      Word lo, Word hi,
+                                                      Word guard) -> std::size_t {
+  assert(n % kWordsPerBlock == 0);
+  const auto lo_v = _mm512_set1_epi64(static_cast<long long>(lo));
+  const auto hi_v = _mm512_set1_epi64(static_cast<long long>(hi | guard));
+  const auto guard_v = _mm512_set1_epi64(static_cast<long long>(guard));
+  auto total = _mm512_setzero_si512();
+  for (std::size_t i = 0; i < n; i += 8) {
+    // The last iteration may only have one block left
+    const auto valid = static_cast<__mmask8>(n - i >= 8 ? 0xff : 0x0f);
+    const auto v = _mm512_maskz_loadu_epi64(valid, words + i);
+    const auto ge = _mm512_sub_epi64(_mm512_or_si512(v, guard_v), lo_v);
+    const auto le = _mm512_sub_epi64(hi_v, v);
+    const auto m = _mm512_maskz_and_epi64(valid, _mm512_and_si512(ge, le), guard_v);
+    total = _mm512_add_epi64(total, _mm512_popcnt_epi64(m));
+  }
+  return simd::detail::horizontal_sum_avx512(total);
+}
+
+// Shifting the block by one lane at a time gives four consecutive
+// rows, which are narrowed from 64 to 32 bits and stored.
+TARGET_AVX2 inline auto unpack_avx2(const Word* words, std::size_t num_blocks,
+                                    const Layout& layout, std::uint32_t* out) -> void {
+  const auto mask = _mm256_set1_epi64x(static_cast<long long>(layout.value_mask_));
+  const auto narrow = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+  for (std::size_t b = 0; b < num_blocks; ++b) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + b * kWordsPerBlock));
+    for (std::size_t lane = 0; lane < layout.lanes_per_word_; ++lane) {
+      const auto shift = _mm_cvtsi64_si128(static_cast<long long>(lane * layout.lane_bits_));
+      const auto values = _mm256_and_si256(_mm256_srl_epi64(v, shift), mask);
+      const auto packed = _mm256_permutevar8x32_epi32(values, narrow);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+      out += kWordsPerBlock;
+    }
+  }
+}
+
+#endif // CPU_DISPATCH_ENABLED
+
+} // namespace detail
+
+// Counts the lanes in [lo, hi] of n words, n must be a multiple
+// of kWordsPerBlock
+inline auto count_between(const Word* words, std::size_t n, Word lo, Word hi,
+                          Word guard) -> std::size_t {
+  using Fn = std::size_t (*)(const Word*, std::size_t, Word, Word, Word);
+  static const Fn fn = []() -> Fn {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_popcnt_) return detail::count_between_avx512;
+    if (cpu.avx2_) return detail::count_between_avx2;
+#endif
+    return detail::count_between_generic;
+  }();
+  return fn(words, n, lo, hi, guard);
+}
+
+inline auto unpack(const Word* words, std::size_t num_blocks, const Layout& layout,
+                   std::uint32_t* out) -> void {
+  using Fn = void (*)(const Word*, std::size_t, const Layout&, std::uint32_t*);
+  static const Fn fn = []() -> Fn {
+#if CPU_DISPATCH_ENABLED
+    if (cpu_features().avx2_) return detail::unpack_avx2;
+#endif
+    return detail::unpack_generic;
+  }();
+  fn(words, num_blocks, layout, out);
+}
+
+} // namespace packed
+
+
+class PackedColumn {
+public:
+  static constexpr unsigned kMaxBitWidth = 31;
+
+  explicit PackedColumn(unsigned bit_width) : layout_{check_bit_width(bit_width)} {}
+
+  // Creates a column with the smallest bit width able to hold all values
+  template <typename It>
+  static auto from_values(It first, It last) {
+    auto max_value = std::uint32_t{0};
+    using Value = typename std::iterator_traits<It>::value_type;
+    for (auto it = first; it != last; ++it) {
+      if constexpr (std::is_signed_v<Value>) {
+        assert(*it >= 0);
+      }
+      max_value = std::max(max_value, static_cast<std::uint32_t>(*it));
+    }
+    auto column = PackedColumn{bits_needed(max_value)};
+    for (auto it = first; it != last; ++it) {
+      column.push_back(static_cast<std::uint32_t>(*it));
+    }
+    return column;
+  }
+
+  static auto bits_needed(std::uint32_t max_value) noexcept -> unsigned {
+    auto bits = 1u;
+    while (bits < 32 && (max_value >> bits) != 0) {
+      ++bits;
+    }
+    return bits;
+  }
+
+  auto size() const noexcept { return size_; }
+  auto bit_width() const noexcept { return layout_.bit_width_; }
+  auto memory_usage() const noexcept { return words_.size() * sizeof(packed::Word); }
+
+  // Throws std::out_of_range if value doesn't fit in the bit width
+  auto push_back(std::uint32_t value) {
+    check_value(value);
+    if (size_ == capacity()) {
+      words_.resize(words_.size() + packed::kWordsPerBlock);
+    }
+    ++size_;
+    set(size_ - 1, value);
+  }
+
+  auto get(std::size_t row) const noexcept -> std::uint32_t {
+    assert(row < size_);
+    const auto pos = locate(row);
+    return static_cast<std::uint32_t>((words_[pos.word_] >> pos.shift_) & layout_.value_mask_);
+  }
+
+  // Throws std::out_of_range if value doesn't fit in the bit width,
+  // as it would overwrite the guard bit and the next lane
+  auto set(std::size_t row, std::uint32_t value) -> void {
+    assert(row < size_);
+    check_value(value);
+    const auto pos = locate(row);
+    auto& word = words_[pos.word_];
+    word = (word & ~(layout_.value_mask_ << pos.shift_)) | (packed::Word{value} << pos.shift_);
+  }
+
+  // Writes all values to out, which must have room for size() values
+  auto unpack(std::uint32_t* out) const {
+    const auto num_full_blocks = size_ / layout_.values_per_block();
+    packed::unpack(words_.data(), num_full_blocks, layout_, out);
+    for (auto row = num_full_blocks * layout_.values_per_block(); row < size_; ++row) {
+      out[row] = get(row);
+    }
+  }
+  auto unpack() const {
+    auto values = std::vector<std::uint32_t>(size_);
+    unpack(values.data());
+    return values;
+  }
+
+  //
+  // Predicates pushed down to the packed data
+  //
+  auto count_equal(std::uint32_t value) const -> std::size_t {
+    return count_between(value, value);
+  }
+
+  // Number of values v such that lo <= v <= hi
+  auto count_between(std::uint32_t lo, std::uint32_t hi) const -> std::size_t {
+    if (lo > hi || lo > layout_.value_mask_) {
+      return 0;
+    }
+    hi = std::min(hi, static_cast<std::uint32_t>(layout_.value_mask_));
+    const auto count = packed::count_between(
+      words_.data(), words_.size(),
+      layout_.broadcast(lo), layout_.broadcast(hi), layout_.guard_bits_);
+    // The unused lanes at the end hold zeros, which must not be counted
+    const auto padding = lo == 0 ? capacity() - size_ : 0;
+    return count - padding;
+  }
+
+  // Returns a bitmap with the rows whose value is in [lo, hi] set
+  auto filter_between(std::uint32_t lo, std::uint32_t hi) const -> DynamicBitset {
+    auto rows = DynamicBitset(size_);
+    if (lo > hi || lo > layout_.value_mask_) {
+      return rows;
+    }
+    hi = std::min(hi, static_cast<std::uint32_t>(layout_.value_mask_));
+    const auto lo_bits = layout_.broadcast(lo);
+    const auto hi_bits = layout_.broadcast(hi);
+    for (std::size_t w = 0; w < words_.size(); ++w) {
+      auto m = packed::between_mask(words_[w], lo_bits, hi_bits, layout_.guard_bits_);
+      while (m != 0) {
+        const auto lane = countr_zero64(m) / layout_.lane_bits_;
+        const auto row = (w / packed::kWordsPerBlock) * layout_.values_per_block() +
+                         lane * packed::kWordsPerBlock + w % packed::kWordsPerBlock;
+        if (row < size_) {
+          rows.set(row);
+        }
+        m &= m - 1;
+      }
+    }
+    return rows;
+  }
+
+private:
+  struct Position {
+    std::size_t word_{};
+    unsigned shift_{};
+  };
+
+  static auto check_bit_width(unsigned bit_width) -> unsigned {
+    if (bit_width == 0 || bit_width > kMaxBitWidth) {
+      throw std::invalid_argument("Bit width must be in the range 1-31");
+    }
+    return bit_width;
+  }
+
+  auto check_value(std::uint32_t value) const -> void {
+    if (value > layout_.value_mask_) {
+      throw std::out_of_range("Value does not fit in the bit width of the column");
+    }
+  }
+
+  auto capacity() const noexcept -> std::size_t {
+    return words_.size() / packed::kWordsPerBlock * layout_.values_per_block();
+  }
+
+  auto locate(std::size_t row) const noexcept -> Position {
+    const auto block = row / layout_.values_per_block();
+    const auto r = row % layout_.values_per_block();
+    const auto word = block * packed::kWordsPerBlock + r % packed::kWordsPerBlock;
+    const auto lane = r / packed::kWordsPerBlock;
+    return {word, static_cast<unsigned>(lane * layout_.lane_bits_)};
+  }
+
+  packed::Layout layout_;
+  std::vector<packed::Word> words_{};
+  std::size_t size_{};
+};
+
+#endif
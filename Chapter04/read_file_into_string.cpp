@@ -1,6 +1,7 @@
 #include <string>
 #include <fstream>
 #include <gtest/gtest.h>
+#include "mapped_file.hpp"
 
 //
 // This example demonstrates how to read an entire text file
@@ -34,3 +35,11 @@ TEST_F(ReadFileIntoString, CheckFileSize) {
   ASSERT_EQ(initial_content_, content);
   ASSERT_EQ(static_cast<size_t>(size), initial_content_.size());
 }
+
+TEST_F(ReadFileIntoString, MappedFile) {
+  // The content is accessed directly from the mapped
+  // pages, without being copied into a string
+  const auto file = MappedFile{"file.txt", AccessHint::Sequential};
+  ASSERT_TRUE(file.is_mapped());
+  ASSERT_EQ(initial_content_, file.view());
+}
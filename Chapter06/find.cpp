@@ -2,6 +2,13 @@
 #include <vector>
 #include <cassert>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include "scooped_timer.h"
+#include "simd_find.hpp"
 
 template <typename It, typename Value>
 auto find_slow(It first, It last, const Value& value) {
@@ -40,3 +47,211 @@ TEST(FindAlgorithm, SlowAndFast) {
   auto b = find_fast(vals.begin(), vals.end(), 7);
   ASSERT_TRUE(b != vals.end());
 }
+
+namespace {
+
+// Checks simd::find() and simd::count() against the standard
+// algorithms for all lengths up to 200, starting at unaligned
+// addresses, with the value at every position
+template <typename T>
+auto check_simd_find() {
+  auto vals = std::vector<T>(210);
+  for (size_t i = 0; i < vals.size(); ++i) {
+    vals[i] = static_cast<T>(i % 100 + 1);
+  }
+  const auto value = T{0};
+  for (size_t offset = 0; offset < 4; ++offset) {
+    for (size_t n = 0; n + offset <= 200; n += 7) {
+      const auto first = vals.data() + offset;
+      const auto last = first + n;
+      for (size_t pos = 0; pos < n; ++pos) {
+        first[pos] = value;
+        ASSERT_EQ(std::find(first, last, value), simd::find(first, last, value));
+        ASSERT_EQ(std::count(first, last, value), simd::count(first, last, value));
+        first[pos] = static_cast<T>(pos % 100 + 1);
+      }
+      ASSERT_EQ(last, simd::find(first, last, value));
+      ASSERT_EQ(0, simd::count(first, last, value));
+      // The value in every other position, and then in every position
+      for (size_t pos = 0; pos < n; pos += 2) {
+        first[pos] = value;
+      }
+      ASSERT_EQ(std::count(first, last, value), simd::count(first, last, value));
+      if (n > 0) {
+        ASSERT_EQ(std::find(first + 1, last, value), simd::find(first + 1, last, value));
+      }
+      std::fill(first, last, value);
+      ASSERT_EQ(static_cast<std::ptrdiff_t>(n), simd::count(first, last, value));
+      for (size_t pos = 0; pos < n; ++pos) {
+        first[pos] = static_cast<T>(pos % 100 + 1);
+      }
+    }
+  }
+}
+
+} // namespace
+
+TEST(FindAlgorithm, SimdFindAllTypes) {
+  check_simd_find<std::int8_t>();
+  check_simd_find<std::uint8_t>();
+  check_simd_find<char>();
+  check_simd_find<std::int16_t>();
+  check_simd_find<std::uint16_t>();
+  check_simd_find<std::int32_t>();
+  check_simd_find<std::uint32_t>();
+  check_simd_find<std::int64_t>();
+  check_simd_find<std::uint64_t>();
+  check_simd_find<float>();
+  check_simd_find<double>();
+}
+
+#if CPU_DISPATCH_ENABLED
+namespace {
+
+// simd::find() only uses the best kernel for this CPU, so the others
+// are checked against the generic ones directly, for an element type
+// the kernels take
+template <typename T>
+auto check_kernels() {
+  using namespace simd::detail;
+  const auto& cpu = cpu_features();
+  const auto value = T{7};
+  auto a = std::vector<T>(300, T{1});
+  auto b = std::vector<T>(300, T{2});
+  const auto check = [&](auto find, auto count, auto find_equal) {
+    for (size_t n : {0, 1, 15, 16, 31, 32, 63, 64, 65, 200, 300}) {
+      ASSERT_EQ(find_generic(a.data(), n, value), find(a.data(), n, value)) << n;
+      ASSERT_EQ(count_generic(a.data(), n, value), count(a.data(), n, value)) << n;
+      ASSERT_EQ(find_equal_generic(a.data(), b.data(), n), find_equal(a.data(), b.data(), n))
+        << n;
+    }
+  };
+  for (size_t pos : {0, 15, 16, 31, 63, 64, 200, 299}) {
+    // Two values to count, and an equal pair of elements
+    const auto other = pos * 3 % 300;
+    a[pos] = value;
+    a[other] = value;
+    b[pos] = value;
+    if (cpu.sse42_) {
+      check(find_sse42<T>, count_sse42<T>, find_equal_sse42<T>);
+    }
+    if (cpu.avx2_) {
+      check(find_avx2<T>, count_avx2<T>, find_equal_avx2<T>);
+    }
+    if (cpu.avx512_) {
+      check(find_avx512<T>, count_avx512<T>, find_equal_avx512<T>);
+    }
+    a[pos] = T{1};
+    a[other] = T{1};
+    b[pos] = T{2};
+  }
+}
+
+} // namespace
+
+TEST(FindAlgorithm, SimdFindKernels) {
+  check_kernels<std::uint8_t>();
+  check_kernels<std::uint16_t>();
+  check_kernels<std::uint32_t>();
+  check_kernels<std::uint64_t>();
+  check_kernels<float>();
+  check_kernels<double>();
+}
+#endif
+
+TEST(FindAlgorithm, SimdFindComparesLikeOperatorEq) {
+  // -0.0 == 0.0 and NaN is never equal to anything
+  auto floats = std::vector<float>(100, 1.0f);
+  floats[60] = -0.0f;
+  floats[70] = std::numeric_limits<float>::quiet_NaN();
+  ASSERT_EQ(60, simd::find(floats.begin(), floats.end(), 0.0f) - floats.begin());
+  ASSERT_EQ(floats.end(),
+            simd::find(floats.begin(), floats.end(), std::numeric_limits<float>::quiet_NaN()));
+  // 0.1 can't be represented as a float, so no float equals it
+  floats[80] = 0.1f;
+  ASSERT_EQ(floats.end(), simd::find(floats.begin(), floats.end(), 0.1));
+  ASSERT_EQ(80, simd::find(floats.begin(), floats.end(), 0.1f) - floats.begin());
+
+  // The value is converted as in a comparison with ==
+  auto bytes = std::vector<std::uint8_t>(100, 44);
+  ASSERT_EQ(bytes.end(), simd::find(bytes.begin(), bytes.end(), 300));
+  ASSERT_EQ(100, simd::count(bytes.begin(), bytes.end(), 44));
+  auto uints = std::vector<unsigned>(100, 0);
+  uints[90] = std::numeric_limits<unsigned>::max();
+  ASSERT_EQ(90, simd::find(uints.begin(), uints.end(), -1) - uints.begin());
+  auto longs = std::vector<std::int64_t>(100, 0);
+  longs[50] = -1;
+  ASSERT_EQ(50, simd::find(longs.cbegin(), longs.cend(), -1) - longs.cbegin());
+
+  // Ranges which aren't contiguous use std::find()
+  auto strings = std::vector<std::string>{"a", "b", "c"};
+  ASSERT_EQ(1, simd::find(strings.begin(), strings.end(), "b") - strings.begin());
+}
+
+TEST(FindAlgorithm, SimdFindIfEq) {
+  auto a = std::vector<int>(100);
+  auto b = std::vector<int>(100);
+  for (int i = 0; i < 100; ++i) {
+    a[i] = i;
+    b[i] = -i - 1;
+  }
+  ASSERT_EQ(a.end(), simd::find_if_eq(a.begin(), a.end(), b.begin()));
+  b[77] = 77;
+  ASSERT_EQ(77, simd::find_if_eq(a.begin(), a.end(), b.begin()) - a.begin());
+  ASSERT_EQ(77, simd::find_if_eq(a.begin() + 5, a.end(), b.begin() + 5) - a.begin());
+  ASSERT_EQ(a.begin() + 77, simd::find_if_eq(a.begin(), a.begin() + 77, b.begin()));
+}
+
+TEST(FindAlgorithm, CompareFindTimes) {
+  // Increase if you want more
+  const auto n = size_t{10'000'000};
+  const auto num_repeats = 10;
+  auto vals = std::vector<int>(n, 1);
+  vals[n - 100] = 42;
+  const auto expected = vals.begin() + (n - 100);
+  auto found = vals.end();
+  {
+    ScopedTimer timer{"find_slow"};
+    for (auto i = 0; i < num_repeats; ++i) {
+      found = find_slow(vals.begin(), vals.end(), 42);
+    }
+  }
+  ASSERT_EQ(expected, found);
+  {
+    ScopedTimer timer{"find_fast"};
+    for (auto i = 0; i < num_repeats; ++i) {
+      found = find_fast(vals.begin(), vals.end(), 42);
+    }
+  }
+  ASSERT_EQ(expected, found);
+  {
+    ScopedTimer timer{"std::find"};
+    for (auto i = 0; i < num_repeats; ++i) {
+      found = std::find(vals.begin(), vals.end(), 42);
+    }
+  }
+  ASSERT_EQ(expected, found);
+  {
+    ScopedTimer timer{"simd::find"};
+    for (auto i = 0; i < num_repeats; ++i) {
+      found = simd::find(vals.begin(), vals.end(), 42);
+    }
+  }
+  ASSERT_EQ(expected, found);
+
+  auto count = std::ptrdiff_t{0};
+  {
+    ScopedTimer timer{"std::count"};
+    for (auto i = 0; i < num_repeats; ++i) {
+      count = std::count(vals.begin(), vals.end(), 1);
+    }
+  }
+  ASSERT_EQ(static_cast<std::ptrdiff_t>(n - 1), count);
+  {
+    ScopedTimer timer{"simd::count"};
+    for (auto i = 0; i < num_repeats; ++i) {
+      count = simd::count(vals.begin(), vals.end(), 1);
+    }
+  }
+  ASSERT_EQ(static_cast<std::ptrdiff_t>(n - 1), count);
+}
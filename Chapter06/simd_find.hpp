@@ -0,0 +1,504 @@
+#pragma once
+#ifndef SIMD_FIND_HPP
+#define SIMD_FIND_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "cpu_features.hpp"
+
+//
+// Versions of std::find() and std::count() which compare a whole
+// vector of elements with the value at a time. They work with 8, 16,
+// 32 and 64-bit integers, float and double stored contiguously, and
+// use SSE4.2, AVX2 or AVX-512 depending on the CPU. Any other range
+// is handed to the standard algorithm.
+//
+// The SSE4.2 and AVX2 kernels handle the elements after the last
+// whole vector with a scalar loop, while AVX-512 uses a masked load.
+// Loads are unaligned, so the ranges may start anywhere.
+//
+
+namespace simd {
+namespace detail {
+
+// Pointers, and the iterators of std::vector and std::basic_string,
+// refer to contiguous elements. C++17 has no way of asking an
+// iterator if it does.
+template <typename It>
+constexpr auto is_contiguous_iterator() {
+  using V = typename std::iterator_traits<It>::value_type;
+  if constexpr (std::is_pointer_v<It>) {
+    return true;
+  } else if constexpr (std::is_same_v<V, bool>) {
+    return false; // std::vector<bool> is packed
+  } else if constexpr (std::is_same_v<V, char> || std::is_same_v<V, wchar_t> ||
+                       std::is_same_v<V, char16_t> || std::is_same_v<V, char32_t>) {
+    return std::is_same_v<It, typename std::basic_string<V>::iterator> ||
+           std::is_same_v<It, typename std::basic_string<V>::const_iterator> ||
+           std::is_same_v<It, typename std::vector<V>::iterator> ||
+           std::is_same_v<It, typename std::vector<V>::const_iterator>;
+  } else {
+    return std::is_same_v<It, typename std::vector<V>::iterator> ||
+           std::is_same_v<It, typename std::vector<V>::const_iterator>;
+  }
+}
+
+template <typename T>
+constexpr auto is_simd_element() {
+  if constexpr (std::is_floating_point_v<T>) {
+    return std::is_same_v<T, float> || std::is_same_v<T, double>;
+  } else {
+    return std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+      (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+  }
+}
+
+// The kernels compare integers bit by bit, so signed integers use
+// the kernel for the unsigned type of the same size. Floats are
+// compared as floats, since 0.0 == -0.0 and NaN != NaN.
+template <typename T>
+using kernel_type_t = typename std::conditional_t<
+  std::is_integral_v<T>, std::make_unsigned<T>, std::common_type<T>>::type;
+
+// Converts value to the element type V. Returns nullopt if no V can
+// compare equal to value, e.g. 300 for uint8_t or 0.1 for float, in
+// which case nothing is found.
+template <typename V, typename T>
+auto to_element(const T& value) -> std::optional<V> {
+  using C = std::common_type_t<V, T>;
+  const auto element = static_cast<V>(value);
+  if (static_cast<C>(element) != static_cast<C>(value)) {
+    return std::nullopt;
+  }
+  return element;
+}
+
+template <typename T>
+auto find_generic(const T* a, size_t n, T value) -> size_t {
+  return static_cast<size_t>(std::find(a, a + n, value) - a);
+}
+
+template <typename T>
+auto count_generic(const T* a, size_t n, T value) -> size_t {
+  return static_cast<size_t>(std::count(a, a + n, value));
+}
+
+template <typename T>
+auto find_equal_generic(const T* a, const T* b, size_t n) -> size_t {
+  for (size_t i = 0; i < n; ++i) {
+    if (a[i] == b[i]) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#if CPU_DISPATCH_ENABLED
+
+//
+// SSE4.2, 16 bytes per vector. The comparison gives one bit per byte
+// of the vector, so each matching element sets sizeof(T) bits.
+//
+
+template <typename T>
+TARGET_SSE42 inline auto broadcast_sse42(T value) -> __m128i {
+  if constexpr (std::is_same_v<T, float>) {
+    return _mm_castps_si128(_mm_set1_ps(value));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return _mm_castpd_si128(_mm_set1_pd(value));
+  } else if constexpr (sizeof(T) == 1) {
+    return _mm_set1_epi8(static_cast<char>(value));
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm_set1_epi16(static_cast<short>(value));
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm_set1_epi32(static_cast<int>(value));
+  } else {
+    return _mm_set1_epi64x(static_cast<long long>(value));
+  }
+}
+
+template <typename T>
+TARGET_SSE42 inline auto equal_bits_sse42(const T* a, __m128i b) -> unsigned {
+  const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+  auto eq = __m128i{};
+  if constexpr (std::is_same_v<T, float>) {
+    eq = _mm_castps_si128(_mm_cmpeq_ps(_mm_castsi128_ps(v), _mm_castsi128_ps(b)));
+  } else if constexpr (std::is_same_v<T, double>) {
+    eq = _mm_castpd_si128(_mm_cmpeq_pd(_mm_castsi128_pd(v), _mm_castsi128_pd(b)));
+  } else if constexpr (sizeof(T) == 1) {
+    eq = _mm_cmpeq_epi8(v, b);
+  } else if constexpr (sizeof(T) == 2) {
+    eq = _mm_cmpeq_epi16(v, b);
+  } else if constexpr (sizeof(T) == 4) {
+    eq = _mm_cmpeq_epi32(v, b);
+  } else {
+    eq = _mm_cmpeq_epi64(v, b);
+  }
+  return static_cast<unsigned>(_mm_movemask_epi8(eq));
+}
+
+template <typename T>
+TARGET_SSE42 inline auto find_sse42(const T* a, size_t n, T value) -> size_t {
+  constexpr auto kLanes = 16 / sizeof(T);
+  const auto needle = broadcast_sse42(value);
+  auto i = size_t{0};
+  for (; i + kLanes <= n; i += kLanes) {
+    const auto bits = equal_bits_sse42(a + i, needle);
+    if (bits != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(bits)) / sizeof(T);
+    }
+  }
+  return i + find_generic(a + i, n - i, value);
+}
+
+template <typename T>
+TARGET_SSE42 inline auto count_sse42(const T* a, size_t n, T value) -> size_t {
+  constexpr auto kLanes = 16 / sizeof(T);
+  const auto needle = broadcast_sse42(value);
+  auto count = size_t{0};
+  auto i = size_t{0};
+  for (; i + kLanes <= n; i += kLanes) {
+    count += static_cast<size_t>(_mm_popcnt_u32(equal_bits_sse42(a + i, needle)));
+  }
+  return count / sizeof(T) + count_generic(a + i, n - i, value);
+}
+
+template <typename T>
+TARGET_SSE42 inline auto find_equal_sse42(const T* a, const T* b, size_t n) -> size_t {
+  constexpr auto kLanes = 16 / sizeof(T);
+  auto i = size_t{0};
+  for (; i + kLanes <= n; i += kLanes) {
+    const auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    const auto bits = equal_bits_sse42(a + i, vb);
+    if (bits != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(bits)) / sizeof(T);
+    }
+  }
+  return i + find_equal_generic(a + i, b + i, n - i);
+}
+
+//
+// AVX2, 32 bytes per vector, otherwise the same as SSE4.2
+//
+
+template <typename T>
+TARGET_AVX2 inline auto broadcast_avx2(T value) -> __m256i {
+  if constexpr (std::is_same_v<T, float>) {
+    return _mm256_castps_si256(_mm256_set1_ps(value));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return _mm256_castpd_si256(_mm256_set1_pd(value));
+  } else if constexpr (sizeof(T) == 1) {
+    return _mm256_set1_epi8(static_cast<char>(value));
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm256_set1_epi16(static_cast<short>(value));
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm256_set1_epi32(static_cast<int>(value));
+  } else {
+    return _mm256_set1_epi64x(static_cast<long long>(value));
+  }
+}
+
+template <typename T>
+TARGET_AVX2 inline auto equal_bits_avx2(const T* a, __m256i b) -> unsigned {
+  const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+  auto eq = __m256i{};
+  if constexpr (std::is_same_v<T, float>) {
+    eq = _mm256_castps_si256(
+      _mm256_cmp_ps(_mm256_castsi256_ps(v), _mm256_castsi256_ps(b), _CMP_EQ_OQ));
+  } else if constexpr (std::is_same_v<T, double>) {
+    eq = _mm256_castpd_si256(
+      _mm256_cmp_pd(_mm256_castsi256_pd(v), _mm256_castsi256_pd(b), _CMP_EQ_OQ));
+  } else if constexpr (sizeof(T) == 1) {
+    eq = _mm256_cmpeq_epi8(v, b);
+  } else if constexpr (sizeof(T) == 2) {
+    eq = _mm256_cmpeq_epi16(v, b);
+  } else if constexpr (sizeof(T) == 4) {
+    eq = _mm256_cmpeq_epi32(v, b);
+  } else {
+    eq = _mm256_cmpeq_epi64(v, b);
+  }
+  return static_cast<unsigned>(_mm256_movemask_epi8(eq));
+}
+
+template <typename T>
+TARGET_AVX2 inline auto find_avx2(const T* a, size_t n, T value) -> size_t {
+  constexpr auto kLanes = 32 / sizeof(T);
+  const auto needle = broadcast_avx2(value);
+  auto i = size_t{0};
+  for (; i + kLanes <= n; i += kLanes) {
+    const auto bits = equal_bits_avx2(a + i, needle);
+    if (bits != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(bits)) / sizeof(T);
+    }
+  }
+  return i + find_generic(a + i, n - i, value);
+}
+
+template <typename T>
+TARGET_AVX2 inline auto count_avx2(const T* a, size_t n, T value) -> size_t {
+  constexpr auto kLanes = 32 / sizeof(T);
+  const auto needle = broadcast_avx2(value);
+  auto count = size_t{0};
+  auto i = size_t{0};
+  for (; i + kLanes <= n; i += kLanes) {
+    count += static_cast<size_t>(_mm_popcnt_u32(equal_bits_avx2(a + i, needle)));
+  }
+  return count / sizeof(T) + count_generic(a + i, n - i, value);
+}
+
+template <typename T>
+TARGET_AVX2 inline auto find_equal_avx2(const T* a, const T* b, size_t n) -> size_t {
+  constexpr auto kLanes = 32 / sizeof(T);
+  auto i = size_t{0};
+  for (; i + kLanes <= n; i += kLanes) {
+    const auto vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    const auto bits = equal_bits_avx2(a + i, vb);
+    if (bits != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(bits)) / sizeof(T);
+    }
+  }
+  return i + find_equal_generic(a + i, b + i, n - i);
+}
+
+//
+// AVX-512, 64 bytes per vector. The comparisons give one bit per
+// element, and only the elements in valid are loaded and compared.
+//
+
+template <typename T>
+TARGET_AVX512 inline auto broadcast_avx512(T value) -> __m512i {
+  if constexpr (std::is_same_v<T, float>) {
+    return _mm512_castps_si512(_mm512_set1_ps(value));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return _mm512_castpd_si512(_mm512_set1_pd(value));
+  } else if constexpr (sizeof(T) == 1) {
+    return _mm512_set1_epi8(static_cast<char>(value));
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm512_set1_epi16(static_cast<short>(value));
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm512_set1_epi32(static_cast<int>(value));
+  } else {
+    return _mm512_set1_epi64(static_cast<long long>(value));
+  }
+}
+
+template <typename T>
+TARGET_AVX512 inline auto load_avx512(const T* a, std::uint64_t valid) -> __m512i {
+  if constexpr (sizeof(T) == 1) {
+    return _mm512_maskz_loadu_epi8(static_cast<__mmask64>(valid), a);
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm512_maskz_loadu_epi16(static_cast<__mmask32>(valid), a);
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm512_maskz_loadu_epi32(static_cast<__mmask16>(valid), a);
+  } else {
+    return _mm512_maskz_loadu_epi64(static_cast<__mmask8>(valid), a);
+  }
+}
+
+template <typename T>
+TARGET_AVX512 inline auto equal_bits_avx512(__m512i a, __m512i b,
+                                            std::uint64_t valid) -> std::uint64_t {
+  if constexpr (std::is_same_v<T, float>) {
+    return _mm512_mask_cmp_ps_mask(static_cast<__mmask16>(valid), _mm512_castsi512_ps(a),
+                                   _mm512_castsi512_ps(b), _CMP_EQ_OQ);
+  } else if constexpr (std::is_same_v<T, double>) {
+    return _mm512_mask_cmp_pd_mask(static_cast<__mmask8>(valid), _mm512_castsi512_pd(a),
+                                   _mm512_castsi512_pd(b), _CMP_EQ_OQ);
+  } else if constexpr (sizeof(T) == 1) {
+    return _mm512_mask_cmpeq_epi8_mask(static_cast<__mmask64>(valid), a, b);
+  } else if constexpr (sizeof(T) == 2) {
+    return _mm512_mask_cmpeq_epi16_mask(static_cast<__mmask32>(valid), a, b);
+  } else if constexpr (sizeof(T) == 4) {
+    return _mm512_mask_cmpeq_epi32_mask(static_cast<__mmask16>(valid), a, b);
+  } else {
+    return _mm512_mask_cmpeq_epi64_mask(static_cast<__mmask8>(valid), a, b);
+  }
+}
+
+// Mask of the lanes of a vector at i which are before n
+template <typename T>
+inline auto valid_lanes(size_t i, size_t n) -> std::uint64_t {
+  constexpr auto kLanes = 64 / sizeof(T);
+  const auto remaining = n - i;
+  return remaining >= kLanes ? ~std::uint64_t{0} >> (64 - kLanes)
+                             : (std::uint64_t{1} << remaining) - 1;
+}
+
+template <typename T>
+TARGET_AVX512 inline auto find_avx512(const T* a, size_t n, T value) -> size_t {
+  constexpr auto kLanes = 64 / sizeof(T);
+  const auto needle = broadcast_avx512(value);
+  for (size_t i = 0; i < n; i += kLanes) {
+    const auto valid = valid_lanes<T>(i, n);
+    const auto bits = equal_bits_avx512<T>(load_avx512(a + i, valid), needle, valid);
+    if (bits != 0) {
+      return i + static_cast<size_t>(__builtin_ctzll(bits));
+    }
+  }
+  return n;
+}
+
+template <typename T>
+TARGET_AVX512 inline auto count_avx512(const T* a, size_t n, T value) -> size_t {
+  constexpr auto kLanes = 64 / sizeof(T);
+  const auto needle = broadcast_avx512(value);
+  auto count = size_t{0};
+  for (size_t i = 0; i < n; i += kLanes) {
+    const auto valid = valid_lanes<T>(i, n);
+    const auto bits = equal_bits_avx512<T>(load_avx512(a + i, valid), needle, valid);
+    count += static_cast<size_t>(_mm_popcnt_u64(bits));
+  }
+  return count;
+}
+
+template <typename T>
+TARGET_AVX512 inline auto find_equal_avx512(const T* a, const T* b, size_t n) -> size_t {
+  constexpr auto kLanes = 64 / sizeof(T);
+  for (size_t i = 0; i < n; i += kLanes) {
+    const auto valid = valid_lanes<T>(i, n);
+    const auto bits = equal_bits_avx512<T>(load_avx512(a + i, valid),
+                                           load_avx512(b + i, valid), valid);
+    if (bits != 0) {
+      return i + static_cast<size_t>(__builtin_ctzll(bits));
+    }
+  }
+  return n;
+}
+
+#endif // CPU_DISPATCH_ENABLED
+
+template <typename T>
+using FindFn = size_t (*)(const T*, size_t, T);
+template <typename T>
+using CountFn = size_t (*)(const T*, size_t, T);
+template <typename T>
+using FindEqualFn = size_t (*)(const T*, const T*, size_t);
+
+// One kernel of each kind is selected for every element type
+template <typename T>
+auto find_kernel() -> FindFn<T> {
+  static const FindFn<T> fn = []() -> FindFn<T> {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_) return find_avx512<T>;
+    if (cpu.avx2_) return find_avx2<T>;
+    if (cpu.sse42_) return find_sse42<T>;
+#endif
+    return find_generic<T>;
+  }();
+  return fn;
+}
+
+template <typename T>
+auto count_kernel() -> CountFn<T> {
+  static const CountFn<T> fn = []() -> CountFn<T> {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_) return count_avx512<T>;
+    if (cpu.avx2_) return count_avx2<T>;
+    if (cpu.sse42_) return count_sse42<T>;
+#endif
+    return count_generic<T>;
+  }();
+  return fn;
+}
+
+template <typename T>
+auto find_equal_kernel() -> FindEqualFn<T> {
+  static const FindEqualFn<T> fn = []() -> FindEqualFn<T> {
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_) return find_equal_avx512<T>;
+    if (cpu.avx2_) return find_equal_avx2<T>;
+    if (cpu.sse42_) return find_equal_sse42<T>;
+#endif
+    return find_equal_generic<T>;
+  }();
+  return fn;
+}
+
+template <typename It>
+auto kernel_data(It it) {
+  using V = typename std::iterator_traits<It>::value_type;
+  return reinterpret_cast<const kernel_type_t<V>*>(std::addressof(*it));
+}
+
+} // namespace detail
+
+// Returns an iterator to the first element equal to value, or last
+template <typename It, typename T>
+auto find(It first, It last, const T& value) -> It {
+  using V = typename std::iterator_traits<It>::value_type;
+  if constexpr (detail::is_contiguous_iterator<It>() && detail::is_simd_element<V>()) {
+    const auto n = static_cast<size_t>(last - first);
+    const auto element = detail::to_element<V>(value);
+    if (n == 0 || !element) {
+      return last;
+    }
+    using K = detail::kernel_type_t<V>;
+    const auto i = detail::find_kernel<K>()(detail::kernel_data(first), n,
+                                             static_cast<K>(*element));
+    return first + static_cast<typename std::iterator_traits<It>::difference_type>(i);
+  } else {
+    return std::find(first, last, value);
+  }
+}
+
+// Returns the number of elements equal to value
+template <typename It, typename T>
+auto count(It first, It last, const T& value)
+  -> typename std::iterator_traits<It>::difference_type {
+  using V = typename std::iterator_traits<It>::value_type;
+  using Diff = typename std::iterator_traits<It>::difference_type;
+  if constexpr (detail::is_contiguous_iterator<It>() && detail::is_simd_element<V>()) {
+    const auto n = static_cast<size_t>(last - first);
+    const auto element = detail::to_element<V>(value);
+    if (n == 0 || !element) {
+      return 0;
+    }
+    using K = detail::kernel_type_t<V>;
+    return static_cast<Diff>(detail::count_kernel<K>()(detail::kernel_data(first), n,
+                                                       static_cast<K>(*element)));
+  } else {
+    return std::count(first, last, value);
+  }
+}
+
+// Returns an iterator to the first element in [first1, last1) which
+// is equal to the element at the same position in the range starting
+// at first2, or last1 if there is none. This is the opposite of
+// std::mismatch(), and is used e.g. to find where two columns agree.
+template <typename It1, typename It2>
+auto find_if_eq(It1 first1, It1 last1, It2 first2) -> It1 {
+  using V = typename std::iterator_traits<It1>::value_type;
+  using V2 = typename std::iterator_traits<It2>::value_type;
+  if constexpr (detail::is_contiguous_iterator<It1>() && detail::is_contiguous_iterator<It2>() &&
+                std::is_same_v<V, V2> && detail::is_simd_element<V>()) {
+    const auto n = static_cast<size_t>(last1 - first1);
+    if (n == 0) {
+      return last1;
+    }
+    using K = detail::kernel_type_t<V>;
+    const auto i = detail::find_equal_kernel<K>()(detail::kernel_data(first1),
+                                                   detail::kernel_data(first2), n);
+    return first1 + static_cast<typename std::iterator_traits<It1>::difference_type>(i);
+  } else {
+    for (; first1 != last1; ++first1, ++first2) {
+      if (*first1 == *first2) {
+        break;
+      }
+    }
+    return first1;
+  }
+}
+
+} // namespace simd
+
+#endif
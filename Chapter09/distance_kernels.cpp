@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include "distance_kernels.hpp"
+#include "scooped_timer.h"
+
+//
+// This example compares the SIMD distance kernels with computing one
+// squared distance at a time the way DistProxy in distance_proxy.cpp
+// does, with std::pow() on an array of points.
+//
+
+namespace {
+
+// Number of points in the benchmark. Increase if you want more.
+constexpr auto kNumPoints = size_t{4'000'000};
+constexpr auto kNumQueries = size_t{50};
+constexpr auto kRowsPerCall = size_t{16};
+
+struct Points {
+  std::vector<float> xs_;
+  std::vector<float> ys_;
+  auto size() const { return xs_.size(); }
+};
+
+auto random_points(size_t n, std::mt19937& gen) {
+  auto dist = std::uniform_real_distribution<float>{-1000.0f, 1000.0f};
+  auto points = Points{std::vector<float>(n), std::vector<float>(n)};
+  for (size_t i = 0; i < n; ++i) {
+    points.xs_[i] = dist(gen);
+    points.ys_[i] = dist(gen);
+  }
+  return points;
+}
+
+// The squared distance as computed by DistProxy
+auto proxy_dist_sqrd(float x0, float y0, float x1, float y1) {
+  return static_cast<float>(std::pow(x0 - x1, 2) + std::pow(y0 - y1, 2));
+}
+
+auto scalar_dist_sqrd(float x0, float y0, float x1, float y1) {
+  const auto dx = x0 - x1;
+  const auto dy = y0 - y1;
+  return dx * dx + dy * dy;
+}
+
+} // namespace
+
+TEST(DistanceKernels, SquaredDistances) {
+  auto gen = std::mt19937{};
+  for (auto n : {0, 1, 7, 8, 9, 15, 16, 17, 100}) {
+    const auto p = random_points(n, gen);
+    auto out = std::vector<float>(n + 1, -1.0f);
+    spatial::squared_distances(p.xs_.data(), p.ys_.data(), p.size(), 3.0f, -4.0f, out.data());
+    for (size_t i = 0; i < p.size(); ++i) {
+      ASSERT_FLOAT_EQ(scalar_dist_sqrd(p.xs_[i], p.ys_[i], 3.0f, -4.0f), out[i]);
+    }
+    ASSERT_EQ(-1.0f, out[n]); // Nothing is written past the end
+  }
+}
+
+TEST(DistanceKernels, NearestIsFirstOfTies) {
+  auto gen = std::mt19937{};
+  for (auto n : {1, 7, 8, 9, 16, 17, 33, 1000}) {
+    const auto p = random_points(n, gen);
+    for (auto q = 0; q < 20; ++q) {
+      const auto qx = p.xs_[gen() % n] + 0.5f;
+      const auto qy = p.ys_[gen() % n];
+      auto expected = size_t{0};
+      for (size_t i = 1; i < p.size(); ++i) {
+        if (scalar_dist_sqrd(p.xs_[i], p.ys_[i], qx, qy) <
+            scalar_dist_sqrd(p.xs_[expected], p.ys_[expected], qx, qy)) {
+          expected = i;
+        }
+      }
+      ASSERT_EQ(expected, spatial::nearest(p.xs_.data(), p.ys_.data(), p.size(), qx, qy));
+    }
+  }
+  // All points at the same place, so the first one is the nearest
+  const auto xs = std::vector<float>(37, 1.0f);
+  const auto ys = std::vector<float>(37, 2.0f);
+  ASSERT_EQ(0u, spatial::nearest(xs.data(), ys.data(), xs.size(), 0.0f, 0.0f));
+  ASSERT_EQ(0u, spatial::nearest(xs.data(), ys.data(), 0, 0.0f, 0.0f));
+  // Distances which overflow to infinity
+  const auto far = std::vector<float>(20, std::numeric_limits<float>::max());
+  ASSERT_EQ(0u, spatial::nearest(far.data(), far.data(), far.size(), 0.0f, 0.0f));
+}
+
+TEST(DistanceKernels, WithinRadius) {
+  auto gen = std::mt19937{};
+  for (auto n : {0, 1, 8, 63, 64, 65, 200}) {
+    const auto p = random_points(n, gen);
+    auto bits = std::vector<uint64_t>(spatial::radius_mask_words(n), ~uint64_t{0});
+    const auto count = spatial::within_radius(p.xs_.data(), p.ys_.data(), p.size(), 0.0f, 0.0f,
+                                              800.0f, bits.data());
+    auto expected_count = size_t{0};
+    for (size_t i = 0; i < p.size(); ++i) {
+      const auto inside = scalar_dist_sqrd(p.xs_[i], p.ys_[i], 0.0f, 0.0f) <= 800.0f * 800.0f;
+      expected_count += inside ? 1 : 0;
+      ASSERT_EQ(inside, ((bits[i / 64] >> (i % 64)) & 1) != 0);
+    }
+    ASSERT_EQ(expected_count, count);
+    if (n % 64 != 0) {
+      ASSERT_EQ(0u, bits.back() >> (n % 64)); // Bits past the end are cleared
+    }
+    ASSERT_EQ(0u, spatial::within_radius(p.xs_.data(), p.ys_.data(), p.size(), 0.0f, 0.0f,
+                                         -1.0f, bits.data()));
+  }
+}
+
+TEST(DistanceKernels, Pairwise) {
+  auto gen = std::mt19937{};
+  // Rows left over after the blocks of four, and more than one tile
+  // of columns
+  for (auto [na, nb] : {std::pair{13, 21}, std::pair{6, 2500}}) {
+    const auto a = random_points(na, gen);
+    const auto b = random_points(nb, gen);
+    auto out = std::vector<float>(a.size() * b.size());
+    spatial::pairwise_squared_distances(a.xs_.data(), a.ys_.data(), a.size(), b.xs_.data(),
+                                        b.ys_.data(), b.size(), out.data());
+    for (size_t i = 0; i < a.size(); ++i) {
+      for (size_t j = 0; j < b.size(); ++j) {
+        ASSERT_FLOAT_EQ(scalar_dist_sqrd(a.xs_[i], a.ys_[i], b.xs_[j], b.ys_[j]),
+                        out[i * b.size() + j]);
+      }
+    }
+  }
+}
+
+#if CPU_DISPATCH_ENABLED
+TEST(DistanceKernels, KernelsAgreeWithGenericVersion) {
+  using namespace spatial::dist_detail;
+  const auto& cpu = cpu_features();
+  auto gen = std::mt19937{};
+  // Few distinct coordinates give many ties, between lanes and
+  // between the lanes and the tail
+  auto coord = std::uniform_int_distribution<int>{0, 3};
+  for (size_t n = 0; n < 70; ++n) {
+    auto p = Points{std::vector<float>(n), std::vector<float>(n)};
+    for (size_t i = 0; i < n; ++i) {
+      p.xs_[i] = static_cast<float>(coord(gen));
+      p.ys_[i] = static_cast<float>(coord(gen));
+    }
+    if (n > 5) {
+      p.xs_[n / 2] = std::numeric_limits<float>::quiet_NaN();
+      p.ys_[n - 1] = std::numeric_limits<float>::max();
+    }
+    const auto* xs = p.xs_.data();
+    const auto* ys = p.ys_.data();
+    for (auto q = 0; q < 10; ++q) {
+      const auto qx = static_cast<float>(coord(gen)) + 0.5f;
+      const auto qy = static_cast<float>(coord(gen));
+      const auto expected = nearest_generic(xs, ys, n, qx, qy);
+      auto expected_bits = std::vector<uint64_t>(spatial::radius_mask_words(n));
+      const auto expected_count = within_radius_generic(xs, ys, n, qx, qy, 2.25f,
+                                                        expected_bits.data());
+      auto expected_dists = std::vector<float>(n);
+      squared_distances_generic(xs, ys, n, qx, qy, expected_dists.data());
+      // All pairs of the first points and the points
+      const auto na = std::min(n, size_t{6});
+      auto expected_pairs = std::vector<float>(na * n);
+      pairwise_squared_distances_generic(xs, ys, na, xs, ys, n, expected_pairs.data(), n);
+
+      auto bits = std::vector<uint64_t>(expected_bits.size());
+      auto dists = std::vector<float>(n);
+      auto pairs = std::vector<float>(na * n);
+      const auto check = [&](auto squared_distances, auto nearest, auto within_radius,
+                             auto pairwise) {
+        ASSERT_EQ(expected, nearest(xs, ys, n, qx, qy));
+        std::fill(bits.begin(), bits.end(), 0);
+        ASSERT_EQ(expected_count, within_radius(xs, ys, n, qx, qy, 2.25f, bits.data()));
+        ASSERT_EQ(expected_bits, bits);
+        squared_distances(xs, ys, n, qx, qy, dists.data());
+        for (size_t i = 0; i < n; ++i) {
+          if (!std::isnan(expected_dists[i])) {
+            ASSERT_FLOAT_EQ(expected_dists[i], dists[i]);
+          }
+        }
+        pairwise(xs, ys, na, xs, ys, n, pairs.data(), n);
+        for (size_t i = 0; i < pairs.size(); ++i) {
+          if (!std::isnan(expected_pairs[i])) {
+            ASSERT_FLOAT_EQ(expected_pairs[i], pairs[i]);
+          }
+        }
+      };
+      if (cpu.avx2_) {
+        check(squared_distances_avx2, nearest_avx2, within_radius_avx2,
+              pairwise_squared_distances_avx2);
+      }
+      if (cpu.avx512_) {
+        check(squared_distances_avx512, nearest_avx512, within_radius_avx512,
+              pairwise_squared_distances_avx512);
+      }
+    }
+  }
+}
+#endif
+
+TEST(DistanceKernels, CompareWithDistProxy) {
+  auto gen = std::mt19937{};
+  const auto p = random_points(kNumPoints, gen);
+  const auto queries = random_points(kNumQueries, gen);
+  std::cout << kNumPoints << " points, " << kNumQueries << " queries" << '\n';
+
+  auto out = std::vector<float>(p.size());
+  {
+    ScopedTimer timer{"squared distances, std::pow"};
+    for (size_t q = 0; q < queries.size(); ++q) {
+      for (size_t i = 0; i < p.size(); ++i) {
+        out[i] = proxy_dist_sqrd(p.xs_[i], p.ys_[i], queries.xs_[q], queries.ys_[q]);
+      }
+    }
+  }
+  {
+    ScopedTimer timer{"squared distances, SIMD"};
+    for (size_t q = 0; q < queries.size(); ++q) {
+      spatial::squared_distances(p.xs_.data(), p.ys_.data(), p.size(), queries.xs_[q],
+                                 queries.ys_[q], out.data());
+    }
+  }
+
+  auto nearest_proxy = std::vector<size_t>{};
+  {
+    ScopedTimer timer{"nearest, std::pow"};
+    for (size_t q = 0; q < queries.size(); ++q) {
+      auto best = size_t{0};
+      auto best_dist = std::numeric_limits<float>::infinity();
+      for (size_t i = 0; i < p.size(); ++i) {
+        const auto d = proxy_dist_sqrd(p.xs_[i], p.ys_[i], queries.xs_[q], queries.ys_[q]);
+        if (d < best_dist) {
+          best = i;
+          best_dist = d;
+        }
+      }
+      nearest_proxy.push_back(best);
+    }
+  }
+  auto nearest_simd = std::vector<size_t>{};
+  {
+    ScopedTimer timer{"nearest, SIMD"};
+    for (size_t q = 0; q < queries.size(); ++q) {
+      nearest_simd.push_back(
+        spatial::nearest(p.xs_.data(), p.ys_.data(), p.size(), queries.xs_[q], queries.ys_[q]));
+    }
+  }
+  // The points found may differ if two are almost as near, since
+  // std::pow() rounds differently, but their distances may not
+  for (size_t q = 0; q < queries.size(); ++q) {
+    const auto qx = queries.xs_[q];
+    const auto qy = queries.ys_[q];
+    const auto d_proxy = scalar_dist_sqrd(p.xs_[nearest_proxy[q]], p.ys_[nearest_proxy[q]], qx, qy);
+    const auto d_simd = scalar_dist_sqrd(p.xs_[nearest_simd[q]], p.ys_[nearest_simd[q]], qx, qy);
+    ASSERT_NEAR(d_proxy, d_simd, 1e-4f * d_proxy + 1e-6f) << q;
+  }
+
+  // Pairs of the first points closer than a limit. The distances are
+  // computed kRowsPerCall rows at a time, which fit in the L2 cache.
+  const auto n = size_t{4096};
+  const auto limit = 100.0f * 100.0f;
+  auto rows = std::vector<float>(kRowsPerCall * n);
+  auto count_proxy = size_t{0};
+  {
+    ScopedTimer timer{"all pairs, std::pow"};
+    for (size_t i = 0; i < n; i += kRowsPerCall) {
+      for (size_t r = 0; r < kRowsPerCall; ++r) {
+        for (size_t j = 0; j < n; ++j) {
+          rows[r * n + j] = proxy_dist_sqrd(p.xs_[i + r], p.ys_[i + r], p.xs_[j], p.ys_[j]);
+        }
+      }
+      count_proxy += static_cast<size_t>(
+        std::count_if(rows.begin(), rows.end(), [=](float d) { return d < limit; }));
+    }
+  }
+  auto count_simd = size_t{0};
+  {
+    ScopedTimer timer{"all pairs, SIMD"};
+    for (size_t i = 0; i < n; i += kRowsPerCall) {
+      spatial::pairwise_squared_distances(p.xs_.data() + i, p.ys_.data() + i, kRowsPerCall,
+                                          p.xs_.data(), p.ys_.data(), n, rows.data());
+      count_simd += static_cast<size_t>(
+        std::count_if(rows.begin(), rows.end(), [=](float d) { return d < limit; }));
+    }
+  }
+  // The SIMD kernels may round differently, for example with FMA
+  ASSERT_NEAR(double(count_proxy), double(count_simd), count_proxy * 1e-3);
+}
@@ -0,0 +1,417 @@
+#pragma once
+#ifndef DISTANCE_KERNELS_HPP
+#define DISTANCE_KERNELS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "cpu_features.hpp"
+
+//
+// Distance kernels over points stored as a structure of arrays, one
+// array of x and one of y. DistProxy in distance_proxy.cpp computes
+// one squared distance at a time with std::pow(); these kernels
+// compute 8 (AVX2) or 16 (AVX-512) at a time with plain multiplies,
+// and never take a square root.
+//
+// - squared_distances() writes the squared distance from a query to
+//   each point.
+// - nearest() finds the index of the point nearest to a query.
+// - within_radius() sets one bit per point inside a circle.
+// - pairwise_squared_distances() computes all pairs of two point
+//   arrays. It goes through b in tiles which fit in the L1 cache, and
+//   computes four rows at a time, so that each load of b is used for
+//   four points of a.
+//
+// The kernel for the CPU is chosen once, at the first call.
+//
+
+namespace spatial {
+namespace dist_detail {
+
+inline auto squared_distances_generic(const float* xs, const float* ys, size_t n, float qx,
+                                      float qy, float* out) -> void {
+  for (size_t i = 0; i < n; ++i) {
+    const auto dx = xs[i] - qx;
+    const auto dy = ys[i] - qy;
+    out[i] = dx * dx + dy * dy;
+  }
+}
+
+// The first of the nearest points, ignoring NaN distances
+inline auto nearest_generic(const float* xs, const float* ys, size_t n, float qx, float qy)
+  -> size_t {
+  auto best = n;
+  auto best_dist = std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i < n; ++i) {
+    const auto dx = xs[i] - qx;
+    const auto dy = ys[i] - qy;
+    const auto d = dx * dx + dy * dy;
+    if (d < best_dist || (best == n && d == best_dist)) {
+      best = i;
+      best_dist = d;
+    }
+  }
+  return best;
+}
+
+// Sets bit i % 64 of bits[i / 64] for the points inside the circle,
+// and returns their number. The words of bits must be zero.
+inline auto within_radius_generic(const float* xs, const float* ys, size_t n, float qx, float qy,
+                                  float r_sqrd, uint64_t* bits) -> size_t {
+  auto count = size_t{0};
+  for (size_t i = 0; i < n; ++i) {
+    const auto dx = xs[i] - qx;
+    const auto dy = ys[i] - qy;
+    if (dx * dx + dy * dy <= r_sqrd) {
+      bits[i / 64] |= uint64_t{1} << (i % 64);
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Number of rows of a which the pairwise kernels compute at a time
+constexpr auto kPairwiseRows = size_t{4};
+
+// out[i * stride + j] is the squared distance between point i of a
+// and point j of b
+inline auto pairwise_squared_distances_generic(const float* axs, const float* ays, size_t na,
+                                               const float* bxs, const float* bys, size_t nb,
+                                               float* out, size_t stride) -> void {
+  for (size_t i = 0; i < na; ++i) {
+    squared_distances_generic(bxs, bys, nb, axs[i], ays[i], out + i * stride);
+  }
+}
+
+#if CPU_DISPATCH_ENABLED
+
+TARGET_AVX2 inline auto squared_distances_avx2(const float* xs, const float* ys, size_t n,
+                                               float qx, float qy, float* out) -> void {
+  const auto vqx = _mm256_set1_ps(qx);
+  const auto vqy = _mm256_set1_ps(qy);
+  auto i = size_t{0};
+  for (; i + 8 <= n; i += 8) {
+    const auto dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), vqx);
+    const auto dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), vqy);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+  }
+  squared_distances_generic(xs + i, ys + i, n - i, qx, qy, out + i);
+}
+
+// Each lane keeps its nearest point, and the lanes are reduced at the
+// end. Lanes only replace on a strictly smaller distance, and the
+// reduction prefers the smaller index, so the first nearest is found.
+TARGET_AVX2 inline auto nearest_avx2(const float* xs, const float* ys, size_t n, float qx,
+                                     float qy) -> size_t {
+  const auto vqx = _mm256_set1_ps(qx);
+  const auto vqy = _mm256_set1_ps(qy);
+  auto best_dist = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  auto best_index = _mm256_set1_epi32(-1);
+  auto index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const auto step = _mm256_set1_epi32(8);
+  auto i = size_t{0};
+  for (; i + 8 <= n; i += 8) {
+    const auto dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), vqx);
+    const auto dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), vqy);
+    const auto d = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    const auto less = _mm256_cmp_ps(d, best_dist, _CMP_LT_OQ);
+    best_dist = _mm256_blendv_ps(best_dist, d, less);
+    best_index = _mm256_castps_si256(_mm256_blendv_ps(
+      _mm256_castsi256_ps(best_index), _mm256_castsi256_ps(index), less));
+    index = _mm256_add_epi32(index, step);
+  }
+  alignas(32) float dists[8];
+  alignas(32) int32_t indices[8];
+  _mm256_store_ps(dists, best_dist);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(indices), best_index);
+  auto best = n;
+  auto best_d = std::numeric_limits<float>::infinity();
+  for (auto lane = 0; lane < 8; ++lane) {
+    const auto j = static_cast<size_t>(indices[lane]);
+    if (indices[lane] >= 0 && (dists[lane] < best_d || (dists[lane] == best_d && j < best))) {
+      best = j;
+      best_d = dists[lane];
+    }
+  }
+  const auto tail = nearest_generic(xs + i, ys + i, n - i, qx, qy);
+  if (tail != n - i) {
+    const auto dx = xs[i + tail] - qx;
+    const auto dy = ys[i + tail] - qy;
+    if (dx * dx + dy * dy < best_d) {
+      best = i + tail;
+    }
+  }
+  // No point had a distance below infinity
+  return best != n ? best : nearest_generic(xs, ys, n, qx, qy);
+}
+
+TARGET_AVX2 inline auto within_radius_avx2(const float* xs, const float* ys, size_t n, float qx,
+                                           float qy, float r_sqrd, uint64_t* bits) -> size_t {
+  const auto vqx = _mm256_set1_ps(qx);
+  const auto vqy = _mm256_set1_ps(qy);
+  const auto vr = _mm256_set1_ps(r_sqrd);
+  auto count = size_t{0};
+  auto i = size_t{0};
+  for (; i + 8 <= n; i += 8) {
+    const auto dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), vqx);
+    const auto dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), vqy);
+    const auto d = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    const auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(d, vr, _CMP_LE_OQ)));
+    // i is a multiple of 8, so the 8 bits never straddle two words
+    bits[i / 64] |= uint64_t{mask} << (i % 64);
+    count += static_cast<size_t>(_mm_popcnt_u32(mask));
+  }
+  for (; i < n; ++i) {
+    const auto dx = xs[i] - qx;
+    const auto dy = ys[i] - qy;
+    if (dx * dx + dy * dy <= r_sqrd) {
+      bits[i / 64] |= uint64_t{1} << (i % 64);
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Computes kPairwiseRows rows at a time, with the points of a in
+// registers, and the rows which are left one at a time
+TARGET_AVX2 inline auto pairwise_squared_distances_avx2(const float* axs, const float* ays,
+                                                        size_t na, const float* bxs,
+                                                        const float* bys, size_t nb, float* out,
+                                                        size_t stride) -> void {
+  auto i = size_t{0};
+  for (; i + kPairwiseRows <= na; i += kPairwiseRows) {
+    __m256 ax[kPairwiseRows];
+    __m256 ay[kPairwiseRows];
+    for (size_t r = 0; r < kPairwiseRows; ++r) {
+      ax[r] = _mm256_set1_ps(axs[i + r]);
+      ay[r] = _mm256_set1_ps(ays[i + r]);
+    }
+    auto j = size_t{0};
+    for (; j + 8 <= nb; j += 8) {
+      const auto bx = _mm256_loadu_ps(bxs + j);
+      const auto by = _mm256_loadu_ps(bys + j);
+      for (size_t r = 0; r < kPairwiseRows; ++r) {
+        const auto dx = _mm256_sub_ps(bx, ax[r]);
+        const auto dy = _mm256_sub_ps(by, ay[r]);
+        _mm256_storeu_ps(out + (i + r) * stride + j,
+                         _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+      }
+    }
+    for (size_t r = 0; r < kPairwiseRows; ++r) {
+      squared_distances_generic(bxs + j, bys + j, nb - j, axs[i + r], ays[i + r],
+                                out + (i + r) * stride + j);
+    }
+  }
+  for (; i < na; ++i) {
+    squared_distances_avx2(bxs, bys, nb, axs[i], ays[i], out + i * stride);
+  }
+}
+
+// The AVX-512 kernels load the tail with a mask instead of a scalar
+// loop
+
+TARGET_AVX512 inline auto tail_mask16(size_t remaining) -> __mmask16 {
+  return static_cast<__mmask16>(remaining >= 16 ? 0xffff : (1u << remaining) - 1);
+}
+
+TARGET_AVX512 inline auto squared_distances_avx512(const float* xs, const float* ys, size_t n,
+                                                   float qx, float qy, float* out) -> void {
+  const auto vqx = _mm512_set1_ps(qx);
+  const auto vqy = _mm512_set1_ps(qy);
+  for (size_t i = 0; i < n; i += 16) {
+    const auto m = tail_mask16(n - i);
+    const auto dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, xs + i), vqx);
+    const auto dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, ys + i), vqy);
+    _mm512_mask_storeu_ps(out + i, m, _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)));
+  }
+}
+
+// Minimum of the lanes. Each step takes the minimum with the other
+// half of the lanes. _mm512_reduce_min_ps() and
+// _mm512_mask_reduce_min_epu32() do the same, but they and the
+// unmasked shuffles and minimums make GCC warn about an uninitialized
+// variable in its headers, so all the steps are masked.
+TARGET_AVX512 inline auto min_lane(__m512 v) -> float {
+  constexpr auto all = __mmask16{0xffff};
+  v = _mm512_maskz_min_ps(all, v, _mm512_maskz_shuffle_f32x4(all, v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm512_maskz_min_ps(all, v, _mm512_maskz_shuffle_f32x4(all, v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  v = _mm512_maskz_min_ps(all, v, _mm512_maskz_permute_ps(all, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm512_maskz_min_ps(all, v, _mm512_maskz_permute_ps(all, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm512_cvtss_f32(v);
+}
+
+TARGET_AVX512 inline auto min_lane_epu32(__m512i v) -> uint32_t {
+  constexpr auto all = __mmask16{0xffff};
+  v = _mm512_maskz_min_epu32(all, v, _mm512_maskz_shuffle_i32x4(all, v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm512_maskz_min_epu32(all, v, _mm512_maskz_shuffle_i32x4(all, v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  v = _mm512_maskz_min_epu32(all, v, _mm512_maskz_shuffle_epi32(all, v, _MM_PERM_BADC));
+  v = _mm512_maskz_min_epu32(all, v, _mm512_maskz_shuffle_epi32(all, v, _MM_PERM_CDAB));
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm512_maskz_extracti32x4_epi32(0xf, v, 0)));
+}
+
+TARGET_AVX512 inline auto nearest_avx512(const float* xs, const float* ys, size_t n, float qx,
+                                         float qy) -> size_t {
+  const auto vqx = _mm512_set1_ps(qx);
+  const auto vqy = _mm512_set1_ps(qy);
+  auto best_dist = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+  auto best_index = _mm512_set1_epi32(-1);
+  auto index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const auto step = _mm512_set1_epi32(16);
+  for (size_t i = 0; i < n; i += 16) {
+    const auto m = tail_mask16(n - i);
+    const auto dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, xs + i), vqx);
+    const auto dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, ys + i), vqy);
+    const auto d = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+    const auto less = _mm512_mask_cmp_ps_mask(m, d, best_dist, _CMP_LT_OQ);
+    best_dist = _mm512_mask_mov_ps(best_dist, less, d);
+    best_index = _mm512_mask_mov_epi32(best_index, less, index);
+    index = _mm512_add_epi32(index, step);
+  }
+  // Lanes which never found a point keep index -1, which is the
+  // largest unsigned index, so the minimum index among the lanes
+  // with the minimum distance is the first nearest point
+  const auto min_dist = min_lane(best_dist);
+  const auto at_min = _mm512_cmp_ps_mask(best_dist, _mm512_set1_ps(min_dist), _CMP_EQ_OQ);
+  const auto min_index =
+    min_lane_epu32(_mm512_mask_mov_epi32(_mm512_set1_epi32(-1), at_min, best_index));
+  if (at_min == 0 || min_index == std::numeric_limits<uint32_t>::max()) {
+    // No point had a distance below infinity
+    return nearest_generic(xs, ys, n, qx, qy);
+  }
+  return min_index;
+}
+
+TARGET_AVX512 inline auto pairwise_squared_distances_avx512(const float* axs, const float* ays,
+                                                            size_t na, const float* bxs,
+                                                            const float* bys, size_t nb,
+                                                            float* out, size_t stride) -> void {
+  auto i = size_t{0};
+  for (; i + kPairwiseRows <= na; i += kPairwiseRows) {
+    __m512 ax[kPairwiseRows];
+    __m512 ay[kPairwiseRows];
+    for (size_t r = 0; r < kPairwiseRows; ++r) {
+      ax[r] = _mm512_set1_ps(axs[i + r]);
+      ay[r] = _mm512_set1_ps(ays[i + r]);
+    }
+    for (size_t j = 0; j < nb; j += 16) {
+      const auto m = tail_mask16(nb - j);
+      const auto bx = _mm512_maskz_loadu_ps(m, bxs + j);
+      const auto by = _mm512_maskz_loadu_ps(m, bys + j);
+      for (size_t r = 0; r < kPairwiseRows; ++r) {
+        const auto dx = _mm512_sub_ps(bx, ax[r]);
+        const auto dy = _mm512_sub_ps(by, ay[r]);
+        _mm512_mask_storeu_ps(out + (i + r) * stride + j, m,
+                              _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)));
+      }
+    }
+  }
+  for (; i < na; ++i) {
+    squared_distances_avx512(bxs, bys, nb, axs[i], ays[i], out + i * stride);
+  }
+}
+
+TARGET_AVX512 inline auto within_radius_avx512(const float* xs, const float* ys, size_t n,
+                                               float qx, float qy, float r_sqrd, uint64_t* bits)
+  -> size_t {
+  const auto vqx = _mm512_set1_ps(qx);
+  const auto vqy = _mm512_set1_ps(qy);
+  const auto vr = _mm512_set1_ps(r_sqrd);
+  auto count = size_t{0};
+  for (size_t i = 0; i < n; i += 16) {
+    const auto m = tail_mask16(n - i);
+    const auto dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, xs + i), vqx);
+    const auto dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, ys + i), vqy);
+    const auto d = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+    const auto mask = static_cast<unsigned>(_mm512_mask_cmp_ps_mask(m, d, vr, _CMP_LE_OQ));
+    bits[i / 64] |= uint64_t{mask} << (i % 64);
+    count += static_cast<size_t>(_mm_popcnt_u32(mask));
+  }
+  return count;
+}
+
+#endif // CPU_DISPATCH_ENABLED
+
+using SquaredDistancesFn = void (*)(const float*, const float*, size_t, float, float, float*);
+using NearestFn = size_t (*)(const float*, const float*, size_t, float, float);
+using WithinRadiusFn = size_t (*)(const float*, const float*, size_t, float, float, float,
+                                  uint64_t*);
+using PairwiseFn = void (*)(const float*, const float*, size_t, const float*, const float*,
+                            size_t, float*, size_t);
+
+struct Kernels {
+  SquaredDistancesFn squared_distances_{squared_distances_generic};
+  NearestFn nearest_{nearest_generic};
+  WithinRadiusFn within_radius_{within_radius_generic};
+  PairwiseFn pairwise_{pairwise_squared_distances_generic};
+};
+
+inline auto kernels() -> const Kernels& {
+  static const auto k = []() {
+    auto k = Kernels{};
+#if CPU_DISPATCH_ENABLED
+    const auto& cpu = cpu_features();
+    if (cpu.avx512_) {
+      k = Kernels{squared_distances_avx512, nearest_avx512, within_radius_avx512,
+                  pairwise_squared_distances_avx512};
+    } else if (cpu.avx2_) {
+      k = Kernels{squared_distances_avx2, nearest_avx2, within_radius_avx2,
+                  pairwise_squared_distances_avx2};
+    }
+#endif
+    return k;
+  }();
+  return k;
+}
+
+} // namespace dist_detail
+
+// out[i] is the squared distance from (qx, qy) to (xs[i], ys[i])
+inline auto squared_distances(const float* xs, const float* ys, size_t n, float qx, float qy,
+                              float* out) -> void {
+  dist_detail::kernels().squared_distances_(xs, ys, n, qx, qy, out);
+}
+
+// Index of the first point nearest to (qx, qy), or n if there are
+// no points or all distances are NaN. The SIMD kernels keep indices
+// in 32-bit lanes, so n must be less than 2^31.
+inline auto nearest(const float* xs, const float* ys, size_t n, float qx, float qy) -> size_t {
+  return dist_detail::kernels().nearest_(xs, ys, n, qx, qy);
+}
+
+// Number of words needed by within_radius() for n points
+constexpr auto radius_mask_words(size_t n) { return (n + 63) / 64; }
+
+// Sets bit i % 64 of bits[i / 64] for each point at a distance of at
+// most r from (qx, qy), and returns the number of such points. The
+// other bits are cleared.
+inline auto within_radius(const float* xs, const float* ys, size_t n, float qx, float qy,
+                          float r, uint64_t* bits) -> size_t {
+  for (size_t w = 0; w < radius_mask_words(n); ++w) {
+    bits[w] = 0;
+  }
+  if (!(r >= 0.0f)) {
+    return 0;
+  }
+  return dist_detail::kernels().within_radius_(xs, ys, n, qx, qy, r * r, bits);
+}
+
+// out[i * nb + j] is the squared distance between point i of a and
+// point j of b. The columns are computed one tile of b at a time, so
+// that the tile stays in the L1 cache while every row of a uses it.
+inline auto pairwise_squared_distances(const float* axs, const float* ays, size_t na,
+                                       const float* bxs, const float* bys, size_t nb, float* out)
+  -> void {
+  // 8 KiB of coordinates, and 16 KiB of the rows being written
+  constexpr auto kTileColumns = size_t{1024};
+  const auto kernel = dist_detail::kernels().pairwise_;
+  for (size_t j = 0; j < nb; j += kTileColumns) {
+    kernel(axs, ays, na, bxs + j, bys + j, std::min(kTileColumns, nb - j), out + j, nb);
+  }
+}
+
+} // namespace spatial
+
+#endif
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "kd_tree.hpp"
+#include "scooped_timer.h"
+
+//
+// This example compares nearest neighbour and radius queries in a
+// KdTree with brute force searches, which compute the squared
+// distance to every point.
+//
+
+namespace {
+
+// Number of points in the benchmark. Increase if you want more.
+constexpr auto kNumPoints = size_t{1'000'000};
+constexpr auto kNumQueries = size_t{500};
+constexpr auto kNumNeighbors = size_t{10};
+
+auto random_points(size_t n, float min_value, float max_value, std::mt19937& gen) {
+  auto dist = std::uniform_real_distribution<float>{min_value, max_value};
+  auto points = std::vector<spatial::Point>(n);
+  for (auto& p : points) {
+    p = spatial::Point{dist(gen), dist(gen)};
+  }
+  return points;
+}
+
+auto all_distances(const std::vector<spatial::Point>& points, const spatial::Point& q) {
+  auto result = std::vector<spatial::Neighbor>(points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    const auto dx = points[i].x - q.x;
+    const auto dy = points[i].y - q.y;
+    result[i] = {static_cast<uint32_t>(i), dx * dx + dy * dy};
+  }
+  return result;
+}
+
+auto brute_force_knn(const std::vector<spatial::Point>& points, const spatial::Point& q,
+                     size_t k) {
+  auto result = all_distances(points, q);
+  k = std::min(k, result.size());
+  std::partial_sort(result.begin(), result.begin() + k, result.end());
+  result.resize(k);
+  return result;
+}
+
+auto brute_force_radius(const std::vector<spatial::Point>& points, const spatial::Point& q,
+                        float r) {
+  auto result = all_distances(points, q);
+  result.erase(std::remove_if(result.begin(), result.end(),
+                              [r](const spatial::Neighbor& n) { return n.dist_sqrd_ > r * r; }),
+               result.end());
+  return result;
+}
+
+// Ties may be ordered differently, so only the distances are compared
+auto expect_same_distances(const std::vector<spatial::Neighbor>& expected,
+                           std::vector<spatial::Neighbor> actual) {
+  std::sort(actual.begin(), actual.end());
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_FLOAT_EQ(expected[i].dist_sqrd_, actual[i].dist_sqrd_);
+  }
+}
+
+} // namespace
+
+TEST(KdTree, KnnSameAsBruteForce) {
+  auto gen = std::mt19937{};
+  for (auto n : {0, 1, 31, 32, 33, 100, 1000, 10000}) {
+    const auto points = random_points(n, -100.0f, 100.0f, gen);
+    const auto tree = spatial::KdTree{points};
+    for (const auto& q : random_points(50, -150.0f, 150.0f, gen)) {
+      for (auto k : {1, 5, 40}) {
+        const auto result = tree.knn(q, k);
+        ASSERT_TRUE(std::is_sorted(result.begin(), result.end()));
+        expect_same_distances(brute_force_knn(points, q, k), result);
+      }
+    }
+  }
+}
+
+TEST(KdTree, RadiusSameAsBruteForce) {
+  auto gen = std::mt19937{};
+  const auto points = random_points(20000, -100.0f, 100.0f, gen);
+  const auto tree = spatial::KdTree{points};
+  for (const auto& q : random_points(50, -150.0f, 150.0f, gen)) {
+    for (auto r : {0.0f, 1.0f, 10.0f, 60.0f}) {
+      auto expected = brute_force_radius(points, q, r);
+      std::sort(expected.begin(), expected.end());
+      expect_same_distances(expected, tree.radius(q, r));
+    }
+  }
+  ASSERT_TRUE(tree.radius({0, 0}, -1.0f).empty());
+}
+
+TEST(KdTree, DuplicatePoints) {
+  // Many equal coordinates end up on both sides of the splits
+  auto points = std::vector<spatial::Point>(1000, spatial::Point{1.0f, 2.0f});
+  for (size_t i = 0; i < points.size(); i += 3) {
+    points[i].x = static_cast<float>(i % 7);
+  }
+  const auto tree = spatial::KdTree{points};
+  const auto q = spatial::Point{1.0f, 2.0f};
+  expect_same_distances(brute_force_knn(points, q, 700), tree.knn(q, 700));
+  ASSERT_EQ(points.size(), tree.knn(q, 5000).size());
+  auto expected = brute_force_radius(points, q, 0.0f);
+  std::sort(expected.begin(), expected.end());
+  expect_same_distances(expected, tree.radius(q, 0.0f));
+}
+
+TEST(KdTree, DistanceIsSquareRoot) {
+  const auto points = std::vector<spatial::Point>{{23, 42}, {33, 12}};
+  const auto nearest = spatial::KdTree{points}.knn({31, 11}, 1);
+  ASSERT_EQ(1u, nearest.size());
+  ASSERT_EQ(1u, nearest[0].index_);
+  ASSERT_FLOAT_EQ(5.0f, nearest[0].dist_sqrd_);
+  ASSERT_FLOAT_EQ(std::sqrt(5.0f), nearest[0].distance());
+}
+
+TEST(KdTree, CompareWithBruteForce) {
+  auto gen = std::mt19937{};
+  const auto points = random_points(kNumPoints, 0.0f, 1000.0f, gen);
+  const auto queries = random_points(kNumQueries, 0.0f, 1000.0f, gen);
+  std::cout << kNumPoints << " points, " << kNumQueries << " queries" << '\n';
+  auto tree = std::unique_ptr<spatial::KdTree>{};
+  {
+    ScopedTimer timer{"build k-d tree"};
+    tree = std::make_unique<spatial::KdTree>(points);
+  }
+  auto sum_brute = 0.0;
+  {
+    ScopedTimer timer{"knn, brute force"};
+    for (const auto& q : queries) {
+      sum_brute += brute_force_knn(points, q, kNumNeighbors).back().dist_sqrd_;
+    }
+  }
+  auto sum_tree = 0.0;
+  {
+    ScopedTimer timer{"knn, k-d tree"};
+    for (const auto& q : queries) {
+      sum_tree += tree->knn(q, kNumNeighbors).back().dist_sqrd_;
+    }
+  }
+  // The SIMD kernels may round differently, for example with FMA
+  ASSERT_NEAR(sum_brute, sum_tree, sum_brute * 1e-6);
+
+  auto count_brute = size_t{0};
+  {
+    ScopedTimer timer{"radius, brute force"};
+    for (const auto& q : queries) {
+      count_brute += brute_force_radius(points, q, 5.0f).size();
+    }
+  }
+  auto count_tree = size_t{0};
+  {
+    ScopedTimer timer{"radius, k-d tree"};
+    for (const auto& q : queries) {
+      count_tree += tree->radius(q, 5.0f).size();
+    }
+  }
+  ASSERT_EQ(count_brute, count_tree);
+}
@@ -0,0 +1,226 @@
+#pragma once
+#ifndef KD_TREE_HPP
+#define KD_TREE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+#include "distance_kernels.hpp"
+
+//
+// A static k-d tree of 2D points for nearest neighbour and radius
+// queries.
+//
+// The nodes are stored in one array in depth-first order, so the
+// left child of a node is the next node and only the right child
+// needs an index. The points are reordered so that each leaf is a
+// contiguous range of a structure of arrays, which the leaf scan
+// reads with squared_distances() from distance_kernels.hpp.
+//
+// Like DistProxy in distance_proxy.cpp, all comparisons are made on
+// squared distances, and a square root is only taken if the caller
+// asks a Neighbor for its distance().
+//
+
+namespace spatial {
+
+struct Point {
+  float x{};
+  float y{};
+};
+
+struct Neighbor {
+  uint32_t index_{}; // Index of the point in the array passed to KdTree
+  float dist_sqrd_{};
+  auto distance() const { return std::sqrt(dist_sqrd_); }
+  auto operator<(const Neighbor& n) const { return dist_sqrd_ < n.dist_sqrd_; }
+};
+
+class KdTree {
+public:
+  // Maximum number of points in a leaf
+  static constexpr auto kLeafSize = size_t{32};
+  // Subtrees smaller than this are built by the calling thread
+  static constexpr auto kParallelBuildSize = size_t{1} << 16;
+
+  // Throws if there are too many points for the 32-bit indices
+  explicit KdTree(const std::vector<Point>& points) : size_{points.size()} {
+    if (size_ > std::numeric_limits<uint32_t>::max()) {
+      throw std::length_error("Too many points for a KdTree");
+    }
+    auto order = std::vector<uint32_t>(size_);
+    std::iota(order.begin(), order.end(), uint32_t{0});
+    nodes_.resize(num_nodes(size_));
+    build(points, order.data(), 0, size_, 0);
+    xs_.resize(size_);
+    ys_.resize(size_);
+    ids_ = std::move(order);
+    for (size_t i = 0; i < size_; ++i) {
+      xs_[i] = points[ids_[i]].x;
+      ys_[i] = points[ids_[i]].y;
+    }
+  }
+
+  auto size() const noexcept { return size_; }
+
+  // The k points nearest to q, nearest first. Points at the same
+  // distance are ordered arbitrarily.
+  auto knn(const Point& q, size_t k) const -> std::vector<Neighbor> {
+    auto heap = std::priority_queue<Neighbor>{};
+    if (k == 0 || size_ == 0) {
+      return {};
+    }
+    float buffer[kLeafSize];
+    const auto worst = [&] {
+      return heap.size() < k ? std::numeric_limits<float>::infinity() : heap.top().dist_sqrd_;
+    };
+    visit(q, worst, [&](size_t first, size_t n) {
+      squared_distances(xs_.data() + first, ys_.data() + first, n, q.x, q.y, buffer);
+      for (size_t i = 0; i < n; ++i) {
+        if (heap.size() < k) {
+          heap.push({ids_[first + i], buffer[i]});
+        } else if (buffer[i] < heap.top().dist_sqrd_) {
+          heap.pop();
+          heap.push({ids_[first + i], buffer[i]});
+        }
+      }
+    });
+    auto result = std::vector<Neighbor>(heap.size());
+    for (auto i = result.size(); i > 0; --i) {
+      result[i - 1] = heap.top();
+      heap.pop();
+    }
+    return result;
+  }
+
+  // All points at a distance of at most r from q, in no particular
+  // order
+  auto radius(const Point& q, float r) const -> std::vector<Neighbor> {
+    auto result = std::vector<Neighbor>{};
+    if (size_ == 0 || !(r >= 0.0f)) {
+      return result;
+    }
+    float buffer[kLeafSize];
+    const auto r_sqrd = r * r;
+    visit(q, [r_sqrd] { return std::nextafter(r_sqrd, std::numeric_limits<float>::infinity()); },
+          [&](size_t first, size_t n) {
+            squared_distances(xs_.data() + first, ys_.data() + first, n, q.x, q.y, buffer);
+            for (size_t i = 0; i < n; ++i) {
+              if (buffer[i] <= r_sqrd) {
+                result.push_back({ids_[first + i], buffer[i]});
+              }
+            }
+          });
+    return result;
+  }
+
+private:
+  struct Node {
+    float split_{};
+    uint32_t first_{}; // Range of points in the subtree
+    uint32_t last_{};
+    uint32_t right_{}; // Index of the right child, 0 for leaves
+    uint32_t axis_{};
+  };
+
+  // Number of nodes of a subtree of n points, so that the subtrees
+  // built in parallel can write to their own part of the node array
+  static auto num_nodes(size_t n) -> size_t {
+    if (n <= kLeafSize) {
+      return 1;
+    }
+    return 1 + num_nodes(n / 2) + num_nodes(n - n / 2);
+  }
+
+  auto build(const std::vector<Point>& points, uint32_t* order, size_t first, size_t last,
+             size_t node) -> void {
+    auto& nd = nodes_[node];
+    nd.first_ = static_cast<uint32_t>(first);
+    nd.last_ = static_cast<uint32_t>(last);
+    const auto n = last - first;
+    if (n <= kLeafSize) {
+      return;
+    }
+    // Splits the axis where the points are spread the most
+    auto min_x = std::numeric_limits<float>::infinity();
+    auto min_y = min_x;
+    auto max_x = -min_x;
+    auto max_y = -min_x;
+    for (auto i = first; i < last; ++i) {
+      const auto& p = points[order[i]];
+      min_x = std::min(min_x, p.x);
+      max_x = std::max(max_x, p.x);
+      min_y = std::min(min_y, p.y);
+      max_y = std::max(max_y, p.y);
+    }
+    nd.axis_ = max_y - min_y > max_x - min_x ? 1 : 0;
+    const auto coord = [&points, axis = nd.axis_](uint32_t i) {
+      return axis == 0 ? points[i].x : points[i].y;
+    };
+    const auto middle = first + n / 2;
+    std::nth_element(order + first, order + middle, order + last,
+                     [&](uint32_t a, uint32_t b) { return coord(a) < coord(b); });
+    nd.split_ = coord(order[middle]);
+    nd.right_ = static_cast<uint32_t>(node + 1 + num_nodes(n / 2));
+    const auto right = nd.right_;
+    if (n >= kParallelBuildSize) {
+      // Without std::launch::async the subtree may be built by this
+      // thread when it waits, after the other half
+      auto future = std::async(std::launch::async,
+                               [=, &points] { build(points, order, first, middle, node + 1); });
+      build(points, order, middle, last, right);
+      future.wait();
+    } else {
+      build(points, order, first, middle, node + 1);
+      build(points, order, middle, last, right);
+    }
+  }
+
+  // Calls scan_leaf(first, n) for the leaves which may hold points
+  // nearer than bound(), visiting the side of q first
+  template <typename Bound, typename ScanLeaf>
+  auto visit(const Point& q, Bound&& bound, ScanLeaf&& scan_leaf) const -> void {
+    struct Pending {
+      uint32_t node_;
+      float dist_sqrd_; // Squared distance to the splitting line
+    };
+    Pending stack[64];
+    auto top = 0;
+    stack[top++] = {0, 0.0f};
+    while (top > 0) {
+      const auto pending = stack[--top];
+      if (!(pending.dist_sqrd_ < bound())) {
+        continue;
+      }
+      auto node = pending.node_;
+      while (nodes_[node].right_ != 0) {
+        const auto& nd = nodes_[node];
+        const auto diff = (nd.axis_ == 0 ? q.x : q.y) - nd.split_;
+        const auto near = diff < 0.0f ? node + 1 : nd.right_;
+        const auto far = diff < 0.0f ? nd.right_ : node + 1;
+        // The stack can't overflow as the tree depth is below 64
+        stack[top++] = {far, std::max(pending.dist_sqrd_, diff * diff)};
+        node = near;
+      }
+      const auto& leaf = nodes_[node];
+      scan_leaf(leaf.first_, leaf.last_ - leaf.first_);
+    }
+  }
+
+  size_t size_{};
+  std::vector<Node> nodes_;
+  std::vector<float> xs_;
+  std::vector<float> ys_;
+  std::vector<uint32_t> ids_;
+};
+
+} // namespace spatial
+
+#endif
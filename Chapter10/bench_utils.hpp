@@ -0,0 +1,124 @@
+#pragma once
+#ifndef BENCH_UTILS_HPP
+#define BENCH_UTILS_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <thread>
+#include <vector>
+
+//
+// Helpers for the benchmarks of this chapter's tests.
+//
+
+template <typename F>
+auto time_ms(F&& f) {
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  const auto d = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+}
+
+// The queue of producer_consumer.cpp, a std::queue guarded by a mutex
+// and condition variables, which the queues of this chapter are
+// compared with. It is unbounded unless given a capacity.
+template <typename T>
+class MutexQueue {
+public:
+  explicit MutexQueue(size_t capacity = std::numeric_limits<size_t>::max())
+    : capacity_{capacity} {}
+
+  // Blocks while the queue is full
+  auto push(const T& item) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      not_full_.wait(lock, [&] { return queue_.size() < capacity_; });
+      queue_.push(item);
+    }
+    not_empty_.notify_one();
+  }
+
+  // Blocks while the queue is empty
+  auto pop() {
+    auto item = T{};
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      not_empty_.wait(lock, [&] { return !queue_.empty(); });
+      item = queue_.front();
+      queue_.pop();
+    }
+    not_full_.notify_one();
+    return item;
+  }
+
+  auto try_push(const T& item) -> bool {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (queue_.size() >= capacity_) {
+        return false;
+      }
+      queue_.push(item);
+    }
+    not_empty_.notify_one();
+    return true;
+  }
+
+  auto try_pop(T& item) -> bool {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (queue_.empty()) {
+        return false;
+      }
+      item = queue_.front();
+      queue_.pop();
+    }
+    not_full_.notify_one();
+    return true;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::queue<T> queue_;
+  size_t capacity_{};
+};
+
+// Runs num_threads producers, which call push(first, last) with their
+// share of 0, 1, ..., num_items - 1, and as many consumers, which call
+// pop(count) with the number of items of one producer and return the
+// sum of what they popped. stop() is called once the producers are
+// done, to let the consumers know. Returns the sum of all consumers.
+template <typename Push, typename Pop, typename Stop>
+auto run_producers_and_consumers(int num_threads, int num_items, Push&& push, Pop&& pop,
+                                 Stop&& stop) {
+  auto producers = std::vector<std::thread>{};
+  auto consumers = std::vector<std::thread>{};
+  auto sums = std::vector<long long>(num_threads);
+  for (auto t = 0; t < num_threads; ++t) {
+    const auto first = num_items / num_threads * t;
+    const auto last = t + 1 == num_threads ? num_items : first + num_items / num_threads;
+    producers.emplace_back([=, &push] { push(first, last); });
+    consumers.emplace_back([=, &pop, &sums] { sums[t] = pop(last - first); });
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  stop();
+  for (auto& t : consumers) {
+    t.join();
+  }
+  return std::accumulate(sums.begin(), sums.end(), 0ll);
+}
+
+template <typename Push, typename Pop>
+auto run_producers_and_consumers(int num_threads, int num_items, Push&& push, Pop&& pop) {
+  return run_producers_and_consumers(num_threads, num_items, push, pop, [] {});
+}
+
+#endif
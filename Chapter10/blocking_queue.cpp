@@ -0,0 +1,207 @@
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "bench_utils.hpp"
+#include "blocking_queue.hpp"
+
+//
+// This example passes ints from producer threads to consumer threads
+// through BlockingQueue, in batches of various sizes, and compares it
+// with one mutex and condition variable as in producer_consumer.cpp,
+// where every item takes the lock and notifies the consumer.
+//
+
+namespace {
+
+// Number of items passed in each run. Increase if you want more.
+constexpr auto kNumItems = 1'000'000;
+constexpr auto kNumThreads = 2; // Producers, and as many consumers
+constexpr auto kCapacity = size_t{4096};
+
+// Tells the consumers of a MutexQueue that there are no more items
+constexpr auto kDone = -1;
+
+// Passes the items in batches of batch_size through a queue with the
+// given capacity. Batches of 1 use push() and pop().
+auto run_batches(size_t capacity, size_t batch_size) {
+  auto q = BlockingQueue<int>{capacity};
+  return run_producers_and_consumers(
+    kNumThreads, kNumItems,
+    [&](int first, int last) {
+      if (batch_size == 1) {
+        for (auto i = first; i < last; ++i) {
+          q.push(i);
+        }
+        return;
+      }
+      auto batch = std::vector<int>(batch_size);
+      for (auto i = first; i < last; i += static_cast<int>(batch_size)) {
+        const auto n = std::min<size_t>(batch_size, last - i);
+        std::iota(batch.begin(), batch.begin() + n, i);
+        q.push_batch(batch.begin(), batch.begin() + n);
+      }
+    },
+    [&](int) {
+      auto sum = 0ll;
+      if (batch_size == 1) {
+        while (const auto item = q.pop()) {
+          sum += *item;
+        }
+        return sum;
+      }
+      auto batch = std::vector<int>{};
+      while (q.pop_all(batch, batch_size) != 0) {
+        sum = std::accumulate(batch.begin(), batch.end(), sum);
+        batch.clear();
+      }
+      return sum;
+    },
+    [&] { q.close(); });
+}
+
+} // namespace
+
+TEST(BlockingQueue, PushAndPop) {
+  auto q = BlockingQueue<int>{};
+  ASSERT_FALSE(q.try_pop());
+  for (auto i = 0; i < 5; ++i) {
+    ASSERT_TRUE(q.push(i));
+  }
+  ASSERT_EQ(5u, q.size());
+  for (auto i = 0; i < 5; ++i) {
+    ASSERT_EQ(i, q.pop());
+  }
+  ASSERT_FALSE(q.try_pop());
+}
+
+TEST(BlockingQueue, CloseDrainsRemainingItems) {
+  auto q = BlockingQueue<std::unique_ptr<int>>{};
+  ASSERT_TRUE(q.push(std::make_unique<int>(1)));
+  ASSERT_TRUE(q.push(std::make_unique<int>(2)));
+  q.close();
+  ASSERT_TRUE(q.closed());
+  ASSERT_FALSE(q.push(std::make_unique<int>(3)));
+  ASSERT_FALSE(q.try_push(std::make_unique<int>(3)));
+  ASSERT_EQ(1, **q.pop());
+  ASSERT_EQ(2, **q.pop());
+  ASSERT_FALSE(q.pop());
+  auto out = std::vector<std::unique_ptr<int>>{};
+  ASSERT_EQ(0u, q.pop_all(out));
+}
+
+TEST(BlockingQueue, CloseWakesConsumers) {
+  auto q = BlockingQueue<int>{};
+  auto consumer = std::thread{[&q] {
+    auto popped = std::vector<int>{};
+    while (auto item = q.pop()) {
+      popped.push_back(*item);
+    }
+    ASSERT_EQ(std::vector<int>({1, 2, 3}), popped);
+  }};
+  for (auto i : {1, 2, 3}) {
+    q.push(i);
+  }
+  q.close();
+  consumer.join();
+}
+
+TEST(BlockingQueue, Batches) {
+  auto q = BlockingQueue<int>{};
+  auto in = std::vector<int>(10);
+  std::iota(in.begin(), in.end(), 0);
+  ASSERT_EQ(10u, q.push_batch(in.begin(), in.end()));
+  auto out = std::vector<int>{};
+  ASSERT_EQ(4u, q.pop_all(out, 4));
+  ASSERT_EQ(6u, q.pop_all(out));
+  ASSERT_EQ(in, out);
+}
+
+TEST(BlockingQueue, BoundedCapacityBlocksProducer) {
+  auto q = BlockingQueue<int>{3};
+  ASSERT_EQ(3u, q.capacity());
+  for (auto i = 0; i < 3; ++i) {
+    ASSERT_TRUE(q.try_push(i));
+  }
+  ASSERT_FALSE(q.try_push(3));
+  // The producer can only push a batch of 10 as the consumer makes room
+  auto producer = std::thread{[&q] {
+    auto in = std::vector<int>(10);
+    std::iota(in.begin(), in.end(), 3);
+    ASSERT_EQ(10u, q.push_batch(in.begin(), in.end()));
+    q.close();
+  }};
+  auto out = std::vector<int>{};
+  while (q.pop_all(out, 2) != 0) {
+    ASSERT_LE(q.size(), 3u);
+  }
+  producer.join();
+  auto expected = std::vector<int>(13);
+  std::iota(expected.begin(), expected.end(), 0);
+  ASSERT_EQ(expected, out);
+}
+
+TEST(BlockingQueue, CloseWakesBlockedProducer) {
+  auto q = BlockingQueue<int>{1};
+  ASSERT_TRUE(q.push(0));
+  auto producer = std::thread{[&q] { ASSERT_FALSE(q.push(1)); }};
+  q.close();
+  producer.join();
+  ASSERT_EQ(0, q.pop());
+  ASSERT_FALSE(q.pop());
+}
+
+TEST(BlockingQueue, ManyProducersAndConsumers) {
+  const auto expected = static_cast<long long>(kNumItems) * (kNumItems - 1) / 2;
+  ASSERT_EQ(expected, run_batches(16, 1));
+  ASSERT_EQ(expected, run_batches(16, 7));
+  ASSERT_EQ(expected, run_batches(BlockingQueue<int>::kUnbounded, 100));
+}
+
+TEST(BlockingQueue, CompareWithMutexAndConditionVariable) {
+  const auto expected = static_cast<long long>(kNumItems) * (kNumItems - 1) / 2;
+  std::cout << "ms for " << kNumItems << " items, " << kNumThreads << " producers and "
+            << kNumThreads << " consumers" << '\n';
+  {
+    auto q = MutexQueue<int>{};
+    auto sum = 0ll;
+    const auto ms = time_ms([&] {
+      sum = run_producers_and_consumers(
+        kNumThreads, kNumItems,
+        [&](int first, int last) {
+          for (auto i = first; i < last; ++i) {
+            q.push(i);
+          }
+        },
+        [&](int) {
+          auto s = 0ll;
+          for (auto i = q.pop(); i != kDone; i = q.pop()) {
+            s += i;
+          }
+          return s;
+        },
+        [&] {
+          for (auto t = 0; t < kNumThreads; ++t) {
+            q.push(kDone);
+          }
+        });
+    });
+    ASSERT_EQ(expected, sum);
+    std::cout << std::setw(6) << ms << " mutex+cv, one item at a time" << '\n';
+  }
+  std::cout << std::setw(12) << "batch size" << std::setw(12) << "unbounded" << std::setw(10)
+            << "bounded" << '\n';
+  for (auto batch_size : {1, 8, 64, 512}) {
+    auto sum = 0ll;
+    const auto unbounded_ms =
+      time_ms([&] { sum = run_batches(BlockingQueue<int>::kUnbounded, batch_size); });
+    ASSERT_EQ(expected, sum);
+    const auto bounded_ms = time_ms([&] { sum = run_batches(kCapacity, batch_size); });
+    ASSERT_EQ(expected, sum);
+    std::cout << std::setw(12) << batch_size << std::setw(12) << unbounded_ms << std::setw(10)
+              << bounded_ms << '\n';
+  }
+}
@@ -0,0 +1,222 @@
+#pragma once
+#ifndef BLOCKING_QUEUE_HPP
+#define BLOCKING_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "cache_line.hpp"
+#include "parking.hpp"
+
+//
+// A queue for producer and consumer threads which blocks consumers
+// while it's empty, and producers while it's full if it has a
+// capacity.
+//
+// Compared to the mutex and condition variable in
+// producer_consumer.cpp:
+// - Waiting threads spin briefly before they park on a futex, and
+//   producers only make a system call when a consumer is parked.
+//   Each item wakes one parked consumer rather than all of them.
+// - push_batch() and pop_all() move many items per lock acquisition.
+// - close() replaces a sentinel value such as done = -1. Consumers
+//   drain the items which are left, and then pop() returns nothing.
+//
+
+template <typename T>
+class BlockingQueue {
+public:
+  static constexpr auto kUnbounded = std::numeric_limits<size_t>::max();
+
+  explicit BlockingQueue(size_t capacity = kUnbounded)
+    : capacity_{std::max<size_t>(capacity, 1)} {}
+
+  BlockingQueue(const BlockingQueue&) = delete;
+  auto operator=(const BlockingQueue&) -> BlockingQueue& = delete;
+
+  auto capacity() const noexcept { return capacity_; }
+  auto size() const noexcept { return size_.load(std::memory_order_relaxed); }
+  auto closed() const noexcept { return closed_.load(std::memory_order_acquire); }
+
+  // Blocks while the queue is full. Returns false, without pushing, if
+  // the queue is closed.
+  template <typename U>
+  auto push(U&& item) -> bool {
+    auto pushed = false;
+    not_full_.await_hinted([&] { return has_room_or_closed(); }, [&] {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (closed_.load(std::memory_order_relaxed)) {
+        return true;
+      }
+      if (items_.size() >= capacity_) {
+        return false;
+      }
+      items_.push_back(std::forward<U>(item));
+      size_.store(items_.size(), std::memory_order_relaxed);
+      pushed = true;
+      return true;
+    });
+    if (pushed) {
+      not_empty_.notify_one_locked();
+    }
+    return pushed;
+  }
+
+  template <typename U>
+  auto try_push(U&& item) -> bool {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (closed_.load(std::memory_order_relaxed) || items_.size() >= capacity_) {
+        return false;
+      }
+      items_.push_back(std::forward<U>(item));
+      size_.store(items_.size(), std::memory_order_relaxed);
+    }
+    not_empty_.notify_one_locked();
+    return true;
+  }
+
+  // Moves the items of [first, last) into the queue, as many at a time
+  // as there is room for. Blocks until all are pushed or the queue is
+  // closed, and returns the number pushed.
+  template <typename It>
+  auto push_batch(It first, It last) -> size_t {
+    auto pushed = size_t{0};
+    while (first != last) {
+      auto closed = false;
+      auto n = size_t{0};
+      not_full_.await_hinted([&] { return has_room_or_closed(); }, [&] {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (closed_.load(std::memory_order_relaxed)) {
+          closed = true;
+          return true;
+        }
+        const auto room = capacity_ - std::min(capacity_, items_.size());
+        if (room == 0) {
+          return false;
+        }
+        for (n = 0; n < room && first != last; ++n, ++first, ++pushed) {
+          items_.push_back(std::move(*first));
+        }
+        size_.store(items_.size(), std::memory_order_relaxed);
+        return true;
+      });
+      if (closed) {
+        break;
+      }
+      notify(not_empty_, n);
+    }
+    return pushed;
+  }
+
+  // Blocks while the queue is empty and open. Returns nothing once the
+  // queue is closed and drained.
+  auto pop() -> std::optional<T> {
+    auto item = std::optional<T>{};
+    not_empty_.await_hinted([&] { return has_items_or_closed(); }, [&] {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (items_.empty()) {
+        return closed_.load(std::memory_order_relaxed);
+      }
+      item.emplace(std::move(items_.front()));
+      items_.pop_front();
+      size_.store(items_.size(), std::memory_order_relaxed);
+      return true;
+    });
+    if (item) {
+      notify_not_full(1);
+    }
+    return item;
+  }
+
+  auto try_pop() -> std::optional<T> {
+    auto item = std::optional<T>{};
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (items_.empty()) {
+        return item;
+      }
+      item.emplace(std::move(items_.front()));
+      items_.pop_front();
+      size_.store(items_.size(), std::memory_order_relaxed);
+    }
+    notify_not_full(1);
+    return item;
+  }
+
+  // Blocks while the queue is empty and open, and then appends up to
+  // max_items items to out. Returns the number of items, which is 0
+  // only once the queue is closed and drained.
+  auto pop_all(std::vector<T>& out, size_t max_items = kUnbounded) -> size_t {
+    auto popped = size_t{0};
+    not_empty_.await_hinted([&] { return has_items_or_closed(); }, [&] {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (items_.empty()) {
+        return closed_.load(std::memory_order_relaxed);
+      }
+      popped = std::min(max_items, items_.size());
+      const auto last = items_.begin() + static_cast<std::ptrdiff_t>(popped);
+      out.insert(out.end(), std::make_move_iterator(items_.begin()),
+                 std::make_move_iterator(last));
+      items_.erase(items_.begin(), last);
+      size_.store(items_.size(), std::memory_order_relaxed);
+      return true;
+    });
+    if (popped != 0) {
+      notify_not_full(popped);
+    }
+    return popped;
+  }
+
+  // Rejects further pushes and wakes all waiting threads. The items in
+  // the queue can still be popped.
+  auto close() -> void {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      closed_.store(true, std::memory_order_release);
+    }
+    not_empty_.notify_all_locked();
+    not_full_.notify_all_locked();
+  }
+
+private:
+  // The waiting threads check these without the lock while spinning,
+  // and then with the lock before they park, which is what makes it
+  // safe to notify them with notify_all_locked()
+  auto has_items_or_closed() const noexcept -> bool {
+    return size() != 0 || closed();
+  }
+  auto has_room_or_closed() const noexcept -> bool {
+    return size() < capacity_ || closed();
+  }
+
+  // Wakes one waiting thread for each item, or slot, which was added
+  static auto notify(EventCount& event, size_t n) -> void {
+    event.notify_locked(static_cast<int>(std::min<size_t>(n, INT_MAX)));
+  }
+
+  auto notify_not_full(size_t n) -> void {
+    if (capacity_ != kUnbounded) {
+      notify(not_full_, n);
+    }
+  }
+
+  std::mutex mutex_;
+  std::deque<T> items_;
+  const size_t capacity_;
+  // Copies of the state for reading without the lock
+  std::atomic<size_t> size_{0};
+  std::atomic<bool> closed_{false};
+  alignas(kCacheLineSize) EventCount not_empty_;
+  alignas(kCacheLineSize) EventCount not_full_;
+};
+
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+#ifndef CACHE_LINE_HPP
+#define CACHE_LINE_HPP
+
+#include <cstddef>
+
+// Data written by different threads is aligned to this size to avoid
+// false sharing. std::hardware_destructive_interference_size would be
+// the standard way, but it is missing from many standard libraries.
+// Two lines are used as the adjacent line prefetcher of Intel CPUs
+// pulls cache lines in pairs.
+constexpr auto kCacheLineSize = size_t{128};
+
+#endif
@@ -0,0 +1,228 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <gtest/gtest.h>
+#include "concurrent_map.hpp"
+
+//
+// This example compares ConcurrentMap with a std::unordered_map
+// guarded by a std::mutex, which serializes all the threads, and by a
+// std::shared_mutex, which lets readers share the lock. Threads look
+// up and assign random keys, with 95% and 50% lookups.
+//
+
+namespace {
+
+// Number of operations by all threads in each run. Increase if you
+// want more.
+constexpr auto kNumOperations = 2'000'000;
+constexpr auto kNumKeys = 100'000;
+
+// ReadLock is std::shared_lock for a std::shared_mutex
+template <typename Mutex, template <typename> class ReadLock>
+class LockedMap {
+public:
+  auto find(int key) const -> std::optional<int> {
+    ReadLock<Mutex> lock{mutex_};
+    const auto it = map_.find(key);
+    return it != map_.end() ? std::optional<int>{it->second} : std::nullopt;
+  }
+  auto insert_or_assign(int key, int value) {
+    std::lock_guard<Mutex> lock{mutex_};
+    return map_.insert_or_assign(key, value).second;
+  }
+
+private:
+  mutable Mutex mutex_{};
+  std::unordered_map<int, int> map_{};
+};
+
+// Runs f(t, n) in num_threads threads, where the n add up to total
+template <typename F>
+auto run(int num_threads, int total, F&& f) {
+  auto threads = std::vector<std::thread>{};
+  for (auto t = 0; t < num_threads; ++t) {
+    threads.emplace_back([t, n = total / num_threads, &f] { f(t, n); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+// Returns the ms it takes num_threads threads to do kNumOperations
+// lookups and assignments of random keys, of which read_percent are
+// lookups. Half of the keys are there to begin with.
+template <typename Map>
+auto time_mix(Map& map, int num_threads, int read_percent) {
+  for (auto key = 0; key < kNumKeys; key += 2) {
+    map.insert_or_assign(key, key);
+  }
+  auto found = std::atomic<int>{0};
+  const auto start = std::chrono::steady_clock::now();
+  run(num_threads, kNumOperations, [&](int t, int n) {
+    auto rng = std::mt19937{static_cast<unsigned>(t)};
+    auto keys = std::uniform_int_distribution<int>{0, kNumKeys - 1};
+    auto percent = std::uniform_int_distribution<int>{0, 99};
+    auto f = 0;
+    for (auto i = 0; i < n; ++i) {
+      const auto key = keys(rng);
+      if (percent(rng) < read_percent) {
+        f += map.find(key) ? 1 : 0;
+      } else {
+        map.insert_or_assign(key, i);
+      }
+    }
+    found += f;
+  });
+  const auto d = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+}
+
+struct Person {
+  std::string name_;
+  int age_;
+};
+
+struct PersonHash {
+  auto operator()(const Person& p) const {
+    return std::hash<std::string>{}(p.name_) * 31 + std::hash<int>{}(p.age_);
+  }
+};
+
+struct PersonEqual {
+  auto operator()(const Person& lhs, const Person& rhs) const {
+    return lhs.name_ == rhs.name_ && lhs.age_ == rhs.age_;
+  }
+};
+
+} // namespace
+
+TEST(ConcurrentMap, FindInsertErase) {
+  auto map = ConcurrentMap<std::string, int>{};
+  ASSERT_FALSE(map.find("John"));
+  ASSERT_TRUE(map.insert_or_assign("John", 32));
+  ASSERT_TRUE(map.insert_or_assign("Anne", 45));
+  ASSERT_FALSE(map.insert_or_assign("John", 33));
+  ASSERT_EQ(33, map.find("John"));
+  ASSERT_EQ(2u, map.size());
+  ASSERT_TRUE(map.erase("John"));
+  ASSERT_FALSE(map.erase("John"));
+  ASSERT_FALSE(map.contains("John"));
+  ASSERT_EQ(1u, map.size());
+}
+
+TEST(ConcurrentMap, CustomHashAndEqual) {
+  auto ages = ConcurrentMap<Person, int, PersonHash, PersonEqual>{};
+  ages.insert_or_assign(Person{"John", 32}, 1);
+  ages.insert_or_assign(Person{"Anne", 45}, 2);
+  ASSERT_FALSE(ages.contains(Person{"John", 31}));
+  ASSERT_EQ(2, ages.find(Person{"Anne", 45}));
+}
+
+TEST(ConcurrentMap, ShardsGrowOnTheirOwn) {
+  auto map = ConcurrentMap<int, int>{4, 1};
+  ASSERT_EQ(4u, map.bucket_count());
+  for (auto i = 0; i < 1'000; ++i) {
+    map.insert_or_assign(i, i * i);
+  }
+  ASSERT_GE(map.bucket_count(), 1'000u);
+  for (auto i = 0; i < 1'000; ++i) {
+    ASSERT_EQ(i * i, map.find(i));
+  }
+}
+
+TEST(ConcurrentMap, SpreadsStridedAndAlignedKeys) {
+  // std::hash returns ints and pointers as they are, so all of these
+  // keys share their low bits
+  auto strided = ConcurrentMap<int, int>{16, 1};
+  for (auto i = 0; i < 4'096; ++i) {
+    strided.insert_or_assign(i * 4'096, i);
+  }
+  ASSERT_LE(strided.longest_chain(), 8u);
+
+  struct alignas(64) Block {
+    char data_[64];
+  };
+  auto blocks = std::vector<Block>(4'096);
+  auto aligned = ConcurrentMap<const Block*, int>{16, 1};
+  for (auto i = 0; i < 4'096; ++i) {
+    aligned.insert_or_assign(&blocks[i], i);
+  }
+  ASSERT_LE(aligned.longest_chain(), 8u);
+}
+
+TEST(ConcurrentMap, ComputeIfAbsentComputesOnce) {
+  // Like get_bitmap_resource() in compile_time_hash.cpp, but shared
+  // by threads which load the same resources
+  auto resources = ConcurrentMap<int, std::shared_ptr<const std::string>>{};
+  auto num_loads = std::atomic<int>{0};
+  run(8, 8 * 1'000, [&](int, int n) {
+    for (auto i = 0; i < n; ++i) {
+      const auto r = resources.compute_if_absent(i % 100, [&](int key) {
+        ++num_loads;
+        return std::make_shared<const std::string>(std::to_string(key));
+      });
+      ASSERT_EQ(std::to_string(i % 100), *r);
+    }
+  });
+  ASSERT_EQ(100, num_loads.load());
+}
+
+TEST(ConcurrentMap, ReadersSeeWholeValuesWhileGrowing) {
+  // The values are too large to assign in place, so every assignment
+  // replaces a node. A reader checks that the parts of a value match.
+  auto map = ConcurrentMap<int, std::array<int, 3>>{2, 1};
+  auto done = std::atomic<bool>{false};
+  auto writer = std::thread{[&] {
+    for (auto m = 1; m <= 20; ++m) {
+      for (auto key = 0; key < 2'000; ++key) {
+        map.insert_or_assign(key, std::array<int, 3>{key, m, key * m});
+      }
+      for (auto key = 0; key < 2'000; key += 7) {
+        map.erase(key);
+      }
+    }
+    done = true;
+  }};
+  run(3, 3, [&](int, int) {
+    while (!done) {
+      for (auto key = 0; key < 2'000; ++key) {
+        if (const auto value = map.find(key)) {
+          ASSERT_EQ(key, (*value)[0]);
+          ASSERT_EQ(key * (*value)[1], (*value)[2]);
+        }
+      }
+    }
+  });
+  writer.join();
+  ASSERT_EQ(2'000u - 286u, map.size());
+}
+
+TEST(ConcurrentMap, CompareWithLockedMap) {
+  for (const auto read_percent : {95, 50}) {
+    std::cout << "ms for " << kNumOperations << " operations, " << read_percent << "% reads"
+              << '\n'
+              << std::setw(8) << "threads" << std::setw(8) << "mutex" << std::setw(14)
+              << "shared_mutex" << std::setw(16) << "ConcurrentMap" << '\n';
+    for (auto num_threads = 1; num_threads <= 8; num_threads *= 2) {
+      auto mutex_map = LockedMap<std::mutex, std::unique_lock>{};
+      auto shared_map = LockedMap<std::shared_mutex, std::shared_lock>{};
+      auto concurrent_map = ConcurrentMap<int, int>{};
+      const auto mutex_ms = time_mix(mutex_map, num_threads, read_percent);
+      const auto shared_ms = time_mix(shared_map, num_threads, read_percent);
+      const auto concurrent_ms = time_mix(concurrent_map, num_threads, read_percent);
+      std::cout << std::setw(8) << num_threads << std::setw(8) << mutex_ms << std::setw(14)
+                << shared_ms << std::setw(16) << concurrent_ms << '\n';
+    }
+  }
+}
@@ -0,0 +1,319 @@
+#pragma once
+#ifndef CONCURRENT_MAP_HPP
+#define CONCURRENT_MAP_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "cache_line.hpp"
+#include "reclaim.hpp"
+#include "sync_utils.hpp"
+
+//
+// A hash map for many reader and writer threads.
+//
+// The keys are split into shards by their hash, and each shard is a
+// chained hash table with its own mutex. Writers lock the shard of the
+// key, so writers of different shards don't wait for each other.
+//
+// Readers don't lock at all. The keys and values of the nodes are
+// never changed once they are linked, so a writer replaces a node
+// instead of assigning to it, and frees the old one through an
+// EpochDomain once no reader can still be walking past it. A reader
+// pins the epoch, walks the chain and copies the value out.
+//
+// A shard grows on its own when it holds more keys than buckets. It
+// copies its nodes into a table twice as large and publishes it,
+// while readers keep using the old table until then. Only writers of
+// that shard wait, never the whole map.
+//
+// Values which fit in a lock-free std::atomic, such as ints and
+// pointers, are assigned in place instead, which saves allocating a
+// node per assignment. Since values are copied out by find(), large
+// values are better stored behind a std::shared_ptr.
+//
+
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class ConcurrentMap {
+public:
+  // Both are rounded up to powers of two
+  explicit ConcurrentMap(size_t num_shards = default_num_shards(),
+                         size_t buckets_per_shard = 8, const Hash& hash = Hash{},
+                         const KeyEqual& equal = KeyEqual{})
+    : shard_mask_{round_up_to_power_of_two(num_shards) - 1},
+      shards_{std::make_unique<Shard[]>(shard_mask_ + 1)}, hash_{hash}, equal_{equal} {
+    const auto num_buckets = round_up_to_power_of_two(std::max<size_t>(buckets_per_shard, 1));
+    for (size_t i = 0; i <= shard_mask_; ++i) {
+      shards_[i].table_.store(new Table{num_buckets}, std::memory_order_relaxed);
+    }
+  }
+
+  ConcurrentMap(const ConcurrentMap&) = delete;
+  auto operator=(const ConcurrentMap&) -> ConcurrentMap& = delete;
+
+  ~ConcurrentMap() {
+    for (size_t i = 0; i <= shard_mask_; ++i) {
+      delete shards_[i].table_.load(std::memory_order_relaxed);
+    }
+  }
+
+  auto find(const K& key) const -> std::optional<V> {
+    const auto hash = hash_of(key);
+    auto guard = domain_.pin();
+    const auto& table = *guard.protect(shard_of(hash).table_);
+    if (const auto* node = find_node(table, hash, key)) {
+      return value_of(*node);
+    }
+    return std::nullopt;
+  }
+
+  auto contains(const K& key) const -> bool {
+    const auto hash = hash_of(key);
+    auto guard = domain_.pin();
+    return find_node(*guard.protect(shard_of(hash).table_), hash, key) != nullptr;
+  }
+
+  // Returns true if the key was inserted, and false if it was assigned
+  template <typename U>
+  auto insert_or_assign(const K& key, U&& value) -> bool {
+    const auto hash = hash_of(key);
+    auto& shard = shard_of(hash);
+    auto guard = domain_.pin();
+    std::lock_guard<std::mutex> lock{shard.mutex_};
+    auto& table = *shard.table_.load(std::memory_order_relaxed);
+    auto& link = find_link(table, hash, key);
+    auto* old = link.load(std::memory_order_relaxed);
+    if constexpr (kAssignInPlace) {
+      if (old != nullptr) {
+        old->value_.store(std::forward<U>(value), std::memory_order_release);
+        return false;
+      }
+    } else if (old != nullptr) {
+      // Readers either see the old node or the new one, never a value
+      // in the middle of being assigned
+      auto* node = new Node{hash, key, std::forward<U>(value),
+                            old->next_.load(std::memory_order_relaxed)};
+      link.store(node, std::memory_order_release);
+      guard.retire(old);
+      return false;
+    }
+    insert(shard, table, new Node{hash, key, std::forward<U>(value), nullptr}, guard);
+    return true;
+  }
+
+  // Returns the value of the key, or inserts f(key) if there is none.
+  // f is called at most once per key, even if several threads ask for
+  // the same missing key, but it's called with the shard locked.
+  template <typename F>
+  auto compute_if_absent(const K& key, F&& f) -> V {
+    const auto hash = hash_of(key);
+    auto& shard = shard_of(hash);
+    auto guard = domain_.pin();
+    if (const auto* node = find_node(*guard.protect(shard.table_), hash, key)) {
+      return value_of(*node);
+    }
+    std::lock_guard<std::mutex> lock{shard.mutex_};
+    auto& table = *shard.table_.load(std::memory_order_relaxed);
+    if (const auto* node = find_node(table, hash, key)) {
+      return value_of(*node); // Inserted while we took the lock
+    }
+    auto* node = new Node{hash, key, std::forward<F>(f)(key), nullptr};
+    auto value = value_of(*node);
+    insert(shard, table, node, guard);
+    return value;
+  }
+
+  // Returns true if the key was there
+  auto erase(const K& key) -> bool {
+    const auto hash = hash_of(key);
+    auto& shard = shard_of(hash);
+    auto guard = domain_.pin();
+    std::lock_guard<std::mutex> lock{shard.mutex_};
+    auto& link = find_link(*shard.table_.load(std::memory_order_relaxed), hash, key);
+    auto* node = link.load(std::memory_order_relaxed);
+    if (node == nullptr) {
+      return false;
+    }
+    link.store(node->next_.load(std::memory_order_relaxed), std::memory_order_release);
+    shard.size_.store(shard.size_.load(std::memory_order_relaxed) - 1,
+                      std::memory_order_relaxed);
+    guard.retire(node);
+    return true;
+  }
+
+  // Number of keys, which may be out of date when it's returned
+  auto size() const noexcept {
+    auto size = size_t{0};
+    for (size_t i = 0; i <= shard_mask_; ++i) {
+      size += shards_[i].size_.load(std::memory_order_relaxed);
+    }
+    return size;
+  }
+
+  auto num_shards() const noexcept { return shard_mask_ + 1; }
+
+  // Number of buckets of all shards
+  auto bucket_count() const {
+    auto guard = domain_.pin();
+    auto count = size_t{0};
+    for (size_t i = 0; i <= shard_mask_; ++i) {
+      count += guard.protect(shards_[i].table_)->mask_ + 1;
+    }
+    return count;
+  }
+
+  // Length of the longest chain of all shards, which shows how well
+  // the hash spreads the keys
+  auto longest_chain() const {
+    auto guard = domain_.pin();
+    auto longest = size_t{0};
+    for (size_t i = 0; i <= shard_mask_; ++i) {
+      const auto& table = *guard.protect(shards_[i].table_);
+      for (size_t j = 0; j <= table.mask_; ++j) {
+        auto length = size_t{0};
+        for (auto* node = table.buckets_[j].load(std::memory_order_acquire); node != nullptr;
+             node = node->next_.load(std::memory_order_acquire)) {
+          ++length;
+        }
+        longest = std::max(longest, length);
+      }
+    }
+    return longest;
+  }
+
+private:
+  // Only asks std::atomic<T> once T is known to be trivially copyable
+  template <typename T>
+  struct IsAlwaysLockFree : std::bool_constant<std::atomic<T>::is_always_lock_free> {};
+  static constexpr auto kAssignInPlace =
+    std::conjunction_v<std::is_trivially_copyable<V>, IsAlwaysLockFree<V>>;
+
+  struct Node {
+    const size_t hash_;
+    const K key_;
+    std::conditional_t<kAssignInPlace, std::atomic<V>, const V> value_;
+    std::atomic<Node*> next_;
+  };
+
+  static auto value_of(const Node& node) -> V {
+    if constexpr (kAssignInPlace) {
+      return node.value_.load(std::memory_order_acquire);
+    } else {
+      return node.value_;
+    }
+  }
+
+  struct Table {
+    explicit Table(size_t num_buckets)
+      : mask_{num_buckets - 1}, buckets_{std::make_unique<std::atomic<Node*>[]>(num_buckets)} {}
+    Table(const Table&) = delete;
+    auto operator=(const Table&) -> Table& = delete;
+    // Frees the nodes still linked, which no other table shares
+    ~Table() {
+      for (size_t i = 0; i <= mask_; ++i) {
+        auto* node = buckets_[i].load(std::memory_order_relaxed);
+        while (node != nullptr) {
+          delete std::exchange(node, node->next_.load(std::memory_order_relaxed));
+        }
+      }
+    }
+    auto bucket(size_t hash) const noexcept -> std::atomic<Node*>& {
+      return buckets_[hash & mask_];
+    }
+    const size_t mask_;
+    const std::unique_ptr<std::atomic<Node*>[]> buckets_;
+  };
+
+  struct alignas(kCacheLineSize) Shard {
+    std::mutex mutex_{};
+    std::atomic<Table*> table_{nullptr};
+    std::atomic<size_t> size_{0}; // Only written with mutex_ locked
+  };
+
+  static auto default_num_shards() -> size_t {
+    return 16 * std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  // Mixes hashes such as std::hash<int>, which returns the int, with
+  // the splitmix64 finalizer. A multiplication alone leaves the low
+  // bits as weak as they were, so strided keys and aligned pointers,
+  // whose low bits are all zero, would end up in a few buckets. After
+  // the finalizer every bit depends on every input bit, so the high
+  // half can pick the shard and the low half the bucket.
+  auto hash_of(const K& key) const -> size_t {
+    auto h = static_cast<uint64_t>(hash_(key));
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<size_t>(h ^ (h >> 31));
+  }
+
+  auto shard_of(size_t hash) const noexcept -> Shard& {
+    return shards_[(static_cast<uint64_t>(hash) >> 32) & shard_mask_];
+  }
+
+  auto find_node(const Table& table, size_t hash, const K& key) const -> const Node* {
+    auto* node = table.bucket(hash).load(std::memory_order_acquire);
+    while (node != nullptr && !(node->hash_ == hash && equal_(node->key_, key))) {
+      node = node->next_.load(std::memory_order_acquire);
+    }
+    return node;
+  }
+
+  // The link which points to the node of the key, or the null link at
+  // the end of its chain. Only used by writers holding the lock.
+  auto find_link(Table& table, size_t hash, const K& key) const -> std::atomic<Node*>& {
+    auto* link = &table.bucket(hash);
+    for (auto* node = link->load(std::memory_order_relaxed);
+         node != nullptr && !(node->hash_ == hash && equal_(node->key_, key));
+         node = link->load(std::memory_order_relaxed)) {
+      link = &node->next_;
+    }
+    return *link;
+  }
+
+  auto insert(Shard& shard, Table& table, Node* node, reclaim::EpochDomain::Guard& guard)
+    -> void {
+    auto& head = table.bucket(node->hash_);
+    node->next_.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    head.store(node, std::memory_order_release);
+    const auto size = shard.size_.load(std::memory_order_relaxed) + 1;
+    shard.size_.store(size, std::memory_order_relaxed);
+    if (size > table.mask_ + 1) {
+      grow(shard, table, guard);
+    }
+  }
+
+  // Copies the nodes to a table with twice the buckets, as readers may
+  // still walk the chains of the old one
+  auto grow(Shard& shard, Table& table, reclaim::EpochDomain::Guard& guard) -> void {
+    auto* bigger = new Table{2 * (table.mask_ + 1)};
+    for (size_t i = 0; i <= table.mask_; ++i) {
+      for (auto* node = table.buckets_[i].load(std::memory_order_relaxed); node != nullptr;
+           node = node->next_.load(std::memory_order_relaxed)) {
+        auto& head = bigger->bucket(node->hash_);
+        head.store(new Node{node->hash_, node->key_, value_of(*node),
+                            head.load(std::memory_order_relaxed)},
+                   std::memory_order_relaxed);
+      }
+    }
+    shard.table_.store(bigger, std::memory_order_release);
+    guard.retire(&table);
+  }
+
+  const size_t shard_mask_;
+  const std::unique_ptr<Shard[]> shards_;
+  const Hash hash_;
+  const KeyEqual equal_;
+  mutable reclaim::EpochDomain domain_{};
+};
+
+#endif
@@ -0,0 +1,267 @@
+#include "coro.hpp"
+
+#if CORO_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "blocking_queue.hpp"
+#include "thread_pool.hpp"
+
+//
+// This example runs many waiting operations as coroutines on a few
+// threads, and compares it with one thread per operation. It also
+// measures a switch between two coroutines passing an int back and
+// forth through channels, against two threads doing the same through
+// blocking queues.
+//
+
+namespace {
+
+// Number of operations in the benchmarks. Increase if you want more.
+constexpr auto kNumCoroutines = 10'000;
+constexpr auto kNumThreads = 1'000; // Threads are much more expensive
+constexpr auto kNumRoundTrips = 50'000;
+
+using coro::Task;
+
+auto square(std::int64_t i) -> Task<std::int64_t> { co_return i * i; }
+
+auto sum_of_squares(std::int64_t n) -> Task<std::int64_t> {
+  auto sum = std::int64_t{0};
+  for (auto i = std::int64_t{1}; i <= n; ++i) {
+    sum += co_await square(i);
+  }
+  co_return sum;
+}
+
+auto fail() -> Task<int> {
+  throw std::runtime_error{"failed"};
+  co_return 0;
+}
+
+auto add_one_after_failure() -> Task<int> { co_return 1 + co_await fail(); }
+
+auto thread_after_schedule(ThreadPool& pool) -> Task<std::thread::id> {
+  co_await coro::schedule(pool);
+  co_return std::this_thread::get_id();
+}
+
+auto increment_locked(ThreadPool& pool, coro::AsyncMutex& mutex, int& counter,
+                      std::atomic<int>& remaining, coro::AsyncEvent& done) -> Task<> {
+  co_await coro::schedule(pool);
+  for (auto i = 0; i < 100; ++i) {
+    auto guard = co_await mutex.scoped_lock();
+    ++counter;
+  }
+  if (remaining.fetch_sub(1) == 1) {
+    done.set();
+  }
+}
+
+auto wait_for(coro::AsyncEvent& event) -> Task<> { co_await event; }
+
+auto lock_and_count(coro::AsyncMutex& mutex, int& counter) -> Task<> {
+  auto guard = co_await mutex.scoped_lock();
+  ++counter;
+}
+
+auto produce(coro::Channel<int>& channel, int n) -> Task<> {
+  for (auto i = 0; i < n; ++i) {
+    co_await channel.send(i);
+  }
+  channel.close();
+}
+
+auto consume(coro::Channel<int>& channel, std::vector<int>& out) -> Task<> {
+  while (auto item = co_await channel.receive()) {
+    out.push_back(*item);
+  }
+}
+
+// Waits for start, like an operation waiting for I/O, and counts down
+auto wait_and_count(ThreadPool& pool, coro::AsyncEvent& start, std::atomic<int>& remaining,
+                    coro::AsyncEvent& done) -> Task<> {
+  co_await coro::schedule(pool);
+  co_await start;
+  if (remaining.fetch_sub(1) == 1) {
+    done.set();
+  }
+}
+
+auto echo(coro::Channel<int>& ping, coro::Channel<int>& pong) -> Task<> {
+  while (auto item = co_await ping.receive()) {
+    co_await pong.send(*item);
+  }
+}
+
+auto serve(coro::Channel<int>& ping, coro::Channel<int>& pong, int n) -> Task<long long> {
+  auto sum = 0ll;
+  for (auto i = 0; i < n; ++i) {
+    co_await ping.send(i);
+    sum += *co_await pong.receive();
+  }
+  ping.close();
+  co_return sum;
+}
+
+auto elapsed_ns(std::chrono::steady_clock::time_point start) {
+  const auto d = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+} // namespace
+
+TEST(Coro, TaskReturnsValue) {
+  ASSERT_EQ(1 + 4 + 9, coro::sync_wait(sum_of_squares(3)));
+}
+
+TEST(Coro, LongLoopOfTasksKeepsStackFlat) {
+  // If each completed task resumed its awaiter from a nested call,
+  // this would overflow the stack, in unoptimized builds too
+  const auto n = std::int64_t{1'000'000};
+  ASSERT_EQ(n * (n + 1) * (2 * n + 1) / 6, coro::sync_wait(sum_of_squares(n)));
+}
+
+TEST(Coro, ExceptionsPropagate) {
+  ASSERT_THROW(coro::sync_wait(add_one_after_failure()), std::runtime_error);
+}
+
+TEST(Coro, ScheduleMovesToThreadPool) {
+  auto pool = ThreadPool{2};
+  ASSERT_NE(std::this_thread::get_id(), coro::sync_wait(thread_after_schedule(pool)));
+}
+
+TEST(Coro, AsyncMutex) {
+  auto pool = ThreadPool{4};
+  auto mutex = coro::AsyncMutex{};
+  auto counter = 0;
+  auto remaining = std::atomic<int>{100};
+  auto done = coro::AsyncEvent{};
+  for (auto i = 0; i < 100; ++i) {
+    coro::spawn(increment_locked(pool, mutex, counter, remaining, done));
+  }
+  coro::sync_wait(wait_for(done));
+  ASSERT_EQ(100 * 100, counter);
+  ASSERT_TRUE(mutex.try_lock());
+  ASSERT_FALSE(mutex.try_lock());
+  mutex.unlock();
+}
+
+TEST(Coro, AsyncMutexHandOffKeepsStackFlat) {
+  // Each waiter unlocks as soon as it gets the mutex, which would
+  // resume the next one from a nested call
+  const auto n = 200'000;
+  auto mutex = coro::AsyncMutex{};
+  auto counter = 0;
+  ASSERT_TRUE(mutex.try_lock());
+  for (auto i = 0; i < n; ++i) {
+    coro::spawn(lock_and_count(mutex, counter));
+  }
+  ASSERT_EQ(0, counter);
+  mutex.unlock();
+  ASSERT_EQ(n, counter);
+  ASSERT_TRUE(mutex.try_lock());
+  mutex.unlock();
+}
+
+TEST(Coro, AsyncEvent) {
+  auto event = coro::AsyncEvent{};
+  auto resumed = false;
+  auto waiter = [](coro::AsyncEvent& e, bool& r) -> Task<> {
+    co_await e;
+    r = true;
+  };
+  coro::spawn(waiter(event, resumed));
+  ASSERT_FALSE(resumed);
+  event.set();
+  ASSERT_TRUE(resumed);
+  coro::sync_wait(wait_for(event)); // Already set
+}
+
+TEST(Coro, Channel) {
+  auto channel = coro::Channel<int>{2};
+  auto out = std::vector<int>{};
+  coro::spawn(consume(channel, out));
+  coro::sync_wait(produce(channel, 10));
+  ASSERT_EQ(std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), out);
+}
+
+TEST(Coro, CompareWithThreadPerTask) {
+  {
+    auto pool = ThreadPool{};
+    auto start_event = coro::AsyncEvent{};
+    auto done = coro::AsyncEvent{};
+    auto remaining = std::atomic<int>{kNumCoroutines};
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < kNumCoroutines; ++i) {
+      coro::spawn(wait_and_count(pool, start_event, remaining, done));
+    }
+    start_event.set();
+    coro::sync_wait(wait_for(done));
+    std::cout << elapsed_ns(start) / kNumCoroutines << " ns per operation, " << kNumCoroutines
+              << " coroutines on " << pool.size() << " threads" << '\n';
+  }
+  {
+    auto mutex = std::mutex{};
+    auto cv = std::condition_variable{};
+    auto started = false;
+    const auto start = std::chrono::steady_clock::now();
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 0; i < kNumThreads; ++i) {
+      threads.emplace_back([&] {
+        std::unique_lock<std::mutex> lock{mutex};
+        cv.wait(lock, [&] { return started; });
+      });
+    }
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      started = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) {
+      t.join();
+    }
+    std::cout << elapsed_ns(start) / kNumThreads << " ns per operation, " << kNumThreads
+              << " threads" << '\n';
+  }
+  const auto expected = static_cast<long long>(kNumRoundTrips) * (kNumRoundTrips - 1) / 2;
+  {
+    auto ping = coro::Channel<int>{1};
+    auto pong = coro::Channel<int>{1};
+    const auto start = std::chrono::steady_clock::now();
+    coro::spawn(echo(ping, pong));
+    ASSERT_EQ(expected, coro::sync_wait(serve(ping, pong, kNumRoundTrips)));
+    std::cout << elapsed_ns(start) / (2 * kNumRoundTrips)
+              << " ns per switch between coroutines" << '\n';
+  }
+  {
+    auto ping = BlockingQueue<int>{};
+    auto pong = BlockingQueue<int>{};
+    const auto start = std::chrono::steady_clock::now();
+    auto echo_thread = std::thread{[&] {
+      while (const auto item = ping.pop()) {
+        pong.push(*item);
+      }
+    }};
+    auto sum = 0ll;
+    for (auto i = 0; i < kNumRoundTrips; ++i) {
+      ping.push(i);
+      sum += *pong.pop();
+    }
+    ping.close();
+    echo_thread.join();
+    ASSERT_EQ(expected, sum);
+    std::cout << elapsed_ns(start) / (2 * kNumRoundTrips) << " ns per switch between threads"
+              << '\n';
+  }
+}
+
+#endif // CORO_ENABLED
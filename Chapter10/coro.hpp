@@ -0,0 +1,528 @@
+#pragma once
+#ifndef CORO_HPP
+#define CORO_HPP
+
+// Coroutines need C++20, and the examples are skipped without them
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+  #if __has_include(<coroutine>)
+    #define CORO_ENABLED 1
+  #endif
+#endif
+#ifndef CORO_ENABLED
+  #define CORO_ENABLED 0
+#endif
+
+#if CORO_ENABLED
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "parking.hpp"
+
+//
+// Coroutines which suspend instead of blocking a thread, so that many
+// operations waiting for I/O or for each other can share a few
+// threads:
+//
+//   auto handle(ThreadPool& pool, Channel<Request>& requests) -> Task<> {
+//     co_await schedule(pool);
+//     while (auto request = co_await requests.receive()) {
+//       co_await process(*request);
+//     }
+//   }
+//
+// - Task<T> is a lazily started coroutine returning a T. Awaiting it
+//   starts it. If it finishes without suspending, the awaiting
+//   coroutine just continues, so long loops of tasks don't grow the
+//   stack even when the compiler doesn't turn resumes into tail calls.
+//   Otherwise it resumes the awaiting coroutine when it's done.
+// - schedule(ex) moves the coroutine to an executor, which is anything
+//   with a post(task) member function, such as ThreadPool.
+// - sync_wait() blocks a thread until a task is done, and spawn()
+//   starts one without waiting.
+// - AsyncMutex, AsyncEvent and Channel suspend the awaiting coroutine
+//   instead of its thread. The thread which unlocks, sets or sends
+//   resumes a waiting coroutine right away, except that a coroutine
+//   unlocking from inside another unlock is queued, so a long line of
+//   waiters doesn't nest on the stack.
+//
+
+namespace coro {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+class PromiseBase {
+public:
+  // Whichever of the task and its awaiter gets here second resumes
+  // the awaiting coroutine. If the task finished while the awaiter
+  // was still starting it, the awaiter just doesn't suspend.
+  struct FinalAwaiter {
+    auto await_ready() const noexcept { return false; }
+    template <typename Promise>
+    auto await_suspend(std::coroutine_handle<Promise> h) noexcept -> std::coroutine_handle<> {
+      auto& promise = h.promise();
+      if (promise.ready_.exchange(true, std::memory_order_acq_rel)) {
+        return promise.continuation_;
+      }
+      return std::noop_coroutine();
+    }
+    auto await_resume() const noexcept {}
+  };
+
+  auto initial_suspend() const noexcept { return std::suspend_always{}; }
+  auto final_suspend() const noexcept { return FinalAwaiter{}; }
+  auto unhandled_exception() noexcept { error_ = std::current_exception(); }
+
+  std::coroutine_handle<> continuation_{std::noop_coroutine()};
+  std::atomic<bool> ready_{false};
+
+protected:
+  auto rethrow_if_failed() const {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+private:
+  std::exception_ptr error_;
+};
+
+template <typename T>
+class Promise : public PromiseBase {
+public:
+  auto get_return_object() noexcept -> Task<T>;
+  template <typename U>
+  auto return_value(U&& value) {
+    value_.emplace(std::forward<U>(value));
+  }
+  auto result() -> T {
+    rethrow_if_failed();
+    return std::move(*value_);
+  }
+
+private:
+  std::optional<T> value_;
+};
+
+template <>
+class Promise<void> : public PromiseBase {
+public:
+  auto get_return_object() noexcept -> Task<void>;
+  auto return_void() noexcept {}
+  auto result() -> void { rethrow_if_failed(); }
+};
+
+} // namespace detail
+
+template <typename T>
+class [[nodiscard]] Task {
+public:
+  using promise_type = detail::Promise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  explicit Task(Handle h) noexcept : h_{h} {}
+  Task(Task&& other) noexcept : h_{std::exchange(other.h_, {})} {}
+  auto operator=(Task&& other) noexcept -> Task& {
+    if (this != &other) {
+      if (h_) {
+        h_.destroy();
+      }
+      h_ = std::exchange(other.h_, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+
+  // Starts the task, and resumes the awaiting coroutine with its
+  // result when it's done. A task which finishes right away returns
+  // to await_suspend(), instead of resuming the awaiting coroutine
+  // from a nested call.
+  auto operator co_await() noexcept {
+    struct Awaiter {
+      Handle h_;
+      auto await_ready() const noexcept { return false; }
+      auto await_suspend(std::coroutine_handle<> awaiting) noexcept -> bool {
+        h_.promise().continuation_ = awaiting;
+        h_.resume();
+        return !h_.promise().ready_.exchange(true, std::memory_order_acq_rel);
+      }
+      auto await_resume() -> T { return h_.promise().result(); }
+    };
+    return Awaiter{h_};
+  }
+
+private:
+  Handle h_;
+};
+
+namespace detail {
+
+template <typename T>
+auto Promise<T>::get_return_object() noexcept -> Task<T> {
+  return Task<T>{std::coroutine_handle<Promise<T>>::from_promise(*this)};
+}
+
+inline auto Promise<void>::get_return_object() noexcept -> Task<void> {
+  return Task<void>{std::coroutine_handle<Promise<void>>::from_promise(*this)};
+}
+
+// A coroutine which starts right away and destroys itself when done
+struct Detached {
+  struct promise_type {
+    auto get_return_object() const noexcept { return Detached{}; }
+    auto initial_suspend() const noexcept { return std::suspend_never{}; }
+    auto final_suspend() const noexcept { return std::suspend_never{}; }
+    auto return_void() const noexcept {}
+    [[noreturn]] auto unhandled_exception() const noexcept { std::terminate(); }
+  };
+};
+
+// Resumes h in the calling thread. If the thread is already resuming
+// a coroutine here, h is queued and resumed once that one suspends or
+// finishes, so that handing off from one coroutine to the next, to
+// the next, and so on runs in a loop instead of nesting.
+inline auto resume_flat(std::coroutine_handle<> h) -> void {
+  static thread_local auto queued = std::deque<std::coroutine_handle<>>{};
+  static thread_local auto resuming = false;
+  if (resuming) {
+    queued.push_back(h);
+    return;
+  }
+  resuming = true;
+  h.resume();
+  while (!queued.empty()) {
+    const auto next = queued.front();
+    queued.pop_front();
+    next.resume();
+  }
+  resuming = false;
+}
+
+inline auto run_detached(Task<> task) -> Detached {
+  co_await task;
+}
+
+template <typename T>
+struct SyncWaitState {
+  std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> value_;
+  std::exception_ptr error_;
+  std::atomic<bool> done_{false};
+  EventCount event_;
+};
+
+// The state is shared, as sync_wait() may return and destroy its
+// stack frame while this still notifies it
+template <typename T>
+auto run_and_signal(Task<T>& task, std::shared_ptr<SyncWaitState<T>> state) -> Detached {
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+    } else {
+      state->value_.emplace(co_await task);
+    }
+  } catch (...) {
+    state->error_ = std::current_exception();
+  }
+  state->done_.store(true, std::memory_order_release);
+  state->event_.notify_all();
+}
+
+} // namespace detail
+
+// Resumes the awaiting coroutine on one of the threads of ex
+template <typename Ex>
+auto schedule(Ex& ex) noexcept {
+  struct Awaiter {
+    Ex& ex_;
+    auto await_ready() const noexcept { return false; }
+    auto await_suspend(std::coroutine_handle<> h) { ex_.post([h] { h.resume(); }); }
+    auto await_resume() const noexcept {}
+  };
+  return Awaiter{ex};
+}
+
+// Starts the task in the calling thread, and lets it run on its own
+// once it suspends. An exception from the task terminates the program.
+inline auto spawn(Task<> task) -> void {
+  detail::run_detached(std::move(task));
+}
+
+// Runs the task and blocks the calling thread until it's done
+template <typename T>
+auto sync_wait(Task<T> task) -> T {
+  auto state = std::make_shared<detail::SyncWaitState<T>>();
+  detail::run_and_signal(task, state);
+  state->event_.await([&] { return state->done_.load(std::memory_order_acquire); });
+  if (state->error_) {
+    std::rethrow_exception(state->error_);
+  }
+  if constexpr (!std::is_void_v<T>) {
+    return std::move(*state->value_);
+  }
+}
+
+// An event which coroutines can wait for. Once set, it stays set.
+class AsyncEvent {
+public:
+  AsyncEvent() = default;
+  AsyncEvent(const AsyncEvent&) = delete;
+  auto operator=(const AsyncEvent&) -> AsyncEvent& = delete;
+
+  auto is_set() const noexcept { return set_.load(std::memory_order_acquire); }
+
+  // Resumes all the waiting coroutines in the calling thread
+  auto set() -> void {
+    auto waiters = std::vector<std::coroutine_handle<>>{};
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      set_.store(true, std::memory_order_release);
+      waiters.swap(waiters_);
+    }
+    for (auto h : waiters) {
+      h.resume();
+    }
+  }
+
+  auto operator co_await() noexcept {
+    struct Awaiter {
+      AsyncEvent& event_;
+      auto await_ready() const noexcept { return event_.is_set(); }
+      auto await_suspend(std::coroutine_handle<> h) -> bool {
+        std::lock_guard<std::mutex> lock{event_.mutex_};
+        if (event_.set_.load(std::memory_order_relaxed)) {
+          return false;
+        }
+        event_.waiters_.push_back(h);
+        return true;
+      }
+      auto await_resume() const noexcept {}
+    };
+    return Awaiter{*this};
+  }
+
+private:
+  std::mutex mutex_;
+  std::atomic<bool> set_{false};
+  std::vector<std::coroutine_handle<>> waiters_;
+};
+
+// A mutex which suspends the coroutines waiting for it, and hands it
+// to them in the order they came
+class AsyncMutex {
+public:
+  class Guard {
+  public:
+    explicit Guard(AsyncMutex& mutex) noexcept : mutex_{&mutex} {}
+    Guard(Guard&& other) noexcept : mutex_{std::exchange(other.mutex_, nullptr)} {}
+    Guard(const Guard&) = delete;
+    auto operator=(const Guard&) -> Guard& = delete;
+    ~Guard() {
+      if (mutex_ != nullptr) {
+        mutex_->unlock();
+      }
+    }
+
+  private:
+    AsyncMutex* mutex_;
+  };
+
+  AsyncMutex() = default;
+  AsyncMutex(const AsyncMutex&) = delete;
+  auto operator=(const AsyncMutex&) -> AsyncMutex& = delete;
+
+  auto try_lock() -> bool {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return std::exchange(locked_, true) == false;
+  }
+
+  struct LockAwaiter {
+    AsyncMutex& mutex_;
+    auto await_ready() const noexcept { return false; }
+    auto await_suspend(std::coroutine_handle<> h) -> bool {
+      std::lock_guard<std::mutex> lock{mutex_.mutex_};
+      if (!mutex_.locked_) {
+        mutex_.locked_ = true;
+        return false;
+      }
+      mutex_.waiters_.push_back(h);
+      return true;
+    }
+    auto await_resume() const noexcept {}
+  };
+
+  struct ScopedLockAwaiter : LockAwaiter {
+    auto await_resume() const noexcept { return Guard{mutex_}; }
+  };
+
+  // co_await mutex.lock() returns once the coroutine holds the mutex
+  auto lock() noexcept { return LockAwaiter{*this}; }
+
+  // Like lock(), but returns a Guard which unlocks the mutex
+  auto scoped_lock() noexcept { return ScopedLockAwaiter{{*this}}; }
+
+  // Hands the mutex to the next waiting coroutine, if any, and resumes
+  // it in the calling thread. When that coroutine unlocks in turn, the
+  // one after it is resumed once it suspends or finishes.
+  auto unlock() -> void {
+    auto next = std::coroutine_handle<>{};
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (waiters_.empty()) {
+        locked_ = false;
+        return;
+      }
+      next = waiters_.front();
+      waiters_.pop_front();
+    }
+    detail::resume_flat(next);
+  }
+
+private:
+  std::mutex mutex_;
+  bool locked_{false};
+  std::deque<std::coroutine_handle<>> waiters_;
+};
+
+// A bounded queue between coroutines. Senders wait while it's full,
+// and receivers while it's empty. Once closed, sends fail and receives
+// return nothing after the remaining items.
+template <typename T>
+class Channel {
+public:
+  explicit Channel(size_t capacity) : capacity_{std::max<size_t>(capacity, 1)} {}
+  Channel(const Channel&) = delete;
+  auto operator=(const Channel&) -> Channel& = delete;
+
+  // co_await channel.send(item) returns false if the channel is closed
+  template <typename U>
+  auto send(U&& item) {
+    struct Awaiter {
+      Channel& channel_;
+      T item_;
+      bool sent_{false};
+      auto await_ready() const noexcept { return false; }
+      auto await_suspend(std::coroutine_handle<> h) -> bool {
+        auto receiver = Receiver{};
+        {
+          std::lock_guard<std::mutex> lock{channel_.mutex_};
+          if (channel_.closed_) {
+            return false;
+          }
+          sent_ = true;
+          if (!channel_.receivers_.empty()) {
+            // The buffer is empty, so hand the item over directly
+            receiver = channel_.receivers_.front();
+            channel_.receivers_.pop_front();
+            receiver.item_->emplace(std::move(item_));
+          } else if (channel_.items_.size() < channel_.capacity_) {
+            channel_.items_.push_back(std::move(item_));
+          } else {
+            channel_.senders_.push_back(Sender{h, &item_, &sent_});
+            return true;
+          }
+        }
+        if (receiver.h_) {
+          receiver.h_.resume();
+        }
+        return false;
+      }
+      auto await_resume() const noexcept { return sent_; }
+    };
+    return Awaiter{*this, T(std::forward<U>(item))};
+  }
+
+  // co_await channel.receive() returns nothing once the channel is
+  // closed and empty
+  auto receive() noexcept {
+    struct Awaiter {
+      Channel& channel_;
+      std::optional<T> item_{};
+      auto await_ready() const noexcept { return false; }
+      auto await_suspend(std::coroutine_handle<> h) -> bool {
+        auto sender = Sender{};
+        {
+          std::lock_guard<std::mutex> lock{channel_.mutex_};
+          if (!channel_.items_.empty()) {
+            item_.emplace(std::move(channel_.items_.front()));
+            channel_.items_.pop_front();
+            // Make room for the first waiting sender's item
+            if (!channel_.senders_.empty()) {
+              sender = channel_.senders_.front();
+              channel_.senders_.pop_front();
+              channel_.items_.push_back(std::move(*sender.item_));
+            }
+          } else if (!channel_.closed_) {
+            channel_.receivers_.push_back(Receiver{h, &item_});
+            return true;
+          }
+        }
+        if (sender.h_) {
+          sender.h_.resume();
+        }
+        return false;
+      }
+      auto await_resume() { return std::move(item_); }
+    };
+    return Awaiter{*this};
+  }
+
+  // Resumes all waiting coroutines: senders fail and receivers get
+  // nothing
+  auto close() -> void {
+    auto senders = std::deque<Sender>{};
+    auto receivers = std::deque<Receiver>{};
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      closed_ = true;
+      senders.swap(senders_);
+      receivers.swap(receivers_);
+    }
+    for (auto& s : senders) {
+      *s.sent_ = false;
+      s.h_.resume();
+    }
+    for (auto& r : receivers) {
+      r.h_.resume();
+    }
+  }
+
+private:
+  struct Sender {
+    std::coroutine_handle<> h_{};
+    T* item_{};
+    bool* sent_{};
+  };
+  struct Receiver {
+    std::coroutine_handle<> h_{};
+    std::optional<T>* item_{};
+  };
+
+  std::mutex mutex_;
+  std::deque<T> items_;
+  std::deque<Sender> senders_;
+  std::deque<Receiver> receivers_;
+  const size_t capacity_;
+  bool closed_{false};
+};
+
+} // namespace coro
+
+#endif // CORO_ENABLED
+
+#endif
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "ledger.hpp"
+
+//
+// This example compares transfers between accounts locked with
+// std::lock, as in avoid_deadlock.cpp, with ledger::Ledger. The
+// accounts are picked from a Zipf distribution, where the account of
+// rank k is picked in proportion to 1 / k, so that a few hot accounts
+// take part in most transfers.
+//
+
+namespace {
+
+// Number of operations in each run. Increase if you want more.
+constexpr auto kNumOperations = 1'000'000;
+constexpr auto kNumAccounts = size_t{10'000};
+constexpr auto kInitialBalance = int64_t{1'000'000'000};
+constexpr auto kBatchSize = size_t{256};
+
+// Picks account ids 0, 1, ..., n - 1 with probability proportional
+// to 1 / (id + 1)^s
+class Zipf {
+public:
+  Zipf(size_t n, double s) : cdf_(n) {
+    auto sum = 0.0;
+    for (size_t k = 0; k < n; ++k) {
+      sum += 1.0 / std::pow(static_cast<double>(k + 1), s);
+      cdf_[k] = sum;
+    }
+    for (auto& c : cdf_) {
+      c /= sum;
+    }
+  }
+  template <typename Rng>
+  auto operator()(Rng& rng) const -> uint32_t {
+    const auto u = std::uniform_real_distribution<double>{0.0, 1.0}(rng);
+    const auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+    return static_cast<uint32_t>(std::min<ptrdiff_t>(it - cdf_.begin(), cdf_.size() - 1));
+  }
+
+private:
+  std::vector<double> cdf_;
+};
+
+// The accounts of avoid_deadlock.cpp, padded like those of Ledger
+struct alignas(kCacheLineSize) MutexAccount {
+  int64_t balance_{kInitialBalance};
+  std::mutex m_{};
+};
+
+auto transfer_with_std_lock(MutexAccount& from, MutexAccount& to, int64_t amount) {
+  if (&from == &to) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock1{from.m_, std::defer_lock};
+  std::unique_lock<std::mutex> lock2{to.m_, std::defer_lock};
+  std::lock(lock1, lock2);
+  if (from.balance_ >= amount) {
+    from.balance_ -= amount;
+    to.balance_ += amount;
+  }
+}
+
+// Transfers of 1 between Zipf distributed accounts, one list per
+// thread
+auto make_transfers(int num_threads) {
+  const auto zipf = Zipf{kNumAccounts, 1.0};
+  auto transfers = std::vector<std::vector<ledger::Transfer>>(num_threads);
+  auto rng = std::mt19937{42};
+  for (auto& list : transfers) {
+    for (auto i = 0; i < kNumOperations / num_threads; ++i) {
+      list.push_back(ledger::Transfer{zipf(rng), zipf(rng), 1});
+    }
+  }
+  return transfers;
+}
+
+// Runs f(t) in num_threads threads and returns the ms it took
+template <typename F>
+auto time_threads(int num_threads, F&& f) {
+  const auto start = std::chrono::steady_clock::now();
+  auto threads = std::vector<std::thread>{};
+  for (auto t = 0; t < num_threads; ++t) {
+    threads.emplace_back([t, &f] { f(t); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const auto d = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+}
+
+} // namespace
+
+TEST(Ledger, Transfer) {
+  auto ledger = ledger::Ledger{3, 100};
+  ASSERT_TRUE(ledger.transfer(0, 1, 20));
+  ASSERT_EQ(80, ledger.balance(0));
+  ASSERT_EQ(120, ledger.balance(1));
+  ASSERT_FALSE(ledger.transfer(2, 0, 101)); // Not enough money
+  ASSERT_EQ(100, ledger.balance(2));
+  ASSERT_TRUE(ledger.transfer(2, 2, 50));
+  ASSERT_EQ(300, ledger.total());
+}
+
+TEST(Ledger, ApplyBatch) {
+  auto ledger = ledger::Ledger{8, 10, 4}; // Shards of accounts 0-3 and 4-7
+  const auto transfers = std::vector<ledger::Transfer>{
+    {0, 1, 5}, {1, 2, 15}, {2, 3, 1}, {5, 4, 10}, {4, 5, 20}, {3, 6, 5}, {7, 6, 11}};
+  // All succeed except 7 -> 6, which is one more than the balance
+  ASSERT_EQ(6u, ledger.apply(transfers));
+  const auto expected = std::vector<int64_t>{5, 0, 24, 6, 0, 20, 15, 10};
+  for (uint32_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(expected[i], ledger.balance(i)) << i;
+  }
+}
+
+TEST(Ledger, RejectsNegativeAmounts) {
+  auto ledger = ledger::Ledger{2, 10};
+  ASSERT_THROW(ledger.transfer(0, 1, -5), std::invalid_argument);
+  // None of the batch is applied if one of its amounts is negative
+  const auto transfers = std::vector<ledger::Transfer>{{0, 1, 5}, {1, 0, -5}};
+  ASSERT_THROW(ledger.apply(transfers), std::invalid_argument);
+  ASSERT_EQ(10, ledger.balance(0));
+  ASSERT_EQ(10, ledger.balance(1));
+}
+
+TEST(Ledger, NoAccounts) {
+  auto ledger = ledger::Ledger{0, 10};
+  ASSERT_EQ(0u, ledger.apply({}));
+  ASSERT_EQ(0, ledger.total());
+}
+
+TEST(Ledger, ConcurrentTransfersKeepTotal) {
+  auto ledger = ledger::Ledger{kNumAccounts, 100};
+  const auto transfers = make_transfers(4);
+  time_threads(4, [&](int t) {
+    const auto& list = transfers[t];
+    // Half of the threads transfer one by one, and half in batches
+    if (t % 2 == 0) {
+      for (const auto& tr : list) {
+        ledger.transfer(tr.to_, tr.from_, 3);
+      }
+      return;
+    }
+    for (size_t i = 0; i < list.size(); i += kBatchSize) {
+      const auto last = std::min(list.size(), i + kBatchSize);
+      ledger.apply({list.begin() + i, list.begin() + last});
+    }
+  });
+  ASSERT_EQ(static_cast<int64_t>(kNumAccounts) * 100, ledger.total());
+  for (uint32_t i = 0; i < kNumAccounts; ++i) {
+    ASSERT_GE(ledger.balance(i), 0);
+  }
+}
+
+TEST(Ledger, CompareWithStdLock) {
+  std::cout << "ms for " << kNumOperations << " Zipf distributed transfers" << '\n'
+            << std::setw(8) << "threads" << std::setw(10) << "std::lock" << std::setw(9)
+            << "ordered" << std::setw(9) << "batched" << '\n';
+  for (auto num_threads = 1; num_threads <= 16; num_threads *= 2) {
+    const auto transfers = make_transfers(num_threads);
+    auto accounts = std::make_unique<MutexAccount[]>(kNumAccounts);
+    const auto std_lock_ms = time_threads(num_threads, [&](int t) {
+      for (const auto& tr : transfers[t]) {
+        transfer_with_std_lock(accounts[tr.from_], accounts[tr.to_], tr.amount_);
+      }
+    });
+    auto ledger = ledger::Ledger{kNumAccounts, kInitialBalance};
+    const auto ordered_ms = time_threads(num_threads, [&](int t) {
+      for (const auto& tr : transfers[t]) {
+        ledger.transfer(tr.from_, tr.to_, tr.amount_);
+      }
+    });
+    const auto batched_ms = time_threads(num_threads, [&](int t) {
+      const auto& list = transfers[t];
+      auto batch = std::vector<ledger::Transfer>{};
+      for (size_t i = 0; i < list.size(); i += kBatchSize) {
+        batch.assign(list.begin() + i, list.begin() + std::min(list.size(), i + kBatchSize));
+        ledger.apply(batch);
+      }
+    });
+    ASSERT_EQ(static_cast<int64_t>(kNumAccounts) * kInitialBalance, ledger.total());
+    std::cout << std::setw(8) << num_threads << std::setw(10) << std_lock_ms << std::setw(9)
+              << ordered_ms << std::setw(9) << batched_ms << '\n';
+  }
+
+  // Each thread reads 19 balances per transfer
+  std::cout << "ms for " << kNumOperations << " operations, 95% balance reads" << '\n'
+            << std::setw(8) << "threads" << std::setw(8) << "mutex" << std::setw(12)
+            << "optimistic" << '\n';
+  for (auto num_threads = 1; num_threads <= 16; num_threads *= 2) {
+    const auto transfers = make_transfers(num_threads);
+    auto accounts = std::make_unique<MutexAccount[]>(kNumAccounts);
+    auto sum = int64_t{0};
+    auto sum_mutex = std::mutex{};
+    const auto mutex_ms = time_threads(num_threads, [&](int t) {
+      auto s = int64_t{0};
+      const auto& list = transfers[t];
+      for (size_t i = 0; i < list.size(); ++i) {
+        const auto& tr = list[i];
+        if (i % 20 == 0) {
+          transfer_with_std_lock(accounts[tr.from_], accounts[tr.to_], tr.amount_);
+        } else {
+          std::lock_guard<std::mutex> lock{accounts[tr.from_].m_};
+          s += accounts[tr.from_].balance_;
+        }
+      }
+      std::lock_guard<std::mutex> lock{sum_mutex};
+      sum += s;
+    });
+    auto ledger = ledger::Ledger{kNumAccounts, kInitialBalance};
+    const auto optimistic_ms = time_threads(num_threads, [&](int t) {
+      auto s = int64_t{0};
+      const auto& list = transfers[t];
+      for (size_t i = 0; i < list.size(); ++i) {
+        const auto& tr = list[i];
+        if (i % 20 == 0) {
+          ledger.transfer(tr.from_, tr.to_, tr.amount_);
+        } else {
+          s += ledger.balance(tr.from_);
+        }
+      }
+      std::lock_guard<std::mutex> lock{sum_mutex};
+      sum -= s;
+    });
+    std::cout << std::setw(8) << num_threads << std::setw(8) << mutex_ms << std::setw(12)
+              << optimistic_ms << '\n';
+  }
+}
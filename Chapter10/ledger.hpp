@@ -0,0 +1,240 @@
+#pragma once
+#ifndef LEDGER_HPP
+#define LEDGER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "cache_line.hpp"
+#include "seqlock.hpp"
+#include "sync_utils.hpp"
+
+//
+// Account balances which many threads transfer money between.
+//
+// Instead of std::lock, which locks one mutex and tries the others,
+// backing off and retrying when one is taken, a transfer locks the
+// account with the lower id first. As all threads lock in the same
+// order there can be no deadlock, and a thread waiting for a hot
+// account waits without giving up the locks it already has.
+//
+// The lock of an account is the SeqCount of seqlock.hpp, a version
+// number which is odd while the account is locked, and incremented
+// again when unlocked. balance() reads the balance without locking, and only
+// retries if the version changed while it read. Readers don't make
+// writers wait, unless an account keeps changing while they read.
+// Then balance() gives up after a few attempts and locks it.
+//
+// apply() takes a batch of transfers and groups them by shard, a
+// range of account ids. For each shard it locks every account its
+// transfers touch once, instead of twice per transfer, which pays off
+// when a few hot accounts take part in most transfers.
+//
+
+namespace ledger {
+
+struct Transfer {
+  uint32_t from_{};
+  uint32_t to_{};
+  int64_t amount_{};
+};
+
+class Ledger {
+public:
+  static constexpr auto kDefaultShardSize = size_t{64};
+  static constexpr auto kMaxShardSize = size_t{64};
+
+  // The shard size is rounded up to a power of two, and at most
+  // kMaxShardSize
+  Ledger(size_t num_accounts, int64_t initial_balance,
+         size_t shard_size = kDefaultShardSize)
+    : num_accounts_{num_accounts}, shard_shift_{log2_ceil(std::min(shard_size, kMaxShardSize))},
+      accounts_{std::make_unique<Account[]>(num_accounts)} {
+    for (size_t i = 0; i < num_accounts; ++i) {
+      accounts_[i].balance_.store(initial_balance, std::memory_order_relaxed);
+    }
+  }
+
+  auto size() const noexcept { return num_accounts_; }
+
+  // Moves amount from one account to another, unless that would make
+  // the balance of from negative. Returns true if it did. Throws if
+  // amount is negative, which would move money the other way.
+  auto transfer(uint32_t from, uint32_t to, int64_t amount) -> bool {
+    assert(from < num_accounts_ && to < num_accounts_);
+    check_amount(amount);
+    if (from == to) {
+      return balance(from) >= amount;
+    }
+    auto& first = accounts_[std::min(from, to)].lock_;
+    auto& second = accounts_[std::max(from, to)].lock_;
+    first.lock();
+    second.lock();
+    const auto ok = apply_locked(from, to, amount);
+    second.unlock();
+    first.unlock();
+    return ok;
+  }
+
+  // Applies the transfers and returns how many succeeded. Transfers
+  // within a shard are applied in the order given, but those between
+  // shards are applied last. Throws before applying any of them if an
+  // amount is negative.
+  auto apply(const std::vector<Transfer>& transfers) -> size_t {
+    for (const auto& t : transfers) {
+      assert(t.from_ < num_accounts_ && t.to_ < num_accounts_);
+      check_amount(t.amount_);
+    }
+    const auto shard_size = size_t{1} << shard_shift_;
+    const auto num_shards = (num_accounts_ + shard_size - 1) / shard_size;
+    // Scratch space reused between calls, to not allocate per batch
+    thread_local auto offsets = std::vector<uint32_t>{};
+    thread_local auto by_shard = std::vector<Transfer>{};
+    thread_local auto between_shards = std::vector<Transfer>{};
+    // Counting sort of the transfers within a shard by shard
+    offsets.assign(num_shards + 1, 0);
+    between_shards.clear();
+    for (const auto& t : transfers) {
+      if (shard_of(t.from_) == shard_of(t.to_)) {
+        ++offsets[shard_of(t.from_) + 1];
+      } else {
+        between_shards.push_back(t);
+      }
+    }
+    for (size_t s = 0; s < num_shards; ++s) {
+      offsets[s + 1] += offsets[s];
+    }
+    by_shard.resize(offsets[num_shards]);
+    for (const auto& t : transfers) {
+      if (shard_of(t.from_) == shard_of(t.to_)) {
+        // Uses offsets[s] as the next free slot of shard s, which
+        // leaves it at the start of shard s + 1
+        by_shard[offsets[shard_of(t.from_)]++] = t;
+      }
+    }
+
+    auto succeeded = size_t{0};
+    auto begin = uint32_t{0};
+    for (size_t s = 0; s < num_shards; ++s) {
+      const auto end = offsets[s];
+      if (begin == end) {
+        continue;
+      }
+      // One bit per account of the shard, so that they are locked once
+      // each, in the order of their ids
+      auto used = uint64_t{0};
+      for (auto i = begin; i < end; ++i) {
+        used |= bit_of(by_shard[i].from_) | bit_of(by_shard[i].to_);
+      }
+      const auto first = static_cast<uint32_t>(s << shard_shift_);
+      for_each_bit(used, first, [this](uint32_t id) { accounts_[id].lock_.lock(); });
+      for (auto i = begin; i < end; ++i) {
+        const auto& t = by_shard[i];
+        succeeded += apply_locked(t.from_, t.to_, t.amount_) ? 1 : 0;
+      }
+      for_each_bit(used, first, [this](uint32_t id) { accounts_[id].lock_.unlock(); });
+      begin = end;
+    }
+    for (const auto& t : between_shards) {
+      succeeded += transfer(t.from_, t.to_, t.amount_) ? 1 : 0;
+    }
+    return succeeded;
+  }
+
+  // Reads the balance without locking. If writers keep changing the
+  // account, it gives up after a few attempts and locks it.
+  auto balance(uint32_t id) -> int64_t {
+    auto& account = accounts_[id];
+    for (auto attempt = 0; attempt < kOptimisticAttempts; ++attempt) {
+      const auto version = account.lock_.read_begin();
+      const auto balance = account.balance_.load(std::memory_order_relaxed);
+      if (account.lock_.validate(version)) {
+        return balance;
+      }
+      cpu_relax();
+    }
+    account.lock_.lock();
+    const auto balance = account.balance_.load(std::memory_order_relaxed);
+    account.lock_.unlock();
+    return balance;
+  }
+
+  // The sum of all balances at one point in time, which locks all the
+  // accounts
+  auto total() -> int64_t {
+    auto sum = int64_t{0};
+    for (size_t i = 0; i < num_accounts_; ++i) {
+      accounts_[i].lock_.lock();
+      sum += accounts_[i].balance_.load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < num_accounts_; ++i) {
+      accounts_[i].lock_.unlock();
+    }
+    return sum;
+  }
+
+private:
+  static constexpr auto kOptimisticAttempts = 8;
+
+  // Accounts are on their own cache lines, since the hot accounts of
+  // a skewed distribution are often next to each other
+  struct alignas(kCacheLineSize) Account {
+    SeqCount lock_;
+    std::atomic<int64_t> balance_{0};
+  };
+
+  static auto log2_ceil(size_t n) noexcept -> unsigned {
+    auto shift = 0u;
+    while ((size_t{1} << shift) < n) {
+      ++shift;
+    }
+    return shift;
+  }
+
+  auto shard_of(uint32_t id) const noexcept -> size_t { return id >> shard_shift_; }
+
+  // The bit of an account within the bits of its shard
+  auto bit_of(uint32_t id) const noexcept -> uint64_t {
+    return uint64_t{1} << (id & ((uint32_t{1} << shard_shift_) - 1));
+  }
+
+  template <typename F>
+  static auto for_each_bit(uint64_t bits, uint32_t first, F&& f) -> void {
+    for (auto id = first; bits != 0; bits >>= 1, ++id) {
+      if (bits & 1) {
+        f(id);
+      }
+    }
+  }
+
+  static auto check_amount(int64_t amount) -> void {
+    if (amount < 0) {
+      throw std::invalid_argument("Negative amount");
+    }
+  }
+
+  auto apply_locked(uint32_t from, uint32_t to, int64_t amount) -> bool {
+    auto& source = accounts_[from].balance_;
+    const auto balance = source.load(std::memory_order_relaxed);
+    if (balance < amount) {
+      return false;
+    }
+    source.store(balance - amount, std::memory_order_relaxed);
+    auto& target = accounts_[to].balance_;
+    target.store(target.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    return true;
+  }
+
+  const size_t num_accounts_;
+  const unsigned shard_shift_;
+  const std::unique_ptr<Account[]> accounts_;
+};
+
+} // namespace ledger
+
+#endif
@@ -0,0 +1,238 @@
+#include <array>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "bench_utils.hpp"
+#include "lite_future.hpp"
+#include "thread_pool.hpp"
+
+//
+// This example compares lite::Future with std::future for passing
+// values through futures, and for fanning out requests to a thread
+// pool and combining the results. With std::future a thread has to
+// block in get() for each result, while lite::Future chains the work
+// with then() and when_all().
+//
+
+namespace {
+
+// Number of futures in the benchmarks. Increase if you want more.
+constexpr auto kNumRoundTrips = 1'000'000;
+constexpr auto kNumRequests = 2'000;
+constexpr auto kFanOut = 16;
+
+auto divide(int a, int b) {
+  if (b == 0) {
+    throw std::runtime_error("Divide by zero exception");
+  }
+  return a / b;
+}
+
+} // namespace
+
+TEST(LiteFuture, PromiseFromOtherThread) {
+  auto promise = lite::Promise<int>{};
+  auto future = promise.get_future();
+  auto t = std::thread{[&promise] { promise.set_value(divide(45, 5)); }};
+  ASSERT_EQ(45 / 5, future.get());
+  ASSERT_FALSE(future.valid());
+  t.join();
+}
+
+TEST(LiteFuture, ThenOnExecutor) {
+  auto pool = ThreadPool{2};
+  auto promise = lite::Promise<int>{};
+  auto future = promise.get_future()
+                  .then(pool, [](int i) { return i * 2; })
+                  .then(pool, [](int i) { return std::to_string(i); })
+                  .then([](std::string s) { return s + "!"; });
+  promise.set_value(21);
+  ASSERT_EQ("42!", future.get());
+}
+
+TEST(LiteFuture, ThenOnReadyFutureRunsInline) {
+  const auto caller = std::this_thread::get_id();
+  auto future = lite::make_ready_future(1).then([caller](int i) {
+    EXPECT_EQ(caller, std::this_thread::get_id());
+    return i + 1;
+  });
+  ASSERT_TRUE(future.is_ready());
+  ASSERT_EQ(2, future.get());
+}
+
+TEST(LiteFuture, ExceptionsSkipContinuations) {
+  auto calls = 0;
+  auto future = lite::make_ready_future(0)
+                  .then([](int i) { return divide(1, i); })
+                  .then([&calls](int i) {
+                    ++calls;
+                    return i;
+                  });
+  ASSERT_THROW(future.get(), std::runtime_error);
+  ASSERT_EQ(0, calls);
+}
+
+TEST(LiteFuture, VoidContinuationGivesUnit) {
+  auto result = 0;
+  auto future = lite::make_ready_future(5).then([&result](int i) { result = i; });
+  static_assert(std::is_same_v<decltype(future), lite::Future<lite::Unit>>);
+  future.get();
+  ASSERT_EQ(5, result);
+}
+
+TEST(LiteFuture, BrokenPromise) {
+  auto future = lite::Future<int>{};
+  {
+    auto promise = lite::Promise<int>{};
+    future = promise.get_future();
+  }
+  ASSERT_THROW(future.get(), std::future_error);
+}
+
+TEST(LiteFuture, SmallContinuationsAreStoredInPlace) {
+  auto small = [p = std::unique_ptr<int>{}, i = 0] {};
+  auto large = [a = std::array<char, 64>{}] {};
+  ASSERT_TRUE(lite::detail::Callback::fits_inline<decltype(small)>());
+  ASSERT_FALSE(lite::detail::Callback::fits_inline<decltype(large)>());
+  // Continuations too large to fit still work
+  auto future = lite::make_ready_future(1).then(
+    [a = std::array<int, 64>{}](int i) { return i + static_cast<int>(a.size()); });
+  ASSERT_EQ(65, future.get());
+}
+
+TEST(LiteFuture, WhenAll) {
+  auto pool = ThreadPool{4};
+  auto promises = std::vector<lite::Promise<int>>(10);
+  auto futures = std::vector<lite::Future<int>>{};
+  for (auto& p : promises) {
+    futures.push_back(p.get_future().then(pool, [](int i) { return i * i; }));
+  }
+  futures.push_back(lite::make_ready_future(100));
+  auto all = lite::when_all(std::move(futures));
+  for (auto i = 9; i >= 0; --i) {
+    promises[i].set_value(i);
+  }
+  ASSERT_EQ(std::vector<int>({0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 100}), all.get());
+  ASSERT_TRUE(lite::when_all(std::vector<lite::Future<int>>{}).get().empty());
+}
+
+TEST(LiteFuture, WhenAllFailsWithFirstException) {
+  auto slow = lite::Promise<int>{};
+  auto futures = std::vector<lite::Future<int>>{};
+  futures.push_back(slow.get_future());
+  futures.push_back(lite::make_ready_future(0).then([](int i) { return divide(1, i); }));
+  auto all = lite::when_all(std::move(futures));
+  // Fails without waiting for the slow one
+  ASSERT_TRUE(all.is_ready());
+  ASSERT_THROW(all.get(), std::runtime_error);
+  slow.set_value(1);
+}
+
+TEST(LiteFuture, WhenAny) {
+  auto promises = std::vector<lite::Promise<std::string>>(3);
+  auto futures = std::vector<lite::Future<std::string>>{};
+  for (auto& p : promises) {
+    futures.push_back(p.get_future());
+  }
+  auto any = lite::when_any(std::move(futures));
+  ASSERT_FALSE(any.is_ready());
+  promises[1].set_value("one");
+  promises[0].set_value("zero");
+  const auto [index, value] = any.get();
+  ASSERT_EQ(1u, index);
+  ASSERT_EQ("one", value);
+  promises[2].set_value("two");
+}
+
+TEST(LiteFuture, CompareWithStdFuture) {
+  std::cout << "ms for " << kNumRoundTrips << " promise, set_value(), get()" << '\n';
+  auto sum = 0ll;
+  auto ms = time_ms([&] {
+    for (auto i = 0; i < kNumRoundTrips; ++i) {
+      auto p = std::promise<int>{};
+      auto f = p.get_future();
+      p.set_value(i);
+      sum += f.get();
+    }
+  });
+  std::cout << "  " << ms << " std::future" << '\n';
+  ms = time_ms([&] {
+    for (auto i = 0; i < kNumRoundTrips; ++i) {
+      auto p = lite::Promise<int>{};
+      auto f = p.get_future();
+      p.set_value(i);
+      sum -= f.get();
+    }
+  });
+  std::cout << "  " << ms << " lite::Future" << '\n';
+  ASSERT_EQ(0, sum);
+
+  std::cout << "ms for " << kNumRoundTrips << " ready values passed through 3 functions"
+            << '\n';
+  const auto inc = [](int i) { return i + 1; };
+  ms = time_ms([&] {
+    for (auto i = 0; i < kNumRoundTrips; ++i) {
+      auto f = std::async(std::launch::deferred, [i, inc] { return inc(inc(inc(i))); });
+      sum += f.get();
+    }
+  });
+  std::cout << "  " << ms << " std::async, deferred" << '\n';
+  ms = time_ms([&] {
+    for (auto i = 0; i < kNumRoundTrips; ++i) {
+      sum -= lite::make_ready_future(i).then(inc).then(inc).then(inc).get();
+    }
+  });
+  std::cout << "  " << ms << " lite::Future, then()" << '\n';
+  ASSERT_EQ(0, sum);
+
+  // Each request fans out kFanOut tasks to the pool and adds up their
+  // results in another task
+  std::cout << "ms for " << kNumRequests << " requests of " << kFanOut << " tasks" << '\n';
+  auto pool = ThreadPool{};
+  const auto expected = static_cast<long long>(kNumRequests) * kFanOut * (kFanOut - 1) / 2;
+  ms = time_ms([&] {
+    auto results = std::vector<std::future<long long>>{};
+    for (auto r = 0; r < kNumRequests; ++r) {
+      auto parts = std::make_shared<std::vector<std::future<int>>>();
+      for (auto i = 0; i < kFanOut; ++i) {
+        parts->push_back(pool.submit([i] { return i; }));
+      }
+      // The combining task blocks a worker until the parts are done
+      results.push_back(pool.submit([parts] {
+        auto s = 0ll;
+        for (auto& p : *parts) {
+          s += p.get();
+        }
+        return s;
+      }));
+    }
+    for (auto& f : results) {
+      sum += f.get();
+    }
+  });
+  ASSERT_EQ(expected, sum);
+  std::cout << "  " << ms << " std::future" << '\n';
+  ms = time_ms([&] {
+    auto results = std::vector<lite::Future<long long>>{};
+    for (auto r = 0; r < kNumRequests; ++r) {
+      auto parts = std::vector<lite::Future<int>>{};
+      for (auto i = 0; i < kFanOut; ++i) {
+        parts.push_back(lite::make_ready_future(i).then(pool, [](int i) { return i; }));
+      }
+      results.push_back(lite::when_all(std::move(parts)).then(pool, [](std::vector<int> v) {
+        return std::accumulate(v.begin(), v.end(), 0ll);
+      }));
+    }
+    for (auto& f : results) {
+      sum -= f.get();
+    }
+  });
+  ASSERT_EQ(0, sum);
+  std::cout << "  " << ms << " lite::Future, then() and when_all()" << '\n';
+}
@@ -0,0 +1,480 @@
+#pragma once
+#ifndef LITE_FUTURE_HPP
+#define LITE_FUTURE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "parking.hpp"
+
+//
+// A future and promise which, unlike std::future, can be chained
+// without blocking a thread:
+//
+//   auto f = read_async(path)
+//              .then(pool, [](Buffer b) { return parse(b); })
+//              .then([](Document d) { return d.title(); });
+//
+// then() runs its function on the given executor once the value is
+// set, or inline without an executor. An executor is anything with a
+// post(task) member function, such as the ThreadPool of
+// thread_pool.hpp. If the future fails, the function isn't called and
+// the exception is passed on to the returned future.
+//
+// Compared to std::future:
+// - The shared state holds the continuation in place if it's small,
+//   so then() makes one allocation, for the state of the next future.
+// - make_ready_future() needs no shared state, and then() without an
+//   executor on a ready future calls the function right away, so a
+//   chain of ready futures doesn't allocate at all.
+// - get() spins briefly before it parks, see parking.hpp.
+//
+// A function returning void gives a Future<Unit>.
+//
+
+namespace lite {
+
+struct Unit {};
+
+// Runs tasks right away in the calling thread
+class InlineExecutor {
+public:
+  template <typename F>
+  auto post(F&& task) -> void {
+    std::forward<F>(task)();
+  }
+};
+
+template <typename T>
+class Future;
+template <typename T>
+class Promise;
+template <typename U>
+auto make_ready_future(U&& value) -> Future<std::decay_t<U>>;
+template <typename T>
+auto make_exceptional_future(std::exception_ptr e) -> Future<T>;
+
+namespace detail {
+
+// A void() function object which is stored in place if it fits in
+// kInlineSize bytes, and on the heap otherwise. It can't be moved, as
+// it's built where it's used.
+class Callback {
+public:
+  static constexpr auto kInlineSize = size_t{48};
+
+  template <typename F>
+  static constexpr auto fits_inline() {
+    using D = std::decay_t<F>;
+    return sizeof(D) <= kInlineSize && alignof(D) <= alignof(std::max_align_t);
+  }
+
+  Callback() = default;
+  Callback(const Callback&) = delete;
+  auto operator=(const Callback&) -> Callback& = delete;
+  ~Callback() { reset(); }
+
+  template <typename F>
+  auto emplace(F&& f) -> void {
+    using D = std::decay_t<F>;
+    reset();
+    if constexpr (fits_inline<F>()) {
+      target_ = ::new (static_cast<void*>(&buffer_)) D(std::forward<F>(f));
+      destroy_ = [](void* p) { static_cast<D*>(p)->~D(); };
+    } else {
+      target_ = new D(std::forward<F>(f));
+      destroy_ = [](void* p) { delete static_cast<D*>(p); };
+    }
+    call_ = [](void* p) { (*static_cast<D*>(p))(); };
+  }
+
+  auto operator()() -> void { call_(target_); }
+
+  auto reset() noexcept -> void {
+    if (destroy_ != nullptr) {
+      destroy_(target_);
+      destroy_ = nullptr;
+    }
+  }
+
+private:
+  std::aligned_storage_t<kInlineSize, alignof(std::max_align_t)> buffer_;
+  void* target_{};
+  void (*call_)(void*){};
+  void (*destroy_)(void*){};
+};
+
+template <typename T>
+struct Result {
+  std::optional<T> value_;
+  std::exception_ptr error_;
+};
+
+// The state shared by a promise and its future, which is deleted when
+// both are done with it. The promise sets the result once, and the
+// future either waits for it or subscribes a callback once.
+template <typename T>
+class State {
+public:
+  State() = default;
+  State(const State&) = delete;
+  auto operator=(const State&) -> State& = delete;
+
+  auto add_ref() noexcept { refs_.fetch_add(1, std::memory_order_relaxed); }
+  auto release() noexcept {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  template <typename... Args>
+  auto set_value(Args&&... args) -> void {
+    result_.value_.emplace(std::forward<Args>(args)...);
+    complete();
+  }
+  auto set_exception(std::exception_ptr e) -> void {
+    result_.error_ = std::move(e);
+    complete();
+  }
+
+  auto is_ready() const noexcept {
+    return status_.load(std::memory_order_acquire) == kReady;
+  }
+  auto wait() -> Result<T>& {
+    ready_.await([this] { return is_ready(); });
+    return result_;
+  }
+
+  // Posts f(result) to ex once the result is set. Takes over the
+  // caller's reference to the state, and releases it after f.
+  template <typename Ex, typename F>
+  auto subscribe(Ex& ex, F&& f) -> void {
+    callback_.emplace([this, f = std::forward<F>(f)]() mutable {
+      f(std::move(result_));
+      release();
+    });
+    executor_ = &ex;
+    post_ = [](void* executor, State* state) {
+      if constexpr (std::is_same_v<Ex, InlineExecutor>) {
+        state->callback_();
+      } else {
+        // A pointer is cheap to copy, as some executors require
+        static_cast<Ex*>(executor)->post([state] { state->callback_(); });
+      }
+    };
+    auto expected = kEmpty;
+    if (!status_.compare_exchange_strong(expected, kSubscribed, std::memory_order_acq_rel)) {
+      post_(executor_, this); // The result was already set
+    }
+  }
+
+private:
+  static constexpr auto kEmpty = uint8_t{0};
+  static constexpr auto kSubscribed = uint8_t{1};
+  static constexpr auto kReady = uint8_t{2};
+
+  auto complete() -> void {
+    if (status_.exchange(kReady, std::memory_order_acq_rel) == kSubscribed) {
+      post_(executor_, this);
+    } else {
+      ready_.notify_all();
+    }
+  }
+
+  std::atomic<int> refs_{1};
+  std::atomic<uint8_t> status_{kEmpty};
+  Result<T> result_;
+  Callback callback_;
+  void* executor_{};
+  void (*post_)(void*, State*){};
+  EventCount ready_;
+};
+
+template <typename F, typename T>
+using invoke_result_t = std::conditional_t<std::is_void_v<std::invoke_result_t<F, T>>, Unit,
+                                           std::invoke_result_t<F, T>>;
+
+// Sets the promise to f(arg), or to what f throws
+template <typename R, typename F, typename T>
+auto fulfill(Promise<R>& promise, F& f, T&& arg) -> void {
+  try {
+    if constexpr (std::is_void_v<std::invoke_result_t<F, T>>) {
+      f(std::forward<T>(arg));
+      promise.set_value(Unit{});
+    } else {
+      promise.set_value(f(std::forward<T>(arg)));
+    }
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+inline auto inline_executor() -> InlineExecutor& {
+  static auto executor = InlineExecutor{};
+  return executor;
+}
+
+} // namespace detail
+
+template <typename T>
+class Future {
+public:
+  Future() = default;
+  Future(Future&& other) noexcept
+    : value_{std::move(other.value_)}, state_{std::exchange(other.state_, nullptr)} {
+    other.value_.reset();
+  }
+  auto operator=(Future&& other) noexcept -> Future& {
+    if (this != &other) {
+      reset();
+      value_ = std::move(other.value_);
+      other.value_.reset();
+      state_ = std::exchange(other.state_, nullptr);
+    }
+    return *this;
+  }
+  ~Future() { reset(); }
+
+  auto valid() const noexcept { return value_.has_value() || state_ != nullptr; }
+  auto is_ready() const noexcept { return value_.has_value() || state_->is_ready(); }
+
+  // Blocks until the value is set and returns it, or throws the
+  // exception it was set to. Leaves the future invalid.
+  auto get() -> T {
+    if (value_) {
+      auto value = std::move(*value_);
+      value_.reset();
+      return value;
+    }
+    auto* state = std::exchange(state_, nullptr);
+    auto& result = state->wait();
+    auto guard = std::unique_ptr<detail::State<T>, Release>{state};
+    if (result.error_) {
+      std::rethrow_exception(result.error_);
+    }
+    return std::move(*result.value_);
+  }
+
+  // Runs f(value) on ex, and returns a future for its result. Leaves
+  // this future invalid.
+  template <typename Ex, typename F>
+  auto then(Ex& ex, F&& f) -> Future<detail::invoke_result_t<std::decay_t<F>, T>> {
+    using R = detail::invoke_result_t<std::decay_t<F>, T>;
+    if constexpr (std::is_same_v<Ex, InlineExecutor>) {
+      if (value_) {
+        try {
+          if constexpr (std::is_void_v<std::invoke_result_t<std::decay_t<F>, T>>) {
+            f(get());
+            return make_ready_future(Unit{});
+          } else {
+            return make_ready_future(f(get()));
+          }
+        } catch (...) {
+          return make_exceptional_future<R>(std::current_exception());
+        }
+      }
+    }
+    auto promise = Promise<R>{};
+    auto next = promise.get_future();
+    on_result(ex, [promise = std::move(promise),
+                   f = std::forward<F>(f)](detail::Result<T>&& result) mutable {
+      if (result.error_) {
+        promise.set_exception(std::move(result.error_));
+      } else {
+        detail::fulfill(promise, f, std::move(*result.value_));
+      }
+    });
+    return next;
+  }
+
+  // Runs f(value) in the thread which sets the value, or right away if
+  // it's already set
+  template <typename F>
+  auto then(F&& f) {
+    return then(detail::inline_executor(), std::forward<F>(f));
+  }
+
+private:
+  template <typename U>
+  friend class Promise;
+  template <typename U>
+  friend auto make_ready_future(U&& value) -> Future<std::decay_t<U>>;
+  template <typename U>
+  friend auto when_all(std::vector<Future<U>> futures) -> Future<std::vector<U>>;
+  template <typename U>
+  friend auto when_any(std::vector<Future<U>> futures) -> Future<std::pair<size_t, U>>;
+
+  struct Release {
+    auto operator()(detail::State<T>* state) const noexcept { state->release(); }
+  };
+
+  explicit Future(detail::State<T>* state) noexcept : state_{state} {}
+  struct ReadyTag {};
+  template <typename U>
+  Future(ReadyTag, U&& value) : value_{std::forward<U>(value)} {}
+
+  auto reset() noexcept -> void {
+    value_.reset();
+    if (state_ != nullptr) {
+      std::exchange(state_, nullptr)->release();
+    }
+  }
+
+  // Posts f(Result<T>&&) to ex once the result is set, and leaves
+  // this future invalid
+  template <typename Ex, typename F>
+  auto on_result(Ex& ex, F&& f) -> void {
+    if (value_) {
+      // A ready value needs a state to wait in the executor's queue
+      auto* state = new detail::State<T>{};
+      state->set_value(std::move(*value_));
+      value_.reset();
+      state->subscribe(ex, std::forward<F>(f));
+      return;
+    }
+    std::exchange(state_, nullptr)->subscribe(ex, std::forward<F>(f));
+  }
+
+  std::optional<T> value_;
+  detail::State<T>* state_{};
+};
+
+template <typename T>
+class Promise {
+public:
+  Promise() : state_{new detail::State<T>{}} {}
+  Promise(Promise&& other) noexcept
+    : state_{std::exchange(other.state_, nullptr)}, satisfied_{other.satisfied_} {}
+  auto operator=(Promise&& other) noexcept -> Promise& {
+    if (this != &other) {
+      abandon();
+      state_ = std::exchange(other.state_, nullptr);
+      satisfied_ = other.satisfied_;
+    }
+    return *this;
+  }
+  ~Promise() { abandon(); }
+
+  // May only be called once
+  auto get_future() -> Future<T> {
+    state_->add_ref();
+    return Future<T>{state_};
+  }
+
+  template <typename U>
+  auto set_value(U&& value) -> void {
+    satisfied_ = true;
+    state_->set_value(std::forward<U>(value));
+  }
+  auto set_exception(std::exception_ptr e) -> void {
+    satisfied_ = true;
+    state_->set_exception(std::move(e));
+  }
+
+private:
+  // A promise destroyed without a result breaks it, like std::promise
+  auto abandon() noexcept -> void {
+    if (state_ == nullptr) {
+      return;
+    }
+    if (!satisfied_) {
+      state_->set_exception(
+        std::make_exception_ptr(std::future_error{std::future_errc::broken_promise}));
+    }
+    std::exchange(state_, nullptr)->release();
+  }
+
+  detail::State<T>* state_{};
+  bool satisfied_{false};
+};
+
+// A future which already has its value, without any allocation
+template <typename U>
+auto make_ready_future(U&& value) -> Future<std::decay_t<U>> {
+  return Future<std::decay_t<U>>{typename Future<std::decay_t<U>>::ReadyTag{},
+                                 std::forward<U>(value)};
+}
+
+template <typename T>
+auto make_exceptional_future(std::exception_ptr e) -> Future<T> {
+  auto promise = Promise<T>{};
+  promise.set_exception(std::move(e));
+  return promise.get_future();
+}
+
+// A future for the values of all the futures, in the same order. If
+// any of them fails, it fails with the first exception, without
+// waiting for the others.
+template <typename T>
+auto when_all(std::vector<Future<T>> futures) -> Future<std::vector<T>> {
+  if (futures.empty()) {
+    return make_ready_future(std::vector<T>{});
+  }
+  struct All {
+    explicit All(size_t n) : values_(n), remaining_{n} {}
+    std::vector<std::optional<T>> values_;
+    std::atomic<size_t> remaining_;
+    std::atomic<bool> failed_{false};
+    Promise<std::vector<T>> promise_;
+  };
+  auto all = std::make_shared<All>(futures.size());
+  auto result = all->promise_.get_future();
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].on_result(detail::inline_executor(), [all, i](detail::Result<T>&& r) {
+      if (r.error_) {
+        if (!all->failed_.exchange(true, std::memory_order_acq_rel)) {
+          all->promise_.set_exception(std::move(r.error_));
+        }
+      } else {
+        all->values_[i] = std::move(r.value_);
+      }
+      // The last one sees all the values, and if any failed
+      if (all->remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+          !all->failed_.load(std::memory_order_relaxed)) {
+        auto values = std::vector<T>{};
+        values.reserve(all->values_.size());
+        for (auto& v : all->values_) {
+          values.push_back(std::move(*v));
+        }
+        all->promise_.set_value(std::move(values));
+      }
+    });
+  }
+  return result;
+}
+
+// A future for the index and value of the first of the futures to be
+// set, or its exception if it failed. The futures must not be empty.
+template <typename T>
+auto when_any(std::vector<Future<T>> futures) -> Future<std::pair<size_t, T>> {
+  struct Any {
+    std::atomic<bool> done_{false};
+    Promise<std::pair<size_t, T>> promise_;
+  };
+  auto any = std::make_shared<Any>();
+  auto result = any->promise_.get_future();
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].on_result(detail::inline_executor(), [any, i](detail::Result<T>&& r) {
+      if (any->done_.exchange(true, std::memory_order_acq_rel)) {
+        return;
+      }
+      if (r.error_) {
+        any->promise_.set_exception(std::move(r.error_));
+      } else {
+        any->promise_.set_value(std::make_pair(i, std::move(*r.value_)));
+      }
+    });
+  }
+  return result;
+}
+
+} // namespace lite
+
+#endif
@@ -0,0 +1,167 @@
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "bench_utils.hpp"
+#include "mpmc_queue.hpp"
+
+//
+// This example compares MpmcQueue with a bounded queue guarded by a
+// mutex and two condition variables, like the queue in
+// producer_consumer.cpp, with the same number of producer and
+// consumer threads.
+//
+
+namespace {
+
+// Number of items passed in each run. Increase if you want more.
+constexpr auto kNumItems = 400'000;
+constexpr auto kCapacity = size_t{1024};
+constexpr auto kBatchSize = size_t{32};
+
+} // namespace
+
+TEST(MpmcQueue, PushAndPop) {
+  auto q = MpmcQueue<int>{3};
+  ASSERT_EQ(4u, q.capacity());
+  auto item = 0;
+  ASSERT_FALSE(q.try_pop(item));
+  for (auto i = 0; i < 4; ++i) {
+    ASSERT_TRUE(q.try_push(i));
+  }
+  ASSERT_FALSE(q.try_push(4));
+  for (auto i = 4; i < 20; ++i) {
+    ASSERT_TRUE(q.try_pop(item));
+    ASSERT_EQ(i - 4, item);
+    ASSERT_TRUE(q.try_push(i));
+  }
+  ASSERT_EQ(4u, q.size_approx());
+}
+
+TEST(MpmcQueue, Batches) {
+  auto q = MpmcQueue<int>{8};
+  auto in = std::vector<int>(12);
+  std::iota(in.begin(), in.end(), 0);
+  ASSERT_EQ(8u, q.try_push_n(in.data(), in.size()));
+  ASSERT_EQ(0u, q.try_push_n(in.data(), in.size()));
+  auto out = std::vector<int>(12);
+  ASSERT_EQ(5u, q.try_pop_n(out.data(), 5));
+  ASSERT_EQ(4u, q.try_push_n(in.data() + 8, 4));
+  ASSERT_EQ(7u, q.try_pop_n(out.data() + 5, 100));
+  ASSERT_EQ(0u, q.try_pop_n(out.data(), 100));
+  ASSERT_EQ(in, out);
+}
+
+TEST(MpmcQueue, RejectsCapacityWithoutPowerOfTwo) {
+  const auto largest = (std::numeric_limits<size_t>::max() >> 1) + 1;
+  ASSERT_EQ(largest, round_up_to_power_of_two(largest - 1));
+  ASSERT_THROW(MpmcQueue<int>{largest + 1}, std::length_error);
+}
+
+TEST(MpmcQueue, ManyProducersAndConsumers) {
+  auto q = MpmcQueue<int>{16};
+  // Half of the producers push batches, and the consumers pop batches
+  const auto sum = run_producers_and_consumers(
+    4, kNumItems,
+    [&](int first, int last) {
+      if (first < kNumItems / 2) {
+        for (auto i = first; i < last; ++i) {
+          q.push(i);
+        }
+        return;
+      }
+      auto items = std::vector<int>(last - first);
+      std::iota(items.begin(), items.end(), first);
+      for (size_t i = 0; i < items.size(); i += 5) {
+        q.push_n(items.data() + i, std::min<size_t>(5, items.size() - i));
+      }
+    },
+    [&](int count) {
+      auto sum = 0ll;
+      int items[3];
+      while (count > 0) {
+        const auto popped = q.pop_n(items, std::min(3, count));
+        for (size_t i = 0; i < popped; ++i) {
+          sum += items[i];
+        }
+        count -= static_cast<int>(popped);
+      }
+      return sum;
+    });
+  ASSERT_EQ(static_cast<long long>(kNumItems) * (kNumItems - 1) / 2, sum);
+}
+
+TEST(MpmcQueue, CompareWithMutexQueue) {
+  const auto expected = static_cast<long long>(kNumItems) * (kNumItems - 1) / 2;
+  std::cout << "ms for " << kNumItems << " items" << '\n'
+            << std::setw(10) << "threads" << std::setw(12) << "mutex+cv" << std::setw(8)
+            << "mpmc" << std::setw(14) << "mpmc batch" << '\n';
+  for (auto t = 1; t <= 64; t *= 2) {
+    auto mutex_queue = MutexQueue<int>{kCapacity};
+    auto sum = 0ll;
+    const auto mutex_ms = time_ms([&] {
+      sum = run_producers_and_consumers(
+        t, kNumItems, [&](int first, int last) {
+          for (auto i = first; i < last; ++i) {
+            mutex_queue.push(i);
+          }
+        },
+        [&](int count) {
+          auto s = 0ll;
+          for (auto i = 0; i < count; ++i) {
+            s += mutex_queue.pop();
+          }
+          return s;
+        });
+    });
+    ASSERT_EQ(expected, sum);
+
+    auto q = MpmcQueue<int>{kCapacity};
+    const auto mpmc_ms = time_ms([&] {
+      sum = run_producers_and_consumers(
+        t, kNumItems, [&](int first, int last) {
+          for (auto i = first; i < last; ++i) {
+            q.push(i);
+          }
+        },
+        [&](int count) {
+          auto s = 0ll;
+          for (auto i = 0; i < count; ++i) {
+            s += q.pop();
+          }
+          return s;
+        });
+    });
+    ASSERT_EQ(expected, sum);
+
+    const auto batch_ms = time_ms([&] {
+      sum = run_producers_and_consumers(
+        t, kNumItems, [&](int first, int last) {
+          int items[kBatchSize];
+          for (auto i = first; i < last; i += kBatchSize) {
+            const auto n = std::min<size_t>(kBatchSize, last - i);
+            std::iota(items, items + n, i);
+            q.push_n(items, n);
+          }
+        },
+        [&](int count) {
+          auto s = 0ll;
+          int items[kBatchSize];
+          while (count > 0) {
+            const auto popped = q.pop_n(items, std::min<size_t>(kBatchSize, count));
+            for (size_t i = 0; i < popped; ++i) {
+              s += items[i];
+            }
+            count -= static_cast<int>(popped);
+          }
+          return s;
+        });
+    });
+    ASSERT_EQ(expected, sum);
+    std::cout << std::setw(10) << 2 * t << std::setw(12) << mutex_ms << std::setw(8) << mpmc_ms
+              << std::setw(14) << batch_ms << '\n';
+  }
+}
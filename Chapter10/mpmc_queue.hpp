@@ -0,0 +1,211 @@
+#pragma once
+#ifndef MPMC_QUEUE_HPP
+#define MPMC_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "cache_line.hpp"
+#include "parking.hpp"
+#include "sync_utils.hpp"
+
+//
+// A bounded lock-free queue for any number of producers and consumers,
+// after Dmitry Vyukov's design.
+//
+// Each cell of the ring buffer has a sequence number which tells whose
+// turn it is. A producer claims position pos by moving the tail from
+// pos to pos + 1 with a CAS, but only once the cell's sequence is pos,
+// meaning it's empty for this lap. After writing the item it sets the
+// sequence to pos + 1, which hands the cell to the consumer of pos.
+// The consumer sets it to pos + capacity when done, handing it to the
+// producer of the next lap. Producers and consumers only contend on
+// their own index, and never wait for a thread in the middle of an
+// operation on another cell.
+//
+// The batch operations claim several consecutive cells with one CAS.
+//
+// The blocking push() and pop() spin for a while, and then park on an
+// EventCount until the queue changes. Each item, or free cell, wakes
+// one parked thread.
+//
+
+template <typename T>
+class MpmcQueue {
+public:
+  // The capacity is rounded up to a power of two
+  explicit MpmcQueue(size_t capacity)
+    : capacity_{round_up_to_power_of_two(std::max<size_t>(capacity, 2))},
+      mask_{capacity_ - 1}, cells_{std::make_unique<Cell[]>(capacity_)} {
+    for (size_t i = 0; i < capacity_; ++i) {
+      cells_[i].sequence_.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpmcQueue(const MpmcQueue&) = delete;
+  auto operator=(const MpmcQueue&) -> MpmcQueue& = delete;
+
+  auto capacity() const noexcept { return capacity_; }
+
+  // Number of items, which may be out of date when it's returned
+  auto size_approx() const noexcept {
+    const auto head = head_.load(std::memory_order_relaxed);
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    return tail > head ? std::min(tail - head, capacity_) : size_t{0};
+  }
+
+  template <typename U>
+  auto try_push(U&& item) -> bool {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& cell = cells_[pos & mask_];
+      const auto seq = cell.sequence_.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.item_ = std::forward<U>(item);
+          cell.sequence_.store(pos + 1, std::memory_order_release);
+          not_empty_.notify_one();
+          return true;
+        }
+      } else if (diff < 0) {
+        return false; // The cell still holds an item from the last lap
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  auto try_pop(T& item) -> bool {
+    auto pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& cell = cells_[pos & mask_];
+      const auto seq = cell.sequence_.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          item = std::move(cell.item_);
+          cell.sequence_.store(pos + capacity_, std::memory_order_release);
+          not_full_.notify_one();
+          return true;
+        }
+      } else if (diff < 0) {
+        return false; // Nothing has been pushed to the cell yet
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Pushes the first items of [items, items + n) which fit, and
+  // returns how many were pushed
+  auto try_push_n(const T* items, size_t n) -> size_t {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      // The free cells from pos can't be taken without moving the tail
+      auto k = size_t{0};
+      while (k < n && cells_[(pos + k) & mask_].sequence_.load(std::memory_order_acquire) ==
+                        pos + k) {
+        ++k;
+      }
+      if (k == 0) {
+        const auto seq = cells_[pos & mask_].sequence_.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos) < 0) {
+          return 0;
+        }
+        pos = tail_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (tail_.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) {
+        for (size_t i = 0; i < k; ++i) {
+          auto& cell = cells_[(pos + i) & mask_];
+          cell.item_ = items[i];
+          cell.sequence_.store(pos + i + 1, std::memory_order_release);
+        }
+        not_empty_.notify(static_cast<int>(std::min<size_t>(k, INT_MAX)));
+        return k;
+      }
+    }
+  }
+
+  // Pops up to n items into out, and returns how many were popped
+  auto try_pop_n(T* out, size_t n) -> size_t {
+    auto pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      auto k = size_t{0};
+      while (k < n && cells_[(pos + k) & mask_].sequence_.load(std::memory_order_acquire) ==
+                        pos + k + 1) {
+        ++k;
+      }
+      if (k == 0) {
+        const auto seq = cells_[pos & mask_].sequence_.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1) < 0) {
+          return 0;
+        }
+        pos = head_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (head_.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) {
+        for (size_t i = 0; i < k; ++i) {
+          auto& cell = cells_[(pos + i) & mask_];
+          out[i] = std::move(cell.item_);
+          cell.sequence_.store(pos + i + capacity_, std::memory_order_release);
+        }
+        not_full_.notify(static_cast<int>(std::min<size_t>(k, INT_MAX)));
+        return k;
+      }
+    }
+  }
+
+  // Blocks while the queue is full
+  template <typename U>
+  auto push(U&& item) -> void {
+    not_full_.await([&] { return try_push(std::forward<U>(item)); });
+  }
+
+  // Blocks while the queue is empty
+  auto pop() -> T {
+    auto item = T{};
+    not_empty_.await([&] { return try_pop(item); });
+    return item;
+  }
+
+  // Blocks until all n items are pushed
+  auto push_n(const T* items, size_t n) -> void {
+    auto pushed = size_t{0};
+    not_full_.await([&] {
+      pushed += try_push_n(items + pushed, n - pushed);
+      return pushed == n;
+    });
+  }
+
+  // Blocks until at least one item is popped, and returns how many
+  auto pop_n(T* out, size_t n) -> size_t {
+    auto popped = size_t{0};
+    not_empty_.await([&] {
+      popped = try_pop_n(out, n);
+      return popped != 0 || n == 0;
+    });
+    return popped;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence_{0};
+    T item_{};
+  };
+
+  alignas(kCacheLineSize) std::atomic<size_t> tail_{0}; // Next position to push
+  alignas(kCacheLineSize) std::atomic<size_t> head_{0}; // Next position to pop
+  alignas(kCacheLineSize) EventCount not_empty_;
+  alignas(kCacheLineSize) EventCount not_full_;
+  alignas(kCacheLineSize) const size_t capacity_;
+  const size_t mask_;
+  const std::unique_ptr<Cell[]> cells_;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#pragma once
+#ifndef PARKING_HPP
+#define PARKING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include "sync_utils.hpp"
+
+#if defined(__linux__)
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+  #define PARKING_FUTEX_ENABLED 1
+#else
+  #include <condition_variable>
+  #include <mutex>
+  #define PARKING_FUTEX_ENABLED 0
+#endif
+
+//
+// Helpers for threads which wait for a condition by first spinning a
+// short while, and then parking in the kernel until another thread
+// notifies them.
+//
+// EventCount lets a thread sleep until a condition, which is checked
+// outside of the EventCount, becomes true. It works like this:
+//
+//   Waiter                            Notifier
+//   auto key = ec.prepare_wait();     make the condition true
+//   if (condition) {                  ec.notify_all();
+//     ec.cancel_wait(key);
+//   } else {
+//     ec.wait(key);
+//   }
+//
+// The state is one 64-bit word holding an epoch, the number of
+// waiters and how many of them have been signaled. A notification
+// increments the epoch, so a notification between prepare_wait() and
+// wait() makes wait() return at once instead of being missed, and
+// signals as many waiters as it wakes. Waiters remove themselves, and
+// a signal, when they return. Once every waiter is signaled, further
+// notifications only cost a load, even if the woken threads haven't
+// run yet.
+//
+// notify_one() wakes one sleeping waiter, for conditions such as an
+// item in a queue which only one waiter can take. Waiters which
+// haven't gone to sleep yet return too, and check their condition
+// again.
+//
+// The waiter's registration and the notifier's change of the
+// condition are ordered by the asymmetric fences of sync_utils.hpp.
+// The waiter takes the heavy one, so that the notifier, which is on
+// the fast path of e.g. every push to a queue, only needs a compiler
+// barrier on Linux.
+//
+// On Linux the waiters sleep on a futex on the epoch half of the
+// word. Elsewhere a mutex and a condition variable are used.
+//
+
+class EventCount {
+public:
+  EventCount() = default;
+  EventCount(const EventCount&) = delete;
+  auto operator=(const EventCount&) -> EventCount& = delete;
+
+  auto prepare_wait() noexcept -> uint32_t {
+    const auto prev = state_.fetch_add(1, std::memory_order_seq_cst);
+    // Orders the registration before the caller's check of the
+    // condition, pairing with the fence in notify()
+    heavy_fence();
+    return epoch_of(prev);
+  }
+
+  auto cancel_wait(uint32_t key) noexcept -> void {
+    // A notification since prepare_wait() may have counted on us to
+    // check the condition
+    remove_waiter(key);
+  }
+
+  // Sleeps until a notification after the prepare_wait() which
+  // returned key
+  auto wait(uint32_t key) noexcept -> void {
+#if PARKING_FUTEX_ENABLED
+    while (epoch_of(state_.load(std::memory_order_acquire)) == key) {
+      syscall(SYS_futex, epoch_word(), FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+    }
+#else
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      cv_.wait(lock, [&] { return epoch_of(state_.load(std::memory_order_acquire)) != key; });
+    }
+#endif
+    remove_waiter(key);
+  }
+
+  // Wakes all waiting threads. Without waiters it only costs a load,
+  // so it can be called on every change of the condition.
+  auto notify_all() noexcept -> void { notify(INT_MAX); }
+
+  // Like notify_all(), for a condition which is changed and checked
+  // while holding the same mutex. The mutex orders the change and the
+  // waiter's prepare_wait(), so the fence isn't needed.
+  auto notify_all_locked() noexcept -> void { notify_locked(INT_MAX); }
+
+  // Wakes one sleeping thread, if any
+  auto notify_one() noexcept -> void { notify(1); }
+  auto notify_one_locked() noexcept -> void { notify_locked(1); }
+
+  // Wakes up to num_threads sleeping threads, such as one for each
+  // item of a batch
+  auto notify(int num_threads) noexcept -> void {
+    // Orders the caller's change of the condition before the load of
+    // the waiters, pairing with the fence in prepare_wait()
+    light_fence();
+    notify_locked(num_threads);
+  }
+
+  auto notify_locked(int num_threads) noexcept -> void {
+    auto state = state_.load(std::memory_order_relaxed);
+    auto next = uint64_t{};
+    do {
+      const auto unsignaled = waiters_of(state) - signaled_of(state);
+      if (unsignaled == 0) {
+        return; // Every waiter will check the condition anyway
+      }
+      const auto n = std::min<uint32_t>(unsignaled, static_cast<uint32_t>(num_threads));
+      next = make_state(epoch_of(state) + 1, waiters_of(state), signaled_of(state) + n);
+    } while (!state_.compare_exchange_weak(state, next, std::memory_order_release,
+                                           std::memory_order_relaxed));
+#if PARKING_FUTEX_ENABLED
+    syscall(SYS_futex, epoch_word(), FUTEX_WAKE_PRIVATE, num_threads, nullptr, nullptr, 0);
+#else
+    { std::lock_guard<std::mutex> lock{mutex_}; }
+    if (num_threads == 1) {
+      cv_.notify_one();
+    } else {
+      cv_.notify_all();
+    }
+#endif
+  }
+
+  // Calls ready() until it returns true, spinning spin_count times
+  // before parking. With a single CPU the thread we wait for can't run
+  // while we spin, so it parks right away.
+  template <typename Ready>
+  auto await(Ready&& ready, int spin_count = 100) -> void {
+    if (single_cpu()) {
+      spin_count = 0;
+    }
+    for (auto i = 0; i < spin_count; ++i) {
+      if (ready()) {
+        return;
+      }
+      cpu_relax();
+    }
+    for (;;) {
+      const auto key = prepare_wait();
+      if (ready()) {
+        cancel_wait(key);
+        return;
+      }
+      wait(key);
+      if (ready()) {
+        return;
+      }
+    }
+  }
+
+  // Like await(), but only calls ready() while spinning once the
+  // cheaper hint() returns true. ready() must check the condition on
+  // its own, since hint() may be out of date.
+  template <typename Hint, typename Ready>
+  auto await_hinted(Hint&& hint, Ready&& ready, int spin_count = 100) -> void {
+    if (single_cpu()) {
+      spin_count = 0;
+    }
+    for (auto i = 0; i < spin_count; ++i) {
+      if (hint() && ready()) {
+        return;
+      }
+      cpu_relax();
+    }
+    await(ready, 0);
+  }
+
+private:
+  // Removes a waiter which registered in epoch key. If a notification
+  // has come since, the waiter takes one of its signals, or one meant
+  // for a waiter which is still asleep. Either way the number of
+  // signaled waiters never exceeds those which will return on their
+  // own, so no notification which is skipped is missed.
+  auto remove_waiter(uint32_t key) noexcept -> void {
+    auto state = state_.load(std::memory_order_relaxed);
+    auto next = uint64_t{};
+    do {
+      auto signaled = signaled_of(state);
+      if (epoch_of(state) != key && signaled != 0) {
+        --signaled;
+      }
+      next = make_state(epoch_of(state), waiters_of(state) - 1,
+                        std::min(signaled, waiters_of(state) - 1));
+    } while (!state_.compare_exchange_weak(state, next, std::memory_order_relaxed));
+  }
+
+  // The epoch is the high half, which the waiters sleep on, and the
+  // low half holds 16 bits each of signaled waiters and waiters, which
+  // limits the number of waiting threads to 65535
+  static constexpr auto make_state(uint32_t epoch, uint32_t waiters, uint32_t signaled) noexcept
+    -> uint64_t {
+    return uint64_t{epoch} << 32 | uint64_t{signaled} << 16 | waiters;
+  }
+  static constexpr auto epoch_of(uint64_t state) noexcept -> uint32_t {
+    return static_cast<uint32_t>(state >> 32);
+  }
+  static constexpr auto signaled_of(uint64_t state) noexcept -> uint32_t {
+    return static_cast<uint32_t>(state >> 16) & 0xffff;
+  }
+  static constexpr auto waiters_of(uint64_t state) noexcept -> uint32_t {
+    return static_cast<uint32_t>(state) & 0xffff;
+  }
+
+#if PARKING_FUTEX_ENABLED
+  // The futex is the 32-bit half of the state holding the epoch
+  auto epoch_word() noexcept -> uint32_t* {
+    auto* words = reinterpret_cast<uint32_t*>(&state_);
+    return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? words + 1 : words;
+  }
+#endif
+
+  std::atomic<uint64_t> state_{0};
+#if !PARKING_FUTEX_ENABLED
+  std::mutex mutex_;
+  std::condition_variable cv_;
+#endif
+};
+
+#endif
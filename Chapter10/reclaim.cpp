@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "reclaim.hpp"
+
+//
+// This example uses EpochDomain and HazardDomain to free the nodes of
+// a lock-free stack, and compares their cost for readers with loading
+// a std::shared_ptr atomically. Readers read a shared configuration
+// which is replaced every now and then.
+//
+
+namespace {
+
+// Number of reads by all threads in each run. Increase if you want
+// more.
+constexpr auto kNumReads = 4'000'000;
+constexpr auto kWriteInterval = 1'000; // One write every this many reads
+constexpr auto kReadsPerGuard = 64;
+
+// Counts the live objects, to find leaks and double frees
+struct Counted {
+  static std::atomic<int> live_;
+  explicit Counted(int value) : value_{value} { live_.fetch_add(1); }
+  ~Counted() { live_.fetch_sub(1); }
+  int value_;
+};
+std::atomic<int> Counted::live_{0};
+
+// A record like the ones of the domains, which counts the live ones
+struct CountedRecord {
+  static int live_;
+  CountedRecord() { ++live_; }
+  ~CountedRecord() { --live_; }
+  std::atomic<bool> in_use_{false};
+  CountedRecord* next_{};
+};
+int CountedRecord::live_{0};
+
+// A Treiber stack, whose pop() would read freed memory without the
+// domain, if the node it loaded was popped and freed meanwhile
+template <typename Domain>
+class Stack {
+public:
+  ~Stack() {
+    while (pop(domain_)) {
+    }
+  }
+  auto push(int value) {
+    auto* node = new Node{Counted{value}, head_.load(std::memory_order_relaxed)};
+    while (!head_.compare_exchange_weak(node->next_, node)) {
+    }
+  }
+  auto pop() { return pop(domain_); }
+
+private:
+  struct Node {
+    Counted item_;
+    Node* next_;
+  };
+
+  auto pop(reclaim::EpochDomain& domain) -> bool {
+    auto guard = domain.pin();
+    auto* node = guard.protect(head_);
+    while (node != nullptr && !head_.compare_exchange_weak(node, node->next_)) {
+    }
+    if (node == nullptr) {
+      return false;
+    }
+    guard.retire(node);
+    return true;
+  }
+
+  auto pop(reclaim::HazardDomain& domain) -> bool {
+    auto hazard = domain.hazard();
+    for (;;) {
+      auto* node = hazard.protect(head_);
+      if (node == nullptr) {
+        return false;
+      }
+      if (head_.compare_exchange_strong(node, node->next_)) {
+        hazard.reset();
+        domain.retire(node);
+        return true;
+      }
+    }
+  }
+
+  Domain domain_{};
+  std::atomic<Node*> head_{nullptr};
+};
+
+template <typename Domain>
+auto push_and_pop_concurrently() {
+  {
+    auto stack = Stack<Domain>{};
+    auto threads = std::vector<std::thread>{};
+    for (auto t = 0; t < 4; ++t) {
+      threads.emplace_back([&stack] {
+        for (auto i = 0; i < 50'000; ++i) {
+          stack.push(i);
+          stack.pop();
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  return Counted::live_.load();
+}
+
+struct Config {
+  int64_t values_[4];
+};
+
+// A std::shared_ptr which is loaded and stored atomically. The free
+// functions used before C++20 are deprecated by std::atomic.
+class SharedConfig {
+public:
+  SharedConfig() : ptr_{std::make_shared<Config>(Config{{1, 2, 3, 4}})} {}
+#if __cpp_lib_atomic_shared_ptr >= 201711L
+  auto load() const { return ptr_.load(); }
+  auto store(std::shared_ptr<Config> p) { ptr_.store(std::move(p)); }
+
+private:
+  std::atomic<std::shared_ptr<Config>> ptr_;
+#else
+  auto load() const { return std::atomic_load(&ptr_); }
+  auto store(std::shared_ptr<Config> p) { std::atomic_store(&ptr_, std::move(p)); }
+
+private:
+  std::shared_ptr<Config> ptr_;
+#endif
+};
+
+// Runs f(n) in num_threads threads, where the n add up to kNumReads,
+// and returns the ns per read
+template <typename F>
+auto time_reads(int num_threads, F&& f) {
+  const auto start = std::chrono::steady_clock::now();
+  auto threads = std::vector<std::thread>{};
+  for (auto t = 0; t < num_threads; ++t) {
+    threads.emplace_back([num_threads, &f] { f(kNumReads / num_threads); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const auto d = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(d).count() / kNumReads;
+}
+
+} // namespace
+
+TEST(Reclaim, EpochGuardDelaysFree) {
+  auto domain = reclaim::EpochDomain{};
+  auto reader = domain.pin();
+  {
+    auto guard = domain.pin(); // Nested
+    guard.retire(new Counted{1});
+  }
+  // Another thread retires a node too, while the reader is pinned
+  std::thread{[&domain] {
+    auto guard = domain.pin();
+    guard.retire(new Counted{2});
+  }}.join();
+  for (auto i = 0; i < 10; ++i) {
+    domain.collect();
+  }
+  ASSERT_EQ(2, Counted::live_.load());
+  { auto unpin = std::move(reader); }
+  for (auto i = 0; i < 2; ++i) {
+    domain.collect();
+  }
+  // The node retired by the other thread is freed by the destructor
+  ASSERT_EQ(0u, domain.num_retired());
+  ASSERT_EQ(1, Counted::live_.load());
+}
+
+TEST(Reclaim, EpochAmortizesCollection) {
+  auto domain = reclaim::EpochDomain{};
+  for (auto i = 0; i < 1'000; ++i) {
+    auto guard = domain.pin();
+    guard.retire(new Counted{i});
+  }
+  ASSERT_LT(domain.num_retired(), 128u);
+  ASSERT_GT(domain.epoch(), 0u);
+}
+
+TEST(Reclaim, HazardProtectsNode) {
+  auto domain = reclaim::HazardDomain{};
+  auto node = std::atomic<Counted*>{new Counted{1}};
+  auto hazard = domain.hazard();
+  auto* p = hazard.protect(node);
+  node.store(nullptr);
+  domain.retire(p);
+  domain.collect();
+  ASSERT_EQ(1, p->value_); // Still alive
+  hazard.reset();
+  domain.collect();
+  ASSERT_EQ(0, Counted::live_.load());
+  auto hazards = std::vector<reclaim::HazardDomain::Hazard>{};
+  for (auto i = 1u; i < reclaim::HazardDomain::kSlotsPerThread; ++i) {
+    hazards.push_back(domain.hazard());
+  }
+  ASSERT_THROW(domain.hazard(), std::length_error);
+}
+
+TEST(Reclaim, HazardBoundsRetiredNodes) {
+  auto domain = reclaim::HazardDomain{};
+  for (auto i = 0; i < 1'000; ++i) {
+    domain.retire(new Counted{i});
+    ASSERT_LE(domain.num_retired(), 64u);
+  }
+}
+
+TEST(Reclaim, ThreadsDropRecordsOfDestroyedDomains) {
+  for (auto i = 0; i < 10'000; ++i) {
+    auto registry = reclaim::detail::Registry<CountedRecord>{};
+    registry.local();
+    ASSERT_LE(CountedRecord::live_, 2);
+  }
+  // The last one is dropped when the thread registers again
+  ASSERT_EQ(1, CountedRecord::live_);
+}
+
+TEST(Reclaim, StackFreesEveryNode) {
+  ASSERT_EQ(0, push_and_pop_concurrently<reclaim::EpochDomain>());
+  ASSERT_EQ(0, push_and_pop_concurrently<reclaim::HazardDomain>());
+}
+
+TEST(Reclaim, CompareWithSharedPtr) {
+  std::cout << "ns per read of a config replaced every " << kWriteInterval << " reads" << '\n'
+            << std::setw(8) << "threads" << std::setw(12) << "shared_ptr" << std::setw(8)
+            << "epoch" << std::setw(10) << "epoch/" << kReadsPerGuard << std::setw(8)
+            << "hazard" << '\n';
+  for (auto num_threads = 1; num_threads <= 8; num_threads *= 2) {
+    auto sum = std::atomic<int64_t>{0};
+
+    auto shared = SharedConfig{};
+    const auto shared_ns = time_reads(num_threads, [&](int n) {
+      auto s = int64_t{0};
+      for (auto i = 1; i <= n; ++i) {
+        s += shared.load()->values_[i % 4];
+        if (i % kWriteInterval == 0) {
+          shared.store(std::make_shared<Config>(Config{{s, 2, 3, 4}}));
+        }
+      }
+      sum += s;
+    });
+
+    auto epoch_domain = reclaim::EpochDomain{};
+    auto epoch_config = std::atomic<Config*>{new Config{{1, 2, 3, 4}}};
+    const auto epoch_ns = time_reads(num_threads, [&](int n) {
+      auto s = int64_t{0};
+      for (auto i = 1; i <= n; ++i) {
+        auto guard = epoch_domain.pin();
+        s += guard.protect(epoch_config)->values_[i % 4];
+        if (i % kWriteInterval == 0) {
+          guard.retire(epoch_config.exchange(new Config{{s, 2, 3, 4}}));
+        }
+      }
+      sum += s;
+    });
+    // Keeping the guard for several reads pins the epoch once for all
+    const auto batched_ns = time_reads(num_threads, [&](int n) {
+      auto s = int64_t{0};
+      for (auto i = 1; i <= n;) {
+        auto guard = epoch_domain.pin();
+        for (const auto end = std::min(n + 1, i + kReadsPerGuard); i < end; ++i) {
+          s += guard.protect(epoch_config)->values_[i % 4];
+          if (i % kWriteInterval == 0) {
+            guard.retire(epoch_config.exchange(new Config{{s, 2, 3, 4}}));
+          }
+        }
+      }
+      sum += s;
+    });
+    delete epoch_config.load();
+
+    auto hazard_domain = reclaim::HazardDomain{};
+    auto hazard_config = std::atomic<Config*>{new Config{{1, 2, 3, 4}}};
+    const auto hazard_ns = time_reads(num_threads, [&](int n) {
+      auto s = int64_t{0};
+      auto hazard = hazard_domain.hazard();
+      for (auto i = 1; i <= n; ++i) {
+        s += hazard.protect(hazard_config)->values_[i % 4];
+        if (i % kWriteInterval == 0) {
+          hazard.reset();
+          hazard_domain.retire(hazard_config.exchange(new Config{{s, 2, 3, 4}}));
+        }
+      }
+      sum += s;
+    });
+    delete hazard_config.load();
+
+    std::cout << std::fixed << std::setprecision(1) << std::setw(8) << num_threads
+              << std::setw(12) << shared_ns << std::setw(8) << epoch_ns << std::setw(12)
+              << batched_ns << std::setw(8) << hazard_ns << '\n';
+  }
+}
@@ -0,0 +1,428 @@
+#pragma once
+#ifndef RECLAIM_HPP
+#define RECLAIM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "cache_line.hpp"
+
+//
+// Safe memory reclamation for lock-free data structures.
+//
+// A thread which removes a node from a lock-free structure can't free
+// it right away, since other threads may have loaded a pointer to it
+// just before and still read it. Instead it retires the node, and the
+// node is freed once no thread can hold a pointer to it anymore.
+//
+// EpochDomain uses epoch-based reclamation. A thread pins the current
+// epoch with a Guard while it reads the structure. A node retired in
+// epoch e is freed once the global epoch has reached e + 2, which
+// requires every thread pinned at the time of retirement to have
+// unpinned. Reads only cost a store and a fence when pinning, and a
+// guard can be kept across many reads. But a thread which stays
+// pinned stops all reclamation, so memory use is unbounded.
+//
+// HazardDomain uses hazard pointers. A thread publishes each pointer
+// it's about to read in a hazard slot, and a retired node is freed
+// once no slot holds it. Each read costs a fence, but a stalled thread
+// only keeps the few nodes in its slots alive, so each thread has at
+// most a fixed number of retired nodes which are not yet freed.
+//
+// In both domains a thread registers on first use, and its record is
+// reused by another thread after it exits. Nodes still retired when a
+// domain is destroyed are freed by its destructor, which must not run
+// while other threads use the domain.
+//
+
+namespace reclaim {
+
+namespace detail {
+
+// Ids are never reused, so that a thread can tell a new domain from a
+// destroyed one at the same address
+inline auto next_domain_id() -> uint64_t {
+  static auto next = std::atomic<uint64_t>{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+auto delete_object(void* p) -> void {
+  delete static_cast<T*>(p);
+}
+
+struct Retired {
+  void* p_{};
+  void (*deleter_)(void*){};
+  uint64_t epoch_{}; // Only used by EpochDomain
+};
+
+// The records of a domain, one for each thread using it. Records are
+// pushed to a lock-free list which is never shrunk, so that it can be
+// scanned without locking. A thread finds its own record through a
+// thread local cache. The records are shared with the threads, which
+// mark them as free when they exit, even if the domain is gone. A
+// thread drops the records of destroyed domains when it registers
+// with another one, so creating many domains doesn't leak.
+template <typename Record>
+class Registry {
+public:
+  Registry() : id_{next_domain_id()} {}
+
+  Registry(const Registry&) = delete;
+  auto operator=(const Registry&) -> Registry& = delete;
+
+  auto local() -> Record& {
+    if (cache_.id_ == id_) {
+      return *cache_.record_;
+    }
+    return local_slow();
+  }
+
+  auto head() const noexcept { return head_.load(std::memory_order_acquire); }
+  auto size() const noexcept { return size_.load(std::memory_order_relaxed); }
+
+private:
+  struct Cache {
+    uint64_t id_{0};
+    Record* record_{};
+  };
+
+  // The records a thread holds, which are freed when it exits
+  struct Owned {
+    std::vector<std::pair<uint64_t, std::shared_ptr<Record>>> records_{};
+    ~Owned() {
+      for (auto& entry : records_) {
+        entry.second->in_use_.store(false, std::memory_order_release);
+      }
+    }
+  };
+
+  auto local_slow() -> Record& {
+    thread_local auto owned = Owned{};
+    auto it = std::find_if(owned.records_.begin(), owned.records_.end(),
+                           [this](const auto& entry) { return entry.first == id_; });
+    if (it == owned.records_.end()) {
+      // The registry holds a copy of each of its records, so a record
+      // only this thread holds belongs to a destroyed domain
+      owned.records_.erase(std::remove_if(owned.records_.begin(), owned.records_.end(),
+                                          [](const auto& entry) { return entry.second.use_count() == 1; }),
+                           owned.records_.end());
+      owned.records_.emplace_back(id_, acquire());
+      it = owned.records_.end() - 1;
+    }
+    cache_ = Cache{id_, it->second.get()};
+    return *it->second;
+  }
+
+  // Takes the record of a thread which has exited, or adds a new one
+  auto acquire() -> std::shared_ptr<Record> {
+    auto lock = std::lock_guard<std::mutex>{mutex_};
+    for (const auto& record : records_) {
+      auto in_use = false;
+      if (record->in_use_.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+        return record;
+      }
+    }
+    auto record = std::make_shared<Record>();
+    record->in_use_.store(true, std::memory_order_relaxed);
+    record->next_ = head_.load(std::memory_order_relaxed);
+    records_.push_back(record);
+    head_.store(record.get(), std::memory_order_release);
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return record;
+  }
+
+  static thread_local Cache cache_;
+  const uint64_t id_;
+  std::mutex mutex_{}; // Only taken when a thread registers
+  std::vector<std::shared_ptr<Record>> records_{};
+  std::atomic<Record*> head_{nullptr};
+  std::atomic<size_t> size_{0};
+};
+
+template <typename Record>
+thread_local typename Registry<Record>::Cache Registry<Record>::cache_{};
+
+inline auto free_all(std::vector<Retired>& retired) -> void {
+  for (const auto& r : retired) {
+    r.deleter_(r.p_);
+  }
+  retired.clear();
+}
+
+} // namespace detail
+
+class EpochDomain {
+  struct Record;
+
+public:
+  EpochDomain() = default;
+  EpochDomain(const EpochDomain&) = delete;
+  auto operator=(const EpochDomain&) -> EpochDomain& = delete;
+
+  ~EpochDomain() {
+    for (auto* r = registry_.head(); r != nullptr; r = r->next_) {
+      detail::free_all(r->retired_);
+    }
+  }
+
+  // Keeps the nodes the thread reads from being freed while it lives.
+  // Guards can be nested.
+  class Guard {
+  public:
+    Guard(Guard&& other) noexcept
+      : domain_{std::exchange(other.domain_, nullptr)}, record_{other.record_} {}
+    Guard(const Guard&) = delete;
+    auto operator=(const Guard&) -> Guard& = delete;
+    auto operator=(Guard&&) -> Guard& = delete;
+    ~Guard() {
+      if (domain_ != nullptr) {
+        domain_->unpin(*record_);
+      }
+    }
+
+    template <typename T>
+    auto protect(const std::atomic<T*>& src) const noexcept -> T* {
+      return src.load(std::memory_order_acquire);
+    }
+
+    // Frees p with delete once no thread can read it. It must already
+    // be unreachable for threads which pin after this.
+    template <typename T>
+    auto retire(T* p) -> void {
+      retire(p, &detail::delete_object<T>);
+    }
+    auto retire(void* p, void (*deleter)(void*)) -> void { domain_->retire(*record_, p, deleter); }
+
+  private:
+    friend class EpochDomain;
+    Guard(EpochDomain& domain, Record& record) : domain_{&domain}, record_{&record} {}
+    EpochDomain* domain_;
+    Record* record_;
+  };
+
+  auto pin() -> Guard {
+    auto& record = registry_.local();
+    if (record.nesting_++ == 0) {
+      const auto epoch = epoch_.load(std::memory_order_relaxed);
+      // The exchange is a full fence, so that a thread trying to
+      // advance the epoch either sees this thread as pinned, or this
+      // thread sees every node unlinked before that
+      record.state_.exchange(epoch * 2 + 1, std::memory_order_seq_cst);
+    }
+    return Guard{*this, record};
+  }
+
+  // Tries to advance the epoch and frees the nodes of this thread
+  // which no thread can read anymore. It's called every few retires,
+  // but can also be called to free memory sooner.
+  auto collect() -> void { collect(registry_.local()); }
+
+  auto epoch() const noexcept { return epoch_.load(std::memory_order_acquire); }
+
+  // Nodes retired by the calling thread which are not yet freed
+  auto num_retired() -> size_t { return registry_.local().retired_.size(); }
+
+private:
+  static constexpr auto kCollectInterval = size_t{64};
+
+  struct alignas(kCacheLineSize) Record {
+    std::atomic<uint64_t> state_{0}; // Epoch * 2 + 1 while pinned, else 0
+    std::atomic<bool> in_use_{false};
+    Record* next_{};
+    // Only used by the thread which owns the record
+    size_t nesting_{0};
+    size_t retires_since_collect_{0};
+    std::vector<detail::Retired> retired_{}; // In the order of their epochs
+  };
+
+  auto unpin(Record& record) -> void {
+    if (--record.nesting_ == 0) {
+      record.state_.store(0, std::memory_order_release);
+    }
+  }
+
+  auto retire(Record& record, void* p, void (*deleter)(void*)) -> void {
+    const auto epoch = epoch_.load(std::memory_order_seq_cst);
+    record.retired_.push_back(detail::Retired{p, deleter, epoch});
+    if (++record.retires_since_collect_ >= kCollectInterval) {
+      collect(record);
+    }
+  }
+
+  // The epoch can only move from e to e + 1 when every pinned thread
+  // has pinned e
+  auto try_advance() -> uint64_t {
+    auto epoch = epoch_.load(std::memory_order_seq_cst);
+    for (auto* r = registry_.head(); r != nullptr; r = r->next_) {
+      const auto state = r->state_.load(std::memory_order_seq_cst);
+      if ((state & 1) != 0 && (state >> 1) != epoch) {
+        return epoch;
+      }
+    }
+    if (epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel)) {
+      return epoch + 1;
+    }
+    return epoch;
+  }
+
+  auto collect(Record& record) -> void {
+    record.retires_since_collect_ = 0;
+    const auto epoch = try_advance();
+    const auto end = std::find_if(record.retired_.begin(), record.retired_.end(),
+                                  [epoch](const auto& r) { return r.epoch_ + 2 > epoch; });
+    for (auto it = record.retired_.begin(); it != end; ++it) {
+      it->deleter_(it->p_);
+    }
+    record.retired_.erase(record.retired_.begin(), end);
+  }
+
+  alignas(kCacheLineSize) std::atomic<uint64_t> epoch_{0};
+  detail::Registry<Record> registry_{};
+};
+
+class HazardDomain {
+  struct Record;
+
+public:
+  // Number of hazard pointers a thread can hold at once
+  static constexpr auto kSlotsPerThread = size_t{4};
+
+  HazardDomain() = default;
+  HazardDomain(const HazardDomain&) = delete;
+  auto operator=(const HazardDomain&) -> HazardDomain& = delete;
+
+  ~HazardDomain() {
+    for (auto* r = registry_.head(); r != nullptr; r = r->next_) {
+      detail::free_all(r->retired_);
+    }
+  }
+
+  // Keeps one node from being freed, from when protect() returns it
+  // until reset() or destruction
+  class Hazard {
+  public:
+    Hazard(Hazard&& other) noexcept
+      : record_{std::exchange(other.record_, nullptr)}, slot_{other.slot_} {}
+    Hazard(const Hazard&) = delete;
+    auto operator=(const Hazard&) -> Hazard& = delete;
+    auto operator=(Hazard&&) -> Hazard& = delete;
+    ~Hazard() {
+      if (record_ != nullptr) {
+        reset();
+        record_->used_ &= ~(1u << slot_);
+      }
+    }
+
+    // Loads src and publishes it, retrying until src still holds the
+    // published pointer. Then it can't have been retired before the
+    // pointer was published, and a later scan will see it.
+    template <typename T>
+    auto protect(const std::atomic<T*>& src) noexcept -> T* {
+      auto& hazard = record_->slots_[slot_];
+      auto p = src.load(std::memory_order_relaxed);
+      for (;;) {
+        hazard.store(p, std::memory_order_seq_cst);
+        const auto q = src.load(std::memory_order_seq_cst);
+        if (q == p) {
+          return p;
+        }
+        p = q;
+      }
+    }
+
+    auto reset() noexcept -> void {
+      record_->slots_[slot_].store(nullptr, std::memory_order_release);
+    }
+
+  private:
+    friend class HazardDomain;
+    Hazard(Record& record, unsigned slot) : record_{&record}, slot_{slot} {}
+    Record* record_;
+    unsigned slot_;
+  };
+
+  auto hazard() -> Hazard {
+    auto& record = registry_.local();
+    for (auto slot = 0u; slot < kSlotsPerThread; ++slot) {
+      if ((record.used_ & (1u << slot)) == 0) {
+        record.used_ |= 1u << slot;
+        return Hazard{record, slot};
+      }
+    }
+    throw std::length_error{"Out of hazard pointers"};
+  }
+
+  // Frees p with delete once no hazard pointer holds it. It must
+  // already be unreachable from the structure.
+  template <typename T>
+  auto retire(T* p) -> void {
+    retire(p, &detail::delete_object<T>);
+  }
+  auto retire(void* p, void (*deleter)(void*)) -> void {
+    auto& record = registry_.local();
+    record.retired_.push_back(detail::Retired{p, deleter});
+    // Scanning when the retired nodes outnumber the hazard pointers by
+    // a constant factor frees at least half of them, so the cost of a
+    // scan is spread over as many retires as there are slots
+    const auto threshold =
+      std::max(kMinScanThreshold, 2 * kSlotsPerThread * registry_.size());
+    if (record.retired_.size() >= threshold) {
+      scan(record);
+    }
+  }
+
+  // Frees the nodes retired by the calling thread which no hazard
+  // pointer holds
+  auto collect() -> void { scan(registry_.local()); }
+
+  // Nodes retired by the calling thread which are not yet freed
+  auto num_retired() -> size_t { return registry_.local().retired_.size(); }
+
+private:
+  static constexpr auto kMinScanThreshold = size_t{64};
+
+  struct alignas(kCacheLineSize) Record {
+    std::array<std::atomic<void*>, kSlotsPerThread> slots_{};
+    std::atomic<bool> in_use_{false};
+    Record* next_{};
+    // Only used by the thread which owns the record
+    unsigned used_{0}; // One bit per slot
+    std::vector<detail::Retired> retired_{};
+    std::vector<void*> hazards_{}; // Scratch space of scan()
+  };
+
+  auto scan(Record& record) -> void {
+    auto& hazards = record.hazards_;
+    hazards.clear();
+    for (auto* r = registry_.head(); r != nullptr; r = r->next_) {
+      for (const auto& slot : r->slots_) {
+        if (auto* p = slot.load(std::memory_order_seq_cst)) {
+          hazards.push_back(p);
+        }
+      }
+    }
+    std::sort(hazards.begin(), hazards.end());
+    const auto kept = std::partition(
+      record.retired_.begin(), record.retired_.end(),
+      [&](const auto& r) { return std::binary_search(hazards.begin(), hazards.end(), r.p_); });
+    for (auto it = kept; it != record.retired_.end(); ++it) {
+      it->deleter_(it->p_);
+    }
+    record.retired_.erase(kept, record.retired_.end());
+  }
+
+  detail::Registry<Record> registry_{};
+};
+
+} // namespace reclaim
+
+#endif
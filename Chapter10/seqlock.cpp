@@ -0,0 +1,73 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "seqlock.hpp"
+
+//
+// This example checks that readers of a SeqLock never see a record
+// which is half written. The benchmark against std::shared_mutex is
+// in snapshot.cpp.
+//
+
+namespace {
+
+// Three words, and one int which doesn't fill a whole word
+struct Prices {
+  int64_t bid_;
+  int64_t ask_;
+  int64_t mid_;
+  int32_t sequence_;
+};
+
+auto make_prices(int32_t i) {
+  return Prices{i * 2, i * 2 + 2, i * 2 + 1, i};
+}
+
+} // namespace
+
+TEST(SeqLock, LoadStoreUpdate) {
+  auto prices = SeqLock<Prices>{make_prices(1)};
+  ASSERT_EQ(3, prices.load().mid_);
+  prices.store(make_prices(5));
+  ASSERT_EQ(5, prices.load().sequence_);
+  prices.update([](Prices& p) { p.mid_ = 100; });
+  ASSERT_EQ(100, prices.load().mid_);
+  ASSERT_EQ(10, prices.load().bid_);
+}
+
+TEST(SeqLock, ReadersNeverSeeTornRecords) {
+  auto prices = SeqLock<Prices>{make_prices(0)};
+  auto done = std::atomic<bool>{false};
+  auto readers = std::vector<std::thread>{};
+  for (auto t = 0; t < 3; ++t) {
+    readers.emplace_back([&] {
+      auto last = int32_t{0};
+      while (!done) {
+        const auto p = prices.load();
+        ASSERT_EQ(p.sequence_ * 2, p.bid_);
+        ASSERT_EQ(p.bid_ + 2, p.ask_);
+        ASSERT_EQ(p.bid_ + 1, p.mid_);
+        ASSERT_GE(p.sequence_, last); // Never goes back in time
+        last = p.sequence_;
+      }
+    });
+  }
+  // Two writers, which take turns through the sequence number
+  auto writers = std::vector<std::thread>{};
+  for (auto t = 0; t < 2; ++t) {
+    writers.emplace_back([&] {
+      for (auto i = 0; i < 50'000; ++i) {
+        prices.update([](Prices& p) { p = make_prices(p.sequence_ + 1); });
+      }
+    });
+  }
+  for (auto& w : writers) {
+    w.join();
+  }
+  done = true;
+  for (auto& r : readers) {
+    r.join();
+  }
+  ASSERT_EQ(100'000, prices.load().sequence_);
+}
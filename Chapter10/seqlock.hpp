@@ -0,0 +1,138 @@
+#pragma once
+#ifndef SEQLOCK_HPP
+#define SEQLOCK_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "cache_line.hpp"
+#include "sync_utils.hpp"
+
+//
+// A small record which many threads read and few threads write, such
+// as the current configuration or a set of prices.
+//
+// A sequence number next to the record is odd while a writer changes
+// it. A reader copies the record without writing anything, and keeps
+// the copy if the sequence number was even and the same before and
+// after. Otherwise it retries. Readers never make writers wait, and as
+// they only read the cache line, it stays shared between their cores.
+//
+// The record is kept in atomic words which are read and written with
+// relaxed loads and stores, as copying plain memory while another
+// thread writes it would be a data race, even if the copy is thrown
+// away afterwards. Writers lock each other out through the sequence
+// number.
+//
+
+// The sequence number of a seqlock on its own, for data which doesn't
+// fit in a SeqLock<T>, such as the balance of an account in ledger.hpp
+class SeqCount {
+public:
+  // The sequence number to pass to validate() after reading
+  auto read_begin() const noexcept -> uint64_t { return seq_.load(std::memory_order_acquire); }
+
+  // True if no writer held the lock or changed the data since
+  // read_begin() returned seq, so that what was read can be kept
+  auto validate(uint64_t seq) const noexcept -> bool {
+    // Keeps the loads of the data before the second load of the
+    // sequence number
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (seq & 1) == 0 && seq_.load(std::memory_order_relaxed) == seq;
+  }
+
+  // Makes the sequence number odd, which keeps out other writers and
+  // makes readers retry
+  auto lock() noexcept -> void {
+    auto seq = seq_.load(std::memory_order_relaxed);
+    for (auto spins = 0;; ++spins) {
+      if ((seq & 1) == 0 &&
+          seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire,
+                                     std::memory_order_relaxed)) {
+        // Keeps the stores of the data after the sequence number
+        // is odd
+        std::atomic_thread_fence(std::memory_order_release);
+        return;
+      }
+      backoff(spins);
+      seq = seq_.load(std::memory_order_relaxed);
+    }
+  }
+
+  auto unlock() noexcept -> void {
+    const auto seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_release);
+  }
+
+private:
+  std::atomic<uint64_t> seq_{0}; // Odd while locked
+};
+
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable_v<T>, "SeqLock copies T word by word");
+
+public:
+  SeqLock() : SeqLock(T{}) {}
+  explicit SeqLock(const T& value) { write_words(value); }
+
+  SeqLock(const SeqLock&) = delete;
+  auto operator=(const SeqLock&) -> SeqLock& = delete;
+
+  auto load() const noexcept -> T {
+    for (auto spins = 0;; ++spins) {
+      const auto seq = seq_.read_begin();
+      const auto value = read_words();
+      if (seq_.validate(seq)) {
+        return value;
+      }
+      backoff(spins);
+    }
+  }
+
+  auto store(const T& value) noexcept -> void {
+    seq_.lock();
+    write_words(value);
+    seq_.unlock();
+  }
+
+  // Calls f with a copy of the record, and stores it after f changed
+  // it. Other writers wait meanwhile, but readers don't.
+  template <typename F>
+  auto update(F&& f) -> void {
+    seq_.lock();
+    auto value = read_words();
+    f(value);
+    write_words(value);
+    seq_.unlock();
+  }
+
+private:
+  static constexpr auto kNumWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  auto read_words() const noexcept -> T {
+    uint64_t words[kNumWords];
+    for (size_t i = 0; i < kNumWords; ++i) {
+      words[i] = words_[i].load(std::memory_order_relaxed);
+    }
+    auto value = T{};
+    std::memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+  auto write_words(const T& value) noexcept -> void {
+    uint64_t words[kNumWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+    for (size_t i = 0; i < kNumWords; ++i) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  // The words are on the cache line of the sequence number if they fit
+  alignas(kCacheLineSize) SeqCount seq_;
+  std::array<std::atomic<uint64_t>, kNumWords> words_{};
+};
+
+#endif
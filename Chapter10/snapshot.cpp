@@ -0,0 +1,184 @@
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "seqlock.hpp"
+#include "snapshot.hpp"
+
+//
+// This example compares readers of a small configuration which is
+// guarded by a std::shared_mutex, a SeqLock and a Snapshot. Every
+// thread reads it all the time, and one of them replaces it every
+// now and then.
+//
+
+namespace {
+
+// Number of reads by all threads in each run. Increase if you want
+// more.
+constexpr auto kNumReads = 20'000'000;
+constexpr auto kWriteInterval = 100'000; // Reads of thread 0 per write
+
+struct Config {
+  int64_t timeout_ms_;
+  int64_t max_connections_;
+  int64_t port_;
+  int64_t version_;
+};
+
+// Counts the live objects, to find leaks and double frees
+struct Counted {
+  static std::atomic<int> live_;
+  explicit Counted(std::string value) : value_{std::move(value)} { live_.fetch_add(1); }
+  Counted(const Counted& other) : value_{other.value_} { live_.fetch_add(1); }
+  ~Counted() { live_.fetch_sub(1); }
+  std::string value_;
+};
+std::atomic<int> Counted::live_{0};
+
+// Calls read() kNumReads times in total from num_threads threads, and
+// write() every kWriteInterval reads of thread 0. Returns the millions
+// of reads per second.
+template <typename Read, typename Write>
+auto reads_per_us(int num_threads, Read&& read, Write&& write) {
+  const auto start = std::chrono::steady_clock::now();
+  auto threads = std::vector<std::thread>{};
+  auto sum = std::atomic<int64_t>{0};
+  for (auto t = 0; t < num_threads; ++t) {
+    threads.emplace_back([t, num_threads, &read, &write, &sum] {
+      auto s = int64_t{0};
+      for (auto i = 1; i <= kNumReads / num_threads; ++i) {
+        s += read();
+        if (t == 0 && i % kWriteInterval == 0) {
+          write(i);
+        }
+      }
+      sum += s;
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const auto d = std::chrono::steady_clock::now() - start;
+  return kNumReads / std::chrono::duration<double, std::micro>(d).count();
+}
+
+} // namespace
+
+TEST(Snapshot, ReadAndPublish) {
+  auto snapshot = Snapshot<Counted>{Counted{"v1"}};
+  {
+    const auto v1 = snapshot.read();
+    ASSERT_EQ("v1", v1->value_);
+  }
+  snapshot.publish(Counted{"v2"});
+  ASSERT_EQ("v2", snapshot.read()->value_);
+  ASSERT_EQ(1, Counted::live_.load()); // v1 is freed
+  snapshot.update([](Counted& c) { c.value_ += "+"; });
+  ASSERT_EQ("v2+", (*snapshot.read()).value_);
+  ASSERT_EQ(1, Counted::live_.load());
+}
+
+TEST(Snapshot, PublishWaitsForReaders) {
+  auto snapshot = Snapshot<Counted>{Counted{"old"}};
+  auto published = std::atomic<bool>{false};
+  auto published_while_reading = true;
+  auto read_while_publishing = std::string{};
+  auto writer = std::thread{};
+  {
+    const auto reader = snapshot.read();
+    const auto nested = snapshot.read();
+    writer = std::thread{[&] {
+      snapshot.publish(Counted{"new"});
+      published = true;
+    }};
+    // New readers get the new version while the writer waits
+    auto seen_new = false;
+    while (!seen_new) {
+      std::thread{[&] { seen_new = snapshot.read()->value_ == "new"; }}.join();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    published_while_reading = published;
+    read_while_publishing = reader->value_ + nested->value_;
+  }
+  writer.join();
+  ASSERT_FALSE(published_while_reading);
+  ASSERT_EQ("oldold", read_while_publishing);
+  ASSERT_EQ(1, Counted::live_.load());
+}
+
+TEST(Snapshot, ConcurrentReadersAndWriters) {
+  auto snapshot = Snapshot<Config>{Config{1, 1, 1, 1}};
+  auto done = std::atomic<bool>{false};
+  auto readers = std::vector<std::thread>{};
+  for (auto t = 0; t < 3; ++t) {
+    readers.emplace_back([&] {
+      while (!done) {
+        const auto config = snapshot.read();
+        ASSERT_EQ(config->version_, config->timeout_ms_);
+        ASSERT_EQ(config->version_, config->port_);
+      }
+    });
+  }
+  auto writers = std::vector<std::thread>{};
+  for (auto t = 0; t < 2; ++t) {
+    writers.emplace_back([&] {
+      for (auto i = 0; i < 100; ++i) {
+        snapshot.update([](Config& c) {
+          ++c.version_;
+          c.timeout_ms_ = c.port_ = c.version_;
+        });
+      }
+    });
+  }
+  for (auto& w : writers) {
+    w.join();
+  }
+  done = true;
+  for (auto& r : readers) {
+    r.join();
+  }
+  ASSERT_EQ(201, snapshot.read()->version_);
+}
+
+TEST(Snapshot, CompareWithSharedMutex) {
+  std::cout << "Million reads per second, one write every " << kWriteInterval
+            << " reads of one thread" << '\n'
+            << std::setw(8) << "threads" << std::setw(14) << "shared_mutex" << std::setw(9)
+            << "SeqLock" << std::setw(10) << "Snapshot" << '\n';
+  for (auto num_threads = 1; num_threads <= 8; num_threads *= 2) {
+    auto mutex = std::shared_mutex{};
+    auto config = Config{1, 1, 1, 1};
+    const auto shared_mutex_rate = reads_per_us(
+      num_threads,
+      [&] {
+        std::shared_lock<std::shared_mutex> lock{mutex};
+        return config.timeout_ms_;
+      },
+      [&](int i) {
+        std::lock_guard<std::shared_mutex> lock{mutex};
+        config = Config{i, 1, 1, i};
+      });
+
+    auto seqlock = SeqLock<Config>{Config{1, 1, 1, 1}};
+    const auto seqlock_rate = reads_per_us(
+      num_threads, [&] { return seqlock.load().timeout_ms_; },
+      [&](int i) { seqlock.store(Config{i, 1, 1, i}); });
+
+    auto snapshot = Snapshot<Config>{Config{1, 1, 1, 1}};
+    const auto snapshot_rate = reads_per_us(
+      num_threads, [&] { return snapshot.read()->timeout_ms_; },
+      [&](int i) { snapshot.publish(Config{i, 1, 1, i}); });
+
+    std::cout << std::fixed << std::setprecision(0) << std::setw(8) << num_threads
+              << std::setw(14) << shared_mutex_rate << std::setw(9) << seqlock_rate
+              << std::setw(10) << snapshot_rate << '\n';
+  }
+}
@@ -0,0 +1,142 @@
+#pragma once
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "cache_line.hpp"
+#include "reclaim.hpp"
+#include "sync_utils.hpp"
+
+//
+// Shared state which is read all the time and replaced now and then,
+// like a routing table, in the style of read-copy-update (RCU).
+//
+// A reader gets a pointer to the current version of the state and
+// reads it as long as it holds the ReadGuard, without locking. A
+// writer publishes a new version by swapping the pointer, and then
+// waits for the readers which may still read the old version before
+// freeing it. New readers get the new version meanwhile.
+//
+// A reader announces when it began reading by storing the global
+// version number in its own record, and stores 0 when done. Neither
+// takes an atomic read-modify-write, and both stay in the reader's
+// own cache line. The announcement must be visible to a writer before
+// the reader loads the pointer, which normally takes a full fence. On
+// Linux the writer instead makes every thread of the process run one
+// with the membarrier() system call, so readers need no fence at all.
+// As writes are rare, the writers pay for it.
+//
+
+template <typename T>
+class Snapshot {
+  struct Record;
+
+public:
+  explicit Snapshot(T value) : Snapshot(std::make_unique<const T>(std::move(value))) {}
+  explicit Snapshot(std::unique_ptr<const T> value)
+    : current_{value.release()} {}
+
+  Snapshot(const Snapshot&) = delete;
+  auto operator=(const Snapshot&) -> Snapshot& = delete;
+
+  ~Snapshot() { delete current_.load(std::memory_order_relaxed); }
+
+  // The version which was current when read() was called. It stays
+  // alive while the guard lives. Guards can be nested.
+  class ReadGuard {
+  public:
+    ReadGuard(ReadGuard&& other) noexcept
+      : record_{std::exchange(other.record_, nullptr)}, value_{other.value_} {}
+    ReadGuard(const ReadGuard&) = delete;
+    auto operator=(const ReadGuard&) -> ReadGuard& = delete;
+    auto operator=(ReadGuard&&) -> ReadGuard& = delete;
+    ~ReadGuard() {
+      if (record_ != nullptr && --record_->nesting_ == 0) {
+        // Orders the reads of the value before it, so that a writer
+        // which sees 0 can free it
+        record_->version_.store(0, std::memory_order_release);
+      }
+    }
+
+    auto get() const noexcept -> const T* { return value_; }
+    auto operator*() const noexcept -> const T& { return *value_; }
+    auto operator->() const noexcept -> const T* { return value_; }
+
+  private:
+    friend class Snapshot;
+    ReadGuard(Record& record, const T* value) : record_{&record}, value_{value} {}
+    Record* record_;
+    const T* value_;
+  };
+
+  auto read() const -> ReadGuard {
+    auto& record = registry_.local();
+    if (record.nesting_++ == 0) {
+      record.version_.store(version_.load(std::memory_order_acquire),
+                            std::memory_order_relaxed);
+      // Pairs with the heavy fence of the writer
+      light_fence();
+    }
+    return ReadGuard{record, current_.load(std::memory_order_acquire)};
+  }
+
+  // Publishes value, and frees the old version once no reader can read
+  // it. It waits for the readers, so the calling thread must not hold
+  // a ReadGuard of this snapshot.
+  auto publish(std::unique_ptr<const T> value) -> void {
+    std::lock_guard<std::mutex> lock{write_mutex_};
+    replace(std::move(value));
+  }
+  auto publish(T value) -> void { publish(std::make_unique<const T>(std::move(value))); }
+
+  // Publishes a copy of the current version changed by f. Writers
+  // can't lose each other's changes, as they take turns.
+  template <typename F>
+  auto update(F&& f) -> void {
+    std::lock_guard<std::mutex> lock{write_mutex_};
+    auto copy = std::make_unique<T>(*current_.load(std::memory_order_relaxed));
+    f(*copy);
+    replace(std::move(copy));
+  }
+
+private:
+  struct alignas(kCacheLineSize) Record {
+    // The version when the outermost read began, or 0 when not reading
+    std::atomic<uint64_t> version_{0};
+    std::atomic<bool> in_use_{false};
+    Record* next_{};
+    size_t nesting_{0}; // Only used by the thread which owns the record
+  };
+
+  auto replace(std::unique_ptr<const T> value) -> void {
+    const auto old =
+      std::unique_ptr<const T>{current_.exchange(value.release(), std::memory_order_acq_rel)};
+    // Readers which announce this version or a later one load the new
+    // pointer, so only those with an earlier one may read the old
+    const auto version = version_.load(std::memory_order_relaxed) + 1;
+    version_.store(version, std::memory_order_release);
+    // Pairs with the light fence of the readers
+    heavy_fence();
+    for (auto* r = registry_.head(); r != nullptr; r = r->next_) {
+      for (;;) {
+        const auto v = r->version_.load(std::memory_order_acquire);
+        if (v == 0 || v >= version) {
+          break;
+        }
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  std::atomic<const T*> current_;
+  std::atomic<uint64_t> version_{1};
+  mutable reclaim::detail::Registry<Record> registry_{};
+  std::mutex write_mutex_{};
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "bench_utils.hpp"
+#include "lock_free_queue.hpp"
+#include "spsc_queue.hpp"
+
+//
+// This example compares SpscQueue with LockFreeQueue and a queue
+// guarded by a mutex. Throughput is the time to pass many ints from
+// one thread to another, and latency the time of a round trip where
+// two threads pass one int back and forth through two queues.
+//
+// The waiting threads yield instead of spinning, so that the
+// benchmark also works on a machine with a single core.
+//
+
+namespace {
+
+// Number of items in the benchmarks. Increase if you want more.
+constexpr auto kNumItems = 2'000'000;
+constexpr auto kNumRoundTrips = 20'000;
+constexpr auto kCapacity = size_t{1024};
+constexpr auto kBatchSize = size_t{64};
+
+// LockFreeQueue throws when full or empty, so the size is checked
+// first, which is safe with one producer and one consumer
+template <typename T, size_t N>
+auto try_push(LockFreeQueue<T, N>& q, const T& item) {
+  if (q.size() >= N) {
+    return false;
+  }
+  q.push(item);
+  return true;
+}
+
+template <typename T, size_t N>
+auto try_pop(LockFreeQueue<T, N>& q, T& item) {
+  if (q.size() == 0) {
+    return false;
+  }
+  item = q.front();
+  q.pop();
+  return true;
+}
+
+template <typename Q>
+auto try_push(Q& q, const int& item) -> decltype(q.try_push(item)) {
+  return q.try_push(item);
+}
+
+template <typename Q>
+auto try_pop(Q& q, int& item) -> decltype(q.try_pop(item)) {
+  return q.try_pop(item);
+}
+
+auto elapsed_ms(std::chrono::steady_clock::time_point start) {
+  const auto d = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+}
+
+// Returns the sum of the popped items
+template <typename Q>
+auto measure_throughput(const char* name, Q& q) {
+  const auto start = std::chrono::steady_clock::now();
+  auto producer = std::thread{[&q] {
+    for (auto i = 0; i < kNumItems; ++i) {
+      while (!try_push(q, i)) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+  auto sum = 0ll;
+  for (auto n = 0; n < kNumItems; ++n) {
+    auto item = 0;
+    while (!try_pop(q, item)) {
+      std::this_thread::yield();
+    }
+    sum += item;
+  }
+  producer.join();
+  std::cout << elapsed_ms(start) << " ms " << name << '\n';
+  return sum;
+}
+
+template <typename Q>
+auto measure_round_trip(const char* name, Q& ping, Q& pong) {
+  const auto start = std::chrono::steady_clock::now();
+  auto echo = std::thread{[&] {
+    for (auto n = 0; n < kNumRoundTrips; ++n) {
+      auto item = 0;
+      while (!try_pop(ping, item)) {
+        std::this_thread::yield();
+      }
+      while (!try_push(pong, item)) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+  for (auto n = 0; n < kNumRoundTrips; ++n) {
+    while (!try_push(ping, n)) {
+      std::this_thread::yield();
+    }
+    auto item = 0;
+    while (!try_pop(pong, item)) {
+      std::this_thread::yield();
+    }
+  }
+  echo.join();
+  const auto d = std::chrono::steady_clock::now() - start;
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+  std::cout << ns / kNumRoundTrips << " ns per round trip, " << name << '\n';
+}
+
+} // namespace
+
+TEST(SpscQueue, PushAndPop) {
+  auto q = SpscQueue<int>{3};
+  ASSERT_EQ(4u, q.capacity());
+  auto item = 0;
+  ASSERT_FALSE(q.try_pop(item));
+  for (auto i = 0; i < 4; ++i) {
+    ASSERT_TRUE(q.try_push(i));
+  }
+  ASSERT_FALSE(q.try_push(4));
+  ASSERT_EQ(4u, q.size_approx());
+  // Wrap around the end of the buffer a few times
+  for (auto i = 4; i < 20; ++i) {
+    ASSERT_TRUE(q.try_pop(item));
+    ASSERT_EQ(i - 4, item);
+    ASSERT_TRUE(q.try_push(i));
+  }
+  for (auto i = 16; i < 20; ++i) {
+    ASSERT_TRUE(q.try_pop(item));
+    ASSERT_EQ(i, item);
+  }
+  ASSERT_FALSE(q.try_pop(item));
+}
+
+TEST(SpscQueue, MoveOnlyItems) {
+  auto q = SpscQueue<std::unique_ptr<int>>{2};
+  ASSERT_TRUE(q.try_push(std::make_unique<int>(7)));
+  auto item = std::unique_ptr<int>{};
+  ASSERT_TRUE(q.try_pop(item));
+  ASSERT_EQ(7, *item);
+}
+
+TEST(SpscQueue, PushAndPopBatches) {
+  auto q = SpscQueue<int>{8};
+  auto in = std::vector<int>(12);
+  std::iota(in.begin(), in.end(), 0);
+  ASSERT_EQ(8u, q.push_n(in.data(), in.size())); // Only room for 8
+  auto out = std::vector<int>(12);
+  ASSERT_EQ(5u, q.pop_n(out.data(), 5));
+  ASSERT_EQ(4u, q.push_n(in.data() + 8, 4));
+  ASSERT_EQ(7u, q.pop_n(out.data() + 5, 12));
+  ASSERT_EQ(0u, q.pop_n(out.data(), 12));
+  ASSERT_EQ(in, out);
+}
+
+TEST(SpscQueue, TwoThreadsKeepOrder) {
+  auto q = SpscQueue<int>{16};
+  constexpr auto n = 100'000;
+  auto producer = std::thread{[&q] {
+    for (auto i = 0; i < n; ++i) {
+      while (!q.try_push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+  for (auto expected = 0; expected < n;) {
+    int items[7];
+    const auto popped = q.pop_n(items, 7);
+    for (size_t i = 0; i < popped; ++i) {
+      ASSERT_EQ(expected++, items[i]);
+    }
+    if (popped == 0) {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+}
+
+TEST(SpscQueue, CompareWithOtherQueues) {
+  const auto expected = static_cast<long long>(kNumItems) * (kNumItems - 1) / 2;
+  {
+    auto q = std::make_unique<LockFreeQueue<int, kCapacity>>();
+    ASSERT_EQ(expected, measure_throughput("LockFreeQueue", *q));
+  }
+  {
+    auto q = MutexQueue<int>{kCapacity};
+    ASSERT_EQ(expected, measure_throughput("MutexQueue", q));
+  }
+  {
+    auto q = SpscQueue<int>{kCapacity};
+    ASSERT_EQ(expected, measure_throughput("SpscQueue", q));
+  }
+  {
+    auto q = SpscQueue<int>{kCapacity};
+    const auto start = std::chrono::steady_clock::now();
+    auto producer = std::thread{[&q] {
+      int batch[kBatchSize];
+      for (auto i = 0; i < kNumItems;) {
+        const auto n = std::min<size_t>(kBatchSize, kNumItems - i);
+        std::iota(batch, batch + n, i);
+        auto pushed = size_t{0};
+        while ((pushed += q.push_n(batch + pushed, n - pushed)) < n) {
+          std::this_thread::yield();
+        }
+        i += static_cast<int>(n);
+      }
+    }};
+    auto sum = 0ll;
+    int batch[kBatchSize];
+    for (auto n = 0; n < kNumItems;) {
+      const auto popped = q.pop_n(batch, kBatchSize);
+      if (popped == 0) {
+        std::this_thread::yield();
+      }
+      for (size_t i = 0; i < popped; ++i) {
+        sum += batch[i];
+      }
+      n += static_cast<int>(popped);
+    }
+    producer.join();
+    std::cout << elapsed_ms(start) << " ms SpscQueue, batches of " << kBatchSize << '\n';
+    ASSERT_EQ(expected, sum);
+  }
+  {
+    auto ping = std::make_unique<LockFreeQueue<int, kCapacity>>();
+    auto pong = std::make_unique<LockFreeQueue<int, kCapacity>>();
+    measure_round_trip("LockFreeQueue", *ping, *pong);
+  }
+  {
+    auto ping = MutexQueue<int>{kCapacity};
+    auto pong = MutexQueue<int>{kCapacity};
+    measure_round_trip("MutexQueue", ping, pong);
+  }
+  {
+    auto ping = SpscQueue<int>{kCapacity};
+    auto pong = SpscQueue<int>{kCapacity};
+    measure_round_trip("SpscQueue", ping, pong);
+  }
+}
@@ -0,0 +1,135 @@
+#pragma once
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include "cache_line.hpp"
+#include "sync_utils.hpp"
+
+//
+// A bounded wait-free queue for one producer thread and one consumer
+// thread.
+//
+// Compared to LockFreeQueue in lock_free_queue.hpp:
+// - There is no shared size. The producer owns the tail index and the
+//   consumer the head index, each on its own cache line.
+// - Each side keeps a cached copy of the other side's index, and only
+//   reloads it when the queue looks full or empty. In a steady stream
+//   the shared cache lines are seldom touched.
+// - The indices are published with release stores and read with
+//   acquire loads instead of sequentially consistent operations.
+// - The capacity is a power of two, so an index is masked instead of
+//   taken modulo the capacity.
+// - A full or empty queue is reported by the return value, not by an
+//   exception.
+//
+// The indices count all pushes and pops and are masked when used, so
+// head == tail means empty and tail - head == capacity means full.
+//
+
+template <typename T>
+class SpscQueue {
+public:
+  // The capacity is rounded up to a power of two
+  explicit SpscQueue(size_t capacity)
+    : capacity_{round_up_to_power_of_two(std::max<size_t>(capacity, 2))},
+      mask_{capacity_ - 1}, buffer_{std::make_unique<T[]>(capacity_)} {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  auto operator=(const SpscQueue&) -> SpscQueue& = delete;
+
+  auto capacity() const noexcept { return capacity_; }
+
+  // Number of items, which may be out of date when it's returned
+  auto size_approx() const noexcept {
+    const auto tail = tail_.load(std::memory_order_acquire);
+    const auto head = head_.load(std::memory_order_acquire);
+    return tail - std::min(head, tail);
+  }
+
+  // Producer thread
+  template <typename U>
+  auto try_push(U&& item) -> bool {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - producer_.cached_head_ == capacity_) {
+      producer_.cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - producer_.cached_head_ == capacity_) {
+        return false;
+      }
+    }
+    buffer_[tail & mask_] = std::forward<U>(item);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Producer thread. Pushes as many of the n items as there is room
+  // for, and returns how many, publishing them all at once.
+  auto push_n(const T* items, size_t n) -> size_t {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    auto free = capacity_ - (tail - producer_.cached_head_);
+    if (free < n) {
+      producer_.cached_head_ = head_.load(std::memory_order_acquire);
+      free = capacity_ - (tail - producer_.cached_head_);
+    }
+    n = std::min(n, free);
+    for (size_t i = 0; i < n; ++i) {
+      buffer_[(tail + i) & mask_] = items[i];
+    }
+    tail_.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer thread
+  auto try_pop(T& item) -> bool {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == consumer_.cached_tail_) {
+      consumer_.cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == consumer_.cached_tail_) {
+        return false;
+      }
+    }
+    item = std::move(buffer_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread. Pops up to n items into out, and returns how many.
+  auto pop_n(T* out, size_t n) -> size_t {
+    const auto head = head_.load(std::memory_order_relaxed);
+    auto available = consumer_.cached_tail_ - head;
+    if (available < n) {
+      consumer_.cached_tail_ = tail_.load(std::memory_order_acquire);
+      available = consumer_.cached_tail_ - head;
+    }
+    n = std::min(n, available);
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = std::move(buffer_[(head + i) & mask_]);
+    }
+    head_.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+private:
+  // Written by the consumer, read by the producer
+  alignas(kCacheLineSize) std::atomic<size_t> head_{0};
+  // Written by the producer, read by the consumer
+  alignas(kCacheLineSize) std::atomic<size_t> tail_{0};
+  // Only used by the producer
+  struct alignas(kCacheLineSize) {
+    size_t cached_head_{0};
+  } producer_;
+  // Only used by the consumer
+  struct alignas(kCacheLineSize) {
+    size_t cached_tail_{0};
+  } consumer_;
+  // Read only after construction
+  alignas(kCacheLineSize) const size_t capacity_;
+  const size_t mask_;
+  const std::unique_ptr<T[]> buffer_;
+};
+
+#endif
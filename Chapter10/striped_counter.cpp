@@ -0,0 +1,184 @@
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "striped_counter.hpp"
+
+//
+// This example compares StripedCounter with the counters of
+// counter_atomic.cpp and counter_mutex.cpp, as the number of threads
+// incrementing them grows.
+//
+
+namespace {
+
+// Number of increments by all threads in each run. Increase if you
+// want more.
+constexpr auto kNumIncrements = 8'000'000;
+
+class AtomicCounter {
+public:
+  auto add() { ++value_; }
+  auto read() const { return value_.load(); }
+
+private:
+  std::atomic<uint64_t> value_{0};
+};
+
+class MutexCounter {
+public:
+  auto add() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    ++value_;
+  }
+  auto read() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return value_;
+  }
+
+private:
+  std::mutex mutex_;
+  uint64_t value_{0};
+};
+
+// Runs f(n) in num_threads threads, where the n add up to total
+template <typename F>
+auto run(int num_threads, int total, F&& f) {
+  auto threads = std::vector<std::thread>{};
+  for (auto t = 0; t < num_threads; ++t) {
+    const auto n = total / num_threads + (t < total % num_threads ? 1 : 0);
+    threads.emplace_back([n, &f] { f(n); });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+// Returns the ms it takes num_threads threads to increment the counter
+// kNumIncrements times in total
+template <typename Counter>
+auto time_increments(Counter& counter, int num_threads) {
+  const auto start = std::chrono::steady_clock::now();
+  run(num_threads, kNumIncrements, [&counter](int n) {
+    for (auto i = 0; i < n; ++i) {
+      counter.add();
+    }
+  });
+  const auto d = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+}
+
+} // namespace
+
+TEST(StripedCounter, CountsAllThreads) {
+  auto counter = StripedCounter{4};
+  run(16, 100'000, [&counter](int n) {
+    for (auto i = 0; i < n; ++i) {
+      counter.add();
+    }
+    counter.add(10);
+  });
+  ASSERT_EQ(100'000u + 16 * 10, counter.read());
+  ASSERT_EQ(100'000u + 16 * 10, counter.read_and_reset());
+  ASSERT_EQ(0u, counter.read());
+}
+
+TEST(StripedCounter, ReadAndResetCountsEveryAddOnce) {
+  auto counter = StripedCounter{};
+  auto done = std::atomic<bool>{false};
+  auto total = uint64_t{0};
+  auto reader = std::thread{[&] {
+    while (!done.load()) {
+      total += counter.read_and_reset();
+      std::this_thread::yield();
+    }
+  }};
+  run(4, 200'000, [&counter](int n) {
+    for (auto i = 0; i < n; ++i) {
+      counter.add();
+    }
+  });
+  done.store(true);
+  reader.join();
+  total += counter.read_and_reset();
+  ASSERT_EQ(200'000u, total);
+}
+
+TEST(StripedGauge, AddAndSubtractInDifferentThreads) {
+  auto gauge = StripedGauge{8};
+  gauge.add(1000);
+  run(8, 1000, [&gauge](int n) {
+    for (auto i = 0; i < n; ++i) {
+      gauge.sub();
+    }
+  });
+  ASSERT_EQ(0, gauge.read());
+  gauge.add(5);
+  gauge.sub(2);
+  ASSERT_EQ(3, gauge.read());
+}
+
+TEST(StripedHistogram, Buckets) {
+  ASSERT_EQ(0u, StripedHistogram::bucket_of(0));
+  ASSERT_EQ(1u, StripedHistogram::bucket_of(1));
+  ASSERT_EQ(2u, StripedHistogram::bucket_of(2));
+  ASSERT_EQ(2u, StripedHistogram::bucket_of(3));
+  ASSERT_EQ(3u, StripedHistogram::bucket_of(4));
+  ASSERT_EQ(64u, StripedHistogram::bucket_of(UINT64_MAX));
+  ASSERT_EQ(3u, StripedHistogram::upper_bound(2));
+  ASSERT_EQ(UINT64_MAX, StripedHistogram::upper_bound(64));
+}
+
+TEST(StripedHistogram, RecordFromManyThreads) {
+  auto histogram = StripedHistogram{};
+  // Each thread records 1, 2, ..., 1000
+  run(4, 4000, [&histogram](int n) {
+    for (auto i = 1; i <= n; ++i) {
+      histogram.record(static_cast<uint64_t>(i));
+    }
+  });
+  const auto snapshot = histogram.read();
+  ASSERT_EQ(4000u, snapshot.count_);
+  ASSERT_EQ(4u * 1000 * 1001 / 2, snapshot.sum_);
+  ASSERT_DOUBLE_EQ(500.5, snapshot.mean());
+  ASSERT_EQ(4u * 64, snapshot.buckets_[7]); // 64, 65, ..., 127
+  ASSERT_EQ(511u, snapshot.quantile(0.5));  // The median 500 is in [256, 512)
+  ASSERT_EQ(1023u, snapshot.quantile(0.99));
+}
+
+TEST(StripedHistogram, Quantiles) {
+  auto histogram = StripedHistogram{};
+  ASSERT_EQ(0u, histogram.read().quantile(0.5)); // Empty
+  histogram.record(3);
+  histogram.record(100);
+  histogram.record(5000);
+  const auto snapshot = histogram.read();
+  ASSERT_EQ(3u, snapshot.quantile(0.0));
+  ASSERT_EQ(3u, snapshot.quantile(1.0 / 3));
+  ASSERT_EQ(127u, snapshot.quantile(0.5));
+  ASSERT_EQ(8191u, snapshot.quantile(1.0));
+  ASSERT_EQ(8191u, snapshot.quantile(2.0));
+}
+
+TEST(StripedCounter, CompareWithAtomicAndMutex) {
+  std::cout << "ms for " << kNumIncrements << " increments" << '\n'
+            << std::setw(8) << "threads" << std::setw(8) << "mutex" << std::setw(8) << "atomic"
+            << std::setw(9) << "striped" << '\n';
+  for (auto t = 1; t <= 64; t *= 2) {
+    auto mutex_counter = MutexCounter{};
+    const auto mutex_ms = time_increments(mutex_counter, t);
+    ASSERT_EQ(static_cast<uint64_t>(kNumIncrements), mutex_counter.read());
+    auto atomic_counter = AtomicCounter{};
+    const auto atomic_ms = time_increments(atomic_counter, t);
+    ASSERT_EQ(static_cast<uint64_t>(kNumIncrements), atomic_counter.read());
+    auto striped_counter = StripedCounter{};
+    const auto striped_ms = time_increments(striped_counter, t);
+    ASSERT_EQ(static_cast<uint64_t>(kNumIncrements), striped_counter.read());
+    std::cout << std::setw(8) << t << std::setw(8) << mutex_ms << std::setw(8) << atomic_ms
+              << std::setw(9) << striped_ms << '\n';
+  }
+}
@@ -0,0 +1,214 @@
+#pragma once
+#ifndef STRIPED_COUNTER_HPP
+#define STRIPED_COUNTER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include "cache_line.hpp"
+#include "sync_utils.hpp"
+
+//
+// Counters for metrics which are updated by many threads and read
+// rarely.
+//
+// A std::atomic counter makes every increment take its cache line
+// from the core which did the previous increment. Here the value is
+// split into slots of one cache line each. A thread always adds to the
+// same slot, which stays in the cache of the core running it for as
+// long as the thread isn't moved, and a read sums all the slots. The
+// slots are not tied to cores: threads get them round-robin in the
+// order they first add, so they only share a slot if there are more
+// threads than slots. The number of slots defaults to the number of
+// hardware threads.
+//
+// A read isn't a snapshot while other threads add to the counter. It
+// includes every add which happened before the read started, and any
+// number of those which happen while it runs. Once the adding threads
+// are done, for example joined, the read is exact.
+//
+
+namespace striped_detail {
+
+inline auto default_num_slots() -> size_t {
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// A number unique to the calling thread, assigned on first use
+inline auto thread_index() -> size_t {
+  static auto next = std::atomic<size_t>{0};
+  thread_local const auto index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+// An array of slots which are each on their own cache lines. The
+// number of slots is rounded up to a power of two, to find a thread's
+// slot with a mask.
+template <typename Slot>
+class Slots {
+public:
+  explicit Slots(size_t num_slots)
+    : mask_{round_up_to_power_of_two(num_slots) - 1},
+      slots_{std::make_unique<Padded[]>(mask_ + 1)} {}
+
+  auto size() const noexcept { return mask_ + 1; }
+  auto local() noexcept -> Slot& { return slots_[thread_index() & mask_].slot_; }
+  auto operator[](size_t i) noexcept -> Slot& { return slots_[i].slot_; }
+  auto operator[](size_t i) const noexcept -> const Slot& { return slots_[i].slot_; }
+
+private:
+  struct alignas(kCacheLineSize) Padded {
+    Slot slot_{};
+  };
+  const size_t mask_;
+  const std::unique_ptr<Padded[]> slots_;
+};
+
+} // namespace striped_detail
+
+// A counter which only goes up
+class StripedCounter {
+public:
+  explicit StripedCounter(size_t num_slots = striped_detail::default_num_slots())
+    : slots_{num_slots} {}
+
+  auto add(uint64_t n = 1) noexcept {
+    slots_.local().fetch_add(n, std::memory_order_relaxed);
+  }
+
+  auto read() const noexcept {
+    auto sum = uint64_t{0};
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      sum += slots_[i].load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+  // Returns the count since the last call and starts over from 0.
+  // Unlike read(), every add is counted exactly once by some call,
+  // which makes it suitable for exporting rates.
+  auto read_and_reset() noexcept {
+    auto sum = uint64_t{0};
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      sum += slots_[i].exchange(0, std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+private:
+  striped_detail::Slots<std::atomic<uint64_t>> slots_;
+};
+
+// A value which goes up and down, such as the number of requests in
+// flight. A thread may add in one slot and subtract in another, so
+// single slots may be negative.
+class StripedGauge {
+public:
+  explicit StripedGauge(size_t num_slots = striped_detail::default_num_slots())
+    : slots_{num_slots} {}
+
+  auto add(int64_t n = 1) noexcept {
+    slots_.local().fetch_add(n, std::memory_order_relaxed);
+  }
+  auto sub(int64_t n = 1) noexcept { add(-n); }
+
+  auto read() const noexcept {
+    auto sum = int64_t{0};
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      sum += slots_[i].load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+private:
+  striped_detail::Slots<std::atomic<int64_t>> slots_;
+};
+
+// Counts of recorded values, such as latencies, in buckets whose
+// bounds are powers of two. Bucket 0 holds the value 0, and bucket b
+// the values in [2^(b-1), 2^b).
+class StripedHistogram {
+public:
+  static constexpr auto kNumBuckets = size_t{65};
+
+  struct Snapshot {
+    std::array<uint64_t, kNumBuckets> buckets_{};
+    uint64_t count_{};
+    uint64_t sum_{};
+
+    auto mean() const noexcept {
+      return count_ == 0 ? 0.0 : static_cast<double>(sum_) / static_cast<double>(count_);
+    }
+
+    // An upper bound of the value below which the fraction q of the
+    // recorded values are, that is of the ceil(q * count_):th smallest
+    // value. Returns 0 if no values are recorded.
+    auto quantile(double q) const noexcept -> uint64_t {
+      if (count_ == 0) {
+        return 0;
+      }
+      const auto position = std::ceil(q * static_cast<double>(count_));
+      const auto rank = !(position > 1.0) ? uint64_t{0}
+                        : position >= static_cast<double>(count_)
+                          ? count_ - 1
+                          : static_cast<uint64_t>(position) - 1;
+      auto seen = uint64_t{0};
+      for (size_t b = 0; b < kNumBuckets; ++b) {
+        seen += buckets_[b];
+        if (seen > rank) {
+          return upper_bound(b);
+        }
+      }
+      return upper_bound(kNumBuckets - 1);
+    }
+  };
+
+  explicit StripedHistogram(size_t num_slots = striped_detail::default_num_slots())
+    : slots_{num_slots} {}
+
+  static auto bucket_of(uint64_t value) noexcept -> size_t {
+    return value == 0 ? 0 : 64 - static_cast<size_t>(__builtin_clzll(value));
+  }
+  // The largest value in the bucket
+  static auto upper_bound(size_t bucket) noexcept -> uint64_t {
+    return bucket == 0 ? 0 : bucket == 64 ? UINT64_MAX : (uint64_t{1} << bucket) - 1;
+  }
+
+  auto record(uint64_t value) noexcept {
+    auto& slot = slots_.local();
+    slot.buckets_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    slot.sum_.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // Like StripedCounter::read(), the snapshot is only exact once the
+  // recording threads are done. The count is the sum of the buckets,
+  // so they always agree, but the sum may not match them yet.
+  auto read() const noexcept {
+    auto snapshot = Snapshot{};
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      const auto& slot = slots_[i];
+      for (size_t b = 0; b < kNumBuckets; ++b) {
+        snapshot.buckets_[b] += slot.buckets_[b].load(std::memory_order_relaxed);
+      }
+      snapshot.sum_ += slot.sum_.load(std::memory_order_relaxed);
+    }
+    for (auto n : snapshot.buckets_) {
+      snapshot.count_ += n;
+    }
+    return snapshot;
+  }
+
+private:
+  struct Slot {
+    std::array<std::atomic<uint64_t>, kNumBuckets> buckets_{};
+    std::atomic<uint64_t> sum_{0};
+  };
+  striped_detail::Slots<Slot> slots_;
+};
+
+#endif
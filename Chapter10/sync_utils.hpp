@@ -0,0 +1,114 @@
+#pragma once
+#ifndef SYNC_UTILS_HPP
+#define SYNC_UTILS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+#endif
+
+#if defined(__linux__)
+  #include <linux/membarrier.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+  #define SYNC_MEMBARRIER_ENABLED 1
+#else
+  #define SYNC_MEMBARRIER_ENABLED 0
+#endif
+
+//
+// Small helpers shared by the queues, counters and locks of this
+// chapter.
+//
+
+// The smallest power of two which is at least n, for sizes which are
+// masked instead of taken modulo. Throws if it doesn't fit in size_t.
+inline auto round_up_to_power_of_two(size_t n) -> size_t {
+  constexpr auto kLargest = (std::numeric_limits<size_t>::max() >> 1) + 1;
+  if (n > kLargest) {
+    throw std::length_error("No power of two fits in size_t");
+  }
+  auto p = size_t{1};
+  while (p < n) {
+    p *= 2;
+  }
+  return p;
+}
+
+// With a single CPU the thread we wait for can't run while we spin.
+// hardware_concurrency() returns 0 if the number is unknown.
+inline auto single_cpu() noexcept -> bool {
+  static const auto single = std::thread::hardware_concurrency() == 1;
+  return single;
+}
+
+// Tells the CPU that this is a spin loop, which saves power and
+// lets the other hyperthread of the core run
+inline auto cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// Waits a little before the next attempt of a spin loop. Spins for
+// the first spin_count attempts, and then yields so that a thread
+// holding the lock which has been preempted can run. With a single
+// CPU it yields right away.
+inline auto backoff(int attempt, int spin_count = 64) noexcept -> void {
+  if (attempt < spin_count && !single_cpu()) {
+    cpu_relax();
+  } else {
+    std::this_thread::yield();
+  }
+}
+
+// A pair of fences for two threads which each store to one variable
+// and then load the other, where one of them does so far more often.
+// On Linux the rare side makes every running thread of the process
+// execute a fence with membarrier(), so that the frequent side only
+// needs a compiler barrier. With a single CPU the threads take turns,
+// and switching between them orders their accesses, so neither side
+// needs a fence. Elsewhere both sides use a fence.
+inline auto asymmetric_fences() noexcept -> bool {
+#if SYNC_MEMBARRIER_ENABLED
+  static const auto registered =
+    single_cpu() || syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+  return registered;
+#else
+  return false;
+#endif
+}
+
+// The fence of the frequent side
+inline auto light_fence() noexcept -> void {
+  if (asymmetric_fences()) {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  } else {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+// The fence of the rare side
+inline auto heavy_fence() noexcept -> void {
+#if SYNC_MEMBARRIER_ENABLED
+  if (asymmetric_fences()) {
+    if (!single_cpu()) {
+      syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+    }
+    return;
+  }
+#endif
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+#endif
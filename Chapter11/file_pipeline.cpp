@@ -0,0 +1,146 @@
+#include "chapter_11.hpp"
+#include "file_pipeline.hpp"
+#include "scooped_timer.h"
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+//
+// This example processes a large text file with one record per line.
+// Each record holds three integers, and the transform parses them and
+// formats the result of a small computation, which makes the work
+// bound by parsing rather than by reading the file.
+//
+
+namespace {
+
+// Size of the file in the benchmark. Increase if you want more.
+constexpr auto kFileSize = size_t{64} * 1024 * 1024;
+
+auto write_file(const std::string& path, const std::string& content) {
+  auto out = std::ofstream{path, std::ios::binary};
+  out.write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+auto generate_records(size_t size) {
+  auto content = std::string{};
+  content.reserve(size + 64);
+  auto x = 12345u;
+  while (content.size() < size) {
+    for (auto i = 0; i < 3; ++i) {
+      x = x * 1103515245u + 12345u; // A simple LCG
+      content += std::to_string(x % 1'000'000);
+      content += i < 2 ? ',' : '\n';
+    }
+  }
+  return content;
+}
+
+// Parses each line "a,b,c" and outputs the line "a*b+c"
+auto transform_records(std::string_view chunk) {
+  auto out = std::string{};
+  out.reserve(chunk.size());
+  auto first = chunk.data();
+  const auto last = chunk.data() + chunk.size();
+  while (first < last) {
+    long long v[3] = {};
+    for (auto& value : v) {
+      const auto result = std::from_chars(first, last, value);
+      first = result.ptr + 1; // Skip ',' or '\n'
+    }
+    char buffer[32];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), v[0] * v[1] + v[2]);
+    out.append(buffer, result.ptr);
+    out += '\n';
+  }
+  return out;
+}
+
+} // namespace
+
+TEST(FilePipeline, ChunksEndAtRecordBoundaries) {
+  const auto content = std::string{"a\nbb\nccc\n\n" + std::string(50, 'd') + "\neeee"};
+  write_file("pipeline.txt", content);
+  for (auto chunk_size : {size_t{1}, size_t{3}, size_t{8}, size_t{1000}}) {
+    auto reader = pipeline::ChunkReader{"pipeline.txt", chunk_size};
+    auto joined = std::string{};
+    auto chunk = std::string{};
+    while (reader.next_chunk(chunk)) {
+      ASSERT_FALSE(chunk.empty());
+      joined += chunk;
+      // Only the last chunk may end without a newline
+      if (joined.size() < content.size()) {
+        ASSERT_EQ('\n', chunk.back());
+      }
+    }
+    ASSERT_EQ(content, joined);
+  }
+  std::remove("pipeline.txt");
+}
+
+TEST(FilePipeline, OutputIsInOrder) {
+  const auto content = generate_records(100'000);
+  write_file("pipeline.txt", content);
+  const auto expected = transform_records(content);
+  for (auto num_workers : {size_t{1}, size_t{2}, size_t{7}}) {
+    auto options = pipeline::PipelineOptions{};
+    options.chunk_size_ = 1000;
+    options.num_workers_ = num_workers;
+    options.max_chunks_in_flight_ = 3;
+    auto output = std::string{};
+    const auto stats = pipeline::process_file(
+      "pipeline.txt", transform_records, [&](std::string s) { output += s; }, options);
+    ASSERT_EQ(content.size(), stats.num_bytes_);
+    ASSERT_EQ(expected, output);
+  }
+  std::remove("pipeline.txt");
+}
+
+TEST(FilePipeline, ExceptionsArePropagated) {
+  write_file("pipeline.txt", generate_records(100'000));
+  auto options = pipeline::PipelineOptions{};
+  options.chunk_size_ = 1000;
+  options.num_workers_ = 4;
+  const auto transform = [](std::string_view chunk) -> int {
+    if (chunk.find("999") != std::string_view::npos) {
+      throw std::runtime_error{"Parse error"};
+    }
+    return 0;
+  };
+  ASSERT_THROW(pipeline::process_file("pipeline.txt", transform, [](int) {}, options),
+               std::runtime_error);
+  ASSERT_THROW(pipeline::process_file("pipeline.txt", [](std::string_view) { return 0; },
+                                      [](int) { throw std::runtime_error{"Disk full"}; },
+                                      options),
+               std::runtime_error);
+  std::remove("pipeline.txt");
+}
+
+TEST(FilePipeline, CompareThroughput) {
+  write_file("pipeline.txt", generate_records(kFileSize));
+  std::cout << "File size: " << (kFileSize >> 20) << " MB" << '\n';
+
+  const auto options = pipeline::PipelineOptions{};
+  auto out_single = std::string{};
+  {
+    ScopedTimer timer{"single-threaded loop"};
+    auto reader = pipeline::ChunkReader{"pipeline.txt", options.chunk_size_};
+    auto chunk = std::string{};
+    while (reader.next_chunk(chunk)) {
+      out_single += transform_records(chunk);
+    }
+  }
+  auto out_pipeline = std::string{};
+  {
+    ScopedTimer timer{"pipeline"};
+    pipeline::process_file("pipeline.txt", transform_records,
+                           [&](std::string s) { out_pipeline += s; }, options);
+  }
+  std::cout << "Workers: " << options.num_workers_ << '\n';
+  ASSERT_EQ(out_single, out_pipeline);
+  std::remove("pipeline.txt");
+}
@@ -0,0 +1,327 @@
+#pragma once
+#ifndef FILE_PIPELINE_HPP
+#define FILE_PIPELINE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "hardware_info.hpp"
+
+//
+// A pipeline for processing a file which is too large to be handled
+// in one piece, using all cores. It consists of three stages:
+//
+//   reader -> transform (N threads) -> writer
+//
+// The reader splits the file into chunks at record boundaries, the
+// transform stage processes the chunks in parallel, and the writer
+// hands the results to a sink in the same order as the chunks
+// appeared in the file. The stages are connected by bounded queues,
+// and the number of chunks in flight is limited, so the memory usage
+// doesn't depend on the size of the file.
+//
+
+namespace pipeline {
+
+// A queue with a fixed capacity. push() blocks while the queue is
+// full and pop() blocks while it's empty. After close(), push()
+// fails and pop() returns the remaining items before failing.
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity_{std::max<size_t>(1, capacity)} {}
+
+  auto push(T item) -> bool {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+      if (closed_) {
+        return false;
+      }
+      items_.push_back(std::move(item));
+    }
+    not_empty_.notify_one();
+    return true;
+  }
+
+  auto pop() -> std::optional<T> {
+    auto item = std::optional<T>{};
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+      if (items_.empty()) {
+        return std::nullopt;
+      }
+      item = std::move(items_.front());
+      items_.pop_front();
+    }
+    not_full_.notify_one();
+    return item;
+  }
+
+  auto close() -> void {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  const size_t capacity_{};
+  std::mutex mutex_{};
+  std::condition_variable not_full_{};
+  std::condition_variable not_empty_{};
+  std::deque<T> items_{};
+  bool closed_{false};
+};
+
+// Reads a file in chunks of about chunk_size bytes. Every chunk ends
+// with the delimiter, except for the last one if the file doesn't,
+// so that no record is split between two chunks. A record longer
+// than chunk_size gives a larger chunk.
+class ChunkReader {
+public:
+  ChunkReader(const std::string& path, size_t chunk_size, char delimiter = '\n')
+    : file_{std::fopen(path.c_str(), "rb")},
+      chunk_size_{std::max<size_t>(1, chunk_size)},
+      delimiter_{delimiter} {
+    if (file_ == nullptr) {
+      throw std::system_error(errno, std::generic_category(), "Failed to open " + path);
+    }
+    // The chunks are read directly into the strings
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+  }
+
+  ChunkReader(const ChunkReader&) = delete;
+  auto operator=(const ChunkReader&) -> ChunkReader& = delete;
+
+  ~ChunkReader() { std::fclose(file_); }
+
+  // Returns false when the whole file has been read
+  auto next_chunk(std::string& chunk) -> bool {
+    chunk.swap(carry_);
+    carry_.clear();
+    auto searched = size_t{0};
+    for (;;) {
+      const auto old_size = chunk.size();
+      if (!eof_ && old_size < chunk_size_ + searched) {
+        chunk.resize(chunk_size_ + searched);
+        const auto n = std::fread(&chunk[old_size], 1, chunk.size() - old_size, file_);
+        chunk.resize(old_size + n);
+        if (n == 0 && std::ferror(file_)) {
+          throw std::system_error(errno, std::generic_category(), "Failed to read file");
+        }
+        eof_ = std::feof(file_) != 0;
+      }
+      // The part before searched is known not to have a delimiter
+      const auto pos = std::string_view{chunk}.substr(searched).find_last_of(delimiter_);
+      if (pos != std::string_view::npos) {
+        carry_.assign(chunk, searched + pos + 1, std::string::npos);
+        chunk.resize(searched + pos + 1);
+        return true;
+      }
+      if (eof_) {
+        return !chunk.empty();
+      }
+      searched = chunk.size();
+    }
+  }
+
+private:
+  std::FILE* file_{};
+  size_t chunk_size_{};
+  char delimiter_{};
+  std::string carry_{}; // The start of the first record of the next chunk
+  bool eof_{false};
+};
+
+struct PipelineOptions {
+  // By default a chunk fills half of the L2 cache, so a worker's
+  // chunk and its result stay in the cache while it's transformed
+  size_t chunk_size_{cache_chunk_size<char>(2)};
+  size_t num_workers_{std::max(1u, std::thread::hardware_concurrency())};
+  // Limits the memory usage, including the chunks waiting to be
+  // written because an earlier chunk hasn't been transformed yet
+  size_t max_chunks_in_flight_{0}; // 0 means four per worker
+  char delimiter_{'\n'};
+};
+
+struct PipelineStats {
+  size_t num_chunks_{};
+  size_t num_bytes_{};
+};
+
+namespace detail {
+
+// Lets the reader run at most max_in_flight chunks ahead of the
+// writer, which also bounds the reorder buffer of the writer
+class InFlightWindow {
+public:
+  explicit InFlightWindow(size_t max_in_flight) : max_in_flight_{max_in_flight} {}
+
+  // Returns false if the pipeline is cancelled
+  auto wait_for_slot(size_t index) -> bool {
+    std::unique_lock<std::mutex> lock{mutex_};
+    cv_.wait(lock, [&] { return cancelled_ || index < num_written_ + max_in_flight_; });
+    return !cancelled_;
+  }
+
+  auto written() -> void {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      ++num_written_;
+    }
+    cv_.notify_one();
+  }
+
+  auto cancel() -> void {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      cancelled_ = true;
+    }
+    cv_.notify_all();
+  }
+
+private:
+  const size_t max_in_flight_{};
+  std::mutex mutex_{};
+  std::condition_variable cv_{};
+  size_t num_written_{};
+  bool cancelled_{false};
+};
+
+} // namespace detail
+
+// Runs the chunks of reader through transform(std::string_view) on
+// num_workers threads, and calls sink() with the results in order on
+// a separate writer thread. If transform or sink throws, the pipeline
+// is stopped and the exception is rethrown.
+template <typename Transform, typename Sink>
+auto run_pipeline(ChunkReader& reader, Transform transform, Sink sink,
+                  const PipelineOptions& options = {}) -> PipelineStats {
+  using Result = std::decay_t<std::invoke_result_t<Transform&, std::string_view>>;
+  struct Chunk { size_t index_; std::string data_; };
+  struct Transformed { size_t index_; Result result_; };
+
+  const auto num_workers = std::max<size_t>(1, options.num_workers_);
+  const auto max_in_flight = options.max_chunks_in_flight_ != 0 ?
+    options.max_chunks_in_flight_ : 4 * num_workers;
+
+  auto chunks = BoundedQueue<Chunk>{num_workers};
+  auto results = BoundedQueue<Transformed>{num_workers};
+  auto window = detail::InFlightWindow{max_in_flight};
+
+  auto error_mutex = std::mutex{};
+  auto error = std::exception_ptr{};
+  auto cancelled = std::atomic<bool>{false};
+  const auto cancel = [&](std::exception_ptr e) {
+    {
+      std::lock_guard<std::mutex> lock{error_mutex};
+      if (!error) {
+        error = e;
+      }
+    }
+    cancelled = true;
+    window.cancel();
+    chunks.close();
+    results.close();
+  };
+
+  auto workers = std::vector<std::thread>{};
+  auto num_running = std::atomic<size_t>{num_workers};
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers.emplace_back([&] {
+      try {
+        while (auto chunk = chunks.pop()) {
+          if (cancelled) {
+            break;
+          }
+          auto result = transform(std::string_view{chunk->data_});
+          results.push(Transformed{chunk->index_, std::move(result)});
+        }
+      } catch (...) {
+        cancel(std::current_exception());
+      }
+      // The last worker to finish tells the writer that no more
+      // results are coming
+      if (--num_running == 0) {
+        results.close();
+      }
+    });
+  }
+
+  auto writer = std::thread{[&] {
+    // A chunk with index i is stored at i % max_in_flight until all
+    // chunks before it have been written
+    auto pending = std::vector<std::optional<Result>>(max_in_flight);
+    auto next_index = size_t{0};
+    try {
+      while (auto transformed = results.pop()) {
+        pending[transformed->index_ % max_in_flight] = std::move(transformed->result_);
+        for (auto* slot = &pending[next_index % max_in_flight]; slot->has_value();
+             slot = &pending[next_index % max_in_flight]) {
+          sink(std::move(**slot));
+          slot->reset();
+          ++next_index;
+          window.written();
+        }
+      }
+    } catch (...) {
+      cancel(std::current_exception());
+    }
+  }};
+
+  auto stats = PipelineStats{};
+  try {
+    auto data = std::string{};
+    while (reader.next_chunk(data)) {
+      if (!window.wait_for_slot(stats.num_chunks_)) {
+        break;
+      }
+      stats.num_bytes_ += data.size();
+      if (!chunks.push(Chunk{stats.num_chunks_, std::move(data)})) {
+        break;
+      }
+      ++stats.num_chunks_;
+      data = std::string{};
+    }
+  } catch (...) {
+    cancel(std::current_exception());
+  }
+  chunks.close();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  writer.join();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return stats;
+}
+
+template <typename Transform, typename Sink>
+auto process_file(const std::string& path, Transform transform, Sink sink,
+                  const PipelineOptions& options = {}) -> PipelineStats {
+  auto reader = ChunkReader{path, options.chunk_size_, options.delimiter_};
+  return run_pipeline(reader, std::move(transform), std::move(sink), options);
+}
+
+} // namespace pipeline
+
+#endif
@@ -1,4 +1,5 @@
 #include "chapter_11.hpp"
+#include "hardware_info.hpp"
 #include <cassert>
 #include <algorithm>
 #include <future>
@@ -44,7 +45,8 @@ TEST(ParallelTransformDivideAndConquer, ParTransform) {
     return sum;
   };
 
-  size_t chunk_sz = 1000;
+  // Each task gets at least an L1 cache worth of elements
+  const auto chunk_sz = parallel_grain_size<float>(n);
   par_transform(src.begin(), src.end(), dst.begin(), transform_func, chunk_sz);
 
   for (size_t i = 0; i < dst.size(); ++i) {
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef CPU_FEATURES_HPP
+#define CPU_FEATURES_HPP
+
+//
+// Runtime detection of the x86 instruction set extensions used by
+// the SIMD kernels in the code examples. The kernels are compiled
+// with per-function target attributes, so the project itself is
+// still built for the baseline ISA, and a kernel is only selected
+// if the CPU we are running on supports it.
+//
+// Runtime dispatch is only enabled for GCC and Clang on x86-64, as
+// the kernels use 64-bit intrinsics. On other compilers and
+// architectures, 32-bit x86 included, every kernel falls back to
+// portable C++.
+//
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+  #define CPU_DISPATCH_ENABLED 1
+  #include <immintrin.h>
+  #define TARGET_POPCNT __attribute__((target("popcnt")))
+  #define TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+  #define TARGET_AVX2 __attribute__((target("avx2,bmi,bmi2,popcnt")))
+  #define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,bmi,bmi2,popcnt")))
+  #define TARGET_AVX512_POPCNT \
+    __attribute__((target("avx512f,avx512bw,avx512vl,avx512vpopcntdq,bmi,bmi2,popcnt")))
+#else
+  #define CPU_DISPATCH_ENABLED 0
+#endif
+
+struct CpuFeatures {
+  bool popcnt_{};
+  bool sse42_{};
+  bool avx2_{};
+  bool avx512_{}; // AVX-512 F, BW and VL
+  bool avx512_popcnt_{}; // AVX-512 VPOPCNTDQ
+};
+
+inline auto detect_cpu_features() -> CpuFeatures {
+  auto features = CpuFeatures{};
+#if CPU_DISPATCH_ENABLED
+  __builtin_cpu_init();
+  features.popcnt_ = __builtin_cpu_supports("popcnt");
+  features.sse42_ = __builtin_cpu_supports("sse4.2");
+  features.avx2_ = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+  features.avx512_ =
+    features.avx2_ &&
+    __builtin_cpu_supports("avx512f") &&
+    __builtin_cpu_supports("avx512bw") &&
+    __builtin_cpu_supports("avx512vl");
+  features.avx512_popcnt_ =
+    features.avx512_ && __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+  return features;
+}
+
+// The features are detected once and then cached
+inline auto cpu_features() -> const CpuFeatures& {
+  static const auto features = detect_cpu_features();
+  return features;
+}
+
+#endif
@@ -0,0 +1,279 @@
+#pragma once
+#ifndef HARDWARE_INFO_HPP
+#define HARDWARE_INFO_HPP
+
+//
+// Runtime detection of the cache and core topology of the machine.
+// On Linux the information is read from sysfs, with sysconf() as a
+// fallback. On other platforms, or if something can't be read,
+// reasonable defaults for a modern desktop CPU are used.
+//
+// The chunk and grain sizes used by the code examples are
+// derived from the detected cache sizes instead of being hardcoded.
+//
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+enum class CacheType { Data, Instruction, Unified };
+
+struct CacheInfo {
+  unsigned level_{};
+  CacheType type_{CacheType::Unified};
+  size_t size_{};      // Bytes
+  size_t line_size_{}; // Bytes
+  unsigned ways_{};
+  unsigned shared_by_cpus_{1}; // Logical CPUs sharing this cache
+};
+
+struct HardwareInfo {
+  size_t cache_line_size_{64};
+  std::vector<CacheInfo> caches_{};
+  unsigned num_logical_cpus_{1};
+  unsigned num_physical_cores_{1};
+  unsigned num_numa_nodes_{1};
+
+  // Size of the data (or unified) cache at level, or 0 if missing
+  auto data_cache_size(unsigned level) const -> size_t {
+    for (const auto& cache : caches_) {
+      if (cache.level_ == level && cache.type_ != CacheType::Instruction) {
+        return cache.size_;
+      }
+    }
+    return 0;
+  }
+
+  // Size of the largest cache level, normally the shared L3
+  auto last_level_cache_size() const -> size_t {
+    auto size = size_t{0};
+    auto level = 0u;
+    for (const auto& cache : caches_) {
+      if (cache.type_ != CacheType::Instruction && cache.level_ >= level) {
+        level = cache.level_;
+        size = cache.size_;
+      }
+    }
+    return size;
+  }
+
+  auto threads_per_core() const -> unsigned {
+    return std::max(1u, num_logical_cpus_ / std::max(1u, num_physical_cores_));
+  }
+};
+
+namespace hardware_info_detail {
+
+constexpr auto kDefaultL1Size = size_t{32 * 1024};
+constexpr auto kDefaultL2Size = size_t{256 * 1024};
+constexpr auto kDefaultL3Size = size_t{8 * 1024 * 1024};
+
+inline auto read_line(const std::string& path) -> std::optional<std::string> {
+  auto in = std::ifstream{path};
+  auto line = std::string{};
+  if (!in || !std::getline(in, line)) {
+    return std::nullopt;
+  }
+  return line;
+}
+
+inline auto read_number(const std::string& path) -> std::optional<size_t> {
+  const auto line = read_line(path);
+  if (!line || line->empty()) {
+    return std::nullopt;
+  }
+  try {
+    return static_cast<size_t>(std::stoull(*line));
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+// Parses sizes such as "48K", "2048K" or "32M"
+inline auto parse_size(const std::string& str) -> size_t {
+  auto pos = size_t{0};
+  auto value = size_t{0};
+  try {
+    value = static_cast<size_t>(std::stoull(str, &pos));
+  } catch (const std::exception&) {
+    return 0;
+  }
+  if (pos < str.size()) {
+    switch (str[pos]) {
+      case 'K': return value * 1024;
+      case 'M': return value * 1024 * 1024;
+      case 'G': return value * 1024 * 1024 * 1024;
+    }
+  }
+  return value;
+}
+
+// Counts the CPUs in a list such as "0-3,8-11"
+inline auto count_cpu_list(const std::string& str) -> unsigned {
+  auto count = 0u;
+  auto pos = size_t{0};
+  while (pos < str.size()) {
+    const auto comma = std::min(str.find(',', pos), str.size());
+    const auto range = str.substr(pos, comma - pos);
+    const auto dash = range.find('-');
+    try {
+      if (dash == std::string::npos) {
+        count += 1;
+      } else {
+        count += static_cast<unsigned>(
+          std::stoul(range.substr(dash + 1)) - std::stoul(range.substr(0, dash)) + 1);
+      }
+    } catch (const std::exception&) {
+      // Ignore malformed entries
+    }
+    pos = comma + 1;
+  }
+  return count;
+}
+
+#if defined(__linux__)
+
+inline auto read_sysfs_caches() -> std::vector<CacheInfo> {
+  auto caches = std::vector<CacheInfo>{};
+  for (auto index = 0;; ++index) {
+    const auto dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+    const auto level = read_number(dir + "level");
+    const auto type = read_line(dir + "type");
+    const auto size = read_line(dir + "size");
+    if (!level || !type || !size) {
+      break;
+    }
+    auto cache = CacheInfo{};
+    cache.level_ = static_cast<unsigned>(*level);
+    cache.type_ =
+      *type == "Data" ? CacheType::Data :
+      *type == "Instruction" ? CacheType::Instruction :
+      CacheType::Unified;
+    cache.size_ = parse_size(*size);
+    cache.line_size_ = read_number(dir + "coherency_line_size").value_or(64);
+    cache.ways_ = static_cast<unsigned>(read_number(dir + "ways_of_associativity").value_or(0));
+    if (const auto shared = read_line(dir + "shared_cpu_list")) {
+      cache.shared_by_cpus_ = std::max(1u, count_cpu_list(*shared));
+    }
+    caches.push_back(cache);
+  }
+  return caches;
+}
+
+// Used if sysfs is not available, e.g. in some containers
+inline auto read_sysconf_caches() -> std::vector<CacheInfo> {
+  auto caches = std::vector<CacheInfo>{};
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+  const auto line_size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+  const auto add = [&](unsigned level, CacheType type, long size) {
+    if (size > 0) {
+      auto cache = CacheInfo{};
+      cache.level_ = level;
+      cache.type_ = type;
+      cache.size_ = static_cast<size_t>(size);
+      cache.line_size_ = line_size > 0 ? static_cast<size_t>(line_size) : 64;
+      caches.push_back(cache);
+    }
+  };
+  add(1, CacheType::Data, sysconf(_SC_LEVEL1_DCACHE_SIZE));
+  add(2, CacheType::Unified, sysconf(_SC_LEVEL2_CACHE_SIZE));
+  add(3, CacheType::Unified, sysconf(_SC_LEVEL3_CACHE_SIZE));
+#endif
+  return caches;
+}
+
+// Counts the unique (package, core) pairs of all online CPUs
+inline auto count_physical_cores(unsigned num_cpus) -> unsigned {
+  auto cores = std::set<std::pair<size_t, size_t>>{};
+  for (auto cpu = 0u; cpu < num_cpus; ++cpu) {
+    const auto dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+    const auto package = read_number(dir + "physical_package_id");
+    const auto core = read_number(dir + "core_id");
+    if (package && core) {
+      cores.emplace(*package, *core);
+    }
+  }
+  return static_cast<unsigned>(cores.size());
+}
+
+#endif // __linux__
+
+} // namespace hardware_info_detail
+
+inline auto detect_hardware_info() -> HardwareInfo {
+  namespace detail = hardware_info_detail;
+  auto info = HardwareInfo{};
+  info.num_logical_cpus_ = std::max(1u, std::thread::hardware_concurrency());
+  info.num_physical_cores_ = info.num_logical_cpus_;
+
+#if defined(__linux__)
+  info.caches_ = detail::read_sysfs_caches();
+  if (info.caches_.empty()) {
+    info.caches_ = detail::read_sysconf_caches();
+  }
+  if (const auto cores = detail::count_physical_cores(info.num_logical_cpus_)) {
+    info.num_physical_cores_ = cores;
+  }
+  if (const auto nodes = detail::read_line("/sys/devices/system/node/online")) {
+    info.num_numa_nodes_ = std::max(1u, detail::count_cpu_list(*nodes));
+  }
+#endif
+
+  // Fill in defaults for the levels that couldn't be detected
+  const auto add_default = [&info](unsigned level, CacheType type, size_t size) {
+    if (info.data_cache_size(level) == 0) {
+      info.caches_.push_back(CacheInfo{level, type, size, info.cache_line_size_, 0, 1});
+    }
+  };
+  add_default(1, CacheType::Data, detail::kDefaultL1Size);
+  add_default(2, CacheType::Unified, detail::kDefaultL2Size);
+  add_default(3, CacheType::Unified, detail::kDefaultL3Size);
+
+  for (const auto& cache : info.caches_) {
+    if (cache.level_ == 1 && cache.type_ != CacheType::Instruction && cache.line_size_ > 0) {
+      info.cache_line_size_ = cache.line_size_;
+    }
+  }
+  return info;
+}
+
+// The hardware is detected once and then cached
+inline auto hardware_info() -> const HardwareInfo& {
+  static const auto info = detect_hardware_info();
+  return info;
+}
+
+
+//
+// Sizes derived from the hardware info
+//
+
+// Number of elements of T in a chunk that fits in half of the cache
+// at level, leaving room for the output and other data
+template <typename T>
+auto cache_chunk_size(unsigned level = 2) -> size_t {
+  return std::max<size_t>(1, hardware_info().data_cache_size(level) / (2 * sizeof(T)));
+}
+
+// Number of elements of T processed by each task when n elements
+// are split among the CPUs. Each CPU gets a few tasks to balance the
+// load, but no task is smaller than a chunk that fills the L1 cache.
+template <typename T>
+auto parallel_grain_size(size_t n, size_t tasks_per_cpu = 4) -> size_t {
+  const auto& hw = hardware_info();
+  const auto min_grain = std::max<size_t>(1, hw.data_cache_size(1) / sizeof(T));
+  const auto num_tasks = std::max<size_t>(1, hw.num_logical_cpus_ * tasks_per_cpu);
+  return std::max(min_grain, n / num_tasks);
+}
+
+#endif
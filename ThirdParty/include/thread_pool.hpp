@@ -0,0 +1,100 @@
+#pragma once
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+//
+// A fixed size pool of worker threads sharing a single task queue.
+// Tasks are either posted without a result, or submitted and
+// returned as a std::future. The destructor runs all tasks which are
+// already queued before joining the workers.
+//
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t num_threads = default_num_threads()) {
+    num_threads = std::max<size_t>(1, num_threads);
+    workers_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers_.emplace_back([this] { run(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  static auto default_num_threads() -> size_t {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  auto size() const noexcept { return workers_.size(); }
+
+  // Runs task on one of the workers. Exceptions thrown by the task
+  // terminate the program, use submit() if the task can throw.
+  auto post(std::function<void()> task) -> void {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  // Runs f on one of the workers and returns a future for its result
+  template <typename F>
+  auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+    using R = std::invoke_result_t<std::decay_t<F>>;
+    // std::function requires a copyable callable
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    post([task] { (*task)(); });
+    return future;
+  }
+
+private:
+  auto run() -> void {
+    for (;;) {
+      auto task = std::function<void()>{};
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return; // Stopping and nothing left to do
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex mutex_{};
+  std::condition_variable cv_{};
+  std::deque<std::function<void()>> tasks_{};
+  bool stopping_{false};
+  std::vector<std::thread> workers_{};
+};
+
+#endif